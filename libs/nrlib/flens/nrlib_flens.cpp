@@ -27,6 +27,14 @@
 #include "../iotools/fileio.hpp"
 #include "../iotools/logkit.hpp"
 
+#ifdef MKL_THREADED
+#include <mkl_service.h>
+#endif
+
+#ifdef PARALLEL
+#include <omp.h>
+#endif
+
 using namespace NRLib;
 
 void NRLib::CholeskySolve(const SymmetricMatrix & A,
@@ -76,6 +84,29 @@ void NRLib::CholeskySolve(const SymmetricMatrix & A,
   }
 }
 
+//--------------------------------------------------------------
+void NRLib::CholeskySolveFactorized(const SymmetricMatrix & A,
+                                    const Vector          & b,
+                                    Vector                & x)
+//--------------------------------------------------------------
+{
+  Matrix B(b.length(), 1);
+  B(flens::_, 0) = b;                   // First column of B
+
+  // potrs does not modify the factor.
+  int info = flens::potrs(A.upLo(), A.dim(), B.numCols(),
+                          const_cast<double *>(A.data()), A.leadingDimension(),
+                          B.data(), B.leadingDimension());
+  if (info != 0) {
+    std::ostringstream oss;
+    oss << "Internal FLENS/Lapack error: Error in argument " << -info
+        << " of potrs call.";
+    throw Exception(oss.str());
+  }
+
+  x = B(flens::_, 0);
+}
+
 //---------------------------------------------------------
 void NRLib::CholeskySolveComplex(ComplexMatrix & A,
                                  ComplexMatrix & B) // This is also where the solution is stored
@@ -156,6 +187,72 @@ void NRLib::ComputeEigenVectorsSymmetric(const SymmetricMatrix & A,
 }
 
 
+//-----------------------------------------------------------------------
+void NRLib::ComputeGeneralizedEigenVectors(const SymmetricMatrix & A,
+                                           const Matrix          & B,
+                                           Vector                & eigen_values,
+                                           Matrix                & eigen_vectors)
+//-----------------------------------------------------------------------
+{
+  Matrix AinvB = B;
+  CholeskySolve(A, AinvB);
+  ComputeEigenVectors(AinvB, eigen_values, eigen_vectors);
+}
+
+//-----------------------------------------------------------------------------------
+void NRLib::ComputeGeneralizedEigenVectors(const std::vector<SymmetricMatrix> & A,
+                                           const std::vector<Matrix>          & B,
+                                           std::vector<Vector>                & eigen_values,
+                                           std::vector<Matrix>                & eigen_vectors)
+//-----------------------------------------------------------------------------------
+{
+  assert(A.size() == B.size());
+
+  int n_problems = static_cast<int>(A.size());
+
+  eigen_values.resize(n_problems);
+  eigen_vectors.resize(n_problems);
+
+  // Exceptions cannot leave a parallel region, so the first error is kept and thrown afterwards.
+  std::string err_text = "";
+
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+  for (int i = 0; i < n_problems; i++) {
+    int n = B[i].numRows();
+    eigen_values[i].resize(n);
+    eigen_vectors[i].resize(n, n);
+    try {
+      ComputeGeneralizedEigenVectors(A[i], B[i], eigen_values[i], eigen_vectors[i]);
+    }
+    catch (NRLib::Exception & e) {
+#ifdef PARALLEL
+#pragma omp critical(generalized_eigen_error)
+#endif
+      {
+        if (err_text == "")
+          err_text = e.what();
+      }
+    }
+  }
+
+  if (err_text != "")
+    throw Exception(err_text);
+}
+
+//----------------------------------------------------
+void NRLib::SetLinearAlgebraThreads(int n_threads)
+//----------------------------------------------------
+{
+#ifdef MKL_THREADED
+  mkl_set_num_threads(n_threads);
+#else
+  (void) n_threads;
+#endif
+}
+
+
 //--------------------------------------------------------
 double NRLib::FindLargestElement(const NRLib::Vector & v)
 //-------------------------------------------------------
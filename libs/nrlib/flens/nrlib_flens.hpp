@@ -23,6 +23,7 @@
 #define NRLIB_FLENS_HPP
 
 #include <complex>
+#include <vector>
 #include <flens/flens.h>
 #include "../exception/exception.hpp"
 
@@ -88,6 +89,12 @@ namespace NRLib {
   void CholeskySolve(const SymmetricMatrix & A,
                      Matrix                & B); // This is also where the solution is stored
 
+  /// \brief Solves the equation system Ax = b, where A has already been
+  ///        factorized by CholeskyFactorize.
+  void CholeskySolveFactorized(const SymmetricMatrix & A,
+                               const Vector          & b,
+                               Vector                & x);
+
   void CholeskySolveComplex(ComplexMatrix & A,
                             ComplexMatrix & B); // This is also where the solution is stored
 
@@ -109,6 +116,29 @@ namespace NRLib {
                                     Vector                & eigen_values,
                                     Matrix                & eigen_vectors);
 
+  /// \brief Eigenvalues and right eigenvectors of inv(A)*B, where A is symmetric and
+  ///        positive definite. inv(A)*B is found with one Cholesky solve with B as the
+  ///        right hand side, rather than by inverting A and multiplying.
+  /// \throw Exception if A is not positive definite.
+  void ComputeGeneralizedEigenVectors(const SymmetricMatrix & A,
+                                      const Matrix          & B,
+                                      Vector                & eigen_values,
+                                      Matrix                & eigen_vectors);
+
+  /// \brief Batched version of the above for many small problems, e.g. one 3x3 or 6x6
+  ///        problem per facies or trend position. The problems are independent and are
+  ///        solved in parallel when compiled with PARALLEL. eigen_values and eigen_vectors
+  ///        are resized to the number of problems.
+  /// \throw Exception if any A is not positive definite.
+  void ComputeGeneralizedEigenVectors(const std::vector<SymmetricMatrix> & A,
+                                      const std::vector<Matrix>          & B,
+                                      std::vector<Vector>                & eigen_values,
+                                      std::vector<Matrix>                & eigen_vectors);
+
+  /// \brief Number of threads used inside BLAS/LAPACK calls. Only has an effect when
+  ///        linking with threaded MKL (MKL_THREADED); the sequential libraries use one.
+  void SetLinearAlgebraThreads(int n_threads);
+
   /// \brief File format for input and output of marixes and vectors.
   enum LinalgFileFormat {
     MatrixAscii,    ///< Space-separated columns with one row for each line.
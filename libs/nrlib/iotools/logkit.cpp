@@ -26,6 +26,10 @@
 #include "logkit.hpp"
 #include "../exception/exception.hpp"
 
+#ifdef PARALLEL
+#include <omp.h>
+#endif
+
 using namespace NRLib;
 
 std::vector<LogStream*> LogKit::logstreams_(0);
@@ -125,21 +129,33 @@ LogKit::SetScreenLog(const std::vector<int> & levels, bool ignore_general) {
 void
 LogKit::LogMessage(int level, const std::string & message) {
   unsigned int i;
-  n_messages_[level]++;
   std::string new_message = prefix_[level] + message;
-  for (i=0;i<logstreams_.size();i++)
-    logstreams_[i]->LogMessage(level, new_message);
-  SendToBuffer(level,-1,new_message);
+  // Messages may come from several threads.
+#ifdef PARALLEL
+#pragma omp critical(logkit)
+#endif
+  {
+    n_messages_[level]++;
+    for (i=0;i<logstreams_.size();i++)
+      logstreams_[i]->LogMessage(level, new_message);
+    SendToBuffer(level,-1,new_message);
+  }
 }
 
 void
 LogKit::LogMessage(int level, int phase, const std::string & message) {
   unsigned int i;
-  n_messages_[level]++;
   std::string new_message = prefix_[level] + message;
-  for (i=0;i<logstreams_.size();i++)
-    logstreams_[i]->LogMessage(level, phase, new_message);
-  SendToBuffer(level,phase,new_message);
+  // Messages may come from several threads.
+#ifdef PARALLEL
+#pragma omp critical(logkit)
+#endif
+  {
+    n_messages_[level]++;
+    for (i=0;i<logstreams_.size();i++)
+      logstreams_[i]->LogMessage(level, phase, new_message);
+    SendToBuffer(level,phase,new_message);
+  }
 }
 
 void
@@ -28,6 +28,11 @@
 
 using namespace NRLib;
 
+RandomGenerator * NRLib::random_thread_generator = NULL;
+#ifdef PARALLEL
+#pragma omp threadprivate(random_thread_generator)
+#endif
+
 bool          Random::is_initialized_ = false;
 unsigned long Random::start_seed_     = 0;
 bool          Random::use_seed_file_  = false;
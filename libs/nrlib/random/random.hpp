@@ -22,12 +22,22 @@
 #ifndef NRLIB_RANDOM_H
 #define NRLIB_RANDOM_H
 
+#include <cstddef>
 #include <string>
 
 #include "dSFMT.h"
+#include "randomgenerator.hpp"
 
 namespace NRLib {
 
+/// Generator that Random draws from on the calling thread, set by
+/// Random::ThreadGenerator. NULL (the default on every thread) means
+/// the shared global generator.
+extern RandomGenerator * random_thread_generator;
+#ifdef PARALLEL
+#pragma omp threadprivate(random_thread_generator)
+#endif
+
 /// Random generator class based on the Mersenne-Twister random
 /// number generator.
 /// Always initialize before use!
@@ -40,14 +50,29 @@ public:
 
   static void Initialize(const std::string& seed_file_);
 
+  /// While an object of this class exists, Random draws from the given
+  /// generator on the calling thread, instead of from the shared global
+  /// generator. Used to sample code that calls Random from several threads.
+  class ThreadGenerator {
+  public:
+    explicit ThreadGenerator(RandomGenerator & generator)
+      : previous_(random_thread_generator) { random_thread_generator = &generator; }
+    ~ThreadGenerator()                    { random_thread_generator = previous_;  }
+  private:
+    ThreadGenerator(const ThreadGenerator &);
+    ThreadGenerator & operator=(const ThreadGenerator &);
+
+    RandomGenerator * previous_;
+  };
+
   /// \return uniform number in [0,1)
-  static double Unif01()             { return dsfmt_gv_genrand_close_open(); }
+  static double Unif01()             { return (random_thread_generator == NULL ? dsfmt_gv_genrand_close_open() : random_thread_generator->Unif01()); }
 
   /// \return uniform number in (0,1)
-  static double Unif01Open()             { return dsfmt_gv_genrand_open_open(); }
+  static double Unif01Open()             { return (random_thread_generator == NULL ? dsfmt_gv_genrand_open_open() : random_thread_generator->Unif01Open()); }
 
   /// \return unsigned 32-bit integer betwen 0 and 0xFFFFFFFF
-  static unsigned long DrawUint32()  { return dsfmt_gv_genrand_uint32(); }
+  static unsigned long DrawUint32()  { return (random_thread_generator == NULL ? dsfmt_gv_genrand_uint32() : random_thread_generator->DrawUint32()); }
 
   /// Marsaglia-Bray's method, see Ripley, p. 84.
   static double Norm01();
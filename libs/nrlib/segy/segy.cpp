@@ -63,7 +63,7 @@ SegY::SegY(const std::string       & fileName,
   /// \todo Replace with safe open function.
  // file_.open(fileName.c_str(), std::ios::in | std::ios::binary);
 
-  OpenRead(file_, fileName, std::ios::in | std::ios::binary);
+  OpenReadBuffered(fileName);
 
   if (!file_) {
     throw new IOError("Error opening " + fileName);
@@ -107,7 +107,7 @@ SegY::SegY(const std::string               & fileName,
 
   /// \todo Replace with safe open function.
  // file_.open(fileName.c_str(), std::ios::in | std::ios::binary);
-  OpenRead(file_, fileName, std::ios::in | std::ios::binary);
+  OpenReadBuffered(fileName);
   if (!file_) {
     throw new IOError("Error opening " + fileName);
   }
@@ -170,7 +170,7 @@ SegY::SegY(const std::string               & fileName,
     {
       file_.close();
       file_.clear();
-      OpenRead(file_, fileName, std::ios::in | std::ios::binary);
+      OpenReadBuffered(fileName);
       if (!file_) {
         throw new IOError("Error opening " + fileName);
       }
@@ -211,7 +211,7 @@ SegY::SegY(const std::string               & fileName,
   file_.clear();
 
  // file_.open(fileName.c_str(), std::ios::in | std::ios::binary);
-  OpenRead(file_, fileName, std::ios::in | std::ios::binary);
+  OpenReadBuffered(fileName);
   if (!file_) {
     throw new IOError("Error opening " + fileName);
   }
@@ -227,6 +227,17 @@ SegY::SegY(const std::string               & fileName,
 }
 
 
+void SegY::OpenReadBuffered(const std::string & fileName)
+{
+  // The default stream buffer is only a few kB, which makes the trace by
+  // trace reading dominated by system calls. The buffer must be set before
+  // the file is opened to take effect.
+  const size_t buffer_size = 4*1024*1024;
+  file_buffer_.resize(buffer_size);
+  file_.rdbuf()->pubsetbuf(&file_buffer_[0], static_cast<std::streamsize>(file_buffer_.size()));
+  OpenRead(file_, fileName, std::ios::in | std::ios::binary);
+}
+
 bool SegY::CompareTraces(TraceHeader *header1, TraceHeader *header2, int &delta, int &deltail, int &deltaxl)
 {
   double deltax  = std::abs(header1->GetUtmx() - header2->GetUtmx());
@@ -1726,35 +1737,19 @@ SegY::SetBogusILXLUndefined(std::vector<NRLib::SegYTrace*> & traces)
 
 void SegY::ReadDummyTrace(std::fstream & file, int format, size_t nz)
 {
-std::vector<float> predata;
-  predata.resize(nz);
-
-  if (format==1)
-  {
-    //IBM
-    ReadBinaryIbmFloatArray(file, predata.begin(), nz);
-
-  }
-  else if (format==2)
-  {
-    std::vector<int> b(nz);
-    ReadBinaryIntArray(file, b.begin(), nz);
-
-  }
-  else if (format==3)
-  {
-    std::vector<short> b(nz);
-    ReadBinaryShortArray(file, b.begin(), nz);
-
-  }
-  else if (format==5)
-  {
-    ReadBinaryFloatArray(file, predata.begin(), nz);
-
-  }
+  // The values are not used, so skip the bytes without converting them.
+  size_t datasize;
+  if (format == 1 || format == 2 || format == 5)
+    datasize = 4;
+  else if (format == 3)
+    datasize = 2;
   else
     throw FileFormatError("Bad format");
 
+  std::streamsize n_bytes = static_cast<std::streamsize>(datasize*nz);
+  file.ignore(n_bytes);
+  if (file.gcount() != n_bytes)
+    throw Exception("Error skipping trace. Trying to read " + ToString(nz) + " elements when end-of-file was reached.\n");
 }
 
 bool
@@ -214,6 +214,7 @@ private:
 
   void                      WriteMainHeader(const TextualHeader& ebcdicHeader); ///< Quasi-dummy at the moment.
   void                      ReadDummyTrace(std::fstream & file, int format, size_t nz);
+  void                      OpenReadBuffered(const std::string & fileName);   ///< Open file_ for reading with a large stream buffer.
   /// Used to find correct trace header format.
   bool                      CompareTraces(TraceHeader *header1, TraceHeader *header2, int &delta, int &deltail, int &deltaxl);
 
@@ -242,6 +243,7 @@ private:
   float                     z0_;                   ///< Top of segy cube
   float                     dz_;                   ///< Sampling density in time
 
+  std::vector<char>         file_buffer_;          ///< Stream buffer for file_. Must outlive file_.
   std::fstream              file_;
   std::string               file_name_;
 
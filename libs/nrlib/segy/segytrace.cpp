@@ -60,17 +60,31 @@ SegYTrace::SegYTrace(std::fstream & file, size_t jStart, size_t jEnd, int format
 
   size_t nData = jEnd - jStart + 1;
   size_t i;
-  std::vector<float> predata;
-  predata.resize(nz);
   data_.resize(nData);
 
   try {
-    if (format == 1)
+    if (format == 1 || format == 5)
     {
-      //IBM
-      ReadBinaryIbmFloatArray(file, predata.begin(), nz);
-      for (i = 0; i < nData; i++)
-        data_[i] = predata[jStart+i];
+      // Read the whole trace in one go, but only convert the samples in the
+      // inversion interval. The conversion dominates the reading time for
+      // traces that are much longer than the interval.
+      std::vector<char> buffer(4*nz);
+      if (!file.read(&buffer[0], static_cast<std::streamsize>(4*nz))) {
+        if (file.eof())
+          throw Exception("Error reading binary float array. Trying to read 4*" + ToString(nz) + " elements when end-of-file was reached.\n");
+        else
+          throw Exception("Error reading binary float array. Hardware error? Full disk?\n");
+      }
+      const char * window = &buffer[4*jStart];
+      if (format == 1) {
+        //IBM
+        for (i = 0; i < nData; i++)
+          ParseIBMFloatBE(&window[4*i], data_[i]);
+      }
+      else {
+        for (i = 0; i < nData; i++)
+          ParseIEEEFloatBE(&window[4*i], data_[i]);
+      }
     }
     else if (format == 2)
     {
@@ -86,12 +100,6 @@ SegYTrace::SegYTrace(std::fstream & file, size_t jStart, size_t jEnd, int format
       for (i = 0; i < nData; i++)
         data_[i] =  static_cast<float> (b[jStart+i]);
     }
-    else if (format == 5)
-    {
-      ReadBinaryFloatArray(file, predata.begin(), nz);
-      for (i = 0; i < nData; i++)
-        data_[i] = predata[jStart + i];
-    }
     else
       throw FileFormatError("Bad format");
   }
@@ -106,20 +114,11 @@ SegYTrace::SegYTrace(std::fstream & file, size_t jStart, size_t jEnd, int format
     text += "\n  coord1    = " + ToString(coord1_,2);
     text += "\n  coord2    = " + ToString(coord2_,2);
     text += "\n  nz        = " + ToString(nz) + "\n";
-    text += "\nInformation about values read for last trace (float values may be unset):";
+    text += "\nInformation about last trace:";
     text += "\n  buffer length                        = " + ToString(nz);
     text += "\n  inversion interval start index       = " + ToString(j_start_);
     text += "\n  inversion interval end index         = " + ToString(j_end_);
     text += "\n  number of data in inversion interval = " + ToString(nData);
-    // This is an ugly way to get hold of the numbers, but the only(?) way
-    // due to the exception throwing in read routines.
-    if (e.what() != std::string("Bad format")) {
-      text += "\n  trace values:\n";
-      if (format == 1 || format == 5) {
-        for (i = 0; i < nz; i++)
-          text += std::string("    ") + ToString(i) + ":  " + ToString(predata[i]) + "\n";
-      }
-    }
     throw Exception(text);
   }
 }
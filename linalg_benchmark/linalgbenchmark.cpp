@@ -0,0 +1,204 @@
+/***************************************************************************
+*      Copyright (C) 2008 by Norwegian Computing Center and Statoil        *
+***************************************************************************/
+
+//
+// Compares the linear algebra paths used by CRAVA:
+//  - many small generalized eigenvalue problems (3x3 as in FaciesProb and
+//    PosteriorElasticPDF, 6x6 as in RockPhysicsInversion4D), solved by explicit
+//    inversion, by one Cholesky solve per problem, and by the batched call.
+//  - one large Cholesky solve, as in kriging and the well filter.
+//
+// Build the program against each backend (make bench, make bench lib=mkl,
+// make bench lib=mkl mklthreads=yes, optionally with parallel=yes) and compare
+// the timings.
+//
+// Usage: linalgbench.exe [n_small_problems] [n_large] [n_threads]
+//
+
+#include "../libs/nrlib/flens/nrlib_flens.hpp"
+#include "../libs/nrlib/exception/exception.hpp"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+#ifdef PARALLEL
+#include <omp.h>
+#endif
+
+//-----------------
+double getSeconds()
+//-----------------
+{
+#ifdef PARALLEL
+  return omp_get_wtime();
+#else
+  return static_cast<double>(clock())/CLOCKS_PER_SEC;
+#endif
+}
+
+//----------------
+double drawUnif()
+//----------------
+{
+  return static_cast<double>(rand())/RAND_MAX;
+}
+
+//--------------------------------------------------------
+void makeProblem(int                       n,
+                 NRLib::SymmetricMatrix  & A,
+                 NRLib::Matrix           & B)
+//--------------------------------------------------------
+{
+  // A is a prior covariance, B = A - C is a posterior covariance, where C is a
+  // small positive semi-definite update. inv(A)*B then has eigenvalues in (0,1].
+  NRLib::Matrix L(n, n);
+  NRLib::Matrix M(n, n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      L(i,j) = drawUnif() - 0.5;
+      M(i,j) = 0.1*(drawUnif() - 0.5);
+    }
+  }
+
+  A.resize(n);
+  B.resize(n, n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      double a = (i == j ? 1.0 : 0.0);
+      double c = 0.0;
+      for (int k = 0; k < n; k++) {
+        a += L(i,k)*L(j,k);
+        c += M(i,k)*M(j,k);
+      }
+      if (j >= i)
+        A(i,j) = a;
+      B(i,j) = a - c;
+    }
+  }
+}
+
+//-----------------------------------------------------------
+void solveByInversion(const NRLib::SymmetricMatrix & A,
+                      const NRLib::Matrix          & B,
+                      NRLib::Vector                & eigen_values,
+                      NRLib::Matrix                & eigen_vectors)
+//-----------------------------------------------------------
+{
+  // The path used before ComputeGeneralizedEigenVectors: invert, multiply, solve.
+  int n = B.numRows();
+  NRLib::Matrix Ainv(n, n);
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      Ainv(i,j) = (j >= i ? A(i,j) : A(j,i));
+  NRLib::Invert(Ainv);
+
+  NRLib::Matrix AinvB = Ainv*B;
+  NRLib::ComputeEigenVectors(AinvB, eigen_values, eigen_vectors);
+}
+
+//--------------------------------------------------
+void benchmarkSmall(int n,
+                    int n_problems)
+//--------------------------------------------------
+{
+  srand(4711);
+
+  std::vector<NRLib::SymmetricMatrix> A(n_problems);
+  std::vector<NRLib::Matrix>          B(n_problems);
+  for (int i = 0; i < n_problems; i++)
+    makeProblem(n, A[i], B[i]);
+
+  std::vector<NRLib::Vector> eigen_values(n_problems);
+  std::vector<NRLib::Matrix> eigen_vectors(n_problems);
+
+  for (int i = 0; i < n_problems; i++) {
+    eigen_values[i].resize(n);
+    eigen_vectors[i].resize(n, n);
+  }
+
+  double t0 = getSeconds();
+  for (int i = 0; i < n_problems; i++)
+    solveByInversion(A[i], B[i], eigen_values[i], eigen_vectors[i]);
+  double t_inversion = getSeconds() - t0;
+
+  t0 = getSeconds();
+  for (int i = 0; i < n_problems; i++)
+    NRLib::ComputeGeneralizedEigenVectors(A[i], B[i], eigen_values[i], eigen_vectors[i]);
+  double t_cholesky = getSeconds() - t0;
+
+  t0 = getSeconds();
+  NRLib::ComputeGeneralizedEigenVectors(A, B, eigen_values, eigen_vectors);
+  double t_batched = getSeconds() - t0;
+
+  std::cout << std::setw(2) << n << "x" << std::setw(2) << n << " GEV, " << n_problems << " problems:\n"
+            << "  inversion          : " << std::fixed << std::setprecision(3) << t_inversion << " s\n"
+            << "  Cholesky, one call : " << t_cholesky << " s\n"
+            << "  Cholesky, batched  : " << t_batched  << " s\n";
+}
+
+//--------------------------------
+void benchmarkLarge(int n)
+//--------------------------------
+{
+  srand(4711);
+
+  NRLib::SymmetricMatrix A;
+  NRLib::Matrix          B;
+  makeProblem(n, A, B);
+
+  double t0 = getSeconds();
+  NRLib::CholeskySolve(A, B);
+  double t_solve = getSeconds() - t0;
+
+  std::cout << "Cholesky solve, n = " << n << " with " << n << " right hand sides: "
+            << std::fixed << std::setprecision(3) << t_solve << " s\n";
+}
+
+//------------------------------
+int main(int argc, char ** argv)
+//------------------------------
+{
+  int n_small   = 20000;
+  int n_large   = 1000;
+  int n_threads = 1;
+
+  if (argc > 1)
+    n_small = atoi(argv[1]);
+  if (argc > 2)
+    n_large = atoi(argv[2]);
+  if (argc > 3)
+    n_threads = atoi(argv[3]);
+
+#ifdef PARALLEL
+  omp_set_num_threads(n_threads);
+#endif
+  NRLib::SetLinearAlgebraThreads(n_threads);
+
+  std::cout << "Threads: " << n_threads
+#ifdef PARALLEL
+            << " (wall clock)"
+#else
+            << " (cpu time, batched call runs sequentially)"
+#endif
+#ifdef MKL_THREADED
+            << ", threaded MKL"
+#endif
+            << "\n\n";
+
+  try {
+    benchmarkSmall(3, n_small);
+    benchmarkSmall(6, n_small);
+    benchmarkLarge(n_large);
+  }
+  catch (NRLib::Exception & e) {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
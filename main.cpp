@@ -24,9 +24,11 @@
 #include "lib/timekit.hpp"
 #include "lib/utils.h"
 
+#include "nrlib/exception/exception.hpp"
 #include "nrlib/segy/segy.hpp"
 #include "nrlib/iotools/logkit.hpp"
 #include "nrlib/random/random.hpp"
+#include "nrlib/flens/nrlib_flens.hpp"
 
 #include "rplib/demmodelling.h"
 
@@ -35,9 +37,11 @@
 #include "src/wavelet.h"
 #include "src/avoinversion.h"
 #include "src/fftgrid.h"
+#include "src/fftplancache.h"
 #include "src/gridmapping.h"
 #include "src/simbox.h"
 #include "src/timings.h"
+#include "src/profiler.h"
 #include "src/spatialwellfilter.h"
 #include "src/tasklist.h"
 #include "src/commondata.h"
@@ -186,7 +190,6 @@ int main(int argc, char** argv)
     CommonData         * common_data        = NULL;
     ModelGeneral       * modelGeneral       = NULL;
     ModelAVOStatic     * modelAVOstatic     = NULL;
-    ModelGravityStatic * modelGravityStatic = NULL;
     CravaResult        * crava_result       = new CravaResult();
     NRLib::Random::Initialize();
 
@@ -196,6 +199,8 @@ int main(int argc, char** argv)
       return(1);
     }
 
+    NRLib::SetLinearAlgebraThreads(modelSettings->getNumberOfThreads());
+
     std::string errTxt = inputFiles->addInputPathAndCheckFiles();
     if(errTxt != "") {
       LogKit::WriteHeader("Error opening files");
@@ -211,149 +216,113 @@ int main(int argc, char** argv)
     AND MODEL SETTINGS
     -------------------------------------------------------------*/
 
-    common_data = new CommonData(modelSettings, inputFiles);
+    {
+      Profiler::Region region("Common data");
+      common_data = new CommonData(modelSettings, inputFiles);
+    }
     int n_intervals = common_data->GetMultipleIntervalGrid()->GetNIntervals();
     std::vector<SeismicParametersHolder> seismicParametersIntervals(common_data->GetMultipleIntervalGrid()->GetNIntervals());
 
     if(modelSettings->getEstimationMode() == false) {
-      //Loop over intervals
-      for (int i_interval = 0; i_interval < n_intervals; i_interval++) {
-
-        modelGeneral       = NULL;
-        modelAVOstatic     = NULL;
-        modelGravityStatic = NULL;
-
-        std::string interval_text = "";
-        if (n_intervals > 1)
-          interval_text = " for interval " + NRLib::ToString(common_data->GetMultipleIntervalGrid()->GetIntervalName(i_interval));
-        LogKit::WriteHeader("Setting up model" + interval_text);
-
-        //Priormodell i 3D
-        const Simbox * simbox = common_data->GetMultipleIntervalGrid()->GetIntervalSimbox(i_interval);
-
-        //Expectationsgrids. NRLib::Grid to FFTGrid, fills in padding
-        LogKit::LogFormatted(LogKit::Low,"\nBackground model..\n");
-
-        seismicParametersIntervals[i_interval].setBackgroundParametersInterval(common_data->GetBackgroundParametersInterval(i_interval),
-                                                                               simbox->GetNXpad(),
-                                                                               simbox->GetNYpad(),
-                                                                               simbox->GetNZpad());
-
-        //Background grids are overwritten in avoinversion
-        crava_result->AddBackgroundVp(seismicParametersIntervals[i_interval].GetMeanVp());
-        crava_result->AddBackgroundVs(seismicParametersIntervals[i_interval].GetMeanVs());
-        crava_result->AddBackgroundRho(seismicParametersIntervals[i_interval].GetMeanRho());
-        //Release background grids from common_data.
-        common_data->ReleaseBackgroundGrids(i_interval, 0);
-        common_data->ReleaseBackgroundGrids(i_interval, 1);
-        common_data->ReleaseBackgroundGrids(i_interval, 2);
-
-        //korrelasjonsgrid (2m)
-        float corr_grad_I = 0.0f;
-        float corr_grad_J = 0.0f;
-        common_data->GetCorrGradIJ(corr_grad_I, corr_grad_J, simbox);
-
-        float dt        = static_cast<float>(simbox->getdz());
-        float low_cut   = modelSettings->getLowCut();
-        int low_int_cut = int(floor(low_cut*(simbox->GetNZpad()*0.001*dt))); // computes the integer which corresponds to the low cut frequency.
-
-        if (!modelSettings->getForwardModeling()) {
-          LogKit::LogFormatted(LogKit::Low,"\nCorrelation parameters..\n");
-          seismicParametersIntervals[i_interval].setCorrelationParameters(common_data->GetPriorCovEst(),
-                                                                          common_data->GetPriorParamCov(i_interval),
-                                                                          common_data->GetPriorAutoCov(i_interval),
-                                                                          common_data->GetPriorCorrT(i_interval),
-                                                                          common_data->GetPriorCorrXY(i_interval),
-                                                                          low_int_cut,
-                                                                          corr_grad_I,
-                                                                          corr_grad_J,
-                                                                          simbox->getnx(),
-                                                                          simbox->getny(),
-                                                                          simbox->getnz(),
-                                                                          simbox->GetNXpad(),
-                                                                          simbox->GetNYpad(),
-                                                                          simbox->GetNZpad(),
-                                                                          simbox->getdz());
-
+      //Intervals are inverted in batches. Intervals in the same batch are inverted concurrently.
+      std::vector<std::vector<int> > interval_batches;
+      findIntervalBatches(interval_batches, modelSettings, inputFiles, common_data);
+
+      std::vector<ModelGeneral *>   model_general_intervals(n_intervals, static_cast<ModelGeneral *>(NULL));
+      std::vector<ModelAVOStatic *> model_avo_static_intervals(n_intervals, static_cast<ModelAVOStatic *>(NULL));
+
+      for (size_t i_batch = 0; i_batch < interval_batches.size(); i_batch++) {
+        const std::vector<int> & batch = interval_batches[i_batch];
+        int n_batch = static_cast<int>(batch.size());
+
+        //Background grids are copied to crava_result in interval order before the inversion.
+        for (int b = 0; b < n_batch; b++) {
+          int i_interval = batch[b];
+
+          std::string interval_text = "";
+          if (n_intervals > 1)
+            interval_text = " for interval " + NRLib::ToString(common_data->GetMultipleIntervalGrid()->GetIntervalName(i_interval));
+          LogKit::WriteHeader("Setting up model" + interval_text);
+
+          //Priormodell i 3D
+          const Simbox * simbox = common_data->GetMultipleIntervalGrid()->GetIntervalSimbox(i_interval);
+
+          //Expectationsgrids. NRLib::Grid to FFTGrid, fills in padding
+          LogKit::LogFormatted(LogKit::Low,"\nBackground model..\n");
+
+          seismicParametersIntervals[i_interval].setBackgroundParametersInterval(common_data->GetBackgroundParametersInterval(i_interval),
+                                                                                 simbox->GetNXpad(),
+                                                                                 simbox->GetNYpad(),
+                                                                                 simbox->GetNZpad());
+
+          //Background grids are overwritten in avoinversion
+          crava_result->AddBackgroundVp(seismicParametersIntervals[i_interval].GetMeanVp());
+          crava_result->AddBackgroundVs(seismicParametersIntervals[i_interval].GetMeanVs());
+          crava_result->AddBackgroundRho(seismicParametersIntervals[i_interval].GetMeanRho());
+          //Release background grids from common_data.
+          common_data->ReleaseBackgroundGrids(i_interval, 0);
+          common_data->ReleaseBackgroundGrids(i_interval, 1);
+          common_data->ReleaseBackgroundGrids(i_interval, 2);
         }
 
-        //ModelGeneral, modelAVOstatic, modelGravityStatic, (modelTravelTimeStatic?)
-        LogKit::LogFormatted(LogKit::Low,"\nStatic models..\n");
-        setupStaticModels(modelGeneral,
-                          modelAVOstatic,
-                          //modelGravityStatic,
-                          modelSettings,
-                          inputFiles,
-                          seismicParametersIntervals[i_interval],
-                          common_data,
-                          i_interval);
-
-        //Loop over dataset
-        //i.   ModelAVODynamic
-        //ii.  Inversion
-        //iii. Move model one time-step ahead
-
-        //Do not run avoinversion if forward modelleing or estimationmode
-        //Syntetic seismic is generated in CravaResult
-        if (!modelSettings->getForwardModeling() && !modelSettings->getEstimationMode()) {
-          int  eventType;
-          int  eventIndex;
-          modelGeneral->GetTimeLine()->ReSet();
-
-          double time;
-          int time_index = 0;
-          bool first     = true;
-          while(modelGeneral->GetTimeLine()->GetNextEvent(eventType, eventIndex, time) == true) {
-            if (first == false) {
-                modelGeneral->AdvanceTime(time_index, seismicParametersIntervals[i_interval], modelSettings);
-                time_index++;
-            }
-            bool failed = false;
-            switch(eventType) {
-            case TimeLine::AVO : {
-              LogKit::LogFormatted(LogKit::Low,"\nAVO inversion, time lapse "+ CommonData::ConvertIntToString(time_index) +"..\n");
-              failed = doTimeLapseAVOInversion(modelSettings,
-                                                modelGeneral,
-                                                modelAVOstatic,
-                                                common_data,
-                                                seismicParametersIntervals[i_interval],
-                                                eventIndex,
-                                                i_interval);
-              break;
-            }
-            case TimeLine::TRAVEL_TIME : {
-              LogKit::LogFormatted(LogKit::Low,"\nTravel time inversion, time lapse "+ CommonData::ConvertIntToString(time_index) +"..\n");
-              //failed = doTimeLapseTravelTimeInversion(modelSettings,
-              //                                        modelGeneral,
-              //                                        modelTravelTimeStatic,
-              //                                        inputFiles,
-              //                                        eventIndex,
-              //                                        seismicParametersIntervals[i_interval]);
-              break;
-            }
-            case TimeLine::GRAVITY : {
-              LogKit::LogFormatted(LogKit::Low,"\nGravimetric inversion, time lapse "+ CommonData::ConvertIntToString(time_index) +"..\n");
-              //failed = doTimeLapseGravimetricInversion(modelSettings,
-              //                                          modelGeneral,
-              //                                          modelGravityStatic,
-              //                                          common_data,
-              //                                          eventIndex,
-              //                                          seismicParametersIntervals[i_interval]);
-              break;
-            }
-            default :
+        bool        failed        = false;
+        bool        out_of_memory = false;
+        bool        io_error      = false;
+        std::string errTxt        = "";
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_batch) if(n_batch > 1)
+#endif
+        for (int b = 0; b < n_batch; b++) {
+          int i_interval = batch[b];
+          Profiler::Region interval_region("Interval", common_data->GetMultipleIntervalGrid()->GetIntervalName(i_interval));
+          try {
+            bool interval_failed = doIntervalInversion(model_general_intervals[i_interval],
+                                                       model_avo_static_intervals[i_interval],
+                                                       modelSettings,
+                                                       inputFiles,
+                                                       seismicParametersIntervals[i_interval],
+                                                       common_data,
+                                                       i_interval);
+            if (interval_failed) {
+#ifdef PARALLEL
+#pragma omp critical(interval_status)
+#endif
               failed = true;
-              break;
             }
-            if(failed)
-              return(1);
-
-            first = false;
+          }
+          catch (std::bad_alloc& ) { //Rethrown outside the parallel region
+#ifdef PARALLEL
+#pragma omp critical(interval_status)
+#endif
+            out_of_memory = true;
+          }
+          catch (NRLib::Exception & e) { //Rethrown outside the parallel region
+#ifdef PARALLEL
+#pragma omp critical(interval_status)
+#endif
+            {
+              if (errTxt == "") {
+                errTxt   = e.what();
+                io_error = (dynamic_cast<NRLib::IOError *>(&e) != NULL);
+              }
+            }
           }
         }
-
-        crava_result->AddBlockedLogs(modelGeneral->GetBlockedWells());
+        if (out_of_memory)
+          throw std::bad_alloc();
+        if (io_error)
+          throw NRLib::IOError(errTxt);
+        if (errTxt != "")
+          throw NRLib::Exception(errTxt);
+        if (failed)
+          return(1);
+
+        for (int b = 0; b < n_batch; b++)
+          crava_result->AddBlockedLogs(model_general_intervals[batch[b]]->GetBlockedWells());
       } //interval_loop
+
+      modelGeneral   = model_general_intervals[n_intervals - 1];
+      modelAVOstatic = model_avo_static_intervals[n_intervals - 1];
     }
     if (n_intervals == 1)
       crava_result->SetBgBlockedLogs(common_data->GetBgBlockedLogs());
@@ -377,13 +346,18 @@ int main(int argc, char** argv)
     else {
       //Combine interval grids to one grid per parameter
       LogKit::WriteHeader("Combine Results and Write to Files");
-      crava_result->CombineResults(modelSettings,
+      {
+        Profiler::Region region("Combine results");
+        crava_result->CombineResults(modelSettings,
+                                     common_data,
+                                     seismicParametersIntervals);
+      }
+      {
+        Profiler::Region region("Write results");
+        crava_result->WriteResults(modelSettings,
                                    common_data,
-                                   seismicParametersIntervals);
-
-      crava_result->WriteResults(modelSettings,
-                                 common_data,
-                                 seismicParametersIntervals[0]);
+                                   seismicParametersIntervals[0]);
+      }
 
       if(modelSettings->getDo4DInversion())
       {
@@ -399,16 +373,14 @@ int main(int argc, char** argv)
         }
       }
     }
-    if (modelSettings->getDoInversion() && FFTGrid::getMaxAllowedGrids() != FFTGrid::getMaxAllocatedGrids()) {
-      //NBNB-PAL: Memory check is bogus at the moment. Include again when 4.0 release is fixed.")
-      //LogKit::LogFormatted(LogKit::Warning,"\nWARNING: A memory requirement inconsistency has been detected:");
-      //LogKit::LogFormatted(LogKit::Warning,"\n            Maximum number of grids requested  :  %2d",FFTGrid::getMaxAllowedGrids());
-      //LogKit::LogFormatted(LogKit::Warning,"\n            Maximum number of grids allocated  :  %2d",FFTGrid::getMaxAllocatedGrids());
-      //TaskList::addTask("The memory usage estimate failed. Please send your XML-model file and the logFile.txt\n    to the CRAVA developers.");
-    }
+    FFTPlanCache::WriteWisdom();
+    FFTPlanCache::DestroyPlans();
 
     Timings::setTimeTotal(wall,cpu);
     Timings::reportAll(LogKit::Medium);
+    Profiler::ReportAll(LogKit::High);
+    if((modelSettings->getOtherOutputFlag() & IO::PROFILE_TRACE) > 0)
+      Profiler::WriteTrace(IO::makeFullFileName("", IO::FileProfile()+IO::SuffixJsonFiles()));
 
     TaskList::viewAllTasks(modelSettings->getTaskFileFlag());
 
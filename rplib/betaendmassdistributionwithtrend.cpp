@@ -173,12 +173,7 @@ BetaEndMassDistributionWithTrend::GetQuantileValue(double u, double s1, double s
 
   double y;
 
-  if(share_level_ > None && resample_ == false)
-    u = current_u_;
-  else {
-    current_u_ = u;
-    resample_ = false;
-  }
+  u = FindSampleQuantile(u);
 
   if(ni_ == 1 && nj_ == 1)
     y = (*beta_endmass_distribution_)(0,0)->Quantile(u);
@@ -2,19 +2,8 @@
 
 #include "nrlib/exception/exception.hpp"
 
-#include "rplib/orddiffeqsolver.h"
-
-#include <numeric>
 #include <cmath>
 
-static DEM* global_dem;
-
-static std::vector<double> WrapperGEQDEMYPrime(std::vector<double>&       y,
-                                               double                     t) {
-  return global_dem->GEQDEMYPrime(y, t);
-}
-
-
 DEM::DEM(const std::vector<double>&       bulk_modulus,
          const std::vector<double>&       shear_modulus,
          const std::vector<double>&       aspect_ratio,
@@ -27,9 +16,6 @@ DEM::DEM(const std::vector<double>&       bulk_modulus,
   shear_modulus_(shear_modulus),
   aspect_ratio_(aspect_ratio),
   concentration_(concentration) {
-
-  global_dem = this;
-
 }
 
 DEM::~DEM() {
@@ -70,82 +56,416 @@ DEM::CalcEffectiveModulus(double&                    effective_bulk_modulus,
     //warning("Assumes all inclusions have the same elastic moduli");
     effective_bulk_modulus  = bulk_modulus_.back();
     effective_shear_modulus = shear_modulus_.back();
+    return;
+  }
+
+  // Runge-Kutta-Fehlberg 4(5) coefficients, as used by OrdDiffEqSolver::Ode45.
+  static const double alpha[5]    = {1.0/4.0, 3.0/8.0, 12.0/13.0, 1.0, 1.0/2.0};
+  static const double beta[5][5]  = {{1.0/4.0, 0.0, 0.0, 0.0, 0.0},
+                                     {3.0/32.0, 9.0/32.0, 0.0, 0.0, 0.0},
+                                     {1932.0/2197.0, -7200.0/2197.0, 7296.0/2197.0, 0.0, 0.0},
+                                     {8341.0/4104.0, -32832.0/4104.0, 29440.0/4104.0, -845.0/4104.0, 0.0},
+                                     {-6080.0/20520.0, 41040.0/20520.0, -28352.0/20520.0, 9295.0/20520.0, -5643.0/20520.0}};
+  static const double gamma[2][6] = {{902880.0/7618050.0, 0.0, 3953664.0/7618050.0, 3855735.0/7618050.0, -1371249.0/7618050.0, 277020.0/7618050.0},
+                                     {-2090.0/752400.0, 0.0, 22528.0/752400.0, 21970.0/752400.0, -15048.0/752400.0, -27360.0/752400.0}};
+  const double tol   = 1e-5;
+  const double power = 1.0/5.0;
+
+  size_t n_inclusions = aspect_ratio_.size();
 
+  // The aspect ratio terms do not depend on the state, so they are computed once.
+  std::vector<double> inc_theta(n_inclusions, 0.0);
+  std::vector<double> inc_fn(n_inclusions, 0.0);
+  std::vector<double> inc_conc(n_inclusions);
+
+  double sum_repaired = 0;
+  for (size_t i = 0; i < n_inclusions; i++)
+    sum_repaired += concentration_[i];
+
+  for (size_t i = 0; i < n_inclusions; i++) {
+    double asp = aspect_ratio_[i];
+
+    // truncation
+    if (asp == 1.0)
+      asp = 0.99;
+    if (asp > 1.0)
+      throw NRLib::Exception("DEM: asp > 1 not supported.");
+
+    //******* P and Q *****************
+    if (asp < 1.0) {
+      inc_theta[i] = (asp/(pow((1 - asp*asp), 3.0/2.0)))*(acos(asp) - asp*sqrt(1 - asp*asp));
+      inc_fn[i]    = ((asp*asp)/(1 - asp*asp))*(3*inc_theta[i] -2);
+    }
+    inc_conc[i] = concentration_[i]/sum_repaired;
   }
-  else {
-    std::vector<double>           y0;
-    std::vector<double>                 tout;
-    std::vector< std::vector<double> >  yout;
-
-    double tfinal = sum_conc;
-    y0.resize(2);
-    y0[0] = bulk_modulus_bg_;
-    y0[1] = shear_modulus_bg_;
-
-    OrdDiffEqSolver::
-    Ode45(&WrapperGEQDEMYPrime,
-          0.0,
-          tfinal,
-          y0,
-          tout,
-          yout,
-          1e-5);
-
-    if (!yout.empty())
-      effective_bulk_modulus  = (yout.back())[0];
-    if (!yout.empty())
-      effective_shear_modulus = (yout.back())[1];
 
+  double tfinal = sum_conc;
+  double hmax   = tfinal/16.0;
+  double h      = hmax/8.0;
+  double t      = 0.0;
+  double k      = bulk_modulus_bg_;
+  double mu     = shear_modulus_bg_;
+
+  // Slopes for the six stages
+  double f_k[6];
+  double f_mu[6];
+
+  while (t < tfinal) {
+    if ((t + h) <= t)
+      throw NRLib::Exception("DEM: Singularity likely.");
+
+    if (t + h > tfinal)
+      h = tfinal - t;
+
+    //Compute the slopes
+    GEQDEMYPrime(n_inclusions, &bulk_modulus_[0], &shear_modulus_[0], &inc_conc[0], &inc_theta[0], &inc_fn[0],
+                 t, k, mu, f_k[0], f_mu[0]);
+
+    for (size_t j = 0; j < 5; j++) {
+      double t1  = t + alpha[j]*h;
+      double k1  = k;
+      double mu1 = mu;
+      for (size_t m = 0; m <= j; m++) {
+        k1  += h*beta[j][m]*f_k[m];
+        mu1 += h*beta[j][m]*f_mu[m];
+      }
+      GEQDEMYPrime(n_inclusions, &bulk_modulus_[0], &shear_modulus_[0], &inc_conc[0], &inc_theta[0], &inc_fn[0],
+                   t1, k1, mu1, f_k[j + 1], f_mu[j + 1]);
+    }
+
+    //estimate error and acceptable error
+    double d_k  = 0.0;
+    double d_mu = 0.0;
+    for (size_t m = 0; m < 6; m++) {
+      d_k  += h*gamma[1][m]*f_k[m];
+      d_mu += h*gamma[1][m]*f_mu[m];
+    }
+
+    double delta = std::abs(d_k);
+    if (std::abs(d_mu) > delta)
+      delta = std::abs(d_mu);
+
+    double tau = std::abs(k);
+    if (std::abs(mu) > tau)
+      tau = std::abs(mu);
+
+    if (1.0 > tau)
+      tau = 1.0;
+
+    tau *= tol;
+
+    //update the solution only if the error is acceptable
+    if (delta <= tau) {
+      t += h;
+      for (size_t m = 0; m < 6; m++) {
+        k  += h*gamma[0][m]*f_k[m];
+        mu += h*gamma[0][m]*f_mu[m];
+      }
+    }
+
+    //update the step size
+    if (delta != 0.0) {
+      h = 0.8*h*pow(tau/delta, power);
+      if (hmax < h)
+        h = hmax;
+    }
   }
 
+  effective_bulk_modulus  = k;
+  effective_shear_modulus = mu;
 }
 
-std::vector<double>
-DEM::GEQDEMYPrime(std::vector<double>&       y,
-                  double                     t) {
+void
+DEM::CalcEffectiveModuli(size_t                       n_samples,
+                         size_t                       n_inclusions,
+                         const std::vector<double>&   bulk_modulus,
+                         const std::vector<double>&   shear_modulus,
+                         const std::vector<double>&   aspect_ratio,
+                         const std::vector<double>&   concentration,
+                         const std::vector<double>&   bulk_modulus_bg,
+                         const std::vector<double>&   shear_modulus_bg,
+                         std::vector<double>&         effective_bulk_modulus,
+                         std::vector<double>&         effective_shear_modulus) {
+
+  // Runge-Kutta-Fehlberg 4(5) coefficients, as used by OrdDiffEqSolver::Ode45.
+  static const double alpha[5]    = {1.0/4.0, 3.0/8.0, 12.0/13.0, 1.0, 1.0/2.0};
+  static const double beta[5][5]  = {{1.0/4.0, 0.0, 0.0, 0.0, 0.0},
+                                     {3.0/32.0, 9.0/32.0, 0.0, 0.0, 0.0},
+                                     {1932.0/2197.0, -7200.0/2197.0, 7296.0/2197.0, 0.0, 0.0},
+                                     {8341.0/4104.0, -32832.0/4104.0, 29440.0/4104.0, -845.0/4104.0, 0.0},
+                                     {-6080.0/20520.0, 41040.0/20520.0, -28352.0/20520.0, 9295.0/20520.0, -5643.0/20520.0}};
+  static const double gamma[2][6] = {{902880.0/7618050.0, 0.0, 3953664.0/7618050.0, 3855735.0/7618050.0, -1371249.0/7618050.0, 277020.0/7618050.0},
+                                     {-2090.0/752400.0, 0.0, 22528.0/752400.0, 21970.0/752400.0, -15048.0/752400.0, -27360.0/752400.0}};
+  const double tol   = 1e-5;
+  const double power = 1.0/5.0;
+
+  effective_bulk_modulus.resize(n_samples);
+  effective_shear_modulus.resize(n_samples);
+  if (n_samples == 0)
+    return;
+
+  // Inclusion properties are stored inclusion by inclusion, so that each is contiguous over the samples.
+  std::vector<double> inc_k(n_inclusions*n_samples);
+  std::vector<double> inc_mu(n_inclusions*n_samples);
+  std::vector<double> inc_conc(n_inclusions*n_samples);
+  std::vector<double> inc_theta(n_inclusions*n_samples);
+  std::vector<double> inc_fn(n_inclusions*n_samples);
+
+  std::vector<double> t(n_samples, 0.0);
+  std::vector<double> tfinal(n_samples, 0.0);
+  std::vector<double> h(n_samples, 0.0);
+  std::vector<double> hmax(n_samples, 0.0);
+  std::vector<double> k(n_samples);
+  std::vector<double> mu(n_samples);
+  std::vector<size_t> lane(n_samples);
+
+  size_t n_lanes = 0;
+
+  for (size_t s = 0; s < n_samples; s++) {
+    const double * conc = &concentration[s*n_inclusions];
+
+    double sum_conc = 0;
+    for (size_t i = 0; i < n_inclusions; i++)
+      sum_conc += conc[i];
+
+    // Same repair as in CalcEffectiveModulus. The equations are normalised with the sum
+    // of the repaired concentrations.
+    double repair_factor = 1.0;
+    if (n_inclusions > 1 && sum_conc == 1.0) {
+      repair_factor = 0.999999;
+      sum_conc     *= repair_factor;
+    }
 
-  size_t ninclusions = aspect_ratio_.size();
+    if (sum_conc == 1) {
+      effective_bulk_modulus[s]  = bulk_modulus[s*n_inclusions + n_inclusions - 1];
+      effective_shear_modulus[s] = shear_modulus[s*n_inclusions + n_inclusions - 1];
+      continue;
+    }
 
-  double krhs = 0;
-  double murhs = 0;
-  double sum_conc = std::accumulate(concentration_.begin(), concentration_.end(), 0.0);
+    double sum_repaired = 0;
+    for (size_t i = 0; i < n_inclusions; i++)
+      sum_repaired += conc[i]*repair_factor;
+
+    for (size_t i = 0; i < n_inclusions; i++) {
+      size_t index = i*n_samples + s;
+      double asp   = aspect_ratio[s*n_inclusions + i];
+
+      // truncation
+      if (asp == 1.0)
+        asp = 0.99;
+      if (asp > 1.0)
+        throw NRLib::Exception("DEM: asp > 1 not supported.");
+
+      //******* P and Q *****************
+      double theta = 0.0;
+      double fn    = 0.0;
+      if (asp < 1.0) {
+        theta = (asp/(pow((1 - asp*asp), 3.0/2.0)))*(acos(asp) - asp*sqrt(1 - asp*asp));
+        fn    = ((asp*asp)/(1 - asp*asp))*(3*theta -2);
+      }
+
+      inc_k[index]     = bulk_modulus[s*n_inclusions + i];
+      inc_mu[index]    = shear_modulus[s*n_inclusions + i];
+      inc_conc[index]  = conc[i]*repair_factor/sum_repaired;
+      inc_theta[index] = theta;
+      inc_fn[index]    = fn;
+    }
+
+    tfinal[s] = sum_conc;
+    hmax[s]   = tfinal[s]/16.0;
+    h[s]      = hmax[s]/8.0;
+    k[s]      = bulk_modulus_bg[s];
+    mu[s]     = shear_modulus_bg[s];
+
+    lane[n_lanes++] = s;
+  }
 
-  std::vector<double> yprime(2, 0.0);
+  // Slopes for the six stages, and the stage arguments.
+  std::vector<double> f_k(6*n_samples);
+  std::vector<double> f_mu(6*n_samples);
+  std::vector<double> t1(n_samples);
+  std::vector<double> k1(n_samples);
+  std::vector<double> mu1(n_samples);
+
+  for (;;) {
+    // Retire lanes that have reached tfinal, or where the step no longer moves t.
+    size_t n_active = 0;
+    for (size_t l = 0; l < n_lanes; l++) {
+      size_t s = lane[l];
+      if (t[s] < tfinal[s] && (t[s] + h[s]) > t[s])
+        lane[n_active++] = s;
+      else if (t[s] < tfinal[s])
+        throw NRLib::Exception("DEM: Singularity likely.");
+      else {
+        effective_bulk_modulus[s]  = k[s];
+        effective_shear_modulus[s] = mu[s];
+      }
+    }
+    n_lanes = n_active;
+    if (n_lanes == 0)
+      break;
+
+    for (size_t l = 0; l < n_lanes; l++) {
+      size_t s = lane[l];
+      if (t[s] + h[s] > tfinal[s])
+        h[s] = tfinal[s] - t[s];
+    }
 
-  for (size_t index = 0; index < ninclusions; index++) {
-    double k2 = bulk_modulus_[index];
-    double mu2 = shear_modulus_[index];
-    double asp = aspect_ratio_[index];
+    //Compute the slopes
+    GEQDEMYPrimeLanes(n_lanes, n_samples, n_inclusions, &lane[0], &inc_k[0], &inc_mu[0], &inc_conc[0], &inc_theta[0], &inc_fn[0],
+                 &t[0], &k[0], &mu[0], &f_k[0], &f_mu[0]);
+
+    for (size_t j = 0; j < 5; j++) {
+      for (size_t l = 0; l < n_lanes; l++) {
+        size_t s = lane[l];
+        t1[s]  = t[s] + alpha[j]*h[s];
+        k1[s]  = k[s];
+        mu1[s] = mu[s];
+        for (size_t m = 0; m <= j; m++) {
+          k1[s]  += h[s]*beta[j][m]*f_k[m*n_samples + s];
+          mu1[s] += h[s]*beta[j][m]*f_mu[m*n_samples + s];
+        }
+      }
+      GEQDEMYPrimeLanes(n_lanes, n_samples, n_inclusions, &lane[0], &inc_k[0], &inc_mu[0], &inc_conc[0], &inc_theta[0], &inc_fn[0],
+                   &t1[0], &k1[0], &mu1[0], &f_k[(j + 1)*n_samples], &f_mu[(j + 1)*n_samples]);
+    }
 
-    double conc = concentration_[index]/sum_conc;
+    //estimate error and acceptable error, and take the step if accepted
+    for (size_t l = 0; l < n_lanes; l++) {
+      size_t s = lane[l];
+
+      double d_k  = 0.0;
+      double d_mu = 0.0;
+      for (size_t m = 0; m < 6; m++) {
+        d_k  += h[s]*gamma[1][m]*f_k[m*n_samples + s];
+        d_mu += h[s]*gamma[1][m]*f_mu[m*n_samples + s];
+      }
+
+      double delta = std::abs(d_k);
+      if (std::abs(d_mu) > delta)
+        delta = std::abs(d_mu);
+
+      double tau = std::abs(k[s]);
+      if (std::abs(mu[s]) > tau)
+        tau = std::abs(mu[s]);
+
+      if (1.0 > tau)
+        tau = 1.0;
+
+      tau *= tol;
+
+      if (delta <= tau) {
+        t[s] += h[s];
+        for (size_t m = 0; m < 6; m++) {
+          k[s]  += h[s]*gamma[0][m]*f_k[m*n_samples + s];
+          mu[s] += h[s]*gamma[0][m]*f_mu[m*n_samples + s];
+        }
+      }
+
+      if (delta != 0.0) {
+        h[s] = 0.8*h[s]*pow(tau/delta, power);
+        if (hmax[s] < h[s])
+          h[s] = hmax[s];
+      }
+    }
+  }
+}
 
-    //double krc = bulk_modulus_bg_*k2/((1 - phic_)*k2 + phic_*bulk_modulus_bg_); //Not used
-    //double murc = shear_modulus_bg_*mu2/((1 - phic_)*mu2 + phic_*shear_modulus_bg_); //Not used
+void
+DEM::GEQDEMYPrimeLanes(size_t                       n_lanes,
+                       size_t                       n_samples,
+                       size_t                       n_inclusions,
+                       const size_t               * lane,
+                       const double               * inc_k,
+                       const double               * inc_mu,
+                       const double               * inc_conc,
+                       const double               * inc_theta,
+                       const double               * inc_fn,
+                       const double               * t,
+                       const double               * k,
+                       const double               * mu,
+                       double                     * k_prime,
+                       double                     * mu_prime) {
+
+  for (size_t l = 0; l < n_lanes; l++) {
+    size_t s = lane[l];
+    k_prime[s]  = 0.0;
+    mu_prime[s] = 0.0;
+  }
 
-    double ka = k2;
-    double mua = mu2;
+  for (size_t i = 0; i < n_inclusions; i++) {
+    const double * ka    = inc_k     + i*n_samples;
+    const double * mua   = inc_mu    + i*n_samples;
+    const double * conc  = inc_conc  + i*n_samples;
+    const double * theta = inc_theta + i*n_samples;
+    const double * fn    = inc_fn    + i*n_samples;
 
+    for (size_t l = 0; l < n_lanes; l++) {
+      size_t s = lane[l];
 
-    double k = y[0];
-    double mu = y[1];
+      double nu = (3*k[s] - 2*mu[s])/(2*(3*k[s] + mu[s]));
+      double r = (1 - 2*nu)/(2*(1 - nu));
+      double a = mua[s]/mu[s] - 1;
+      double b = (1.0/3.0)*(ka[s]/k[s] - mua[s]/mu[s]);
 
-    // truncation
-    if (asp == 1.0)
-      asp = 0.99;
+      double f1a = 1 + a*((3.0/2.0)*(fn[s] + theta[s])-r*((3.0/2.0)*fn[s] + (5.0/2.0)*theta[s] - (4.0/3.0)));
 
-    //******* P and Q *****************
-    double theta = 0.0;
-    double fn = 0.0;
+      double f2a = 1 + a*(1+(3.0/2.0)*(fn[s] + theta[s])-(r/2)*(3*fn[s] + 5*theta[s])) + b*(3-4*r);
+      f2a += (a/2)*(a + 3*b)*(3-4*r)*(fn[s] + theta[s]-r*(fn[s]-theta[s] + 2*theta[s]*theta[s]));
 
-    if (asp < 1.0) {
-      theta = (asp/(pow((1 - asp*asp), 3.0/2.0)))*(acos(asp) - asp*sqrt(1 - asp*asp));
-      fn = ((asp*asp)/(1 - asp*asp))*(3*theta -2);
-    }
-    else {
-      //theta = (asp/(pow((asp*asp - 1), 3.0/2.0)))*(asp*sqrt(asp*asp-1)-acosh(asp)); //bug in original code???
-      fn=((asp*asp)/(asp*asp - 1))*(2-3*theta);
-      throw NRLib::Exception("DEM: asp > 1 not supported.");
+      double f3a = 1 + a*(1-(fn[s]+(3.0/2.0)*theta[s]) + r*(fn[s]+theta[s]));
+
+      double f4a = 1 + (a/4)*(fn[s]+3*theta[s] - r*(fn[s] - theta[s]));
+
+      double f5a = a*(-fn[s] + r*(fn[s]+theta[s]-(4.0/3.0))) + b*theta[s]*(3 - 4*r);
+
+      double f6a = 1 + a*(1 + fn[s] - r*(fn[s] + theta[s])) + b*(1-theta[s])*(3 - 4*r);
+
+      double f7a = 2 + (a/4)*(3*fn[s] + 9*theta[s] - r*(3*fn[s] + 5*theta[s])) + b*theta[s]*(3 - 4*r);
+
+      double f8a = a*(1 - 2*r + (fn[s]/2)*(r - 1)+(theta[s]/2)*(5*r - 3)) + b*(1 - theta[s])*(3 - 4*r);
+
+      double f9a = a*((r - 1)*fn[s] - r*theta[s]) + b*theta[s]*(3 - 4*r);
+
+      double pa = 3*f1a/f2a;
+      double qa = (2/f3a) + (1/f4a) +((f4a*f5a + f6a*f7a - f8a*f9a)/(f2a*f4a));
+
+      pa = pa/3.0;
+      qa = qa/5.0;
+
+      k_prime[s]  += conc[s]*(ka[s] - k[s])*pa;
+      mu_prime[s] += conc[s]*(mua[s] - mu[s])*qa;
     }
+  }
+
+  for (size_t l = 0; l < n_lanes; l++) {
+    size_t s = lane[l];
+    k_prime[s]  = k_prime[s]/(1 - t[s]);
+    mu_prime[s] = mu_prime[s]/(1 - t[s]);
+  }
+}
+
+void
+DEM::GEQDEMYPrime(size_t                       n_inclusions,
+                  const double               * inc_k,
+                  const double               * inc_mu,
+                  const double               * inc_conc,
+                  const double               * inc_theta,
+                  const double               * inc_fn,
+                  double                       t,
+                  double                       k,
+                  double                       mu,
+                  double                     & k_prime,
+                  double                     & mu_prime) {
+
+  double krhs  = 0;
+  double murhs = 0;
+
+  for (size_t i = 0; i < n_inclusions; i++) {
+    double ka    = inc_k[i];
+    double mua   = inc_mu[i];
+    double theta = inc_theta[i];
+    double fn    = inc_fn[i];
 
     double nu = (3*k - 2*mu)/(2*(3*k + mu));
     double r = (1 - 2*nu)/(2*(1 - nu));
@@ -177,17 +497,10 @@ DEM::GEQDEMYPrime(std::vector<double>&       y,
     pa = pa/3.0;
     qa = qa/5.0;
 
-    krhs += conc*(ka - k)*pa;
-    murhs += conc*(mua - mu)*qa;
+    krhs  += inc_conc[i]*(ka - k)*pa;
+    murhs += inc_conc[i]*(mua - mu)*qa;
   }
 
-  yprime[0] = krhs/(1 - t);
-  yprime[1] = murhs/(1 - t);
-
-  return yprime;
-
+  k_prime  = krhs/(1 - t);
+  mu_prime = murhs/(1 - t);
 }
-
-
-
-
@@ -1,6 +1,7 @@
 #ifndef RPLIB_DEM_H
 #define RPLIB_DEM_H
 
+#include <cstddef>
 #include <vector>
 
 class DEM {
@@ -39,10 +40,52 @@ public:
   void CalcEffectiveModulus(double&                    effective_bulk_modulus,
                             double&                    effective_shear_modulus);
 
-  std::vector<double> GEQDEMYPrime(std::vector<double>&       y,
-                                   double                     t);
+  // Batch version of the above for n_samples inclusion sets, each with n_inclusions
+  // inclusions. Inclusion properties are stored sample by sample, and the sets are
+  // integrated together, one lane per sample, with an adaptive step for each lane.
+  // Each lane gives the same result as CalcEffectiveModulus for its set.
+  static void CalcEffectiveModuli(size_t                       n_samples,
+                                  size_t                       n_inclusions,
+                                  const std::vector<double>&   bulk_modulus,
+                                  const std::vector<double>&   shear_modulus,
+                                  const std::vector<double>&   aspect_ratio,
+                                  const std::vector<double>&   concentration,
+                                  const std::vector<double>&   bulk_modulus_bg,
+                                  const std::vector<double>&   shear_modulus_bg,
+                                  std::vector<double>&         effective_bulk_modulus,
+                                  std::vector<double>&         effective_shear_modulus);
 
 private:
+  // Right hand side of the DEM equations. The aspect ratio terms theta and fn, and the
+  // normalised concentrations, are computed once per call to CalcEffectiveModulus.
+  static void GEQDEMYPrime(size_t                       n_inclusions,
+                           const double               * inc_k,
+                           const double               * inc_mu,
+                           const double               * inc_conc,
+                           const double               * inc_theta,
+                           const double               * inc_fn,
+                           double                       t,
+                           double                       k,
+                           double                       mu,
+                           double                     & k_prime,
+                           double                     & mu_prime);
+
+  // As GEQDEMYPrime, for the lanes in lane[0..n_lanes-1] of the batch solver.
+  static void GEQDEMYPrimeLanes(size_t                       n_lanes,
+                                size_t                       n_samples,
+                                size_t                       n_inclusions,
+                                const size_t               * lane,
+                                const double               * inc_k,
+                                const double               * inc_mu,
+                                const double               * inc_conc,
+                                const double               * inc_theta,
+                                const double               * inc_fn,
+                                const double               * t,
+                                const double               * k,
+                                const double               * mu,
+                                double                     * k_prime,
+                                double                     * mu_prime);
+
   double                           bulk_modulus_bg_;
   double                           shear_modulus_bg_;
   const std::vector<double>&       bulk_modulus_;
@@ -60,108 +60,62 @@ DEMTools::CalcCo2Prop(double& bulk_modulus,
                       double ti,
                       double pi) {
 
-  double ttmp[] = {1.7000000e+001,  2.7000000e+001,  3.7000000e+001,  4.7000000e+001,  5.7000000e+001,  6.7000000e+001,  7.7000000e+001,  8.7000000e+001,  9.7000000e+001,  1.0700000e+002,  1.1700000e+002,  1.2700000e+002};
-  size_t nt     = 12;
-
-  double pmpatmp[] = {1.0005000e-001,  1.0005000e+000,  4.0020000e+000,  7.0035000e+000,  1.0005000e+001,  1.4007000e+001,  2.0010000e+001,  2.5012500e+001,  3.0015000e+001,  4.0020000e+001};
-  size_t np        = 10;
-
-  std::vector<double> t(ttmp, ttmp + nt);
-  std::vector<double> pmpa(pmpatmp, pmpatmp + np);
-
-  static std::vector< std::vector<double> > co2_bulk(np, std::vector<double>(nt, 0.0));
-  static std::vector< std::vector<double> > co2_density(np, std::vector<double>(nt, 0.0));
-
-  { // local scope co2 density
-    double tmp0[] = {1.8600000e-003,  1.8000000e-003,  1.7400000e-003,  1.6800000e-003,  1.6300000e-003,  1.5800000e-003,  1.5400000e-003,  1.4900000e-003,  1.4500000e-003,  1.4100000e-003,  1.3800000e-003,  1.3400000e-003};
-    co2_density[0] = std::vector<double>(tmp0, tmp0 + nt);
-
-    double tmp1[] = {1.9630000e-002,  1.8840000e-002,  1.8130000e-002,  1.7480000e-002,  1.6880000e-002,  1.6320000e-002,  1.5800000e-002,  1.5310000e-002,  1.4860000e-002,  1.4440000e-002,  1.4040000e-002,  1.3660000e-002};
-    co2_density[1] = std::vector<double>(tmp1, tmp1 + nt);
-
-    double tmp2[] = {1.2900000e-001,  9.3950000e-002,  8.7090000e-002,  8.1690000e-002,  7.7240000e-002,  7.3450000e-002,  7.0130000e-002,  6.7190000e-002,  6.4540000e-002,  6.2150000e-002,  6.0000000e-002,  5.7970000e-002};
-    co2_density[2] = std::vector<double>(tmp2, tmp2 + nt);
-
-    double tmp3[] = {8.3000000e-001,  6.8000000e-001,  2.0072000e-001,  1.8283000e-001,  1.6362000e-001,  1.4960000e-001,  1.3928000e-001,  1.3094000e-001,  1.2391000e-001,  1.1786000e-001,  1.1275000e-001,  1.0794000e-001};
-    co2_density[3] = std::vector<double>(tmp3, tmp3 + nt);
-
-    double tmp4[] = {9.1700000e-001,  8.0500000e-001,  6.8300000e-001,  4.4973000e-001,  3.2761000e-001,  2.6715000e-001,  2.3550000e-001,  2.1381000e-001,  1.9732000e-001,  1.8422000e-001,  1.7409000e-001,  1.6443000e-001};
-    co2_density[4] = std::vector<double>(tmp4, tmp4 + nt);
-
-    double tmp5[] = {9.3000000e-001,  8.6000000e-001,  7.8000000e-001,  6.9000000e-001,  5.7000000e-001,  4.8000000e-001,  3.9000000e-001,  3.3500000e-001,  3.0000000e-001,  2.7500000e-001,  2.5200000e-001,  2.3500000e-001};
-    co2_density[5] = std::vector<double>(tmp5, tmp5 + nt);
-
-    double tmp6[] = { 9.6000000e-001,  9.1000000e-001,  8.6000000e-001,  8.0000000e-001,  7.4000000e-001,  6.8000000e-001,  6.2000000e-001,  5.6000000e-001,  5.1000000e-001,  4.7000000e-001,  4.2000000e-001,  3.9000000e-001};
-    co2_density[6] = std::vector<double>(tmp6, tmp6 + nt);
-
-    double tmp7[] = {9.9000000e-001,  9.5000000e-001,  9.0000000e-001,  8.5000000e-001,  7.9000000e-001,  7.5000000e-001,  7.0000000e-001,  6.4000000e-001,  5.9000000e-001,  5.5000000e-001,  5.1000000e-001,  4.8000000e-001};
-    co2_density[7] = std::vector<double>(tmp7, tmp7 + nt);
-
-    double tmp8[] = {1.0080000e+000,  9.7000000e-001,  9.3000000e-001,  8.9000000e-001,  8.5000000e-001,  8.1000000e-001,  7.7000000e-001,  7.2000000e-001,  6.8000000e-001,  6.3000000e-001,  6.0000000e-001,  5.7000000e-001};
-    co2_density[8] = std::vector<double>(tmp8, tmp8 + nt);
-
-    double tmp9[] = {1.0400000e+000,  1.0000000e+000,  9.7000000e-001,  9.4000000e-001,  9.0000000e-001,  8.7000000e-001,  8.4000000e-001,  8.0000000e-001,  7.7000000e-001,  7.3000000e-001,  7.0000000e-001,  6.7000000e-001};
-    co2_density[9] = std::vector<double>(tmp9, tmp9 + nt);
-
-  } // local scope end co2 density
-
-  { // local scope for co2 bulk
-    double tmp0[] = {1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004 };
-    co2_bulk[0] = std::vector<double>(tmp0, tmp0 + nt);
-
-    double tmp1[] = {1.2900000e-003,  1.2800000e-003,  1.2800000e-003,  1.2800000e-003,  1.2800000e-003,  1.2700000e-003,  1.2700000e-003,  1.2700000e-003,  1.2600000e-003,  1.2600000e-003,  1.2600000e-003,  1.2600000e-003};
-    co2_bulk[1] = std::vector<double>(tmp1, tmp1 + nt);
-
-    double tmp2[] = {6.2400000e-003,  5.0100000e-003,  5.0400000e-003,  5.1300000e-003,  5.1800000e-003,  5.1400000e-003,  5.1700000e-003,  5.1000000e-003,  5.1000000e-003,  5.1100000e-003,  5.1100000e-003,  5.0700000e-003};
-    co2_bulk[2] = std::vector<double>(tmp2, tmp2 + nt);
-
-    double tmp3[] = {1.1922000e-001,  2.3270000e-002,  8.7300000e-003,  8.7900000e-003,  9.2300000e-003,  9.5100000e-003,  9.6500000e-003,  9.5500000e-003,  9.4100000e-003,  9.3700000e-003,  9.1600000e-003,  9.1000000e-003};
-    co2_bulk[3] = std::vector<double>(tmp3, tmp3 + nt);
-
-    double tmp4[] = {2.1393000e-001,  1.3598000e-001,  1.5990000e-002,  1.2820000e-002,  1.4690000e-002,  1.5200000e-002,  1.4600000e-002,  1.4120000e-002,  1.3860000e-002,  1.3630000e-002,  1.3460000e-002,  1.3410000e-002};
-    co2_bulk[4] = std::vector<double>(tmp4, tmp4 + nt);
-
-    double tmp5[] = {2.8543000e-001,  2.1157000e-001,  1.0449000e-001,  4.9930000e-002,  3.4780000e-002,  2.9520000e-002,  2.5360000e-002,  2.2650000e-002,  2.1710000e-002,  2.1250000e-002,  2.0470000e-002,  1.9900000e-002};
-    co2_bulk[5] = std::vector<double>(tmp5, tmp5 + nt);
-
-    double tmp6[] = {3.8954000e-001,  3.1249000e-001,  2.1672000e-001,  1.5558000e-001,  1.0798000e-001,  8.7150000e-002,  7.7260000e-002,  6.6650000e-002,  5.7920000e-002,  5.0560000e-002,  4.3010000e-002,  3.8450000e-002};
-    co2_bulk[6] = std::vector<double>(tmp6, tmp6 + nt);
-
-    double tmp7[] = {4.6861000e-001,  3.8912000e-001,  3.1435000e-001,  2.4603000e-001,  1.8813000e-001,  1.5870000e-001,  1.3003000e-001,  1.0916000e-001,  9.2990000e-002,  8.0260000e-002,  6.8320000e-002,  5.9470000e-002};
-    co2_bulk[7] = std::vector<double>(tmp7, tmp7 + nt);
-
-    double tmp8[] = {5.4751000e-001,  4.5781000e-001,  3.8212000e-001,  3.1614000e-001,  2.5900000e-001,  2.1987000e-001,  1.8791000e-001,  1.5905000e-001,  1.3770000e-001,  1.1595000e-001,  1.0185000e-001,  8.9840000e-002};
-    co2_bulk[8] = std::vector<double>(tmp8, tmp8 + nt);
-
-    double tmp9[] = {6.8910000e-001,  5.8676000e-001,  4.9450000e-001,  4.2956000e-001,  3.6749000e-001,  3.2906000e-001,  2.9439000e-001,  2.5448000e-001,  2.2871000e-001,  2.0197000e-001,  1.7781000e-001,  1.5890000e-001};
-    co2_bulk[9] = std::vector<double>(tmp9, tmp9 + nt);
-
-  } // local scope end
-
-
-  if (ti < t.front() || ti > t.back() || pi < pmpa.front() || pi > pmpa.back())
+  // Constant tables, initialized at compile time, so they may be shared by several threads.
+  static const size_t nt = 12;
+  static const size_t np = 10;
+
+  static const double t[nt]    = {1.7000000e+001,  2.7000000e+001,  3.7000000e+001,  4.7000000e+001,  5.7000000e+001,  6.7000000e+001,  7.7000000e+001,  8.7000000e+001,  9.7000000e+001,  1.0700000e+002,  1.1700000e+002,  1.2700000e+002};
+  static const double pmpa[np] = {1.0005000e-001,  1.0005000e+000,  4.0020000e+000,  7.0035000e+000,  1.0005000e+001,  1.4007000e+001,  2.0010000e+001,  2.5012500e+001,  3.0015000e+001,  4.0020000e+001};
+
+  static const double co2_density[np][nt] = {
+    {1.8600000e-003,  1.8000000e-003,  1.7400000e-003,  1.6800000e-003,  1.6300000e-003,  1.5800000e-003,  1.5400000e-003,  1.4900000e-003,  1.4500000e-003,  1.4100000e-003,  1.3800000e-003,  1.3400000e-003},
+    {1.9630000e-002,  1.8840000e-002,  1.8130000e-002,  1.7480000e-002,  1.6880000e-002,  1.6320000e-002,  1.5800000e-002,  1.5310000e-002,  1.4860000e-002,  1.4440000e-002,  1.4040000e-002,  1.3660000e-002},
+    {1.2900000e-001,  9.3950000e-002,  8.7090000e-002,  8.1690000e-002,  7.7240000e-002,  7.3450000e-002,  7.0130000e-002,  6.7190000e-002,  6.4540000e-002,  6.2150000e-002,  6.0000000e-002,  5.7970000e-002},
+    {8.3000000e-001,  6.8000000e-001,  2.0072000e-001,  1.8283000e-001,  1.6362000e-001,  1.4960000e-001,  1.3928000e-001,  1.3094000e-001,  1.2391000e-001,  1.1786000e-001,  1.1275000e-001,  1.0794000e-001},
+    {9.1700000e-001,  8.0500000e-001,  6.8300000e-001,  4.4973000e-001,  3.2761000e-001,  2.6715000e-001,  2.3550000e-001,  2.1381000e-001,  1.9732000e-001,  1.8422000e-001,  1.7409000e-001,  1.6443000e-001},
+    {9.3000000e-001,  8.6000000e-001,  7.8000000e-001,  6.9000000e-001,  5.7000000e-001,  4.8000000e-001,  3.9000000e-001,  3.3500000e-001,  3.0000000e-001,  2.7500000e-001,  2.5200000e-001,  2.3500000e-001},
+    {9.6000000e-001,  9.1000000e-001,  8.6000000e-001,  8.0000000e-001,  7.4000000e-001,  6.8000000e-001,  6.2000000e-001,  5.6000000e-001,  5.1000000e-001,  4.7000000e-001,  4.2000000e-001,  3.9000000e-001},
+    {9.9000000e-001,  9.5000000e-001,  9.0000000e-001,  8.5000000e-001,  7.9000000e-001,  7.5000000e-001,  7.0000000e-001,  6.4000000e-001,  5.9000000e-001,  5.5000000e-001,  5.1000000e-001,  4.8000000e-001},
+    {1.0080000e+000,  9.7000000e-001,  9.3000000e-001,  8.9000000e-001,  8.5000000e-001,  8.1000000e-001,  7.7000000e-001,  7.2000000e-001,  6.8000000e-001,  6.3000000e-001,  6.0000000e-001,  5.7000000e-001},
+    {1.0400000e+000,  1.0000000e+000,  9.7000000e-001,  9.4000000e-001,  9.0000000e-001,  8.7000000e-001,  8.4000000e-001,  8.0000000e-001,  7.7000000e-001,  7.3000000e-001,  7.0000000e-001,  6.7000000e-001}
+  };
+
+  static const double co2_bulk[np][nt] = {
+    {1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004,  1.3000000e-004},
+    {1.2900000e-003,  1.2800000e-003,  1.2800000e-003,  1.2800000e-003,  1.2800000e-003,  1.2700000e-003,  1.2700000e-003,  1.2700000e-003,  1.2600000e-003,  1.2600000e-003,  1.2600000e-003,  1.2600000e-003},
+    {6.2400000e-003,  5.0100000e-003,  5.0400000e-003,  5.1300000e-003,  5.1800000e-003,  5.1400000e-003,  5.1700000e-003,  5.1000000e-003,  5.1000000e-003,  5.1100000e-003,  5.1100000e-003,  5.0700000e-003},
+    {1.1922000e-001,  2.3270000e-002,  8.7300000e-003,  8.7900000e-003,  9.2300000e-003,  9.5100000e-003,  9.6500000e-003,  9.5500000e-003,  9.4100000e-003,  9.3700000e-003,  9.1600000e-003,  9.1000000e-003},
+    {2.1393000e-001,  1.3598000e-001,  1.5990000e-002,  1.2820000e-002,  1.4690000e-002,  1.5200000e-002,  1.4600000e-002,  1.4120000e-002,  1.3860000e-002,  1.3630000e-002,  1.3460000e-002,  1.3410000e-002},
+    {2.8543000e-001,  2.1157000e-001,  1.0449000e-001,  4.9930000e-002,  3.4780000e-002,  2.9520000e-002,  2.5360000e-002,  2.2650000e-002,  2.1710000e-002,  2.1250000e-002,  2.0470000e-002,  1.9900000e-002},
+    {3.8954000e-001,  3.1249000e-001,  2.1672000e-001,  1.5558000e-001,  1.0798000e-001,  8.7150000e-002,  7.7260000e-002,  6.6650000e-002,  5.7920000e-002,  5.0560000e-002,  4.3010000e-002,  3.8450000e-002},
+    {4.6861000e-001,  3.8912000e-001,  3.1435000e-001,  2.4603000e-001,  1.8813000e-001,  1.5870000e-001,  1.3003000e-001,  1.0916000e-001,  9.2990000e-002,  8.0260000e-002,  6.8320000e-002,  5.9470000e-002},
+    {5.4751000e-001,  4.5781000e-001,  3.8212000e-001,  3.1614000e-001,  2.5900000e-001,  2.1987000e-001,  1.8791000e-001,  1.5905000e-001,  1.3770000e-001,  1.1595000e-001,  1.0185000e-001,  8.9840000e-002},
+    {6.8910000e-001,  5.8676000e-001,  4.9450000e-001,  4.2956000e-001,  3.6749000e-001,  3.2906000e-001,  2.9439000e-001,  2.5448000e-001,  2.2871000e-001,  2.0197000e-001,  1.7781000e-001,  1.5890000e-001}
+  };
+
+  if (ti < t[0] || ti > t[nt - 1] || pi < pmpa[0] || pi > pmpa[np - 1])
     throw NRLib::Exception("Temperature or pressure outside valid range.");
   size_t i1 = 0;
-  while (i1 < t.size() && ti >= t[i1])
+  while (i1 < nt && ti >= t[i1])
     i1++;
 
   if (i1 >= 1)
     i1--;
 
-  if (i1 > t.size() - 2)
-    i1 = t.size() - 2;
+  if (i1 > nt - 2)
+    i1 = nt - 2;
 
   double t1 = (ti - t[i1])/(t[i1+1] - t[i1]);
 
   size_t j1 = 0;
-  while (j1 < pmpa.size() && pi >= pmpa[j1])
+  while (j1 < np && pi >= pmpa[j1])
     j1++;
 
   if (j1 >= 1)
     j1--;
 
-  if (j1 > pmpa.size() - 2)
-    j1 = pmpa.size() - 2;
+  if (j1 > np - 2)
+    j1 = np - 2;
 
   double t2 = (pi - pmpa[j1])/(pmpa[j1+1] - pmpa[j1]);
 
@@ -270,6 +224,28 @@ DEMTools::CalcEffectiveBulkAndShearModulus(const std::vector<double>&       bulk
   dem.CalcEffectiveModulus(effective_bulk_modulus, effective_shear_modulus);
 }
 
+void
+DEMTools::CalcEffectiveBulkAndShearModuli(size_t                           n_inclusions,
+                                          const std::vector<double>&       bulk_modulus,
+                                          const std::vector<double>&       shear_modulus,
+                                          const std::vector<double>&       aspect_ratio,
+                                          const std::vector<double>&       concentration,
+                                          const std::vector<double>&       bulk_modulus_bg,
+                                          const std::vector<double>&       shear_modulus_bg,
+                                          std::vector<double>&             effective_bulk_modulus,
+                                          std::vector<double>&             effective_shear_modulus) {
+  DEM::CalcEffectiveModuli(bulk_modulus_bg.size(),
+                           n_inclusions,
+                           bulk_modulus,
+                           shear_modulus,
+                           aspect_ratio,
+                           concentration,
+                           bulk_modulus_bg,
+                           shear_modulus_bg,
+                           effective_bulk_modulus,
+                           effective_shear_modulus);
+}
+
 
 double
 DEMTools::CalcVelocityOfBrineFromTPS(double temperature,
@@ -287,32 +263,11 @@ DEMTools::CalcVelocityOfBrineFromTPS(double temperature,
 double
 DEMTools::CalcVelocityOfWaterFromTP(double temperature,
                                     double pressure) {
-  std::vector< std::vector<double> > omega(5, std::vector<double>(4, 0.0));
-
-  omega[0][0] = 1402.85;
-  omega[0][1] = 1.524;
-  omega[0][2] = 3.437E-3;
-  omega[0][3] = -1.197E-5;
-
-  omega[1][0] = 4.871;
-  omega[1][1] = -0.0111;
-  omega[1][2] = 1.739E-4;
-  omega[1][3] = -1.628E-6;
-
-  omega[2][0] = -0.04783;
-  omega[2][1] = 2.747E-4;
-  omega[2][2] = -2.135E-6;
-  omega[2][3] = 1.237E-8;
-
-  omega[3][0] = 1.487E-4;
-  omega[3][1] = -6.503E-7;
-  omega[3][2] = -1.455E-8;
-  omega[3][3] = 1.327E-10;
-
-  omega[4][0] =  -2.197E-7;
-  omega[4][1] = 7.987E-10;
-  omega[4][2] = 5.230E-11;
-  omega[4][3] = -4.614E-13;
+  static const double omega[5][4] = {{ 1402.85,   1.524,     3.437E-3,  -1.197E-5  },
+                                     { 4.871,     -0.0111,   1.739E-4,  -1.628E-6  },
+                                     { -0.04783,  2.747E-4,  -2.135E-6, 1.237E-8   },
+                                     { 1.487E-4,  -6.503E-7, -1.455E-8, 1.327E-10  },
+                                     { -2.197E-7, 7.987E-10, 5.230E-11, -4.614E-13 }};
 
   double ww = 0.0;
 
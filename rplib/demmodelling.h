@@ -1,6 +1,7 @@
 #ifndef RPLIB_DEMMODELLING_H
 #define RPLIB_DEMMODELLING_H
 
+#include <cstddef>
 #include <vector>
 
 namespace DEMTools {
@@ -45,6 +46,18 @@ namespace DEMTools {
                                           double&                    effective_bulk_modulus,
                                           double&                    effective_shear_modulus);
 
+  // Batch version of CalcEffectiveBulkAndShearModulus for one set of n_inclusions inclusions
+  // per element of bulk_modulus_bg, stored set by set. The sets are integrated together.
+  void   CalcEffectiveBulkAndShearModuli(size_t                           n_inclusions,
+                                         const std::vector<double>&       bulk_modulus,
+                                         const std::vector<double>&       shear_modulus,
+                                         const std::vector<double>&       aspect_ratio,
+                                         const std::vector<double>&       concentration,
+                                         const std::vector<double>&       bulk_modulus_bg,
+                                         const std::vector<double>&       shear_modulus_bg,
+                                         std::vector<double>&             effective_bulk_modulus,
+                                         std::vector<double>&             effective_shear_modulus);
+
 
   //list of helper functions called by the main functions
   double CalcVelocityOfBrineFromTPS(double temperature,
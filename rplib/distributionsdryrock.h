@@ -19,6 +19,12 @@ public:
 
   virtual DryRock *               GenerateSample(const std::vector<double> & /*trend_params*/)       = 0;
 
+  // As GenerateSample, with the same draws, but the sample may be unusable until it has been
+  // passed to FinishSamples. This lets models with costly parameters find them in batches.
+  virtual DryRock *               GenerateUnfinishedSample(const std::vector<double> & trend_params) { return GenerateSample(trend_params); }
+
+  virtual void                    FinishSamples(const std::vector<DryRock*> & /*samples*/)         {}
+
   std::vector< DryRock* >         GenerateWellSample(const  std::vector<double> & trend_params,
                                                      double                       corr);
 
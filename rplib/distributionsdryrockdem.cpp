@@ -3,12 +3,51 @@
 #include "rplib/distributionwithtrend.h"
 #include "rplib/dryrockdem.h"
 #include "rplib/demmodelling.h"
+#include "rplib/forwardmodeltable.h"
 
 #include "src/definitions.h"
 
 #include "nrlib/random/distribution.hpp"
+#include "nrlib/random/random.hpp"
+#include "nrlib/iotools/logkit.hpp"
+#include "nrlib/exception/exception.hpp"
 
 #include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace {
+  // (log10 aspect ratio, inclusion concentration) -> (k, mu) for a constant host and inclusion.
+  // Where the integration fails, the moduli are set to NaN so that the cells around are not served.
+  class DEMModel : public ForwardModelTable::Model {
+  public:
+    DEMModel(double host_k, double host_mu, double inc_k, double inc_mu)
+    : host_k_(host_k), host_mu_(host_mu), inc_k_(inc_k), inc_mu_(inc_mu) {}
+
+    void Evaluate(const double * x,
+                  double       * y) const
+    {
+      std::vector<double> inc_k(1, inc_k_);
+      std::vector<double> inc_mu(1, inc_mu_);
+      std::vector<double> inc_spectrum(1, std::pow(10.0, x[0]));
+      std::vector<double> inc_conc(1, x[1]);
+
+      try {
+        DEMTools::CalcEffectiveBulkAndShearModulus(inc_k, inc_mu, inc_spectrum, inc_conc, host_k_, host_mu_, y[0], y[1]);
+      }
+      catch (NRLib::Exception &) {
+        y[0] = std::numeric_limits<double>::quiet_NaN();
+        y[1] = std::numeric_limits<double>::quiet_NaN();
+      }
+    }
+
+  private:
+    double host_k_;
+    double host_mu_;
+    double inc_k_;
+    double inc_mu_;
+  };
+}
 
 DistributionsDryRockDEM::DistributionsDryRockDEM(DistributionsDryRock                         * distr_dryrock,
                                                  std::vector<DistributionsDryRock*>           & distr_dryrock_inc,
@@ -18,7 +57,8 @@ DistributionsDryRockDEM::DistributionsDryRockDEM(DistributionsDryRock
 : DistributionsDryRock(),
   distr_dryrock_inc_(distr_dryrock_inc.size(), NULL),
   distr_incl_spectrum_(distr_incl_spectrum.size(), NULL),
-  distr_incl_concentration_(distr_incl_concentration.size(), NULL)
+  distr_incl_concentration_(distr_incl_concentration.size(), NULL),
+  table_(NULL)
 {
   assert( distr_incl_spectrum.size() + 1 == distr_incl_concentration.size() );
 
@@ -45,16 +85,20 @@ DistributionsDryRockDEM::DistributionsDryRockDEM(DistributionsDryRock
 
   alpha_                      = alpha;   // Order in alpha: aspect_ratios, host_volume_fraction, inclusion_volume_fractions
 
+  if (ForwardModelTable::GetUseTables() == true)
+    SetupTable();
 }
 
 DistributionsDryRockDEM::DistributionsDryRockDEM(const DistributionsDryRockDEM & dist)
-: DistributionsDryRock(dist)
+: DistributionsDryRock(dist),
+  table_(NULL)
 {
   distr_dryrock_ = dist.distr_dryrock_->Clone();
 
   for(size_t i=0; i<dist.distr_dryrock_inc_.size(); i++)
     distr_dryrock_inc_.push_back(dist.distr_dryrock_inc_[i]->Clone());
 
+  distr_incl_spectrum_.resize(dist.distr_incl_spectrum_.size());
   for(size_t i=0; i<dist.distr_incl_spectrum_.size(); i++) {
     if(dist.distr_incl_spectrum_[i]->GetIsShared() == false)
       distr_incl_spectrum_[i] = dist.distr_incl_spectrum_[i]->Clone();
@@ -75,11 +119,14 @@ DistributionsDryRockDEM::DistributionsDryRockDEM(const DistributionsDryRockDEM &
 
   alpha_ = dist.alpha_;   // Order in alpha: aspect_ratios, host_volume_fraction, inclusion_volume_fractions
 
+  if (dist.table_ != NULL)
+    table_ = new ForwardModelTable(*dist.table_);
 }
 
 DistributionsDryRockDEM::~DistributionsDryRockDEM()
 {
   delete distr_dryrock_;
+  delete table_;
 
   for(size_t i=0; i<distr_dryrock_inc_.size(); i++)
     delete distr_dryrock_inc_[i];
@@ -103,6 +150,31 @@ DistributionsDryRockDEM::Clone() const
 
 DryRock *
 DistributionsDryRockDEM::GenerateSample(const std::vector<double> & trend_params)
+{
+  return GenerateSample(trend_params, true);
+}
+
+DryRock *
+DistributionsDryRockDEM::GenerateUnfinishedSample(const std::vector<double> & trend_params)
+{
+  return GenerateSample(trend_params, false);
+}
+
+void
+DistributionsDryRockDEM::FinishSamples(const std::vector<DryRock*> & samples)
+{
+  std::vector<DryRockDEM*> dem_samples(samples.size());
+  for (size_t i = 0; i < samples.size(); ++i) {
+    assert(typeid(*samples[i]) == typeid(DryRockDEM));
+    dem_samples[i] = dynamic_cast<DryRockDEM *>(samples[i]);
+  }
+
+  DryRockDEM::ComputeElasticParams(dem_samples);
+}
+
+DryRock *
+DistributionsDryRockDEM::GenerateSample(const std::vector<double> & trend_params,
+                                        bool                        find_moduli)
 {
   DryRock * dryrock     = distr_dryrock_->GenerateSample(trend_params);
 
@@ -124,7 +196,7 @@ DistributionsDryRockDEM::GenerateSample(const std::vector<double> & trend_params
   if (distr_incl_concentration_.back() != NULL)
     u.back() = NRLib::Random::Unif01();
 
-  DryRock * new_dryrock = GetSample(u, trend_params, dryrock, dryrock_inc);
+  DryRock * new_dryrock = GetSample(u, trend_params, dryrock, dryrock_inc, find_moduli);
 
   // Deep copy taken by constructor of DryRockDEM, hence delete
   // dryrock and dryrock_inc here:
@@ -235,7 +307,8 @@ DryRock *
 DistributionsDryRockDEM::GetSample(const std::vector<double>    & u,
                                    const std::vector<double>    & trend_params,
                                    const DryRock                * dryrock,
-                                   const std::vector< DryRock* >& dryrock_inc)
+                                   const std::vector< DryRock* >& dryrock_inc,
+                                   bool                           find_moduli)
 {
   size_t  n_incl = distr_incl_spectrum_.size();
   std::vector<double> inclusion_spectrum(n_incl);
@@ -266,5 +339,51 @@ DistributionsDryRockDEM::GetSample(const std::vector<double>    & u,
     inclusion_concentration[missing_index] = 1.0 - sum;
   }
 
-  return new DryRockDEM(dryrock, dryrock_inc, inclusion_spectrum, inclusion_concentration, u);
+  return new DryRockDEM(dryrock, dryrock_inc, inclusion_spectrum, inclusion_concentration, u, find_moduli, table_);
+}
+
+void
+DistributionsDryRockDEM::SetupTable()
+{
+  if (distr_dryrock_inc_.size() != 1 ||
+      distr_dryrock_->HasDistribution() == true || distr_dryrock_inc_[0]->HasDistribution() == true)
+    return;
+
+  std::vector<bool> host_trend      = distr_dryrock_->HasTrend();
+  std::vector<bool> inclusion_trend = distr_dryrock_inc_[0]->HasTrend();
+  for (size_t j = 0; j < 2; ++j) {
+    if (host_trend[j] == true || inclusion_trend[j] == true)
+      return;
+  }
+
+  // The host and inclusion are constant, but sampling them draws random numbers. They are
+  // drawn from a generator of their own, so the shared generator is left as it was.
+  double host_k, host_mu, inc_k, inc_mu, rho;
+  {
+    NRLib::RandomGenerator         generator;
+    generator.Initialize(0);
+    NRLib::Random::ThreadGenerator thread_generator(generator);
+
+    std::vector<double> trend_params(2, 0.0);
+    DryRock * host      = distr_dryrock_->GenerateSample(trend_params);
+    DryRock * inclusion = distr_dryrock_inc_[0]->GenerateSample(trend_params);
+
+    host->GetElasticParams(host_k, host_mu, rho);
+    inclusion->GetElasticParams(inc_k, inc_mu, rho);
+
+    delete host;
+    delete inclusion;
+  }
+
+  // Aspect ratios from 0.01 to 1, and inclusion concentrations up to 0.5.
+  std::vector<double> x_min(2);
+  std::vector<double> x_max(2);
+  x_min[0] = -2.0; x_max[0] = 0.0;
+  x_min[1] =  0.0; x_max[1] = 0.5;
+
+  DEMModel model(host_k, host_mu, inc_k, inc_mu);
+  table_ = new ForwardModelTable(model, x_min, x_max, 2, 5.0e-4, 16384);
+
+  NRLib::LogKit::LogFormatted(NRLib::LogKit::Low, "\nDEM dry rock table: %d nodes, %.1f%% of the cells served, largest error %.1e\n",
+                              static_cast<int>(table_->GetNNodes()), 100.0*table_->GetServedFraction(), table_->GetMaxError());
 }
@@ -4,6 +4,7 @@
 #include "rplib/distributionsdryrock.h"
 
 class DistributionWithTrend;
+class ForwardModelTable;
 
 class DistributionsDryRockDEM : public DistributionsDryRock {
 public:
@@ -22,6 +23,10 @@ public:
 
   virtual DryRock               * GenerateSample(const std::vector<double> & trend_params);
 
+  virtual DryRock               * GenerateUnfinishedSample(const std::vector<double> & trend_params);
+
+  virtual void                    FinishSamples(const std::vector<DryRock*> & samples);
+
   virtual bool                    HasDistribution() const;
 
   virtual std::vector<bool>       HasTrend() const;
@@ -33,15 +38,24 @@ public:
 protected:
 
 private:
+  DryRock                       * GenerateSample(const std::vector<double> & trend_params,
+                                                 bool                        find_moduli);
+
   DryRock                       * GetSample(const std::vector<double>    & u,
                                             const std::vector<double>    & trend_params,
                                             const DryRock                * dryrock,
-                                            const std::vector< DryRock* >& dryrock_inc);
+                                            const std::vector< DryRock* >& dryrock_inc,
+                                            bool                           find_moduli = true);
+
+  // Tabulates the DEM moduli over aspect ratio and concentration, if there is one
+  // inclusion and the host and inclusion are constant.
+  void                            SetupTable();
 
   DistributionsDryRock                           * distr_dryrock_;              // Pointer to external object.
   std::vector< DistributionsDryRock*>              distr_dryrock_inc_;          // Pointer to external object.
   std::vector< DistributionWithTrend * >           distr_incl_spectrum_;      // Pointers to external objects.
   std::vector< DistributionWithTrend * >           distr_incl_concentration_; // Pointers to external objects.
+  ForwardModelTable                              * table_;                    // NULL if the moduli are not tabulated.
 };
 
 #endif
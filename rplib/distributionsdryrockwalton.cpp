@@ -5,6 +5,7 @@
 #include "rplib/dryrockwalton.h"
 #include "rplib/solid.h"
 #include "rplib/demmodelling.h"
+#include "rplib/forwardmodeltable.h"
 
 #include "nrlib/random/distribution.hpp"
 
@@ -44,6 +45,8 @@ DistributionsDryRockWalton::DistributionsDryRockWalton(DistributionsSolid
 
   alpha_  = alpha;   // Order in alpha: friction_weight, pressure, porosity, coord_number
 
+  if (ForwardModelTable::GetUseTables() == true)
+    DryRockWalton::SetupTable();
 }
 
 DistributionsDryRockWalton::DistributionsDryRockWalton(const DistributionsDryRockWalton & dist)
@@ -4,6 +4,7 @@
 #include "rplib/demmodelling.h"
 
 #include "rplib/fluidco2.h"
+#include "rplib/forwardmodeltable.h"
 
 #include "nrlib/random/distribution.hpp"
 
@@ -23,6 +24,9 @@ DistributionsFluidCO2::DistributionsFluidCO2(DistributionWithTrend       * distr
     distr_pore_pressure_ = distr_pore_pressure->Clone();
 
   alpha_               = alpha;
+
+  if (ForwardModelTable::GetUseTables() == true)
+    FluidCO2::SetupTable();
 }
 
 DistributionsFluidCO2::DistributionsFluidCO2(const DistributionsFluidCO2 & dist)
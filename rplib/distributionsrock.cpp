@@ -8,6 +8,8 @@
 #include "nrlib/random/random.hpp"
 #include <nrlib/flens/nrlib_flens.hpp>
 
+#include <algorithm>
+
 //--------------------------------------------------------------//
 Rock * DistributionsRock::GenerateSampleAndReservoirVariables(const std::vector<double> & trend_params, std::vector<double> &resVar )
 {
@@ -27,14 +29,36 @@ Rock * DistributionsRock::GenerateSampleAndReservoirVariables(const std::vector<
 //--------------------------------------------------------------//
 Rock * DistributionsRock::GenerateSample(const std::vector<double> & trend_params )
 {
-  size_t nResVar=reservoir_variables_.size();
-  //Note: If this is not a top level rock, reservoir_variables_ are not set, so the loop is skipped.
-  for(size_t i=0;i<nResVar;i++)
-    reservoir_variables_[i]->TriggerNewSample(resampling_level_);
+  TriggerReservoirVariables();
   Rock * result = GenerateSamplePrivate(trend_params);
   return(result);
 }
 
+//--------------------------------------------------------------//
+void DistributionsRock::GenerateSamples(const std::vector<double> & trend_params,
+                                        std::vector<Rock *>       & samples)
+{
+  GenerateSamplesPrivate(trend_params, samples);
+}
+
+//--------------------------------------------------------------//
+void DistributionsRock::GenerateSamplesPrivate(const std::vector<double> & trend_params,
+                                               std::vector<Rock *>       & samples)
+{
+  for(size_t k=0;k<samples.size();k++) {
+    TriggerReservoirVariables();
+    samples[k] = GenerateSamplePrivate(trend_params);
+  }
+}
+
+//--------------------------------------------------------------//
+void DistributionsRock::TriggerReservoirVariables()
+{
+  //Note: If this is not a top level rock, reservoir_variables_ are not set, so the loop is skipped.
+  for(size_t i=0;i<reservoir_variables_.size();i++)
+    reservoir_variables_[i]->TriggerNewSample(resampling_level_);
+}
+
 
 
 
@@ -93,7 +117,8 @@ Rock * DistributionsRock::EvolveSampleAndReservoirVaribles(double
 
 
 //-----------------------------------------------------------------------------------------------------------
-void  DistributionsRock::SetupExpectationAndCovariances(std::string & errTxt)
+void  DistributionsRock::SetupExpectationAndCovariances(int           n_threads,
+                                                        std::string & errTxt)
 //-----------------------------------------------------------------------------------------------------------
 {
   int n  = 1024; // Number of samples generated for each distribution
@@ -118,77 +143,81 @@ void  DistributionsRock::SetupExpectationAndCovariances(std::string & errTxt)
                  tabulated_s0_,
                  tabulated_s1_);
 
-  NRLib::Grid2D<double> cov(3,3);
-  std::vector<double>   mean(3);
-
   unsigned int seed = NRLib::Random::DrawUint32();
 
-  bool failed = false;
-
-  for (int i = 0 ; i < mi ; i++) {
-    for (int j = 0 ; j < mj ; j++) {
-
-      std::vector<double>   expectation_small(3, 0.0);
-      NRLib::Grid2D<double> covariance_small(3, 3, 0.0);
-
-      if(failed == false) {
-
-        NRLib::Random::Initialize(seed);
-        const std::vector<double> & tp = trend_params(i,j); // trend_params = two-dimensional
-
-        NRLib::Vector log_vp(n);
-        NRLib::Vector log_vs(n);
-        NRLib::Vector log_rho(n);
-
-        double vp;
-        double vs;
-        double rho;
-
-        for (int k = 0 ; k < n ; k++) {
-          Rock * rock = GenerateSample(tp);
-
-          rock->GetSeismicParams(vp, vs, rho);
-
-          log_vp(k) = std::log(vp);
-          log_vs(k) = std::log(vs);
-          log_rho(k) = std::log(rho);
-
-          delete rock;
+  // All trend nodes are sampled from the same seed, so the nodes are independent.
+  // All but the last node are sampled in parallel, each from its own generator.
+  // The global generator is shared, and is not touched by the threads. The last
+  // node is sampled here from the global generator, leaving it in the same state
+  // as a serial run would.
+  int n_nodes    = mi*mj;
+  int n_parallel = n_nodes - 1;
+
+  std::vector<std::string> node_err(n_nodes, "");
+  std::vector<int>         node_ok(n_nodes, 1);
+
+  n_threads = std::max(1, std::min(n_threads, std::min(n_parallel, DistributionWithTrend::GetMaxSamplingThreads())));
+
+  if (n_threads > 1)
+    DistributionWithTrend::BeginThreadedSampling();
+
+#ifdef PARALLEL
+#pragma omp parallel num_threads(n_threads) if(n_threads > 1)
+#endif
+  {
+    std::vector<double> log_vp(n);
+    std::vector<double> log_vs(n);
+    std::vector<double> log_rho(n);
+
+#ifdef PARALLEL
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (int node = 0 ; node < n_parallel ; node++) {
+      NRLib::RandomGenerator generator;
+      generator.Initialize(seed);
+      NRLib::Random::ThreadGenerator thread_generator(generator);
+
+      node_ok[node] = SampleLogSeismicParameters(trend_params(node / mj, node % mj),
+                                                 log_vp,
+                                                 log_vs,
+                                                 log_rho,
+                                                 expectation_(node / mj, node % mj),
+                                                 covariance_(node / mj, node % mj),
+                                                 node_err[node]);
+    }
+  }
 
-          if(vp <= 0 || vs < 0 || rho <=0) {
-            errTxt += "\nAt least one sample generated from the rock model obtains negative values.\n";
-            if(vp <= 0)
-              errTxt += "  The variance for Vp might be too large.\n\n";
-            if(vs < 0)
-              errTxt += "  The variance for Vs might be too large.\n\n";
-            if(rho <= 0)
-              errTxt += "  The variance for density might be too large.\n\n";
+  if (n_threads > 1)
+    DistributionWithTrend::EndThreadedSampling();
 
-            failed = true;
-            break;
-          }
-        }
+  {
+    std::vector<double> log_vp(n);
+    std::vector<double> log_vs(n);
+    std::vector<double> log_rho(n);
 
-        if(failed == false) {
+    NRLib::Random::Initialize(seed);
 
-          std::vector<NRLib::Vector> m(3);
-
-          m[0] = log_vp;
-          m[1] = log_vs;
-          m[2] = log_rho;
+    node_ok[n_parallel] = SampleLogSeismicParameters(trend_params(mi - 1, mj - 1),
+                                                     log_vp,
+                                                     log_vs,
+                                                     log_rho,
+                                                     expectation_(mi - 1, mj - 1),
+                                                     covariance_(mi - 1, mj - 1),
+                                                     node_err[n_parallel]);
+  }
 
-          for (int k = 0; k < 3; k++) {
-            expectation_small[k] = NRLib::Mean(m[k]);
-            for (int l = k; l < 3; l++) {
-              covariance_small(k,l) = NRLib::Cov(m[k], m[l]);
-              covariance_small(l,k) = covariance_small(k,l);
-            }
-          }
-        }
-      }
+  // As in a serial run, only the first failing node is reported, and that node
+  // and all nodes after it are left empty.
+  bool failed = false;
 
-      expectation_(i,j) = expectation_small;
-      covariance_(i,j) = covariance_small;
+  for (int node = 0 ; node < n_nodes ; node++) {
+    if (failed == false && node_ok[node] == 0) {
+      errTxt += node_err[node];
+      failed  = true;
+    }
+    if (failed == true) {
+      expectation_(node / mj, node % mj) = std::vector<double>(3, 0.0);
+      covariance_(node / mj, node % mj)  = NRLib::Grid2D<double>(3, 3, 0.0);
     }
   }
 
@@ -223,6 +252,76 @@ void  DistributionsRock::SetupExpectationAndCovariances(std::string & errTxt)
   }
 }
 
+//----------------------------------------------------------------------------------------
+bool DistributionsRock::SampleLogSeismicParameters(const std::vector<double> & trend_params,
+                                                   std::vector<double>       & log_vp,
+                                                   std::vector<double>       & log_vs,
+                                                   std::vector<double>       & log_rho,
+                                                   std::vector<double>       & expectation,
+                                                   NRLib::Grid2D<double>     & covariance,
+                                                   std::string               & errTxt)
+//----------------------------------------------------------------------------------------
+{
+  double vp;
+  double vs;
+  double rho;
+
+  size_t n          = log_vp.size();
+  size_t batch_size = 128; // Samples generated together, letting DEM models integrate them in one batch
+
+  std::vector<Rock *> rocks;
+
+  for (size_t k0 = 0 ; k0 < n ; k0 += batch_size) {
+    rocks.resize(std::min(batch_size, n - k0));
+    GenerateSamples(trend_params, rocks);
+
+    bool negative = false;
+
+    for (size_t j = 0 ; j < rocks.size() ; j++) {
+      if (negative == false) {
+        size_t k = k0 + j;
+
+        rocks[j]->GetSeismicParams(vp, vs, rho);
+
+        log_vp[k]  = std::log(vp);
+        log_vs[k]  = std::log(vs);
+        log_rho[k] = std::log(rho);
+
+        if(vp <= 0 || vs < 0 || rho <=0) {
+          errTxt += "\nAt least one sample generated from the rock model obtains negative values.\n";
+          if(vp <= 0)
+            errTxt += "  The variance for Vp might be too large.\n\n";
+          if(vs < 0)
+            errTxt += "  The variance for Vs might be too large.\n\n";
+          if(rho <= 0)
+            errTxt += "  The variance for density might be too large.\n\n";
+
+          negative = true;
+        }
+      }
+      delete rocks[j];
+    }
+
+    if (negative == true)
+      return(false);
+  }
+
+  const std::vector<double> * m[3] = {&log_vp, &log_vs, &log_rho};
+
+  expectation.resize(3);
+  covariance.Resize(3, 3);
+
+  for (int k = 0; k < 3; k++) {
+    expectation[k] = NRLib::Mean(m[k]->begin(), m[k]->end());
+    for (int l = k; l < 3; l++) {
+      covariance(k,l) = NRLib::Cov(m[k]->begin(), m[k]->end(), m[l]->begin(), m[l]->end());
+      covariance(l,k) = covariance(k,l);
+    }
+  }
+
+  return(true);
+}
+
 //----------------------------------------------------------------------------------------
 void DistributionsRock::FindTabulatedTrendParams(std::vector<double>       & tabulated_s0,
                                                  std::vector<double>       & tabulated_s1,
@@ -553,9 +652,10 @@ void DistributionsRock::InterpolateCovariance(NRLib::Grid2D<double>
 
 
 void DistributionsRock::CompleteTopLevelObject(std::vector<DistributionWithTrend *>   res_var,
+                                               int                                    n_threads,
                                                std::string                          & errTxt)
 {
   reservoir_variables_ = res_var;
   SetResamplingLevel(DistributionWithTrend::Full);
-  SetupExpectationAndCovariances(errTxt);
+  SetupExpectationAndCovariances(n_threads, errTxt);
 }
@@ -19,6 +19,10 @@ public:
   virtual DistributionsRock           * Clone()                                                           const = 0;
 
   Rock                                * GenerateSample(const std::vector<double> & trend_params);
+
+  // Fills samples with samples.size() new samples, drawn as by repeated calls to GenerateSample.
+  void                                  GenerateSamples(const std::vector<double> & trend_params,
+                                                        std::vector<Rock *>       & samples);
   Rock                                * GenerateSampleAndReservoirVariables(const std::vector<double> & trend_params, std::vector<double> &resVar );
 
   void                                  GenerateWellSample(double                 corr,
@@ -57,6 +61,7 @@ public:
 
   //Top level objects (those accessed from outside the rock physics model) need more parameters set, so call this.
   void                                  CompleteTopLevelObject(std::vector<DistributionWithTrend *>   res_var,
+                                                               int                                    n_threads,
                                                                std::string                          & errTxt);
 
   void                                  SetResamplingLevel(int level) {resampling_level_ = level;}
@@ -65,10 +70,27 @@ protected:
   //Since there is a common start of generate sample here, that is the public function.
   //The public function then calls this overloaded function to get the specific object.
   virtual Rock                        * GenerateSamplePrivate(const std::vector<double> & trend_params) = 0;
+
+  // Called by GenerateSamples. Models where samples are cheaper to finish together override this,
+  // keeping the draw order of GenerateSample: TriggerReservoirVariables() first for each sample.
+  virtual void                          GenerateSamplesPrivate(const std::vector<double> & trend_params,
+                                                               std::vector<Rock *>       & samples);
+
+  void                                  TriggerReservoirVariables();
                                         //This function should be called last step in constructor
                                         //for all children classes.
 
-  void                                  SetupExpectationAndCovariances(std::string & errTxt);
+  void                                  SetupExpectationAndCovariances(int           n_threads,
+                                                                       std::string & errTxt);
+
+  // Draws from the generator set by NRLib::Random::ThreadGenerator, if any.
+  bool                                  SampleLogSeismicParameters(const std::vector<double> & trend_params,
+                                                                   std::vector<double>       & log_vp,
+                                                                   std::vector<double>       & log_vs,
+                                                                   std::vector<double>       & log_rho,
+                                                                   std::vector<double>       & expectation,
+                                                                   NRLib::Grid2D<double>     & covariance,
+                                                                   std::string               & errTxt);
 
   void                                  FindTabulatedTrendParams(std::vector<double>       & tabulated_s0,
                                                                  std::vector<double>       & tabulated_s1,
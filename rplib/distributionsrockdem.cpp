@@ -130,6 +130,65 @@ DistributionsRockDEM::GenerateSamplePrivate(const std::vector<double> & trend_pa
   for (size_t i = 0; i < fluid.size(); ++i)
     fluid[i] = distr_fluid_[i]->GenerateSample(trend_params);
 
+  std::vector<double> u = GenerateU();
+
+  Rock * new_rock = GetSample(u, trend_params, solid, fluid);
+
+  // Deep copy taken by constructor of RockInclusion, hence delete
+  // solid and fluid here:
+  delete solid;
+  for (size_t i = 0; i < fluid.size(); ++i)
+    delete fluid[i];
+
+  return new_rock;
+}
+
+void
+DistributionsRockDEM::GenerateSamplesPrivate(const std::vector<double> & trend_params,
+                                             std::vector<Rock *>       & samples)
+{
+  size_t n_samples = samples.size();
+
+  std::vector< Solid* >                solid(n_samples);
+  std::vector< std::vector< Fluid* > > fluid(n_samples, std::vector< Fluid* >(distr_fluid_.size()));
+  std::vector< std::vector<double> >   u(n_samples);
+  std::vector< std::vector<double> >   inclusion_spectrum(n_samples);
+  std::vector< std::vector<double> >   inclusion_concentration(n_samples);
+
+  // Draw all samples in the order used by GenerateSample, and leave the DEM integrations
+  // of the solids and the rocks to one batch each.
+  for (size_t k = 0; k < n_samples; ++k) {
+    TriggerReservoirVariables();
+
+    solid[k] = distr_solid_->GenerateUnfinishedSample(trend_params);
+
+    for (size_t i = 0; i < distr_fluid_.size(); ++i)
+      fluid[k][i] = distr_fluid_[i]->GenerateSample(trend_params);
+
+    u[k] = GenerateU();
+
+    FindInclusionParams(u[k], trend_params, inclusion_spectrum[k], inclusion_concentration[k]);
+  }
+
+  distr_solid_->FinishSamples(solid);
+
+  std::vector<RockDEM *> rock(n_samples);
+
+  for (size_t k = 0; k < n_samples; ++k) {
+    rock[k]    = new RockDEM(solid[k], fluid[k], inclusion_spectrum[k], inclusion_concentration[k], u[k], false);
+    samples[k] = rock[k];
+
+    delete solid[k];
+    for (size_t i = 0; i < fluid[k].size(); ++i)
+      delete fluid[k][i];
+  }
+
+  RockDEM::ComputeSeismicAndElasticParams(rock);
+}
+
+std::vector<double>
+DistributionsRockDEM::GenerateU()
+{
   size_t n_incl = distr_incl_spectrum_.size();
 
   std::vector<double> u(n_incl+n_incl+1, RMISSING);
@@ -144,15 +203,7 @@ DistributionsRockDEM::GenerateSamplePrivate(const std::vector<double> & trend_pa
   if (distr_incl_concentration_.back() != NULL)
     u.back() = NRLib::Random::Unif01();
 
-  Rock * new_rock = GetSample(u, trend_params, solid, fluid);
-
-  // Deep copy taken by constructor of RockInclusion, hence delete
-  // solid and fluid here:
-  delete solid;
-  for (size_t i = 0; i < fluid.size(); ++i)
-    delete fluid[i];
-
-  return new_rock;
+  return u;
 }
 
 bool
@@ -225,10 +276,11 @@ DistributionsRockDEM::SampleVpVsRhoExpectationAndCovariance(std::vector<double>
   NRLib::Vector rho(nsamples);
 
   std::vector<double> dummy(2, 0.0);
+  std::vector<Rock *> rock(nsamples);
+  GenerateSamples(dummy, rock);
   for (int i = 0; i < nsamples; ++i) {
-    Rock * rock = GenerateSample(dummy);
-    rock->GetSeismicParams(vp(i), vs(i), rho(i));
-    delete rock;
+    rock[i]->GetSeismicParams(vp(i), vs(i), rho(i));
+    delete rock[i];
   }
   m[0] = vp;
   m[1] = vs;
@@ -248,10 +300,24 @@ DistributionsRockDEM::GetSample(const std::vector<double>  & u,
                                 const std::vector<double>  & trend_params,
                                 const Solid                * solid,
                                 const std::vector< Fluid *>& fluid)
+{
+  std::vector<double> inclusion_spectrum;
+  std::vector<double> inclusion_concentration;
+
+  FindInclusionParams(u, trend_params, inclusion_spectrum, inclusion_concentration);
+
+  return new RockDEM(solid, fluid, inclusion_spectrum, inclusion_concentration, u);
+}
+
+void
+DistributionsRockDEM::FindInclusionParams(const std::vector<double> & u,
+                                          const std::vector<double> & trend_params,
+                                          std::vector<double>       & inclusion_spectrum,
+                                          std::vector<double>       & inclusion_concentration)
 {
   size_t n_incl = distr_incl_spectrum_.size();
-  std::vector<double> inclusion_spectrum(n_incl);
-  std::vector<double> inclusion_concentration(n_incl + 1, 0.0);
+  inclusion_spectrum.resize(n_incl);
+  inclusion_concentration.assign(n_incl + 1, 0.0);
 
   size_t missing_index = n_incl + 1;
 
@@ -277,8 +343,6 @@ DistributionsRockDEM::GetSample(const std::vector<double>  & u,
 
     inclusion_concentration[missing_index] = 1.0 - sum;
   }
-
-  return new RockDEM(solid, fluid, inclusion_spectrum, inclusion_concentration, u);
 }
 
 Rock *
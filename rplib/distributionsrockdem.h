@@ -46,6 +46,11 @@ public:
 private:
   virtual Rock                                 * GenerateSamplePrivate(const std::vector<double> & trend_params);
 
+  virtual void                                   GenerateSamplesPrivate(const std::vector<double> & trend_params,
+                                                                        std::vector<Rock *>       & samples);
+
+  std::vector<double>                            GenerateU();
+
   void                                           SampleVpVsRhoExpectationAndCovariance(std::vector<double>   & expectation,
                                                                                        NRLib::Grid2D<double> & covariance);
 
@@ -54,6 +59,13 @@ private:
                                                            const Solid                * solid,
                                                            const std::vector< Fluid *>& fluid);
 
+  // Shared reservoir variables keep their value until the next sample is triggered,
+  // so this must be called before TriggerReservoirVariables() is called again.
+  void                                           FindInclusionParams(const std::vector<double> & u,
+                                                                     const std::vector<double> & trend_params,
+                                                                     std::vector<double>       & inclusion_spectrum,
+                                                                     std::vector<double>       & inclusion_concentration);
+
   DistributionsSolid                           * distr_solid_;              // Pointer to external object.
   std::vector< DistributionsFluid *>             distr_fluid_;              // Pointer to external object.
   std::vector< DistributionWithTrend * >         distr_incl_spectrum_;      // Pointers to external objects.
@@ -64,6 +64,32 @@ DistributionsRockGassmann::GenerateSamplePrivate(const std::vector<double> & tre
   return new_rock;
 }
 
+void
+DistributionsRockGassmann::GenerateSamplesPrivate(const std::vector<double> & trend_params,
+                                                  std::vector<Rock *>       & samples)
+{
+  size_t n_samples = samples.size();
+
+  std::vector<DryRock *> dryrock(n_samples);
+  std::vector<Fluid *>   fluid(n_samples);
+
+  // Draw in the order used by GenerateSample, and let the dry rock model finish its samples together.
+  for (size_t k = 0; k < n_samples; ++k) {
+    TriggerReservoirVariables();
+    dryrock[k] = distr_dryrock_->GenerateUnfinishedSample(trend_params);
+    fluid[k]   = distr_fluid_->GenerateSample(trend_params);
+  }
+
+  distr_dryrock_->FinishSamples(dryrock);
+
+  for (size_t k = 0; k < n_samples; ++k) {
+    samples[k] = GetSample(dryrock[k], fluid[k]);
+
+    delete fluid[k];
+    delete dryrock[k];
+  }
+}
+
 bool
 DistributionsRockGassmann::HasDistribution() const
 {
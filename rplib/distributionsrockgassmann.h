@@ -38,6 +38,9 @@ public:
 private:
   virtual Rock                                 * GenerateSamplePrivate(const std::vector<double> & trend_params);
 
+  virtual void                                   GenerateSamplesPrivate(const std::vector<double> & trend_params,
+                                                                        std::vector<Rock *>       & samples);
+
   Rock                                         * GetSample(const DryRock              * dryrock,
                                                            const Fluid                * fluid);
 
@@ -109,6 +109,31 @@ DistributionsSolidDEM::Clone() const
 
 Solid *
 DistributionsSolidDEM::GenerateSample(const std::vector<double> & trend_params)
+{
+  return GenerateSample(trend_params, true);
+}
+
+Solid *
+DistributionsSolidDEM::GenerateUnfinishedSample(const std::vector<double> & trend_params)
+{
+  return GenerateSample(trend_params, false);
+}
+
+void
+DistributionsSolidDEM::FinishSamples(const std::vector<Solid*> & samples)
+{
+  std::vector<SolidDEM*> dem_samples(samples.size());
+  for (size_t i = 0; i < samples.size(); ++i) {
+    assert(typeid(*samples[i]) == typeid(SolidDEM));
+    dem_samples[i] = dynamic_cast<SolidDEM *>(samples[i]);
+  }
+
+  SolidDEM::ComputeElasticParams(dem_samples);
+}
+
+Solid *
+DistributionsSolidDEM::GenerateSample(const std::vector<double> & trend_params,
+                                      bool                        find_moduli)
 {
   Solid * solid     = distr_solid_->GenerateSample(trend_params);
 
@@ -130,7 +155,7 @@ DistributionsSolidDEM::GenerateSample(const std::vector<double> & trend_params)
   if (distr_incl_concentration_.back() != NULL)
     u.back() = NRLib::Random::Unif01();
 
-  Solid * new_solid = GetSample(u, trend_params, solid, solid_inc);
+  Solid * new_solid = GetSample(u, trend_params, solid, solid_inc, find_moduli);
 
   // Deep copy taken by constructor of SolidDEM, hence delete
   // solid and solid_inc here:
@@ -239,7 +264,8 @@ Solid *
 DistributionsSolidDEM::GetSample(const std::vector<double>  & u,
                                  const std::vector<double>  & trend_params,
                                  const Solid                * solid,
-                                 const std::vector< Solid* >& solid_inc)
+                                 const std::vector< Solid* >& solid_inc,
+                                 bool                         find_moduli)
 {
   size_t  n_incl = distr_incl_spectrum_.size();
   std::vector<double> inclusion_spectrum(n_incl);
@@ -270,5 +296,5 @@ DistributionsSolidDEM::GetSample(const std::vector<double>  & u,
     inclusion_concentration[missing_index] = 1.0 - sum;
   }
 
-  return new SolidDEM(solid, solid_inc, inclusion_spectrum, inclusion_concentration, u);
+  return new SolidDEM(solid, solid_inc, inclusion_spectrum, inclusion_concentration, u, find_moduli);
 }
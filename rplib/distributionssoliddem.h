@@ -22,6 +22,10 @@ public:
 
   virtual Solid               * GenerateSample(const std::vector<double> & trend_params);
 
+  virtual Solid               * GenerateUnfinishedSample(const std::vector<double> & trend_params);
+
+  virtual void                  FinishSamples(const std::vector<Solid*> & samples);
+
   virtual bool                  HasDistribution() const;
 
   virtual std::vector<bool>     HasTrend() const;
@@ -33,10 +37,14 @@ public:
 protected:
 
 private:
+  Solid                       * GenerateSample(const std::vector<double> & trend_params,
+                                               bool                        find_moduli);
+
   Solid                       * GetSample(const std::vector<double>  & u,
                                           const std::vector<double>  & trend_params,
                                           const Solid                * solid,
-                                          const std::vector< Solid* >& solid_inc);
+                                          const std::vector< Solid* >& solid_inc,
+                                          bool                         find_moduli = true);
 
   DistributionsSolid                           * distr_solid_;              // Pointer to external object.
   std::vector< DistributionsSolid*>              distr_solid_inc_;          // Pointer to external object.
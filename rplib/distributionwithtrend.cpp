@@ -1,24 +1,36 @@
 #include "rplib/distributionwithtrend.h"
 
+#include <algorithm>
+
+#ifdef PARALLEL
+#include <omp.h>
+#endif
+
+bool DistributionWithTrend::threaded_sampling_ = false;
+int  DistributionWithTrend::sampling_pass_     = 0;
+
 
 DistributionWithTrend::DistributionWithTrend()
 : share_level_(None),
   current_u_(0),  //Ok since resample is true.
-  resample_(true)
+  resample_(true),
+  thread_state_(GetMaxSamplingThreads())
 {
 }
 
 DistributionWithTrend::DistributionWithTrend(const int shareLevel,bool reSample)
 : share_level_(shareLevel),
   current_u_(0),  //Shaky, should not be used with reSample = false, use the one below.
-  resample_(reSample)
+  resample_(reSample),
+  thread_state_(GetMaxSamplingThreads())
 {
 }
 
 DistributionWithTrend::DistributionWithTrend(const int shareLevel,double currentU,bool reSample)
 : share_level_(shareLevel),
   current_u_(currentU),
-  resample_(reSample)
+  resample_(reSample),
+  thread_state_(GetMaxSamplingThreads())
 {
 }
 
@@ -44,7 +56,69 @@ DistributionWithTrend::FindUseTrendCube(std::vector<bool> & use_trend_cube,
 double
 DistributionWithTrend::GetCurrentSample(const std::vector<double> & trend_params)
 {
+  double * current_u = NULL;
+  FindSampleState(&current_u);
+
   double samples;
-  samples=GetQuantileValue(current_u_, trend_params[0], trend_params[1]);
+  samples=GetQuantileValue(*current_u, trend_params[0], trend_params[1]);
   return samples;
 }
+
+double
+DistributionWithTrend::FindSampleQuantile(double u)
+{
+  double * current_u = NULL;
+  bool   * resample  = FindSampleState(&current_u);
+
+  if(share_level_ > None && *resample == false)
+    u = *current_u;
+  else {
+    *current_u = u;
+    *resample  = false;
+  }
+  return u;
+}
+
+bool *
+DistributionWithTrend::FindSampleState(double ** current_u)
+{
+#ifdef PARALLEL
+  if(threaded_sampling_ == true && omp_in_parallel()) {
+    ThreadSampleState & state = thread_state_[omp_get_thread_num()];
+    if(state.pass != sampling_pass_) {
+      state.current_u = current_u_;
+      state.resample  = resample_;
+      state.pass      = sampling_pass_;
+    }
+    if(current_u != NULL)
+      *current_u = &state.current_u;
+    return &state.resample;
+  }
+#endif
+  if(current_u != NULL)
+    *current_u = &current_u_;
+  return &resample_;
+}
+
+void
+DistributionWithTrend::BeginThreadedSampling()
+{
+  sampling_pass_++;
+  threaded_sampling_ = true;
+}
+
+void
+DistributionWithTrend::EndThreadedSampling()
+{
+  threaded_sampling_ = false;
+}
+
+int
+DistributionWithTrend::GetMaxSamplingThreads()
+{
+#ifdef PARALLEL
+  return std::max(1, omp_get_num_procs());
+#else
+  return 1;
+#endif
+}
@@ -1,6 +1,7 @@
 #ifndef RPLIB_DISTRIBUTIONWITHTREND_H
 #define RPLIB_DISTRIBUTIONWITHTREND_H
 
+#include <cstddef>
 #include <vector>
 
 class DistributionWithTrend {
@@ -20,7 +21,7 @@ class DistributionWithTrend {
 
    //Triggers resampling for share_level_ <= level_. Not necessary for share_level_ = 0/None
    void                       TriggerNewSample(int level)             {if(share_level_<=level)
-                                                                                 resample_ = true; }
+                                                                                 *FindSampleState(NULL) = true; }
 
    virtual double                     ReSample(double s1, double s2)                            = 0;
    virtual double                     GetQuantileValue(double u, double s1, double s2)          = 0;
@@ -34,10 +35,33 @@ class DistributionWithTrend {
                                                        int                 reference);
 
    enum                               ShareLevel {None, SingleSample, Full}; //Note: New levels should be inserted between SingleSample and Full.
+
+   //Between these calls, samples may be drawn from several threads. Each thread then has its own
+   //current_u_ and resample_, starting from the values they had when BeginThreadedSampling was called.
+   static void                        BeginThreadedSampling();
+   static void                        EndThreadedSampling();
+   static int                         GetMaxSamplingThreads();
+
 protected:
+  //Returns u, or the quantile of the current sample if it is to be reused. Call this in GetQuantileValue.
+  double                              FindSampleQuantile(double u);
+
   const int                           share_level_;      // Use like in DistributionWithTrendStorage to know if we have a reservoir variable.
   double                              current_u_;        // Quantile of current sample.
   bool                                resample_;         // If false, and share_level_ > 0, reuse current_u_
 
+private:
+  struct ThreadSampleState {
+    double current_u;
+    bool   resample;
+    int    pass;                                         // Threaded sampling pass the state belongs to.
+  };
+
+  bool                              * FindSampleState(double ** current_u);
+
+  std::vector<ThreadSampleState>      thread_state_;     // One per thread, used in threaded sampling only.
+
+  static bool                         threaded_sampling_;
+  static int                          sampling_pass_;
 };
 #endif
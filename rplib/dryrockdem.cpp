@@ -1,14 +1,19 @@
 #include "rplib/dryrockdem.h"
+#include "rplib/forwardmodeltable.h"
 
 #include <cassert>
 #include <algorithm>
+#include <cmath>
 
 DryRockDEM::DryRockDEM(const DryRock                       * dryrock,
                        const std::vector< DryRock* >       & dryrock_inc,
                        const std::vector<double>           & inclusion_spectrum,
                        const std::vector<double>           & inclusion_concentration,
-                       const std::vector<double>           & u)
-: DryRock()
+                       const std::vector<double>           & u,
+                       bool                                  find_moduli,
+                       const ForwardModelTable             * table)
+: DryRock(),
+  table_(table)
 {
   u_ = u; // u contains independent samples used in quantiles of (inclusion_spectrum,inclusion_concentration)
 
@@ -19,13 +24,15 @@ DryRockDEM::DryRockDEM(const DryRock                       * dryrock,
   inclusion_spectrum_      = inclusion_spectrum;
   inclusion_concentration_ = inclusion_concentration;
 
-  ComputeElasticParams();
+  if (find_moduli)
+    ComputeElasticParams();
 
 }
 
 DryRockDEM::DryRockDEM()
 : DryRock(),
-  dryrock_inc_(0)
+  dryrock_inc_(0),
+  table_(NULL)
 {
   dryrock_ = NULL;
 }
@@ -51,6 +58,8 @@ DryRockDEM& DryRockDEM::operator=(const DryRockDEM& rhs)
     dryrock_ = rhs.dryrock_->Clone();
     Clone(rhs.dryrock_inc_);
 
+    table_   = NULL;
+
   }
   return *this;
 }
@@ -73,6 +82,112 @@ DryRockDEM::Clone() const {
 void
 DryRockDEM::ComputeElasticParams() {
 
+  std::vector<double> inc_k, inc_mu, inc_conc;
+  double              host_k, host_mu;
+
+  FindDEMInput(inc_k, inc_mu, inc_conc, host_k, host_mu);
+
+  if (FindTabulatedModuli() == true)
+    return;
+
+  DEMTools::CalcEffectiveBulkAndShearModulus(inc_k,
+                                             inc_mu,
+                                             inclusion_spectrum_,
+                                             inc_conc,
+                                             host_k,
+                                             host_mu,
+                                             k_,
+                                             mu_);
+}
+
+void
+DryRockDEM::ComputeElasticParams(const std::vector<DryRockDEM*> & samples) {
+
+  if (samples.empty())
+    return;
+
+  size_t n_samples    = samples.size();
+  size_t n_inclusions = samples[0]->dryrock_inc_.size();
+
+  // Samples that are not served by their interpolation table are integrated in the batch.
+  std::vector<DryRockDEM*> batch;
+  std::vector<double>      inc_k, inc_mu, inc_spectrum, inc_conc;
+  std::vector<double>      host_k, host_mu;
+
+  batch.reserve(n_samples);
+  inc_k.reserve(n_samples*n_inclusions);
+  inc_mu.reserve(n_samples*n_inclusions);
+  inc_spectrum.reserve(n_samples*n_inclusions);
+  inc_conc.reserve(n_samples*n_inclusions);
+  host_k.reserve(n_samples);
+  host_mu.reserve(n_samples);
+
+  for (size_t s = 0; s < n_samples; ++s) {
+    assert(samples[s]->dryrock_inc_.size() == n_inclusions);
+
+    std::vector<double> k, mu, conc;
+    double              k_bg, mu_bg;
+    samples[s]->FindDEMInput(k, mu, conc, k_bg, mu_bg);
+
+    if (samples[s]->FindTabulatedModuli() == true)
+      continue;
+
+    batch.push_back(samples[s]);
+    inc_k.insert(inc_k.end(), k.begin(), k.end());
+    inc_mu.insert(inc_mu.end(), mu.begin(), mu.end());
+    inc_spectrum.insert(inc_spectrum.end(), samples[s]->inclusion_spectrum_.begin(), samples[s]->inclusion_spectrum_.end());
+    inc_conc.insert(inc_conc.end(), conc.begin(), conc.end());
+    host_k.push_back(k_bg);
+    host_mu.push_back(mu_bg);
+  }
+
+  if (batch.empty())
+    return;
+
+  std::vector<double> k, mu;
+  DEMTools::CalcEffectiveBulkAndShearModuli(n_inclusions,
+                                            inc_k,
+                                            inc_mu,
+                                            inc_spectrum,
+                                            inc_conc,
+                                            host_k,
+                                            host_mu,
+                                            k,
+                                            mu);
+
+  for (size_t s = 0; s < batch.size(); ++s) {
+    batch[s]->k_  = k[s];
+    batch[s]->mu_ = mu[s];
+  }
+}
+
+bool
+DryRockDEM::FindTabulatedModuli() {
+
+  if (table_ == NULL || !(inclusion_spectrum_[0] > 0.0))
+    return false;
+
+  assert(dryrock_inc_.size() == 1);
+
+  double x[2] = {std::log10(inclusion_spectrum_[0]), inclusion_concentration_[1]};
+  double y[2];
+
+  if (table_->Interpolate(x, y) == false)
+    return false;
+
+  k_  = y[0];
+  mu_ = y[1];
+
+  return true;
+}
+
+void
+DryRockDEM::FindDEMInput(std::vector<double> & inc_k,
+                         std::vector<double> & inc_mu,
+                         std::vector<double> & inc_conc,
+                         double              & host_k,
+                         double              & host_mu) {
+
   std::vector<double> dryrock_inc_rho, dryrock_inc_k, dryrock_inc_mu;
   std::vector<double> total_porosity(dryrock_inc_.size()), mineral_moduli_k(dryrock_inc_.size());
 
@@ -114,17 +229,13 @@ DryRockDEM::ComputeElasticParams() {
   }
 
   //remove host from inclusion vector
-  std::vector<double> inc_conc(dryrock_inc_.size());
+  inc_conc.resize(dryrock_inc_.size());
   std::copy(inclusion_concentration_.begin()+1, inclusion_concentration_.end(), inc_conc.begin());
 
-  DEMTools::CalcEffectiveBulkAndShearModulus(dryrock_inc_k,
-                                             dryrock_inc_mu,
-                                             inclusion_spectrum_,
-                                             inc_conc,
-                                             dryrock_k,
-                                             dryrock_mu,
-                                             k_,
-                                             mu_);
+  inc_k   = dryrock_inc_k;
+  inc_mu  = dryrock_inc_mu;
+  host_k  = dryrock_k;
+  host_mu = dryrock_mu;
 }
 
 
@@ -9,6 +9,8 @@
 #include <vector>
 #include <cstring>
 
+class ForwardModelTable;
+
 class DryRockDEM : public DryRock {
 public:
 
@@ -16,7 +18,9 @@ public:
              const std::vector< DryRock* >       & dryrock_inc,
              const std::vector<double>           & inclusion_spectrum,
              const std::vector<double>           & inclusion_concentration, // the first element is the concentration of the host
-             const std::vector<double>           & u);
+             const std::vector<double>           & u,
+             bool                                  find_moduli = true,  // If false, the parameters are found by ComputeElasticParams(samples).
+             const ForwardModelTable             * table       = NULL); // (log10 aspect ratio, inclusion concentration) -> (k, mu) for this host and inclusion.
 
   DryRockDEM();
 
@@ -32,13 +36,27 @@ public:
   const std::vector<DryRock*>           & GetDryRockInclusion()         const { return dryrock_inc_    ;}
   const DryRock                         * GetDryRockInclusion(size_t i) const { return dryrock_inc_[i] ;} // no error checking on valid index range
 
+  // Finds the parameters of samples made with find_moduli = false. All samples must have
+  // the same number of inclusions, and their DEM equations are integrated in one batch.
+  static void                             ComputeElasticParams(const std::vector<DryRockDEM*> & samples);
+
 private:
   //Copy constructor for getting base class variables , used by Clone:
-  DryRockDEM(const DryRockDEM & rhs) : DryRock(rhs) {}
+  DryRockDEM(const DryRockDEM & rhs) : DryRock(rhs), table_(NULL) {}
 
   // Calculate elastic and seismic parameters, to be
   // used whenever new information is sent to class.
   void                                    ComputeElasticParams();
+  // Sets density, total porosity and mineral moduli, and returns the inclusion and host
+  // moduli and the inclusion concentrations (without the host) used in the DEM equations.
+  void                                    FindDEMInput(std::vector<double> & inc_k,
+                                                       std::vector<double> & inc_mu,
+                                                       std::vector<double> & inc_conc,
+                                                       double              & host_k,
+                                                       double              & host_mu);
+  // Finds k and mu from table_. Returns false if there is no table, or if the
+  // aspect ratio and concentration are not served by it.
+  bool                                    FindTabulatedModuli();
   void                                    Clone(const std::vector< DryRock* > & dryrock_in);
   void                                    DeleteInclusion();
 
@@ -47,6 +65,7 @@ private:
   std::vector< DryRock* >                 dryrock_inc_;             // Owned and deleted by this class.
   std::vector<double>                     inclusion_spectrum_;
   std::vector<double>                     inclusion_concentration_; // the first element is the concentration of the host
+  const ForwardModelTable               * table_;                   // Not owned. Only used when the moduli are found, so clones do not keep it.
 };
 
 #endif
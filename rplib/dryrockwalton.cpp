@@ -1,12 +1,28 @@
 #include "rplib/dryrockwalton.h"
 
 #include "rplib/solid.h"
+#include "rplib/forwardmodeltable.h"
 
 #include "nrlib/math/constants.hpp"
+#include "nrlib/iotools/logkit.hpp"
 
 #include <cassert>
 #include <cmath>
 
+const ForwardModelTable * DryRockWalton::table_ = NULL;
+
+namespace {
+  // The moduli scale with the solid bulk modulus, so they are tabulated for a unit bulk modulus:
+  // (mu_solid/k_solid, coord_number*(1 - porosity)*sqrt(pressure/k_solid)) -> (k_rough, mu_rough, mu_smooth)/k_solid
+  class WaltonModel : public ForwardModelTable::Model {
+  public:
+    void Evaluate(const double * x,
+                  double       * y) const
+    {
+      DryRockWalton::CalcModuli(1.0, x[0], x[1], 0.0, 1.0, y[0], y[1], y[2]);
+    }
+  };
+}
 
 DryRockWalton::DryRockWalton(const Solid                       * solid,
                              const double                      & friction_weight,
@@ -99,9 +115,6 @@ DryRockWalton::SetTotalPorosity(double porosity) {
 
 void
 DryRockWalton::ComputeElasticParams() {
-  static const double pi      = NRLib::Pi;
-  static const double pi4_inv = 1.0/(4*pi);
-
   double mu_solid, k_solid, rho_solid;
   solid_->GetElasticParams(k_solid, mu_solid, rho_solid);
   mineral_moduli_k_ = k_solid;
@@ -110,7 +123,49 @@ DryRockWalton::ComputeElasticParams() {
   const double fac = 1000000.0;
   k_solid   /= fac;
   mu_solid  /= fac;
-  
+
+  double k_rough   = 0.0;
+  double mu_rough  = 0.0;
+  double mu_smooth = 0.0;
+
+  bool tabulated = false;
+  if (table_ != NULL) {
+    double x[2] = {mu_solid/k_solid, coord_number_*(1 - total_porosity_)*std::sqrt(pressure_/k_solid)};
+    double y[3];
+    if (table_->Interpolate(x, y) == true) {
+      k_rough   = k_solid*y[0];
+      mu_rough  = k_solid*y[1];
+      mu_smooth = k_solid*y[2];
+      tabulated = true;
+    }
+  }
+
+  if (tabulated == false)
+    CalcModuli(k_solid, mu_solid, coord_number_, total_porosity_, pressure_, k_rough, mu_rough, mu_smooth);
+
+  k_    = k_rough;
+  mu_   = friction_weight_*mu_rough + (1.0 - friction_weight_)*mu_smooth;
+
+  //unit conversion from GPa -> kPa
+  k_  *= fac;
+  mu_ *= fac;
+
+  rho_  = (1-total_porosity_)*rho_solid;
+}
+
+void
+DryRockWalton::CalcModuli(double   k_solid,
+                          double   mu_solid,
+                          double   coord_number,
+                          double   porosity,
+                          double   pressure,
+                          double & k_rough,
+                          double & mu_rough,
+                          double & mu_smooth)
+{
+  static const double pi      = NRLib::Pi;
+  static const double pi4_inv = 1.0/(4*pi);
+
   const double mu_solid_inv = 1.0/mu_solid;
   const double lambda       = k_solid - (2.0*mu_solid)/3.0;
 
@@ -119,22 +174,34 @@ DryRockWalton::ComputeElasticParams() {
   double a = pi4_inv*(mu_solid_inv - modulus_inv);
   double b = pi4_inv*(mu_solid_inv + modulus_inv);
 
-  double x = std::pow((3*coord_number_*coord_number_*(1 - total_porosity_)*(1 - total_porosity_)*pressure_)/(pi*pi*pi*pi*b*b), 1.0/3.0);
+  double x = std::pow((3*coord_number*coord_number*(1 - porosity)*(1 - porosity)*pressure)/(pi*pi*pi*pi*b*b), 1.0/3.0);
 
-  double k_rough  = x/6.0;
-  double mu_rough = (3.0/5.0)*k_rough*(5.0*b + a)/(2.0*b + a);
+  k_rough  = x/6.0;
+  mu_rough = (3.0/5.0)*k_rough*(5.0*b + a)/(2.0*b + a);
 
-  double mu_smooth = x/10.0;
+  mu_smooth = x/10.0;
   //double k_smooth  = 5.0*mu_smooth/3.0; //== k_rough
+}
 
-  k_    = k_rough;
-  mu_   = friction_weight_*mu_rough + (1.0 - friction_weight_)*mu_smooth;
-
-  //unit conversion from GPa -> kPa
-  k_  *= fac;
-  mu_ *= fac;
-
-  rho_  = (1-total_porosity_)*rho_solid;
+void
+DryRockWalton::SetupTable()
+{
+  if (table_ != NULL)
+    return;
+
+  // Covers the common minerals, and coordination numbers up to 14 with pressures up to
+  // 100 MPa for solid bulk moduli above 5 GPa.
+  std::vector<double> x_min(2);
+  std::vector<double> x_max(2);
+  x_min[0] = 0.1; x_max[0] = 1.5;
+  x_min[1] = 0.0; x_max[1] = 2.0;
+
+  static const WaltonModel       model;
+  static const ForwardModelTable table(model, x_min, x_max, 3, 5.0e-4, 65536);
+  table_ = &table;
+
+  NRLib::LogKit::LogFormatted(NRLib::LogKit::Low, "\nWalton moduli table: %d nodes, %.1f%% of the cells served, largest error %.1e\n",
+                              static_cast<int>(table.GetNNodes()), 100.0*table.GetServedFraction(), table.GetMaxError());
 }
 
 double
@@ -4,6 +4,7 @@
 
 #include "rplib/dryrock.h"
 
+class ForwardModelTable;
 class Solid;
 
 class DryRockWalton : public DryRock {
@@ -29,6 +30,19 @@ public:
 
   virtual void                            SetTotalPorosity(double porosity);
 
+  // Rough and smooth moduli, in GPa, from solid moduli and pressure in GPa, without the interpolation table.
+  static void                             CalcModuli(double   k_solid,
+                                                     double   mu_solid,
+                                                     double   coord_number,
+                                                     double   porosity,
+                                                     double   pressure,
+                                                     double & k_rough,
+                                                     double & mu_rough,
+                                                     double & mu_smooth);
+
+  // Builds the interpolation table used by ComputeElasticParams. Not thread safe; call before sampling.
+  static void                             SetupTable();
+
 private:
   //Copy constructor for getting base class variables , used by Clone:
   DryRockWalton(const DryRockWalton & rhs) : DryRock(rhs) {}
@@ -45,6 +59,7 @@ private:
   double                                  coord_number_;
   bool                                    calc_coord_number_;
 
+  static const ForwardModelTable        * table_;
 
 };
 
@@ -1,6 +1,7 @@
 #include "rplib/fluidco2.h"
 
 #include "rplib/demmodelling.h"
+#include "rplib/forwardmodeltable.h"
 
 #include "rplib/table_vp1.h"
 #include "rplib/table_vp2.h"
@@ -11,11 +12,26 @@
 
 #include "nrlib/surface/regularsurface.hpp"
 #include "nrlib/exception/exception.hpp"
+#include "nrlib/iotools/logkit.hpp"
 
 #include <cassert>
 #include <fstream>
 #include <string>
 
+const ForwardModelTable * FluidCO2::table_ = NULL;
+
+namespace {
+  // (temperature, pore pressure) -> (bulk modulus, density)
+  class CO2Model : public ForwardModelTable::Model {
+  public:
+    void Evaluate(const double * x,
+                  double       * y) const
+    {
+      FluidCO2::CalcElasticParams(x[0], x[1], y[0], y[1]);
+    }
+  };
+}
+
 FluidCO2::FluidCO2(double                      temp,
                    double                      pore_pressure,
                    const std::vector<double> & u)
@@ -40,6 +56,43 @@ FluidCO2::Clone() const
 
 void
 FluidCO2::ComputeElasticParams(double temp, double pressure)
+{
+  if (table_ != NULL) {
+    double x[2] = {temp, pressure};
+    double y[2];
+    if (table_->Interpolate(x, y) == true) {
+      k_   = y[0];
+      rho_ = y[1];
+      return;
+    }
+  }
+
+  CalcElasticParams(temp, pressure, k_, rho_);
+}
+
+void
+FluidCO2::SetupTable()
+{
+  if (table_ != NULL)
+    return;
+
+  // The densely sampled part of the Span-Wagner tables. Cells across the phase boundary are
+  // not served.
+  std::vector<double> x_min(2);
+  std::vector<double> x_max(2);
+  x_min[0] =   1.0; x_max[0] = 100.0;
+  x_min[1] =   0.1; x_max[1] = 100.0;
+
+  static const CO2Model          model;
+  static const ForwardModelTable table(model, x_min, x_max, 2, 5.0e-4, 65536);
+  table_ = &table;
+
+  NRLib::LogKit::LogFormatted(NRLib::LogKit::Low, "\nCO2 properties table: %d nodes, %.1f%% of the cells served, largest error %.1e\n",
+                              static_cast<int>(table.GetNNodes()), 100.0*table.GetServedFraction(), table.GetMaxError());
+}
+
+void
+FluidCO2::CalcElasticParams(double temp, double pressure, double & k, double & rho)
 {
   static const NRLib::RegularSurface<double> surf_vp    = ConstDataStoredAsSurface::CreateSurfaceVP();
   static const NRLib::RegularSurface<double> surf_rho   = ConstDataStoredAsSurface::CreateSurfaceRho();
@@ -63,11 +116,11 @@ FluidCO2::ComputeElasticParams(double temp, double pressure)
     double mu = 0;
     bool failed_getz = false;
 
-    rho_  = surf_rho.GetZ(scale*pressure, scale*temp);
-    if (surf_rho.IsMissing(rho_))
+    rho   = surf_rho.GetZ(scale*pressure, scale*temp);
+    if (surf_rho.IsMissing(rho))
       failed_getz = true;
 
-    rho_ *= inv_scale;
+    rho  *= inv_scale;
 
     vp    = surf_vp.GetZ(scale*pressure, scale*temp);
     if (surf_vp.IsMissing(vp))
@@ -80,7 +133,7 @@ FluidCO2::ComputeElasticParams(double temp, double pressure)
 
     //unit conversion from km/s -> m/s
     vp *= 1000.0;
-    DEMTools::CalcElasticParamsFromSeismicParams(vp, 0.0, rho_, k_, mu);
+    DEMTools::CalcElasticParamsFromSeismicParams(vp, 0.0, rho, k, mu);
 
   }
   else {
@@ -102,10 +155,10 @@ FluidCO2::ComputeElasticParams(double temp, double pressure)
     double mu = 0;
     bool failed_getz = false;
     if (scenario == 1) {
-      rho_      = surf_rho1.GetZ(scale*pressure, scale*temp);
-      if (surf_rho1.IsMissing(rho_))
+      rho       = surf_rho1.GetZ(scale*pressure, scale*temp);
+      if (surf_rho1.IsMissing(rho))
         failed_getz = true;
-      rho_     *= inv_scale;
+      rho      *= inv_scale;
 
       vp        = surf_vp1.GetZ(scale*pressure, scale*temp);
       if (surf_vp1.IsMissing(vp))
@@ -113,10 +166,10 @@ FluidCO2::ComputeElasticParams(double temp, double pressure)
       vp       *= inv_scale;
     }
     else {
-      rho_      = surf_rho2.GetZ(scale*pressure, scale*temp);
-      if (surf_rho2.IsMissing(rho_))
+      rho       = surf_rho2.GetZ(scale*pressure, scale*temp);
+      if (surf_rho2.IsMissing(rho))
         failed_getz = true;
-      rho_     *= inv_scale;
+      rho      *= inv_scale;
 
       vp        = surf_vp2.GetZ(scale*pressure, scale*temp);
        if (surf_vp2.IsMissing(vp))
@@ -130,7 +183,7 @@ FluidCO2::ComputeElasticParams(double temp, double pressure)
     //unit conversion from km/s -> m/s
     vp *= 1000.0;
 
-    DEMTools::CalcElasticParamsFromSeismicParams(vp, 0.0, rho_, k_, mu);
+    DEMTools::CalcElasticParamsFromSeismicParams(vp, 0.0, rho, k, mu);
   }
 }
 
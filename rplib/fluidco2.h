@@ -5,6 +5,7 @@
 
 #include <vector>
 
+class ForwardModelTable;
 
 
 class FluidCO2 : public Fluid {
@@ -26,9 +27,18 @@ public:
 
   void                        ComputeElasticParams(double temp, double pressure);
 
-  double                      GetCritTemp()                                                         const { return 30.9783;}
-  double                      GetCritPressure()                                                     const { return 7.3772; }
-  const std::vector<double>   GetPFunc()                                                                  { std::vector<double> pfunc(4); pfunc[0] = 0.000003883701221; pfunc[1] = 0.000930453898625; pfunc[2] = 0.092759127015099, pfunc[3] = 3.480623887319762; return pfunc;}
+  // Bulk modulus and density from the Span-Wagner tables, without the interpolation table.
+  static void                 CalcElasticParams(double temp, double pressure, double & k, double & rho);
+
+  // Builds the interpolation table used by ComputeElasticParams. Not thread safe; call before sampling.
+  static void                 SetupTable();
+
+  static double               GetCritTemp()                                                               { return 30.9783;}
+  static double               GetCritPressure()                                                           { return 7.3772; }
+  static const std::vector<double> GetPFunc()                                                             { std::vector<double> pfunc(4); pfunc[0] = 0.000003883701221; pfunc[1] = 0.000930453898625; pfunc[2] = 0.092759127015099, pfunc[3] = 3.480623887319762; return pfunc;}
+
+private:
+  static const ForwardModelTable * table_;
 };
 
 #endif
@@ -0,0 +1,284 @@
+#include "rplib/forwardmodeltable.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+bool ForwardModelTable::use_tables_ = false;
+
+namespace {
+  const int max_dim = 8;
+
+  // Error relative to scale. Errors that are not finite are returned as the largest double.
+  double RelativeError(double y_table,
+                       double y_model,
+                       double scale)
+  {
+    double error = std::abs(y_table - y_model)/(scale > 0.0 ? scale : 1.0);
+    if (!(error <= std::numeric_limits<double>::max()))
+      error = std::numeric_limits<double>::max();
+    return error;
+  }
+}
+
+ForwardModelTable::ForwardModelTable(const Model               & model,
+                                     const std::vector<double> & x_min,
+                                     const std::vector<double> & x_max,
+                                     int                         n_outputs,
+                                     double                      tolerance,
+                                     size_t                      max_nodes)
+: n_dim_(static_cast<int>(x_min.size())),
+  n_outputs_(n_outputs),
+  tolerance_(tolerance),
+  x_min_(x_min),
+  x_max_(x_max),
+  dx_(x_min.size()),
+  inv_dx_(x_min.size()),
+  n_nodes_(x_min.size(), 5),
+  stride_(x_min.size()),
+  n_total_(0),
+  max_error_(0.0),
+  served_cells_(0.0)
+{
+  assert(n_dim_ > 0 && n_dim_ <= max_dim);
+
+  std::vector<double> old_values;
+  std::vector<size_t> old_n_nodes;
+  std::vector<bool>   refined(n_dim_, false);
+  std::vector<double> cell_error;
+  std::vector<size_t> n_failed;
+
+  // Refine the axis with the most edge midpoints outside the tolerance until all cells are
+  // within it, or the next refinement would exceed the node budget. Counting, rather than
+  // taking the largest error, keeps a small region where the model fails from taking all
+  // the refinements. If only cell centres fail, the axis with the fewest nodes is refined.
+  for (;;) {
+    Tabulate(model, old_values, old_n_nodes, refined);
+    FindErrors(model, cell_error, n_failed);
+
+    int worst_axis = 0;
+    for (int d = 1; d < n_dim_; d++) {
+      if (n_failed[d] > n_failed[worst_axis] ||
+          (n_failed[worst_axis] == 0 && n_nodes_[d] < n_nodes_[worst_axis]))
+        worst_axis = d;
+    }
+    if (n_failed[worst_axis] == 0 && n_failed[n_dim_] == 0)
+      break;
+
+    if (n_total_/n_nodes_[worst_axis]*(2*n_nodes_[worst_axis] - 1) > max_nodes)
+      break;
+
+    old_values.swap(values_);
+    old_n_nodes = n_nodes_;
+    for (int d = 0; d < n_dim_; d++)
+      refined[d] = (d == worst_axis);
+    n_nodes_[worst_axis] = 2*n_nodes_[worst_axis] - 1;
+  }
+
+  served_.assign(n_total_, false);
+
+  size_t n_cells  = 0;
+  size_t n_served = 0;
+
+  for (size_t node = 0; node < n_total_; node++) {
+    if (cell_error[node] < 0.0)
+      continue;
+    n_cells++;
+    if (cell_error[node] <= tolerance_) {
+      served_[node] = true;
+      n_served++;
+      max_error_ = std::max(max_error_, cell_error[node]);
+    }
+  }
+
+  if (n_cells > 0)
+    served_cells_ = static_cast<double>(n_served)/n_cells;
+}
+
+void
+ForwardModelTable::Tabulate(const Model               & model,
+                            const std::vector<double> & old_values,
+                            const std::vector<size_t> & old_n_nodes,
+                            const std::vector<bool>   & refined)
+{
+  n_total_ = 1;
+  for (int d = 0; d < n_dim_; d++) {
+    stride_[d] = n_total_;
+    n_total_  *= n_nodes_[d];
+    dx_[d]     = (x_max_[d] - x_min_[d])/(n_nodes_[d] - 1);
+    inv_dx_[d] = 1.0/dx_[d];
+  }
+
+  values_.resize(n_total_*n_outputs_);
+  scale_.assign(n_outputs_, 0.0);
+
+  std::vector<double> x(n_dim_);
+
+  for (size_t node = 0; node < n_total_; node++) {
+    double * y = &values_[node*n_outputs_];
+
+    bool   old_node   = (old_values.empty() == false);
+    size_t old_index  = 0;
+    size_t old_stride = 1;
+
+    for (int d = 0; d < n_dim_; d++) {
+      size_t i = (node/stride_[d]) % n_nodes_[d];
+      x[d]     = x_min_[d] + i*dx_[d];
+      if (old_node == true) {
+        if (refined[d] == true) {
+          if (i % 2 == 1)
+            old_node = false;
+          i /= 2;
+        }
+        old_index  += i*old_stride;
+        old_stride *= old_n_nodes[d];
+      }
+    }
+
+    if (old_node == true)
+      std::copy(&old_values[old_index*n_outputs_], &old_values[old_index*n_outputs_] + n_outputs_, y);
+    else
+      model.Evaluate(&x[0], y);
+
+    for (int o = 0; o < n_outputs_; o++)
+      scale_[o] = std::max(scale_[o], std::abs(y[o]));
+  }
+}
+
+void
+ForwardModelTable::FindErrors(const Model         & model,
+                              std::vector<double> & cell_error,
+                              std::vector<size_t> & n_failed) const
+{
+  std::vector<double> x(n_dim_);
+  std::vector<double> y_table(n_outputs_);
+  std::vector<double> y_model(n_outputs_);
+  std::vector<size_t> index(n_dim_);
+  double              w[max_dim];
+
+  // Error at the midpoint of the edge from each node along each axis. Cell errors
+  // are set to -1 for nodes that are not the lower corner of a cell.
+  std::vector<double> edge_error(n_total_*n_dim_, 0.0);
+
+  cell_error.assign(n_total_, -1.0);
+  n_failed.assign(n_dim_ + 1, 0);
+
+  for (size_t node = 0; node < n_total_; node++) {
+    bool is_corner = true;
+    for (int d = 0; d < n_dim_; d++) {
+      index[d] = (node/stride_[d]) % n_nodes_[d];
+      if (index[d] + 1 == n_nodes_[d])
+        is_corner = false;
+    }
+
+    for (int a = 0; a <= n_dim_; a++) {
+      if (a < n_dim_ && index[a] + 1 == n_nodes_[a])
+        continue;
+      if (a == n_dim_ && is_corner == false)
+        continue;
+
+      // Edge midpoint along axis a, or cell centre for a == n_dim_.
+      for (int d = 0; d < n_dim_; d++) {
+        w[d] = (a == n_dim_ || d == a) ? 0.5 : 0.0;
+        x[d] = x_min_[d] + (index[d] + w[d])*dx_[d];
+      }
+
+      InterpolateCell(node, w, &y_table[0]);
+      model.Evaluate(&x[0], &y_model[0]);
+
+      double error = 0.0;
+      for (int o = 0; o < n_outputs_; o++)
+        error = std::max(error, RelativeError(y_table[o], y_model[o], scale_[o]));
+
+      if (error > tolerance_)
+        n_failed[a]++;
+      if (a < n_dim_)
+        edge_error[node*n_dim_ + a] = error;
+      else
+        cell_error[node] = error;
+    }
+  }
+
+  // A cell gets the largest error at its centre and at the midpoints of all its edges.
+  size_t n_corners = static_cast<size_t>(1) << n_dim_;
+
+  for (size_t node = 0; node < n_total_; node++) {
+    if (cell_error[node] < 0.0)
+      continue;
+    for (size_t c = 0; c < n_corners; c++) {
+      size_t corner = node;
+      for (int d = 0; d < n_dim_; d++) {
+        if ((c >> d) & 1)
+          corner += stride_[d];
+      }
+      for (int d = 0; d < n_dim_; d++) {
+        if (((c >> d) & 1) == 0)
+          cell_error[node] = std::max(cell_error[node], edge_error[corner*n_dim_ + d]);
+      }
+    }
+  }
+}
+
+bool
+ForwardModelTable::Interpolate(const double * x,
+                               double       * y) const
+{
+  size_t base = 0;
+  double w[max_dim];
+
+  for (int d = 0; d < n_dim_; d++) {
+    if (!(x[d] >= x_min_[d] && x[d] <= x_max_[d]))
+      return false;
+
+    double t = (x[d] - x_min_[d])*inv_dx_[d];
+    int    i = static_cast<int>(t);
+    if (i + 1 >= static_cast<int>(n_nodes_[d]))
+      i = static_cast<int>(n_nodes_[d]) - 2;
+
+    base += i*stride_[d];
+    w[d]  = t - i;
+  }
+
+  if (served_[base] == false)
+    return false;
+
+  InterpolateCell(base, w, y);
+
+  return true;
+}
+
+void
+ForwardModelTable::InterpolateCell(size_t         node,
+                                   const double * w,
+                                   double       * y) const
+{
+  // Weights and offsets of the cell corners, built one axis at a time.
+  double weight[1 << max_dim];
+  size_t offset[1 << max_dim];
+
+  size_t n_corners = 1;
+  weight[0] = 1.0;
+  offset[0] = node*n_outputs_;
+
+  for (int d = 0; d < n_dim_; d++) {
+    for (size_t c = 0; c < n_corners; c++) {
+      weight[c + n_corners]  = weight[c]*w[d];
+      weight[c]             *= 1.0 - w[d];
+      offset[c + n_corners]  = offset[c] + stride_[d]*n_outputs_;
+    }
+    n_corners *= 2;
+  }
+
+  for (int o = 0; o < n_outputs_; o++)
+    y[o] = 0.0;
+
+  for (size_t c = 0; c < n_corners; c++) {
+    if (weight[c] == 0.0) // Also skips corners beyond the grid, for edge midpoints on its upper faces.
+      continue;
+
+    const double * value = &values_[offset[c]];
+    for (int o = 0; o < n_outputs_; o++)
+      y[o] += weight[c]*value[o];
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef RPLIB_FORWARDMODELTABLE_H
+#define RPLIB_FORWARDMODELTABLE_H
+
+#include <cstddef>
+#include <vector>
+
+// Table of a rock physics forward model, f : R^n -> R^m, on a regular grid over a box, with
+// multilinear interpolation between the nodes. The grid is refined, one axis at a time, until
+// the interpolation error is within a tolerance or a node budget is spent. The error is measured
+// against the model at the centre of each cell and at the midpoints of the cell edges leaving its
+// lower corner, relative to the largest tabulated value of each output. Cells where the error
+// exceeds the tolerance are not served, so the model must be evaluated there, as outside the box.
+// Between the check points the error may be somewhat larger, typically where the model has kinks
+// inside a cell, so the tolerance should be set below the accuracy that is needed.
+class ForwardModelTable {
+public:
+  class Model {
+  public:
+    virtual      ~Model() {}
+    virtual void Evaluate(const double * x,
+                          double       * y) const = 0;
+  };
+
+  ForwardModelTable(const Model               & model,
+                    const std::vector<double> & x_min,
+                    const std::vector<double> & x_max,
+                    int                         n_outputs,
+                    double                      tolerance,
+                    size_t                      max_nodes);
+
+  size_t               GetNNodes()                                        const { return n_total_      ;}
+  double               GetTolerance()                                     const { return tolerance_    ;}
+  double               GetMaxError()                                      const { return max_error_    ;} // Largest checked error in served cells.
+  double               GetServedFraction()                                const { return served_cells_ ;} // Fraction of the cells that are served.
+
+  // Interpolates f(x) into y. Returns false, and leaves y untouched, if x is outside
+  // the box or in a cell that is not served.
+  bool                 Interpolate(const double * x,
+                                   double       * y)                      const;
+
+  // Whether forward models should be served from tables. Off by default.
+  static void          SetUseTables(bool use_tables)                            { use_tables_ = use_tables ;}
+  static bool          GetUseTables()                                           { return use_tables_       ;}
+
+private:
+  // Evaluates the model at all nodes. Nodes that are also in the previous grid, where
+  // the axes with refined[d] true had half as many intervals, are copied from it.
+  void                 Tabulate(const Model               & model,
+                                const std::vector<double> & old_values,
+                                const std::vector<size_t> & old_n_nodes,
+                                const std::vector<bool>   & refined);
+
+  // Finds the error of each cell, and the number of edge midpoints along each axis (n_failed[d])
+  // and of cell centres (n_failed[n_dim_]) where the error exceeds the tolerance.
+  void                 FindErrors(const Model         & model,
+                                  std::vector<double> & cell_error,
+                                  std::vector<size_t> & n_failed)   const;
+
+  // Interpolates in the cell with lower corner node, at relative position w within the cell.
+  void                 InterpolateCell(size_t         node,
+                                       const double * w,
+                                       double       * y)                  const;
+
+  int                  n_dim_;
+  int                  n_outputs_;
+  double               tolerance_;
+  std::vector<double>  x_min_;
+  std::vector<double>  x_max_;
+  std::vector<double>  dx_;
+  std::vector<double>  inv_dx_;
+  std::vector<size_t>  n_nodes_;
+  std::vector<size_t>  stride_;
+  size_t               n_total_;
+  std::vector<double>  values_;       // n_outputs_ values for each node, first axis running fastest.
+  std::vector<double>  scale_;        // Largest absolute tabulated value of each output.
+  std::vector<bool>    served_;       // Whether the cell with this lower corner node is served.
+  double               max_error_;
+  double               served_cells_;
+
+  static bool          use_tables_;
+};
+
+#endif
@@ -9,7 +9,8 @@ RockDEM::RockDEM(const Solid                         * solid,
                  const std::vector<Fluid*>           & fluid,
                  const std::vector<double>           & inclusion_spectrum,
                  const std::vector<double>           & inclusion_concentration,
-                 const std::vector<double>           & u)
+                 const std::vector<double>           & u,
+                 bool                                  find_moduli)
 : Rock()
 {
   u_ = u; // u contains independent samples used in quantiles of (inclusion_spectrum,inclusion_concentration), u.back() is for porosity.
@@ -21,7 +22,8 @@ RockDEM::RockDEM(const Solid                         * solid,
   inclusion_spectrum_      = inclusion_spectrum;
   inclusion_concentration_ = inclusion_concentration;
 
-  ComputeSeismicAndElasticParams();
+  if (find_moduli)
+    ComputeSeismicAndElasticParams();
 
 }
 
@@ -99,6 +101,77 @@ RockDEM::SetPorosity(double porosity) {
 
 void
 RockDEM::ComputeSeismicAndElasticParams() {
+  std::vector<double> inc_k, inc_mu, inc_conc;
+  double              host_k, host_mu;
+
+  FindDEMInput(inc_k, inc_mu, inc_conc, host_k, host_mu);
+
+  DEMTools::CalcEffectiveBulkAndShearModulus(inc_k,
+                                             inc_mu,
+                                             inclusion_spectrum_,
+                                             inc_conc,
+                                             host_k,
+                                             host_mu,
+                                             k_,
+                                             mu_);
+
+  DEMTools::CalcSeismicParamsFromElasticParams(k_, mu_, rho_, vp_, vs_);
+}
+
+void
+RockDEM::ComputeSeismicAndElasticParams(const std::vector<RockDEM*> & samples) {
+
+  if (samples.empty())
+    return;
+
+  size_t n_samples    = samples.size();
+  size_t n_inclusions = samples[0]->fluid_.size();
+
+  std::vector<double> inc_k, inc_mu, inc_spectrum, inc_conc;
+  std::vector<double> host_k(n_samples), host_mu(n_samples);
+
+  inc_k.reserve(n_samples*n_inclusions);
+  inc_mu.reserve(n_samples*n_inclusions);
+  inc_spectrum.reserve(n_samples*n_inclusions);
+  inc_conc.reserve(n_samples*n_inclusions);
+
+  for (size_t s = 0; s < n_samples; ++s) {
+    assert(samples[s]->fluid_.size() == n_inclusions);
+
+    std::vector<double> k, mu, conc;
+    samples[s]->FindDEMInput(k, mu, conc, host_k[s], host_mu[s]);
+
+    inc_k.insert(inc_k.end(), k.begin(), k.end());
+    inc_mu.insert(inc_mu.end(), mu.begin(), mu.end());
+    inc_spectrum.insert(inc_spectrum.end(), samples[s]->inclusion_spectrum_.begin(), samples[s]->inclusion_spectrum_.end());
+    inc_conc.insert(inc_conc.end(), conc.begin(), conc.end());
+  }
+
+  std::vector<double> k, mu;
+  DEMTools::CalcEffectiveBulkAndShearModuli(n_inclusions,
+                                            inc_k,
+                                            inc_mu,
+                                            inc_spectrum,
+                                            inc_conc,
+                                            host_k,
+                                            host_mu,
+                                            k,
+                                            mu);
+
+  for (size_t s = 0; s < n_samples; ++s) {
+    RockDEM * rock = samples[s];
+    rock->k_  = k[s];
+    rock->mu_ = mu[s];
+    DEMTools::CalcSeismicParamsFromElasticParams(rock->k_, rock->mu_, rock->rho_, rock->vp_, rock->vs_);
+  }
+}
+
+void
+RockDEM::FindDEMInput(std::vector<double> & inc_k,
+                      std::vector<double> & inc_mu,
+                      std::vector<double> & inc_conc,
+                      double              & host_k,
+                      double              & host_mu) {
   std::vector<double> fluid_rho, fluid_k, fluid_mu;
 
   fluid_rho.resize(fluid_.size());
@@ -120,19 +193,13 @@ RockDEM::ComputeSeismicAndElasticParams() {
   }
 
   //remove host from inclusion vector
-  std::vector<double> inc_conc(fluid_.size());
+  inc_conc.resize(fluid_.size());
   std::copy(inclusion_concentration_.begin() + 1, inclusion_concentration_.end(), inc_conc.begin());
 
-  DEMTools::CalcEffectiveBulkAndShearModulus(fluid_k,
-                                             fluid_mu,
-                                             inclusion_spectrum_,
-                                             inc_conc,
-                                             solid_k,
-                                             solid_mu,
-                                             k_,
-                                             mu_);
-
-  DEMTools::CalcSeismicParamsFromElasticParams(k_, mu_, rho_, vp_, vs_);
+  inc_k   = fluid_k;
+  inc_mu  = fluid_mu;
+  host_k  = solid_k;
+  host_mu = solid_mu;
 }
 
 void
@@ -17,7 +17,8 @@ RockDEM(const Solid                         * solid,
         const std::vector<Fluid*>           & fluid,
         const std::vector<double>           & inclusion_spectrum,
         const std::vector<double>           & inclusion_concentration,
-        const std::vector<double>           & u);
+        const std::vector<double>           & u,
+        bool                                  find_moduli = true); // If false, the parameters are found by ComputeSeismicAndElasticParams(samples).
 
 RockDEM();
 
@@ -36,6 +37,10 @@ RockDEM();
 
   virtual void                          SetPorosity(double porosity);
 
+  // Finds the parameters of samples made with find_moduli = false. All samples must have
+  // the same number of inclusions, and their DEM equations are integrated in one batch.
+  static void                           ComputeSeismicAndElasticParams(const std::vector<RockDEM*> & samples);
+
 private:
                                         //Copy constructor for getting base class variables , used by Clone:
                                         RockDEM(const RockDEM & rhs) : Rock(rhs) {}
@@ -43,6 +48,13 @@ private:
                                         // Calculate elastic and seismic parameters, to be
                                         // used whenever new information is sent to class.
   void                                  ComputeSeismicAndElasticParams();
+                                        // Sets the density, and returns the inclusion and host moduli and the
+                                        // inclusion concentrations (without the host) used in the DEM equations.
+  void                                  FindDEMInput(std::vector<double> & inc_k,
+                                                     std::vector<double> & inc_mu,
+                                                     std::vector<double> & inc_conc,
+                                                     double              & host_k,
+                                                     double              & host_mu);
   void                                  Clone(const std::vector< Fluid* > & fluid_in);
   void                                  DeleteInclusion();
 
@@ -7,7 +7,8 @@ SolidDEM::SolidDEM(const Solid                         * solid,
                    const std::vector< Solid* >         & solid_inc,
                    const std::vector<double>           & inclusion_spectrum,
                    const std::vector<double>           & inclusion_concentration,
-                   const std::vector<double>           & u)
+                   const std::vector<double>           & u,
+                   bool                                  find_moduli)
 : Solid()
 {
   u_ = u; // u contains independent samples used in quantiles of (inclusion_spectrum,inclusion_concentration)
@@ -19,7 +20,8 @@ SolidDEM::SolidDEM(const Solid                         * solid,
   inclusion_spectrum_      = inclusion_spectrum;
   inclusion_concentration_ = inclusion_concentration;
 
-  ComputeElasticParams();
+  if (find_moduli)
+    ComputeElasticParams();
 
 }
 
@@ -73,6 +75,74 @@ SolidDEM::Clone() const {
 void
 SolidDEM::ComputeElasticParams() {
 
+  std::vector<double> inc_k, inc_mu, inc_conc;
+  double              host_k, host_mu;
+
+  FindDEMInput(inc_k, inc_mu, inc_conc, host_k, host_mu);
+
+  DEMTools::CalcEffectiveBulkAndShearModulus(inc_k,
+                                             inc_mu,
+                                             inclusion_spectrum_,
+                                             inc_conc,
+                                             host_k,
+                                             host_mu,
+                                             k_,
+                                             mu_);
+}
+
+void
+SolidDEM::ComputeElasticParams(const std::vector<SolidDEM*> & samples) {
+
+  if (samples.empty())
+    return;
+
+  size_t n_samples    = samples.size();
+  size_t n_inclusions = samples[0]->solid_inc_.size();
+
+  std::vector<double> inc_k, inc_mu, inc_spectrum, inc_conc;
+  std::vector<double> host_k(n_samples), host_mu(n_samples);
+
+  inc_k.reserve(n_samples*n_inclusions);
+  inc_mu.reserve(n_samples*n_inclusions);
+  inc_spectrum.reserve(n_samples*n_inclusions);
+  inc_conc.reserve(n_samples*n_inclusions);
+
+  for (size_t s = 0; s < n_samples; ++s) {
+    assert(samples[s]->solid_inc_.size() == n_inclusions);
+
+    std::vector<double> k, mu, conc;
+    samples[s]->FindDEMInput(k, mu, conc, host_k[s], host_mu[s]);
+
+    inc_k.insert(inc_k.end(), k.begin(), k.end());
+    inc_mu.insert(inc_mu.end(), mu.begin(), mu.end());
+    inc_spectrum.insert(inc_spectrum.end(), samples[s]->inclusion_spectrum_.begin(), samples[s]->inclusion_spectrum_.end());
+    inc_conc.insert(inc_conc.end(), conc.begin(), conc.end());
+  }
+
+  std::vector<double> k, mu;
+  DEMTools::CalcEffectiveBulkAndShearModuli(n_inclusions,
+                                            inc_k,
+                                            inc_mu,
+                                            inc_spectrum,
+                                            inc_conc,
+                                            host_k,
+                                            host_mu,
+                                            k,
+                                            mu);
+
+  for (size_t s = 0; s < n_samples; ++s) {
+    samples[s]->k_  = k[s];
+    samples[s]->mu_ = mu[s];
+  }
+}
+
+void
+SolidDEM::FindDEMInput(std::vector<double> & inc_k,
+                       std::vector<double> & inc_mu,
+                       std::vector<double> & inc_conc,
+                       double              & host_k,
+                       double              & host_mu) {
+
   std::vector<double> solid_inc_rho, solid_inc_k, solid_inc_mu;
 
   solid_inc_rho.resize(solid_inc_.size());
@@ -93,17 +163,13 @@ SolidDEM::ComputeElasticParams() {
   }
 
   //remove host from inclusion vector
-  std::vector<double> inc_conc(solid_inc_.size());
+  inc_conc.resize(solid_inc_.size());
   std::copy(inclusion_concentration_.begin()+1, inclusion_concentration_.end(), inc_conc.begin());
 
-  DEMTools::CalcEffectiveBulkAndShearModulus(solid_inc_k,
-                                             solid_inc_mu,
-                                             inclusion_spectrum_,
-                                             inc_conc,
-                                             solid_k,
-                                             solid_mu,
-                                             k_,
-                                             mu_);
+  inc_k   = solid_inc_k;
+  inc_mu  = solid_inc_mu;
+  host_k  = solid_k;
+  host_mu = solid_mu;
 }
 
 
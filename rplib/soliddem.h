@@ -16,7 +16,8 @@ public:
            const std::vector< Solid* >         & solid_inc,
            const std::vector<double>           & inclusion_spectrum,
            const std::vector<double>           & inclusion_concentration, // the first element is the concentration of the host
-           const std::vector<double>           & u);
+           const std::vector<double>           & u,
+           bool                                  find_moduli = true); // If false, the parameters are found by ComputeElasticParams(samples).
 
   SolidDEM();
 
@@ -32,6 +33,10 @@ public:
   const std::vector<Solid*>           & GetSolidInclusion() const {return solid_inc_;}
   const Solid                         * GetSolidInclusion(size_t i) const { return solid_inc_[i]; } // no error checking on valid index range
 
+  // Finds the parameters of samples made with find_moduli = false. All samples must have
+  // the same number of inclusions, and their DEM equations are integrated in one batch.
+  static void                           ComputeElasticParams(const std::vector<SolidDEM*> & samples);
+
 private:
   //Copy constructor for getting base class variables , used by Clone:
   SolidDEM(const SolidDEM & rhs) : Solid(rhs) {}
@@ -39,6 +44,13 @@ private:
   // Calculate elastic and seismic parameters, to be
   // used whenever new information is sent to class.
   void                                  ComputeElasticParams();
+  // Sets the density, and returns the inclusion and host moduli and the inclusion
+  // concentrations (without the host) used in the DEM equations.
+  void                                  FindDEMInput(std::vector<double> & inc_k,
+                                                     std::vector<double> & inc_mu,
+                                                     std::vector<double> & inc_conc,
+                                                     double              & host_k,
+                                                     double              & host_mu);
   void                                  Clone(const std::vector< Solid* > & solid_in);
   void                                  DeleteInclusion();
 
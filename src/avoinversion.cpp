@@ -21,16 +21,19 @@
 #include "src/vario.h"
 #include "src/krigingdata3d.h"
 #include "src/covgridseparated.h"
+#include "src/covtensorgrid.h"
 #include "src/krigingadmin.h"
 #include "src/faciesprob.h"
 #include "src/definitions.h"
 #include "src/gridmapping.h"
 #include "src/parameteroutput.h"
 #include "src/timings.h"
+#include "src/profiler.h"
 #include "src/spatialwellfilter.h"
 #include "src/qualitygrid.h"
 #include "src/io.h"
 #include "src/tasklist.h"
+#include "src/smallmatrixcpx.h"
 
 #include "lib/timekit.hpp"
 #include "lib/random.h"
@@ -39,6 +42,7 @@
 #include "nrlib/iotools/logkit.hpp"
 #include "nrlib/stormgrid/stormcontgrid.hpp"
 #include "nrlib/grid/grid2d.hpp"
+#include "nrlib/random/randomgenerator.hpp"
 #include "rplib/distributionsstoragekit.h"
 #include "rplib/distributionsrock.h"
 
@@ -91,6 +95,8 @@ AVOInversion::AVOInversion(ModelSettings           * modelSettings,
   outputGridsElastic_= modelSettings_->getOutputGridsElastic();
   writePrediction_   = modelSettings_->getWritePrediction();
   krigingParameter_  = modelSettings_->getKrigingParameter();
+  kriging_           = NULL;
+  krigingData_       = NULL;
   nSim_              = modelSettings_->getNumberOfSimulations();
   blocked_wells_     = modelGeneral_->GetBlockedWells();
   random_            = modelGeneral_->GetRandomGen();
@@ -295,7 +301,8 @@ AVOInversion::AVOInversion(ModelSettings           * modelSettings,
                                          activeAngles,
                                          this,
                                          modelAVOdynamic->GetLocalNoiseScales(),
-                                         seismicParameters);
+                                         seismicParameters,
+                                         modelSettings->getNumberOfThreads());
     if (modelSettings->getEstimateFaciesProb()) {
       bool useFilter = modelSettings->getUseFilterForFaciesProb();
       computeFaciesProb(spat_real_well_filter, spat_synt_well_filter, useFilter, seismicParameters);
@@ -332,6 +339,7 @@ AVOInversion::AVOInversion(ModelSettings           * modelSettings,
 
 AVOInversion::~AVOInversion()
 {
+  releasePostKriging();
   delete [] thetaDeg_;
   delete [] theoSNRatio_;
   delete [] modelVariance_;
@@ -796,51 +804,11 @@ AVOInversion::computePostMeanResidAndFFTCov(ModelGeneral            * modelGener
                                             ModelSettings           * modelSettings)
 {
   LogKit::WriteHeader("Posterior model / Performing Inversion");
+  Profiler::Region region("Posterior solve");
 
   double wall=0.0, cpu=0.0;
   TimeKit::getTime(wall,cpu);
-  int i,j,k,l;
-
-  fftw_complex * kW          = new fftw_complex[ntheta_];
-
-  fftw_complex * errMult1    = new fftw_complex[ntheta_];
-  fftw_complex * errMult2    = new fftw_complex[ntheta_];
-  fftw_complex * errMult3    = new fftw_complex[ntheta_];
-
-  fftw_complex * ijkData     = new fftw_complex[ntheta_];
-  fftw_complex * ijkDataMean = new fftw_complex[ntheta_];
-  fftw_complex * ijkRes      = new fftw_complex[ntheta_];
-  fftw_complex * ijkMean     = new fftw_complex[3];
-  fftw_complex * ijkAns      = new fftw_complex[3];
-  fftw_complex   kD,kD3;
-
-  fftw_complex**  K  = new fftw_complex*[ntheta_];
-  for (i = 0; i < ntheta_; i++)
-    K[i] = new fftw_complex[3];
-
-  fftw_complex**  KS  = new fftw_complex*[ntheta_];
-  for (i = 0; i < ntheta_; i++)
-    KS[i] = new fftw_complex[3];
-
-  fftw_complex**  KScc  = new fftw_complex*[3]; // cc - complex conjugate (and transposed)
-  for (i = 0; i < 3; i++)
-    KScc[i] = new fftw_complex[ntheta_];
-
-  fftw_complex**  parVar = new fftw_complex*[3];
-  for (i = 0; i < 3; i++)
-    parVar[i] = new fftw_complex[3];
-
-  fftw_complex**  margVar = new fftw_complex*[ntheta_];
-  for (i = 0; i < ntheta_; i++)
-    margVar[i] = new fftw_complex[ntheta_];
-
-  fftw_complex**  errVar = new fftw_complex*[ntheta_];
-  for (i = 0; i < ntheta_; i++)
-    errVar[i] = new fftw_complex[ntheta_];
-
-  fftw_complex** reduceVar = new fftw_complex*[3];
-  for (i = 0; i < 3; i++)
-    reduceVar[i]= new fftw_complex[3];
+  int i,k,l;
 
   Wavelet1D * diff1Operator = new Wavelet1D(Wavelet::FIRSTORDERFORWARDDIFF,nz_,nzp_);
   Wavelet1D * diff2Operator = new Wavelet1D(diff1Operator,Wavelet::FIRSTORDERBACKWARDDIFF);
@@ -854,8 +822,6 @@ AVOInversion::computePostMeanResidAndFFTCov(ModelGeneral            * modelGener
   Wavelet1D ** errorSmooth2 = new Wavelet1D*[ntheta_];
   Wavelet1D ** errorSmooth3 = new Wavelet1D*[ntheta_];
 
-  int cnxp  = nxp_/2+1;
-
   for (l = 0; l < ntheta_ ; l++)
   {
     std::string angle = NRLib::ToString(thetaDeg_[l], 1);
@@ -919,10 +885,6 @@ AVOInversion::computePostMeanResidAndFFTCov(ModelGeneral            * modelGener
 
   // Computes the posterior mean first below the covariance is computed
   // To avoid to many grids in memory at the same time
-  double priorVarVp,justfactor;
-  int cholFlag;
-  float realFrequency;
-
   Wavelet1D** seisWaveletForNorm = new Wavelet1D*[ntheta_];
   for (l = 0; l < ntheta_; l++)
   {
@@ -933,6 +895,15 @@ AVOInversion::computePostMeanResidAndFFTCov(ModelGeneral            * modelGener
     }
   }
 
+  //
+  // The Fourier cells are independent, so the k-slabs may be distributed among threads.
+  // This requires direct indexed access to the grid storage, which file grids do not give.
+  //
+  bool indexedAccess = modelSettings->getNumberOfThreads() > 1 && !fileGrid_;
+  for (l = 0; l < ntheta_; l++)
+    indexedAccess = indexedAccess && !seisData_[l]->isFile();
+  indexedAccess = indexedAccess && !errCorr_->isFile() && !postCovVp->isFile();
+
   LogKit::LogFormatted(LogKit::Low,"\nBuilding posterior distribution:");
   float monitorSize = std::max(1.0f, static_cast<float>(nzp_)*0.02f);
   float nextMonitor = monitorSize;
@@ -941,152 +912,44 @@ AVOInversion::computePostMeanResidAndFFTCov(ModelGeneral            * modelGener
     << "\n  |    |    |    |    |    |    |    |    |    |    |  "
     << "\n  ^";
 
-  for (k = 0; k < nzp_; k++)
-  {
-    realFrequency = static_cast<float>((nz_*1000.0f)/(simbox_->getlz()*nzp_)*std::min(k,nzp_-k)); // the physical frequency
-    kD = diff1Operator->getCAmp(k);                      // defines content of kD
-    if(simbox_->getIsConstantThick())
-    {
-      // defines content of K=WDA
-      fillkW(k, kW, seisWavelet_);
-
-      lib_matrProdScalVecCpx(kD, kW, ntheta_);
-
-      // Copy matrix A to float**
-      float ** A = new float * [ntheta_];
-      for (int i = 0; i < ntheta_; i++)
-        A[i] = new float[3];
-      for (int i = 0; i < ntheta_; i++){
-        for (int j = 0; j < 3; j++){
-          A[i][j] = static_cast<float>(A_(i,j));
-        }
-      }
-
-      lib_matrProdDiagCpxR(kW, A, ntheta_, 3, K); // defines content of (WDA) K
-
-      for (int i = 0; i < ntheta_; i++)
-        delete [] A[i];
-      delete [] A;
-
-      // defines error-term multipliers
-      fillkWNorm(k,errMult1,seisWaveletForNorm);         // defines input of  (kWNorm) errMult1
-      fillkWNorm(k,errMult2,errorSmooth3);               // defines input of  (kWD3Norm) errMult2
-      lib_matrFillOnesVecCpx(errMult3,ntheta_);          // defines content of errMult3
-    }
-    else
+  if (indexedAccess) {
+    int n_finished = 0;
+#ifdef PARALLEL
+    int n_threads  = modelSettings->getNumberOfThreads();
+    int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(n_threads)
+#endif
+    for (k = 0; k < nzp_; k++)
     {
-      kD3 = diff3Operator->getCAmp(k);                   // defines  kD3
-
-      // Copy matrix A to float **
-      float ** A = new float * [ntheta_];
-      for (int i = 0; i < ntheta_; i++)
-        A[i] = new float[3];
-      for (int i = 0; i < ntheta_; i++){
-        for (int j = 0; j < 3; j++){
-          A[i][j] = static_cast<float>(A_(i,j));
-        }
-      }
-
-      // defines content of K = DA
-      lib_matrFillValueVecCpx(kD, errMult1, ntheta_);    // errMult1 used as dummy
-      lib_matrProdDiagCpxR(errMult1, A, ntheta_, 3, K); // defines content of ( K = DA )
-
-      for (int i = 0; i < ntheta_; i++)
-        delete [] A[i];
-      delete [] A;
-
-      // defines error-term multipliers
-      lib_matrFillOnesVecCpx(errMult1,ntheta_);          // defines content of errMult1
-      for (l=0; l < ntheta_; l++)
-      {
-        errMult1[l].re /= seisWavelet_[l]->getNorm();    // defines content of errMult1
-      }
-
-      lib_matrFillValueVecCpx(kD3,errMult2,ntheta_);     // defines content of errMult2
-      for (l=0; l < ntheta_; l++)
+      computePostMeanResidAndFFTCovSlab(k, seismicParameters, diff1Operator, diff3Operator,
+                                        errorSmooth3, seisWaveletForNorm, true);
+#ifdef PARALLEL
+#pragma omp critical
+#endif
       {
-        //float errorSmoothMult =  1.0f/errorSmooth3[l]->findNormWithinFrequencyBand(lowCut_,highCut_); // defines scaleFactor;
-        float errorSmoothMult =  1.0f/errorSmooth3[l]->getNorm(); // defines scaleFactor;
-        errMult2[l].re  *= errorSmoothMult; // defines content of errMult2
-        errMult2[l].im  *= errorSmoothMult; // defines content of errMult2
-      }
-      fillInverseAbskWRobust(k,errMult3,seisWaveletForNorm);// defines content of errMult3
-    }
-
-    for ( j = 0; j < nyp_; j++) {
-      for ( i = 0; i < cnxp; i++) {
-        ijkMean[0] = meanVp_ ->getNextComplex();
-        ijkMean[1] = meanVs_ ->getNextComplex();
-        ijkMean[2] = meanRho_->getNextComplex();
-
-        for (l = 0; l < ntheta_; l++ )
+        // Log progress
+        n_finished++;
+        if (n_finished >= static_cast<int>(nextMonitor))
         {
-          ijkData[l] = seisData_[l]->getNextComplex();
-          ijkRes[l]  = ijkData[l];
-        }
-
-        seismicParameters.getNextParameterCovariance(parVar);
-        bool invert_frequency = realFrequency > lowCut_*simbox_->getMinRelThick() &&  realFrequency < highCut_;
-
-        priorVarVp = parVar[0][0].re;
-
-        getNextErrorVariance(errVar, errMult1, errMult2, errMult3, ntheta_, wnc_, errThetaCov_, invert_frequency);
-
-        if(invert_frequency){
-          lib_matrProdCpx(K, parVar , ntheta_, 3 ,3, KS);              //  KS is defined here
-          lib_matrProdAdjointCpx(KS, K, ntheta_, 3 ,ntheta_, margVar); // margVar = (K)S(K)' is defined here
-          lib_matrAddMatCpx(errVar, ntheta_,ntheta_, margVar);         // errVar  is added to margVar = (WDA)S(WDA)'  + errVar
-
-          cholFlag=lib_matrCholCpx(ntheta_,margVar);                   // Choleskey factor of margVar is Defined
-
-          if(cholFlag==0)
-          { // then it is ok else posterior is identical to prior
-
-            lib_matrAdjoint(KS,ntheta_,3,KScc);                        //  WDAScc is adjoint of WDAS
-            lib_matrAXeqBMatCpx(ntheta_, margVar, KS, 3);              // redefines WDAS
-            lib_matrProdCpx(KScc,KS,3,ntheta_,3,reduceVar);            // defines reduceVar
-            //double hj=1000000.0;
-            //if(reduceVar[0][0].im!=0)
-            // hj = MAXIM(reduceVar[0][0].re/reduceVar[0][0].im,-reduceVar[0][0].re/reduceVar[0][0].im); //NBNB DEBUG
-            lib_matrSubtMatCpx(reduceVar,3,3,parVar);                  // redefines parVar as the posterior solution
-
-            lib_matrProdMatVecCpx(K,ijkMean, ntheta_, 3, ijkDataMean); //  defines content of ijkDataMean
-            lib_matrSubtVecCpx(ijkDataMean, ntheta_, ijkData);         //  redefines content of ijkData
-
-            lib_matrProdAdjointMatVecCpx(KS,ijkData,3,ntheta_,ijkAns); // defines ijkAns
-
-            lib_matrAddVecCpx(ijkAns, 3,ijkMean);                      // redefines ijkMean
-            lib_matrProdMatVecCpx(K,ijkMean, ntheta_, 3, ijkData);     // redefines ijkData
-            lib_matrSubtVecCpx(ijkData, ntheta_,ijkRes);               // redefines ijkRes
-          }
-
-          // quality control DEBUG
-          if(priorVarVp*4 < ijkAns[0].re*ijkAns[0].re + ijkAns[0].re*ijkAns[0].re)
-          {
-            justfactor = sqrt(ijkAns[0].re*ijkAns[0].re + ijkAns[0].re*ijkAns[0].re)/sqrt(priorVarVp);
-          }
+          nextMonitor += monitorSize;
+          std::cout << "^";
+          fflush(stdout);
         }
-
-        postVp_ ->setNextComplex(ijkMean[0]);
-        postVs_ ->setNextComplex(ijkMean[1]);
-        postRho_->setNextComplex(ijkMean[2]);
-        postCovVp ->setNextComplex(parVar[0][0]);
-        postCovVs ->setNextComplex(parVar[1][1]);
-        postCovRho->setNextComplex(parVar[2][2]);
-        postCrCovVpVs ->setNextComplex(parVar[0][1]);
-        postCrCovVpRho->setNextComplex(parVar[0][2]);
-        postCrCovVsRho->setNextComplex(parVar[1][2]);
-
-        for (l=0;l<ntheta_;l++)
-          seisData_[l]->setNextComplex(ijkRes[l]);
       }
     }
-    // Log progress
-    if (k+1 >= static_cast<int>(nextMonitor))
+  }
+  else {
+    for (k = 0; k < nzp_; k++)
     {
-      nextMonitor += monitorSize;
-      std::cout << "^";
-      fflush(stdout);
+      computePostMeanResidAndFFTCovSlab(k, seismicParameters, diff1Operator, diff3Operator,
+                                        errorSmooth3, seisWaveletForNorm, false);
+      // Log progress
+      if (k+1 >= static_cast<int>(nextMonitor))
+      {
+        nextMonitor += monitorSize;
+        std::cout << "^";
+        fflush(stdout);
+      }
     }
   }
   std::cout << "\n";
@@ -1185,67 +1048,277 @@ AVOInversion::computePostMeanResidAndFFTCov(ModelGeneral            * modelGener
     writeBWPredicted();
   }
   //delete [] seisData_;
-  delete [] kW;
-  delete [] errMult1;
-  delete [] errMult2;
-  delete [] errMult3;
-  delete [] ijkData;
-  delete [] ijkDataMean;
-  delete [] ijkRes;
-  delete [] ijkMean ;
-  delete [] ijkAns;
   delete    diff1Operator;
   delete    diff3Operator;
 
   for (i = 0; i < ntheta_; i++)
   {
-    delete[]  K[i];
-    delete[]  KS[i];
-    delete[]  margVar[i] ;
-    delete[] errVar[i] ;
     delete errorSmooth3[i];
     delete errorSmooth[i];
     delete seisWaveletForNorm[i];
   }
 
-  delete[] K;
-  delete[] KS;
-  delete[] margVar;
-  delete[] errVar  ;
   delete[] errorSmooth3;
   delete[] errorSmooth;
   delete[] seisWaveletForNorm;
 
+  Timings::addTimeInversion(wall,cpu);
+  return(0);
+}
+
+
+//--------------------------------------------------------------------
+void
+AVOInversion::computePostMeanResidAndFFTCovSlab(int                       k,
+                                                SeismicParametersHolder & seismicParameters,
+                                                Wavelet1D               * diff1Operator,
+                                                Wavelet1D               * diff3Operator,
+                                                Wavelet1D              ** errorSmooth3,
+                                                Wavelet1D              ** seisWaveletForNorm,
+                                                bool                      indexedAccess)
+{
+  //
+  // Inverts all Fourier cells (i,j) in slab k. With indexedAccess the grids are
+  // accessed by index rather than by the get/setNext cursors, so that different
+  // slabs may be handled concurrently. The arithmetic is the same in both cases.
+  //
+  int i,j,l;
+
+  fftw_complex * kW          = new fftw_complex[ntheta_];
+
+  fftw_complex * errMult1    = new fftw_complex[ntheta_];
+  fftw_complex * errMult2    = new fftw_complex[ntheta_];
+  fftw_complex * errMult3    = new fftw_complex[ntheta_];
+
+  fftw_complex * ijkData     = new fftw_complex[ntheta_];
+  fftw_complex * ijkDataMean = new fftw_complex[ntheta_];
+  fftw_complex * ijkRes      = new fftw_complex[ntheta_];
+  fftw_complex * ijkMean     = new fftw_complex[3];
+  fftw_complex * ijkAns      = new fftw_complex[3];
+  fftw_complex   ijkErrCorr;
+  fftw_complex   kD,kD3;
+
+  fftw_complex**  K  = new fftw_complex*[ntheta_];
+  for (i = 0; i < ntheta_; i++)
+    K[i] = new fftw_complex[3];
+
+  fftw_complex**  KS  = new fftw_complex*[ntheta_];
+  for (i = 0; i < ntheta_; i++)
+    KS[i] = new fftw_complex[3];
+
+  fftw_complex**  KScc  = new fftw_complex*[3]; // cc - complex conjugate (and transposed)
+  for (i = 0; i < 3; i++)
+    KScc[i] = new fftw_complex[ntheta_];
+
+  fftw_complex**  parVar = new fftw_complex*[3];
   for (i = 0; i < 3; i++)
+    parVar[i] = new fftw_complex[3];
+
+  fftw_complex**  margVar = new fftw_complex*[ntheta_];
+  for (i = 0; i < ntheta_; i++)
+    margVar[i] = new fftw_complex[ntheta_];
+
+  fftw_complex**  errVar = new fftw_complex*[ntheta_];
+  for (i = 0; i < ntheta_; i++)
+    errVar[i] = new fftw_complex[ntheta_];
+
+  fftw_complex** reduceVar = new fftw_complex*[3];
+  for (i = 0; i < 3; i++)
+    reduceVar[i]= new fftw_complex[3];
+
+  // Fixed-size kernel for the per-cell update, or NULL for the generic lib_matr code
+  SmallMatrixCpx::PosteriorUpdate posteriorUpdate = SmallMatrixCpx::GetPosteriorUpdate(ntheta_);
+
+  FFTGrid * postCovVp      = seismicParameters.GetCovVp();
+  FFTGrid * postCovVs      = seismicParameters.GetCovVs();
+  FFTGrid * postCovRho     = seismicParameters.GetCovRho();
+  FFTGrid * postCrCovVpVs  = seismicParameters.GetCrCovVpVs();
+  FFTGrid * postCrCovVpRho = seismicParameters.GetCrCovVpRho();
+  FFTGrid * postCrCovVsRho = seismicParameters.GetCrCovVsRho();
+
+  int   cnxp          = nxp_/2+1;
+  float realFrequency = static_cast<float>((nz_*1000.0f)/(simbox_->getlz()*nzp_)*std::min(k,nzp_-k)); // the physical frequency
+  kD = diff1Operator->getCAmp(k);                      // defines content of kD
+  if(simbox_->getIsConstantThick())
   {
-    delete[] KScc[i];
-    delete[] parVar[i] ;
-    delete[] reduceVar[i];
+    // defines content of K=WDA
+    fillkW(k, kW, seisWavelet_);
+
+    lib_matrProdScalVecCpx(kD, kW, ntheta_);
+
+    fillK(kW, K);                                      // defines content of (WDA) K
+
+    // defines error-term multipliers
+    fillkWNorm(k,errMult1,seisWaveletForNorm);         // defines input of  (kWNorm) errMult1
+    fillkWNorm(k,errMult2,errorSmooth3);               // defines input of  (kWD3Norm) errMult2
+    lib_matrFillOnesVecCpx(errMult3,ntheta_);          // defines content of errMult3
   }
-  delete[] KScc;
-  delete[] parVar;
-  delete[] reduceVar;
+  else
+  {
+    kD3 = diff3Operator->getCAmp(k);                   // defines  kD3
 
-  Timings::addTimeInversion(wall,cpu);
-  return(0);
-}
+    // defines content of K = DA
+    lib_matrFillValueVecCpx(kD, errMult1, ntheta_);    // errMult1 used as dummy
+    fillK(errMult1, K);                                // defines content of ( K = DA )
+
+    // defines error-term multipliers
+    lib_matrFillOnesVecCpx(errMult1,ntheta_);          // defines content of errMult1
+    for (l=0; l < ntheta_; l++)
+    {
+      errMult1[l].re /= seisWavelet_[l]->getNorm();    // defines content of errMult1
+    }
 
+    lib_matrFillValueVecCpx(kD3,errMult2,ntheta_);     // defines content of errMult2
+    for (l=0; l < ntheta_; l++)
+    {
+      float errorSmoothMult =  1.0f/errorSmooth3[l]->getNorm(); // defines scaleFactor;
+      errMult2[l].re  *= errorSmoothMult; // defines content of errMult2
+      errMult2[l].im  *= errorSmoothMult; // defines content of errMult2
+    }
+    fillInverseAbskWRobust(k,errMult3,seisWaveletForNorm);// defines content of errMult3
+  }
+
+  bool invert_frequency = realFrequency > lowCut_*simbox_->getMinRelThick() &&  realFrequency < highCut_;
+
+  for ( j = 0; j < nyp_; j++) {
+    for ( i = 0; i < cnxp; i++) {
+      if (indexedAccess) {
+        ijkMean[0] = meanVp_ ->getComplexValue(i, j, k, true);
+        ijkMean[1] = meanVs_ ->getComplexValue(i, j, k, true);
+        ijkMean[2] = meanRho_->getComplexValue(i, j, k, true);
+
+        for (l = 0; l < ntheta_; l++ )
+          ijkData[l] = seisData_[l]->getComplexValue(i, j, k, true);
+
+        seismicParameters.getParameterCovariance(parVar, i, j, k);
+        ijkErrCorr = errCorr_->getComplexValue(i, j, k, true);
+      }
+      else {
+        ijkMean[0] = meanVp_ ->getNextComplex();
+        ijkMean[1] = meanVs_ ->getNextComplex();
+        ijkMean[2] = meanRho_->getNextComplex();
+
+        for (l = 0; l < ntheta_; l++ )
+          ijkData[l] = seisData_[l]->getNextComplex();
+
+        seismicParameters.getNextParameterCovariance(parVar);
+        ijkErrCorr = errCorr_->getNextComplex();
+      }
+
+      for (l = 0; l < ntheta_; l++ )
+        ijkRes[l] = ijkData[l];
+
+      computeErrorVariance(errVar, ijkErrCorr, errMult1, errMult2, errMult3, ntheta_, wnc_, errThetaCov_, invert_frequency);
+
+      if(invert_frequency && posteriorUpdate != NULL) {
+        posteriorUpdate(K, parVar, errVar, ijkMean, ijkData, ijkRes);
+      }
+      else if(invert_frequency){
+        lib_matrProdCpx(K, parVar , ntheta_, 3 ,3, KS);              //  KS is defined here
+        lib_matrProdAdjointCpx(KS, K, ntheta_, 3 ,ntheta_, margVar); // margVar = (K)S(K)' is defined here
+        lib_matrAddMatCpx(errVar, ntheta_,ntheta_, margVar);         // errVar  is added to margVar = (WDA)S(WDA)'  + errVar
+
+        int cholFlag=lib_matrCholCpx(ntheta_,margVar);               // Choleskey factor of margVar is Defined
+
+        if(cholFlag==0)
+        { // then it is ok else posterior is identical to prior
+
+          lib_matrAdjoint(KS,ntheta_,3,KScc);                        //  WDAScc is adjoint of WDAS
+          lib_matrAXeqBMatCpx(ntheta_, margVar, KS, 3);              // redefines WDAS
+          lib_matrProdCpx(KScc,KS,3,ntheta_,3,reduceVar);            // defines reduceVar
+          lib_matrSubtMatCpx(reduceVar,3,3,parVar);                  // redefines parVar as the posterior solution
+
+          lib_matrProdMatVecCpx(K,ijkMean, ntheta_, 3, ijkDataMean); //  defines content of ijkDataMean
+          lib_matrSubtVecCpx(ijkDataMean, ntheta_, ijkData);         //  redefines content of ijkData
+
+          lib_matrProdAdjointMatVecCpx(KS,ijkData,3,ntheta_,ijkAns); // defines ijkAns
+
+          lib_matrAddVecCpx(ijkAns, 3,ijkMean);                      // redefines ijkMean
+          lib_matrProdMatVecCpx(K,ijkMean, ntheta_, 3, ijkData);     // redefines ijkData
+          lib_matrSubtVecCpx(ijkData, ntheta_,ijkRes);               // redefines ijkRes
+        }
+      }
+
+      if (indexedAccess) {
+        postVp_ ->setComplexValue(i, j, k, ijkMean[0], true);
+        postVs_ ->setComplexValue(i, j, k, ijkMean[1], true);
+        postRho_->setComplexValue(i, j, k, ijkMean[2], true);
+        postCovVp ->setComplexValue(i, j, k, parVar[0][0], true);
+        postCovVs ->setComplexValue(i, j, k, parVar[1][1], true);
+        postCovRho->setComplexValue(i, j, k, parVar[2][2], true);
+        postCrCovVpVs ->setComplexValue(i, j, k, parVar[0][1], true);
+        postCrCovVpRho->setComplexValue(i, j, k, parVar[0][2], true);
+        postCrCovVsRho->setComplexValue(i, j, k, parVar[1][2], true);
+
+        for (l=0;l<ntheta_;l++)
+          seisData_[l]->setComplexValue(i, j, k, ijkRes[l], true);
+      }
+      else {
+        postVp_ ->setNextComplex(ijkMean[0]);
+        postVs_ ->setNextComplex(ijkMean[1]);
+        postRho_->setNextComplex(ijkMean[2]);
+        postCovVp ->setNextComplex(parVar[0][0]);
+        postCovVs ->setNextComplex(parVar[1][1]);
+        postCovRho->setNextComplex(parVar[2][2]);
+        postCrCovVpVs ->setNextComplex(parVar[0][1]);
+        postCrCovVpRho->setNextComplex(parVar[0][2]);
+        postCrCovVsRho->setNextComplex(parVar[1][2]);
+
+        for (l=0;l<ntheta_;l++)
+          seisData_[l]->setNextComplex(ijkRes[l]);
+      }
+    }
+  }
+
+  delete [] kW;
+  delete [] errMult1;
+  delete [] errMult2;
+  delete [] errMult3;
+  delete [] ijkData;
+  delete [] ijkDataMean;
+  delete [] ijkRes;
+  delete [] ijkMean ;
+  delete [] ijkAns;
+
+  for (i = 0; i < ntheta_; i++)
+  {
+    delete [] K[i];
+    delete [] KS[i];
+    delete [] margVar[i];
+    delete [] errVar[i];
+  }
+  delete [] K;
+  delete [] KS;
+  delete [] margVar;
+  delete [] errVar;
+
+  for (i = 0; i < 3; i++)
+  {
+    delete [] KScc[i];
+    delete [] parVar[i];
+    delete [] reduceVar[i];
+  }
+  delete [] KScc;
+  delete [] parVar;
+  delete [] reduceVar;
+}
 
 //--------------------------------------------------------------------
 void
-AVOInversion::getNextErrorVariance(fftw_complex **& errVar,
-                                   fftw_complex   * errMult1,
-                                   fftw_complex   * errMult2,
-                                   fftw_complex   * errMult3,
-                                   int              ntheta,
-                                   float            wnc,
-                                   double        ** errThetaCov,
-                                   bool             invert_frequency) const
+AVOInversion::computeErrorVariance(fftw_complex      **& errVar,
+                                   const fftw_complex  & ijkErrCorr,
+                                   fftw_complex        * errMult1,
+                                   fftw_complex        * errMult2,
+                                   fftw_complex        * errMult3,
+                                   int                   ntheta,
+                                   float                 wnc,
+                                   double             ** errThetaCov,
+                                   bool                  invert_frequency) const
 {
   fftw_complex ijkErrLam;
   fftw_complex ijkTmp;
 
-  ijkTmp = errCorr_->getNextComplex();
+  ijkTmp = ijkErrCorr;
 
   ijkErrLam.re        = float( sqrt(ijkTmp.re * ijkTmp.re));
   ijkErrLam.im        = 0.0;
@@ -1271,6 +1344,21 @@ AVOInversion::getNextErrorVariance(fftw_complex **& errVar,
   }
 }
 
+void
+AVOInversion::fillK(const fftw_complex * diag, fftw_complex ** K) const
+{
+  // K = diag(diag)*A
+  for (int l = 0; l < ntheta_; l++)
+  {
+    for (int m = 0; m < 3; m++)
+    {
+      float a    = static_cast<float>(A_(l,m));
+      K[l][m].re = diag[l].re * a;
+      K[l][m].im = diag[l].im * a;
+    }
+  }
+}
+
 void
 AVOInversion::fillkW(int k, fftw_complex* kW, std::vector<Wavelet *> seisWavelet) //Wavelet**
 {
@@ -1340,6 +1428,7 @@ void
 AVOInversion::doPredictionKriging(SeismicParametersHolder & seismicParameters)
 {
   if(writePrediction_ == true) { //No need to do this if output not requested.
+    Profiler::Region region("Kriging");
     double wall2=0.0, cpu2=0.0;
     TimeKit::getTime(wall2,cpu2);
     doPostKriging(seismicParameters, *postVp_, *postVs_, *postRho_);
@@ -1355,6 +1444,7 @@ int
 AVOInversion::simulate(SeismicParametersHolder & seismicParameters, RandomGen * randomGen)
 {
   LogKit::WriteHeader("Simulating from posterior model");
+  Profiler::Region region("Simulation");
 
   double wall=0.0, cpu=0.0;
   TimeKit::getTime(wall,cpu);
@@ -1362,181 +1452,309 @@ AVOInversion::simulate(SeismicParametersHolder & seismicParameters, RandomGen *
   if(nSim_>0)
   {
     bool kriging = (krigingParameter_ > 0);
-    FFTGrid * postCovVp      = seismicParameters.GetCovVp();
-    FFTGrid * postCovVs      = seismicParameters.GetCovVs();
-    FFTGrid * postCovRho     = seismicParameters.GetCovRho();
-    FFTGrid * postCrCovVpVs  = seismicParameters.GetCrCovVpVs();
-    FFTGrid * postCrCovVpRho = seismicParameters.GetCrCovVpRho();
-    FFTGrid * postCrCovVsRho = seismicParameters.GetCrCovVsRho();
-
-    assert( postCovVp->getIsTransformed() );
-    assert( postCovVs->getIsTransformed() );
-    assert( postCovRho->getIsTransformed() );
-    assert( postCrCovVpVs->getIsTransformed() );
-    assert( postCrCovVpRho->getIsTransformed() );
-    assert( postCrCovVsRho->getIsTransformed() );
-
-    int             simNr,i,j,k,l;
-    fftw_complex ** ijkPostCov;
-    fftw_complex *  ijkSeed;
-    FFTGrid *       seed0;
-    FFTGrid *       seed1;
-    FFTGrid *       seed2;
-
-    ijkPostCov = new fftw_complex*[3];
-    for (l=0;l<3;l++)
-      ijkPostCov[l]=new fftw_complex[3];
-
-    ijkSeed = new fftw_complex[3];
-
-    seed0 =  createFFTGrid();
-    seed1 =  createFFTGrid();
-    seed2 =  createFFTGrid();
-    seed0->createComplexGrid();
-    seed1->createComplexGrid();
-    seed2->createComplexGrid();
-
-    // long int timestart, timeend;
-
-    for (simNr = 0; simNr < nSim_;  simNr++)
+
+    // Each realisation draws its noise from its own random number stream. The streams are
+    // seeded from the main generator up front, so the realisations are reproducible and
+    // independent of how many of them are generated concurrently.
+    std::vector<unsigned long> seeds(nSim_);
+    for (int simNr = 0; simNr < nSim_; simNr++)
+      seeds[simNr] = static_cast<unsigned long>(randomGen->unif01()*4294967295.0);
+
+    // The Cholesky factor of the posterior covariance is the same for all realisations.
+    // With grids on file, it is instead found for each cell as the realisation is made,
+    // so that it does not take up memory.
+    CovTensorGrid * postCovChol = NULL;
+    if (!fileGrid_) {
+      postCovChol = new CovTensorGrid(nxp_, nyp_, nzp_);
+      computePosteriorCovCholesky(seismicParameters, postCovChol);
+    }
+
+    // The kriging neighbourhoods and factorisations only depend on the well data and
+    // the covariances, and are shared by all realisations.
+    if (kriging == true)
+      setupPostKriging(seismicParameters);
+
+    // The covariances are not needed again until the realisations are done, and are
+    // moved to disk if the realisations would otherwise exceed the memory budget.
+    seismicParameters.makeCovGridsCold();
+
+    // Realisations are generated in batches of one per thread. Grids on file
+    // only support sequential access, so they are generated one at a time.
+    int nBatch = 1;
+    if (modelSettings_->getNumberOfThreads() > 1 && !fileGrid_)
+      nBatch = std::min(modelSettings_->getNumberOfThreads(), nSim_);
+
+    std::vector<FFTGrid *> seed0(nBatch);
+    std::vector<FFTGrid *> seed1(nBatch);
+    std::vector<FFTGrid *> seed2(nBatch);
+    for (int b = 0; b < nBatch; b++) {
+      seed0[b] = createFFTGrid();
+      seed1[b] = createFFTGrid();
+      seed2[b] = createFFTGrid();
+      seed0[b]->createComplexGrid();
+      seed1[b]->createComplexGrid();
+      seed2[b]->createComplexGrid();
+    }
+
+    for (int firstSim = 0; firstSim < nSim_; firstSim += nBatch)
     {
-      // time(&timestart);
-
-      seed0->fillInComplexNoise(randomGen);
-      seed1->fillInComplexNoise(randomGen);
-      seed2->fillInComplexNoise(randomGen);
-
-      postCovVp     ->setAccessMode(FFTGrid::READ);
-      postCovVs     ->setAccessMode(FFTGrid::READ);
-      postCovRho    ->setAccessMode(FFTGrid::READ);
-      postCrCovVpVs ->setAccessMode(FFTGrid::READ);
-      postCrCovVpRho->setAccessMode(FFTGrid::READ);
-      postCrCovVsRho->setAccessMode(FFTGrid::READ);
-      seed0 ->setAccessMode(FFTGrid::READANDWRITE);
-      seed1 ->setAccessMode(FFTGrid::READANDWRITE);
-      seed2 ->setAccessMode(FFTGrid::READANDWRITE);
-
-      int cnxp=nxp_/2+1;
-      int cholFlag;
-      for (k = 0; k < nzp_; k++)
-        for (j = 0; j < nyp_; j++)
-          for (i = 0; i < cnxp; i++)
-          {
-            ijkPostCov[0][0] = postCovVp     ->getNextComplex();
-            ijkPostCov[1][1] = postCovVs     ->getNextComplex();
-            ijkPostCov[2][2] = postCovRho    ->getNextComplex();
-            ijkPostCov[0][1] = postCrCovVpVs ->getNextComplex();
-            ijkPostCov[0][2] = postCrCovVpRho->getNextComplex();
-            ijkPostCov[1][2] = postCrCovVsRho->getNextComplex();
-
-            ijkPostCov[1][0].re =  ijkPostCov[0][1].re;
-            ijkPostCov[1][0].im = -ijkPostCov[0][1].im;
-            ijkPostCov[2][0].re =  ijkPostCov[0][2].re;
-            ijkPostCov[2][0].im = -ijkPostCov[0][2].im;
-            ijkPostCov[2][1].re =  ijkPostCov[1][2].re;
-            ijkPostCov[2][1].im = -ijkPostCov[1][2].im;
-
-            ijkSeed[0]=seed0->getNextComplex();
-            ijkSeed[1]=seed1->getNextComplex();
-            ijkSeed[2]=seed2->getNextComplex();
-
-            cholFlag = lib_matrCholCpx(3,ijkPostCov);  // Choleskey factor of posterior covariance write over ijkPostCov
-            if(cholFlag == 0)
-            {
-              lib_matrProdCholVec(3,ijkPostCov,ijkSeed); // write over ijkSeed
-            }
-            else
-            {
-              for (l=0; l< 3;l++)
-              {
-                ijkSeed[l].re =0.0;
-                ijkSeed[l].im = 0.0;
-              }
-
-            }
-            seed0->setNextComplex(ijkSeed[0]);
-            seed1->setNextComplex(ijkSeed[1]);
-            seed2->setNextComplex(ijkSeed[2]);
-          }
+      int nInBatch = std::min(nBatch, nSim_ - firstSim);
 
-      postCovVp->endAccess();  //
-      postCovVs->endAccess();   //
-      postCovRho->endAccess();
-      postCrCovVpVs->endAccess();
-      postCrCovVpRho->endAccess();
-      postCrCovVsRho->endAccess();
-      seed0->endAccess();
-      seed1->endAccess();
-      seed2->endAccess();
+#ifdef PARALLEL
+      int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(nInBatch)
+#endif
+      for (int b = 0; b < nInBatch; b++)
+        simulateRealisation(seeds[firstSim + b], postCovChol, seismicParameters, seed0[b], seed1[b], seed2[b]);
+
+      // Kriging and storage are done in realisation order.
+      for (int b = 0; b < nInBatch; b++) {
+        if(kriging == true) {
+          double wall2=0.0, cpu2=0.0;
+          TimeKit::getTime(wall2,cpu2);
+          doPostKriging(seismicParameters, *seed0[b], *seed1[b], *seed2[b]);
+          Timings::addToTimeKrigingSim(wall2,cpu2);
+        }
 
-      // time(&timeend);
-      // printf("Simulation in FFT domain in %ld seconds \n",timeend-timestart);
-      // time(&timestart);
+        seismicParameters.AddSimulationSeed0(seed0[b]);
+        seismicParameters.AddSimulationSeed1(seed1[b]);
+        seismicParameters.AddSimulationSeed2(seed2[b]);
+      }
+    }
 
-      seed0->setAccessMode(FFTGrid::RANDOMACCESS);
-      seed0->invFFTInPlace();
+    for (int b = 0; b < nBatch; b++) {
+      delete seed0[b];
+      delete seed1[b];
+      delete seed2[b];
+    }
+    if (postCovChol != NULL)
+      delete postCovChol;
+    releasePostKriging();
+    seismicParameters.makeCovGridsHot();
+  }
+  Timings::addTimeSimulation(wall,cpu);
+  return(0);
+}
 
-      seed1->setAccessMode(FFTGrid::RANDOMACCESS);
-      seed1->invFFTInPlace();
+void
+AVOInversion::computePosteriorCovCholesky(SeismicParametersHolder & seismicParameters,
+                                          CovTensorGrid           * postCovChol) const
+{
+  // postCovChol holds the lower triangle of the Cholesky factor L of the posterior
+  // covariance for each cell, see findCholeskyFactor().
+  FFTGrid * postCovVp      = seismicParameters.GetCovVp();
+  FFTGrid * postCovVs      = seismicParameters.GetCovVs();
+  FFTGrid * postCovRho     = seismicParameters.GetCovRho();
+  FFTGrid * postCrCovVpVs  = seismicParameters.GetCrCovVpVs();
+  FFTGrid * postCrCovVpRho = seismicParameters.GetCrCovVpRho();
+  FFTGrid * postCrCovVsRho = seismicParameters.GetCrCovVsRho();
 
-      seed2->setAccessMode(FFTGrid::RANDOMACCESS);
-      seed2->invFFTInPlace();
+  assert( postCovVp->getIsTransformed() );
+  assert( postCovVs->getIsTransformed() );
+  assert( postCovRho->getIsTransformed() );
+  assert( postCrCovVpVs->getIsTransformed() );
+  assert( postCrCovVpRho->getIsTransformed() );
+  assert( postCrCovVsRho->getIsTransformed() );
 
-      if(modelAVOdynamic_->GetUseLocalNoise()==true)
-      {
-        float vp, vs, rho;
-        float vpnew, vsnew, rhonew;
-
-        for (j=0;j<ny_;j++)
-          for (i=0;i<nx_;i++)
-            for (k=0;k<nz_;k++)
-            {
-              vp  = seed0->getRealValue(i,j,k);
-              vs  = seed1->getRealValue(i,j,k);
-              rho = seed2->getRealValue(i,j,k);
-              vpnew  = float((*sigmamdnew_)(i,j)[0][0]*vp+ (*sigmamdnew_)(i,j)[0][1]*vs+(*sigmamdnew_)(i,j)[0][2]*rho);
-              vsnew  = float((*sigmamdnew_)(i,j)[1][0]*vp+ (*sigmamdnew_)(i,j)[1][1]*vs+(*sigmamdnew_)(i,j)[1][2]*rho);
-              rhonew = float((*sigmamdnew_)(i,j)[2][0]*vp+ (*sigmamdnew_)(i,j)[2][1]*vs+(*sigmamdnew_)(i,j)[2][2]*rho);
-              seed0->setRealValue(i,j,k,vpnew);
-              seed1->setRealValue(i,j,k,vsnew);
-              seed2->setRealValue(i,j,k,rhonew);
-            }
-      }
+  postCovVp     ->setAccessMode(FFTGrid::READ);
+  postCovVs     ->setAccessMode(FFTGrid::READ);
+  postCovRho    ->setAccessMode(FFTGrid::READ);
+  postCrCovVpVs ->setAccessMode(FFTGrid::READ);
+  postCrCovVpRho->setAccessMode(FFTGrid::READ);
+  postCrCovVsRho->setAccessMode(FFTGrid::READ);
 
-      seed0->add(postVp_);
-      seed0->endAccess();
-      seed1->add(postVs_);
-      seed1->endAccess();
-      seed2->add(postRho_);
-      seed2->endAccess();
-
-      if(kriging == true) {
-        double wall2=0.0, cpu2=0.0;
-        TimeKit::getTime(wall2,cpu2);
-        doPostKriging(seismicParameters, *seed0, *seed1, *seed2);
-        Timings::addToTimeKrigingSim(wall2,cpu2);
+  // The covariance grids are in memory here, so the k-slabs are independent.
+  int cnxp = nxp_/2+1;
+  int k;
+#ifdef PARALLEL
+  int n_threads  = modelSettings_->getNumberOfThreads();
+  int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(n_threads)
+#endif
+  for (k = 0; k < nzp_; k++) {
+    fftw_complex   ijkPostCovRows[3][3];
+    fftw_complex * ijkPostCov[3] = {ijkPostCovRows[0], ijkPostCovRows[1], ijkPostCovRows[2]};
+
+    for (int j = 0; j < nyp_; j++) {
+      for (int i = 0; i < cnxp; i++) {
+        ijkPostCov[0][0] = postCovVp     ->getComplexValue(i, j, k, true);
+        ijkPostCov[1][1] = postCovVs     ->getComplexValue(i, j, k, true);
+        ijkPostCov[2][2] = postCovRho    ->getComplexValue(i, j, k, true);
+        ijkPostCov[0][1] = postCrCovVpVs ->getComplexValue(i, j, k, true);
+        ijkPostCov[0][2] = postCrCovVpRho->getComplexValue(i, j, k, true);
+        ijkPostCov[1][2] = postCrCovVsRho->getComplexValue(i, j, k, true);
+
+        findCholeskyFactor(ijkPostCov, postCovChol->getCell(i, j, k));
       }
+    }
+  }
 
-      seismicParameters.AddSimulationSeed0(seed0);
-      seismicParameters.AddSimulationSeed1(seed1);
-      seismicParameters.AddSimulationSeed2(seed2);
+  postCovVp     ->endAccess();
+  postCovVs     ->endAccess();
+  postCovRho    ->endAccess();
+  postCrCovVpVs ->endAccess();
+  postCrCovVpRho->endAccess();
+  postCrCovVsRho->endAccess();
+}
 
-      // time(&timeend);
-      // printf("Back transform and write of simulation in %ld seconds \n",timeend-timestart);
+void
+AVOInversion::findCholeskyFactor(fftw_complex ** ijkPostCov,
+                                 fftw_complex  * L)
+{
+  // ijkPostCov holds the upper triangle of the posterior covariance, and is overwritten.
+  // L is the lower triangle of its Cholesky factor, ordered L00, L10, L11, L20, L21, L22.
+  // L is zero where the covariance is not positive definite.
+  ijkPostCov[1][0].re =  ijkPostCov[0][1].re;
+  ijkPostCov[1][0].im = -ijkPostCov[0][1].im;
+  ijkPostCov[2][0].re =  ijkPostCov[0][2].re;
+  ijkPostCov[2][0].im = -ijkPostCov[0][2].im;
+  ijkPostCov[2][1].re =  ijkPostCov[1][2].re;
+  ijkPostCov[2][1].im = -ijkPostCov[1][2].im;
+
+  int cholFlag = SmallMatrixCpx::Chol<3>(ijkPostCov);  // Cholesky factor of posterior covariance write over ijkPostCov
+
+  int l = 0;
+  for (int r = 0; r < 3; r++) {
+    for (int s = 0; s <= r; s++, l++) {
+      if (cholFlag != 0) {
+        L[l].re = 0.0;
+        L[l].im = 0.0;
+      }
+      else
+        L[l] = ijkPostCov[r][s];
     }
+  }
+}
 
-    delete seed0;
-    delete seed1;
-    delete seed2;
+void
+AVOInversion::simulateRealisation(unsigned long             seed,
+                                  const CovTensorGrid     * postCovChol,
+                                  SeismicParametersHolder & seismicParameters,
+                                  FFTGrid                 * seed0,
+                                  FFTGrid                 * seed1,
+                                  FFTGrid                 * seed2)
+{
+  // The shared Cholesky factor is only read, so several realisations can be generated
+  // concurrently. If there is no shared factor, it is found from the posterior
+  // covariance grids cell by cell.
+  NRLib::RandomGenerator randomGen;
+  randomGen.Initialize(seed);
+
+  seed0->fillInComplexNoise(&randomGen);
+  seed1->fillInComplexNoise(&randomGen);
+  seed2->fillInComplexNoise(&randomGen);
 
-    for (l=0;l<3;l++)
-      delete  [] ijkPostCov[l];
-    delete [] ijkPostCov;
-    delete [] ijkSeed;
+  FFTGrid * postCovVp      = seismicParameters.GetCovVp();
+  FFTGrid * postCovVs      = seismicParameters.GetCovVs();
+  FFTGrid * postCovRho     = seismicParameters.GetCovRho();
+  FFTGrid * postCrCovVpVs  = seismicParameters.GetCrCovVpVs();
+  FFTGrid * postCrCovVpRho = seismicParameters.GetCrCovVpRho();
+  FFTGrid * postCrCovVsRho = seismicParameters.GetCrCovVsRho();
 
+  if (postCovChol == NULL) {
+    postCovVp     ->setAccessMode(FFTGrid::READ);
+    postCovVs     ->setAccessMode(FFTGrid::READ);
+    postCovRho    ->setAccessMode(FFTGrid::READ);
+    postCrCovVpVs ->setAccessMode(FFTGrid::READ);
+    postCrCovVpRho->setAccessMode(FFTGrid::READ);
+    postCrCovVsRho->setAccessMode(FFTGrid::READ);
   }
-  Timings::addTimeSimulation(wall,cpu);
-  return(0);
+  seed0->setAccessMode(FFTGrid::READANDWRITE);
+  seed1->setAccessMode(FFTGrid::READANDWRITE);
+  seed2->setAccessMode(FFTGrid::READANDWRITE);
+
+  fftw_complex   ijkPostCovRows[3][3];
+  fftw_complex * ijkPostCov[3] = {ijkPostCovRows[0], ijkPostCovRows[1], ijkPostCovRows[2]};
+  fftw_complex   cellChol[6];
+  fftw_complex   ijkSeed[3];
+  fftw_complex   ijkSim[3];
+
+  int cnxp = nxp_/2+1;
+  for (int k = 0; k < nzp_; k++)
+    for (int j = 0; j < nyp_; j++)
+      for (int i = 0; i < cnxp; i++)
+      {
+        const fftw_complex * L = cellChol;
+        if (postCovChol != NULL)
+          L = postCovChol->getCell(i, j, k);
+        else {
+          ijkPostCov[0][0] = postCovVp     ->getNextComplex();
+          ijkPostCov[1][1] = postCovVs     ->getNextComplex();
+          ijkPostCov[2][2] = postCovRho    ->getNextComplex();
+          ijkPostCov[0][1] = postCrCovVpVs ->getNextComplex();
+          ijkPostCov[0][2] = postCrCovVpRho->getNextComplex();
+          ijkPostCov[1][2] = postCrCovVsRho->getNextComplex();
+          findCholeskyFactor(ijkPostCov, cellChol);
+        }
+
+        ijkSeed[0] = seed0->getNextComplex();
+        ijkSeed[1] = seed1->getNextComplex();
+        ijkSeed[2] = seed2->getNextComplex();
+
+        // ijkSim = L*ijkSeed
+        int l = 0;
+        for (int r = 0; r < 3; r++) {
+          ijkSim[r].re = 0.0;
+          ijkSim[r].im = 0.0;
+          for (int s = 0; s <= r; s++, l++) {
+            ijkSim[r].re += L[l].re * ijkSeed[s].re - L[l].im * ijkSeed[s].im;
+            ijkSim[r].im += L[l].re * ijkSeed[s].im + L[l].im * ijkSeed[s].re;
+          }
+        }
+
+        seed0->setNextComplex(ijkSim[0]);
+        seed1->setNextComplex(ijkSim[1]);
+        seed2->setNextComplex(ijkSim[2]);
+      }
+
+  if (postCovChol == NULL) {
+    postCovVp     ->endAccess();
+    postCovVs     ->endAccess();
+    postCovRho    ->endAccess();
+    postCrCovVpVs ->endAccess();
+    postCrCovVpRho->endAccess();
+    postCrCovVsRho->endAccess();
+  }
+  seed0->endAccess();
+  seed1->endAccess();
+  seed2->endAccess();
+
+  seed0->setAccessMode(FFTGrid::RANDOMACCESS);
+  seed0->invFFTInPlace();
+
+  seed1->setAccessMode(FFTGrid::RANDOMACCESS);
+  seed1->invFFTInPlace();
+
+  seed2->setAccessMode(FFTGrid::RANDOMACCESS);
+  seed2->invFFTInPlace();
+
+  if(modelAVOdynamic_->GetUseLocalNoise()==true)
+  {
+    float vp, vs, rho;
+    float vpnew, vsnew, rhonew;
+
+    for (int j=0;j<ny_;j++)
+      for (int i=0;i<nx_;i++)
+        for (int k=0;k<nz_;k++)
+        {
+          vp  = seed0->getRealValue(i,j,k);
+          vs  = seed1->getRealValue(i,j,k);
+          rho = seed2->getRealValue(i,j,k);
+          vpnew  = float((*sigmamdnew_)(i,j)[0][0]*vp+ (*sigmamdnew_)(i,j)[0][1]*vs+(*sigmamdnew_)(i,j)[0][2]*rho);
+          vsnew  = float((*sigmamdnew_)(i,j)[1][0]*vp+ (*sigmamdnew_)(i,j)[1][1]*vs+(*sigmamdnew_)(i,j)[1][2]*rho);
+          rhonew = float((*sigmamdnew_)(i,j)[2][0]*vp+ (*sigmamdnew_)(i,j)[2][1]*vs+(*sigmamdnew_)(i,j)[2][2]*rho);
+          seed0->setRealValue(i,j,k,vpnew);
+          seed1->setRealValue(i,j,k,vsnew);
+          seed2->setRealValue(i,j,k,rhonew);
+        }
+  }
+
+  seed0->add(postVp_);
+  seed0->endAccess();
+  seed1->add(postVs_);
+  seed1->endAccess();
+  seed2->add(postRho_);
+  seed2->endAccess();
 }
 
 void
@@ -1548,22 +1766,46 @@ AVOInversion::doPostKriging(SeismicParametersHolder & seismicParameters,
 
   LogKit::WriteHeader("Kriging to wells");
 
-  CovGridSeparated covGridVp     (*seismicParameters.GetCovVp()     );
-  CovGridSeparated covGridVs     (*seismicParameters.GetCovVs()     );
-  CovGridSeparated covGridRho    (*seismicParameters.GetCovRho()    );
-  CovGridSeparated covGridCrVpVs (*seismicParameters.GetCrCovVpVs() );
-  CovGridSeparated covGridCrVpRho(*seismicParameters.GetCrCovVpRho());
-  CovGridSeparated covGridCrVsRho(*seismicParameters.GetCrCovVsRho());
+  bool keepKriging = (kriging_ != NULL);
+  if (keepKriging == false)
+    setupPostKriging(seismicParameters);
 
-  KrigingData3D kd(blocked_wells_, 1); // 1 = full resolution logs
+  kriging_->KrigAll(postVp, postVs, postRho, seismicParameters, false, modelSettings_->getDebugFlag(), modelSettings_->getDoSmoothKriging());
 
-  CKrigingAdmin pKriging(*simbox_,
-                         kd.getData(), kd.getNumberOfData(),
-                         covGridVp, covGridVs, covGridRho,
-                         covGridCrVpVs, covGridCrVpRho, covGridCrVsRho,
-                         krigingParameter_);
+  if (keepKriging == false)
+    releasePostKriging();
+}
 
-  pKriging.KrigAll(postVp, postVs, postRho, seismicParameters, false, modelSettings_->getDebugFlag(), modelSettings_->getDoSmoothKriging());
+void
+AVOInversion::setupPostKriging(SeismicParametersHolder & seismicParameters)
+{
+  krigingCov_.resize(6);
+  krigingCov_[0] = new CovGridSeparated(*seismicParameters.GetCovVp()     );
+  krigingCov_[1] = new CovGridSeparated(*seismicParameters.GetCovVs()     );
+  krigingCov_[2] = new CovGridSeparated(*seismicParameters.GetCovRho()    );
+  krigingCov_[3] = new CovGridSeparated(*seismicParameters.GetCrCovVpVs() );
+  krigingCov_[4] = new CovGridSeparated(*seismicParameters.GetCrCovVpRho());
+  krigingCov_[5] = new CovGridSeparated(*seismicParameters.GetCrCovVsRho());
+
+  krigingData_ = new KrigingData3D(blocked_wells_, 1); // 1 = full resolution logs
+
+  kriging_ = new CKrigingAdmin(*simbox_,
+                               krigingData_->getData(), krigingData_->getNumberOfData(),
+                               *krigingCov_[0], *krigingCov_[1], *krigingCov_[2],
+                               *krigingCov_[3], *krigingCov_[4], *krigingCov_[5],
+                               krigingParameter_, false, modelSettings_->getNumberOfThreads());
+}
+
+void
+AVOInversion::releasePostKriging()
+{
+  delete kriging_;
+  delete krigingData_;
+  for (size_t i = 0; i < krigingCov_.size(); i++)
+    delete krigingCov_[i];
+  kriging_     = NULL;
+  krigingData_ = NULL;
+  krigingCov_.clear();
 }
 
 FFTGrid *
@@ -1716,6 +1958,7 @@ AVOInversion::computeFaciesProb(SpatialRealWellFilter             * filteredReal
   if(modelSettings->getEstimateFaciesProb())
   {
     LogKit::WriteHeader("Facies probability volumes");
+    Profiler::Region region("Facies probabilities");
 
     double wall=0.0, cpu=0.0;
     TimeKit::getTime(wall,cpu);
@@ -1773,12 +2016,9 @@ AVOInversion::computeFaciesProb(SpatialRealWellFilter             * filteredReal
 
     if (modelSettings->getFaciesProbRelative())
     {
-      meanVp2_->subtract(postVp_);
-      meanVp2_->changeSign();
-      meanVs2_->subtract(postVs_);
-      meanVs2_->changeSign();
-      meanRho2_->subtract(postRho_);
-      meanRho2_->changeSign();
+      meanVp2_ ->applyElementwise(FFTGrid::ElementwiseChain().subtract(postVp_).changeSign());
+      meanVs2_ ->applyElementwise(FFTGrid::ElementwiseChain().subtract(postVs_).changeSign());
+      meanRho2_->applyElementwise(FFTGrid::ElementwiseChain().subtract(postRho_).changeSign());
 
       std::vector<double> trend_min;
       std::vector<double> trend_max;
@@ -20,6 +20,7 @@ class Simbox;
 class RandomGen;
 class CKrigingAdmin;
 class CovGridSeparated;
+class CovTensorGrid;
 class KrigingData3D;
 class FaciesProb;
 class GridMapping;
@@ -94,6 +95,7 @@ private:
 
   int                    checkScale(void);
 
+  void                   fillK(const fftw_complex * diag, fftw_complex ** K) const;
   void                   fillkW(int k, fftw_complex* kW, std::vector<Wavelet *> seisWavelet);
   void                   fillInverseAbskWRobust(int k, fftw_complex* invkW ,Wavelet1D** seisWaveletForNorm);
   void                   fillkWNorm(int k, fftw_complex* kWNorm, Wavelet1D** wavelet);
@@ -117,6 +119,8 @@ private:
   void                   divideDataByScaleWavelet(const SeismicParametersHolder & seismicParameters);
   void                   multiplyDataByScaleWaveletAndWriteToFile(const std::string & typeName, std::string & interval_name);
   void                   doPostKriging(SeismicParametersHolder & seismicParameters, FFTGrid & postVp, FFTGrid & postVs, FFTGrid & postRho);
+  void                   setupPostKriging(SeismicParametersHolder & seismicParameters);
+  void                   releasePostKriging();
 
   void                   correctVpVsRho(ModelSettings * modelSettings);
 
@@ -130,14 +134,36 @@ private:
   void                   SetComplexVector(NRLib::ComplexVector & V,
                                           fftw_complex         * v);
 
-  void                   getNextErrorVariance(fftw_complex **& errVar,
-                                              fftw_complex   * errMult1,
-                                              fftw_complex   * errMult2,
-                                              fftw_complex   * errMult3,
-                                              int              ntheta,
-                                              float            wnc,
-                                              double        ** errThetaCov,
-                                              bool             invert_frequency) const;
+  void                   computePostMeanResidAndFFTCovSlab(int                       k,
+                                                           SeismicParametersHolder & seismicParameters,
+                                                           Wavelet1D               * diff1Operator,
+                                                           Wavelet1D               * diff3Operator,
+                                                           Wavelet1D              ** errorSmooth3,
+                                                           Wavelet1D              ** seisWaveletForNorm,
+                                                           bool                      indexedAccess);
+
+  void                   computePosteriorCovCholesky(SeismicParametersHolder & seismicParameters,
+                                                     CovTensorGrid           * postCovChol) const;
+
+  static void            findCholeskyFactor(fftw_complex ** ijkPostCov,
+                                            fftw_complex  * L);
+
+  void                   simulateRealisation(unsigned long             seed,
+                                             const CovTensorGrid     * postCovChol,
+                                             SeismicParametersHolder & seismicParameters,
+                                             FFTGrid                 * seed0,
+                                             FFTGrid                 * seed1,
+                                             FFTGrid                 * seed2);
+
+  void                   computeErrorVariance(fftw_complex      **& errVar,
+                                              const fftw_complex  & ijkErrCorr,
+                                              fftw_complex        * errMult1,
+                                              fftw_complex        * errMult2,
+                                              fftw_complex        * errMult3,
+                                              int                   ntheta,
+                                              float                 wnc,
+                                              double             ** errThetaCov,
+                                              bool                  invert_frequency) const;
 
 
   bool               fileGrid_;         // is true if is storage is on file
@@ -195,6 +221,9 @@ private:
 
   int                                        krigingParameter_;
   std::map<std::string, BlockedLogsCommon *> blocked_wells_;
+  CKrigingAdmin                            * kriging_;       // Kriging set up once for all realisations
+  KrigingData3D                            * krigingData_;
+  std::vector<CovGridSeparated *>            krigingCov_;
 
   int                scaleWarning_;
   std::string        scaleWarningText_;
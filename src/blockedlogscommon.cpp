@@ -9,6 +9,7 @@
 #include "src/multiintervalgrid.h"
 #include "src/wavelet1D.h"
 #include "src/cravatrend.h"
+#include "src/fftplancache.h"
 
 BlockedLogsCommon::BlockedLogsCommon(const NRLib::Well                * well_data,
                                      const std::vector<std::string>   & cont_logs_to_be_blocked,
@@ -2282,7 +2283,37 @@ void    BlockedLogsCommon::RemoveMissingLogValues(const NRLib::Well
 
 }
 
-void BlockedLogsCommon::FindOptimalWellLocation(std::vector<SeismicStorage *> & seismic_data,
+void BlockedLogsCommon::GetSeismicAroundWell(std::vector<SeismicStorage *>     & seismic_data,
+                                             const Simbox                      * estimation_simbox,
+                                             int                                 n_angles,
+                                             int                                 i_max_offset,
+                                             int                                 j_max_offset,
+                                             std::vector<NRLib::Grid<float> >  & seis_cube_small) const
+{
+  int i_tot_offset = 2*i_max_offset+1;
+  int j_tot_offset = 2*j_max_offset+1;
+
+  std::vector<double> seis_log(n_blocks_);
+
+  seis_cube_small.assign(n_angles, NRLib::Grid<float>(i_tot_offset, j_tot_offset, n_blocks_));
+
+  for (int j = 0 ; j < n_angles ; j++)
+  {
+    for (int k = 0; k < i_tot_offset; k++)
+    {
+      for (int l = 0; l < j_tot_offset; l++)
+      {
+        GetBlockedGrid(seismic_data[j], estimation_simbox, seis_log, k - i_max_offset, l - j_max_offset);
+        for (int m = 0; m < static_cast<int>(n_blocks_); m++)
+        {
+          seis_cube_small[j](k, l, m) = static_cast<float>(seis_log[m]);
+        }
+      }
+    }
+  }
+}
+
+void BlockedLogsCommon::FindOptimalWellLocation(const std::vector<NRLib::Grid<float> > & seis_cube_small,
                                                 const Simbox                  * estimation_simbox,
                                                 const Simbox                  & inversion_simbox,
                                                 const NRLib::Matrix           & refl_matrix,
@@ -2292,16 +2323,15 @@ void BlockedLogsCommon::FindOptimalWellLocation(std::vector<SeismicStorage *> &
                                                 int                             i_max_offset,
                                                 int                             j_max_offset,
                                                 const std::vector<Surface *>  & limits,
+                                                int                             n_threads,
                                                 int                           & i_move,
                                                 int                           & j_move,
                                                 float                         & k_move) const
 {
   int   polarity;
-  int   i,j,k,l,m;
+  int   i,j,k,l;
   int   start, length;
-  float sum;
   float shift_F;
-  float max_tot;
   float f1,f2,f3;
 
   int nx              = estimation_simbox->getnx();
@@ -2337,13 +2367,7 @@ void BlockedLogsCommon::FindOptimalWellLocation(std::vector<SeismicStorage *> &
   fftw_real    ** cor_cpp_r           = new fftw_real*[n_angles];
   fftw_complex ** cor_cpp_c           = reinterpret_cast<fftw_complex**>(cor_cpp_r);
 
-  fftw_real    ** seis_r              = new fftw_real*[n_angles];
-  fftw_complex ** seis_c              = reinterpret_cast<fftw_complex**>(seis_r);
-
   fftw_real    ** ccor_seis_cpp_r     = new fftw_real*[n_angles];
-  fftw_complex ** ccor_seis_cpp_c     = reinterpret_cast<fftw_complex**>(ccor_seis_cpp_r);
-
-  fftw_real    ** ccor_seis_cpp_Max_r = new fftw_real*[n_angles];
 
   for (i=0; i < n_angles; i++) {
     max_value_max[i] = 0.0f;
@@ -2369,11 +2393,9 @@ void BlockedLogsCommon::FindOptimalWellLocation(std::vector<SeismicStorage *> &
   FindContinuousPartOfData(has_data, n_layers_, start, length);
 
   for ( j=0; j<n_angles; j++ ) {
-    seis_r[j]              = new fftw_real[rnzp];
     cpp_r[j]               = new fftw_real[rnzp];
     cor_cpp_r[j]           = new fftw_real[rnzp];
     ccor_seis_cpp_r[j]     = new fftw_real[rnzp];
-    ccor_seis_cpp_Max_r[j] = new fftw_real[rnzp];
   }
 
   // Calculate reflection coefficients
@@ -2386,32 +2408,18 @@ void BlockedLogsCommon::FindOptimalWellLocation(std::vector<SeismicStorage *> &
     refl_coefficients[1] = static_cast<float>(refl_matrix(j,1));
     refl_coefficients[2] = static_cast<float>(refl_matrix(j,2));
     FillInCpp(refl_coefficients,start,length,cpp_r[j],nzp);
-    Utils::fft(cpp_r[j],cpp_c[j],nzp);
+    FFTPlanCache::RealToComplex1D(cpp_r[j],cpp_c[j],nzp);
     EstimateCor(cpp_c[j],cpp_c[j],cor_cpp_c[j],cnzp);
-    Utils::fftInv(cor_cpp_c[j],cor_cpp_r[j],nzp);
+    FFTPlanCache::ComplexToReal1D(cor_cpp_c[j],cor_cpp_r[j],nzp);
+    for (i=0; i<nzp; i++)
+      cor_cpp_r[j][i] /= nzp;
     delete [] refl_coefficients;
   }
 
-  std::vector<NRLib::Grid<float> > seis_cube_small(n_angles,NRLib::Grid<float> (i_tot_offset,j_tot_offset,n_blocks_));
-
-  for (j = 0 ; j < n_angles ; j++)
-  {
-    //seismic_data[j]->setAccessMode(FFTGrid::RANDOMACCESS);
-    for (k = 0; k < i_tot_offset; k++)
-    {
-      for (l = 0; l < j_tot_offset; l++)
-      {
-        GetBlockedGrid(seismic_data[j], estimation_simbox, seis_log, i_offset[k], j_offset[l]);
-        for (m = 0; m < static_cast<int>(n_blocks_); m++)
-        {
-          seis_cube_small[j](k, l, m) = static_cast<float>(seis_log[m]);
-        }
-      }
-    }
-    //seis_cube[j]->endAccess();
-  }
-
-  // Loop through possible well locations
+  // Find the candidate locations, in the order they are searched.
+  std::vector<int>   cand_k;
+  std::vector<int>   cand_l;
+  std::vector<float> cand_dz;
   for (k=0; k<i_tot_offset; k++) {
     int i_index = i_pos_[0]+i_offset[k];
     if (i_index<0 || i_index>nx-1) //Check if position is within seismic range
@@ -2427,78 +2435,125 @@ void BlockedLogsCommon::FindOptimalWellLocation(std::vector<SeismicStorage *> &
         if (inversion_simbox.isInside(xp, yp) == false)
           continue;
       }
-
-      for (j = 0; j < n_angles; j++) {
-
-        for (m=0; m<static_cast<int>(n_blocks_); m++)
-          seis_log[m] = seis_cube_small[j](k,l,m);
-
-        GetVerticalTrend(seis_log, seis_data);
-        FillInSeismic(seis_data,start,length,seis_r[j],nzp);
-
-        Utils::fft(seis_r[j],seis_c[j],nzp);
-        EstimateCor(seis_c[j],cpp_c[j],ccor_seis_cpp_c[j],cnzp);
-        Utils::fftInv(ccor_seis_cpp_c[j],ccor_seis_cpp_r[j],nzp);
-      }
-
-      // if the sum from -max_shift to max_shift ms is
-      // positive then polarity is positive
-      dz = static_cast<float>(estimation_simbox->getRelThick(i_index,j_index)*estimation_simbox->getdz());
-      sum = 0;
-      for ( j=0; j<n_angles; j++ ) {
-        if (angle_weight[j] > 0) {
-          for (i=0;i<ceil(max_shift/dz);i++)//zero included
-            sum+=ccor_seis_cpp_r[j][i];
-          for (i=0;i<floor(max_shift/dz);i++)
-            sum+=ccor_seis_cpp_r[j][nzp-i-1];
+      cand_k.push_back(k);
+      cand_l.push_back(l);
+      cand_dz.push_back(static_cast<float>(estimation_simbox->getRelThick(i_index,j_index)*estimation_simbox->getdz()));
+    }
+  }
+  int n_cand = static_cast<int>(cand_k.size());
+
+  std::vector<float>              cand_max_tot(n_cand);
+  std::vector<int>                cand_polarity(n_cand);
+  std::vector<std::vector<int> >  cand_shift_I(n_cand, std::vector<int>(n_angles, 0));
+  std::vector<std::vector<float> > cand_max_value(n_cand, std::vector<float>(n_angles, 0.0f));
+
+  // Correlate the seismic at each candidate location with the reflection coefficients.
+  // The traces of a chunk of candidates are transformed together, with one multi-trace
+  // FFT call in each direction, and the chunks are spread over the threads.
+  const int chunk_size = 16;
+  int       n_chunks   = (n_cand + chunk_size - 1)/chunk_size;
+  int       ch;
+#ifdef PARALLEL
+#pragma omp parallel num_threads(n_threads) if(n_threads > 1 && n_chunks > 1)
+#endif
+  {
+    std::vector<double>    seis_log_c(n_blocks_);
+    std::vector<double>    seis_data_c(n_layers_);
+    std::vector<fftw_real> seis_c_r(chunk_size*n_angles*rnzp);
+    std::vector<fftw_real> ccor_c_r(chunk_size*n_angles*rnzp);
+
+#ifdef PARALLEL
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (ch = 0; ch < n_chunks; ch++) {
+      int first = ch*chunk_size;
+      int n     = std::min(chunk_size, n_cand - first);
+      CorrelateWithReflections(seis_cube_small, &cand_k[first], &cand_l[first], n, cpp_c, n_angles, start, length, nzp,
+                               seis_log_c, seis_data_c, &seis_c_r[0], &ccor_c_r[0]);
+
+      for (int c = first; c < first + n; c++) {
+        const fftw_real * ccor_c = &ccor_c_r[(c - first)*n_angles*rnzp];
+
+        // if the sum from -max_shift to max_shift ms is
+        // positive then polarity is positive
+        float dz_c  = cand_dz[c];
+        float sum_c = 0;
+        for (int a=0; a<n_angles; a++ ) {
+          const fftw_real * ccor = ccor_c + a*rnzp;
+          if (angle_weight[a] > 0) {
+            for (int i1=0;i1<ceil(max_shift/dz_c);i1++)//zero included
+              sum_c+=ccor[i1];
+            for (int i1=0;i1<floor(max_shift/dz_c);i1++)
+              sum_c+=ccor[nzp-i1-1];
+          }
         }
-      }
-      polarity=-1;
-      if (sum > 0)
-        polarity=1;
-
-      // Find maximum correlation and corresponding shift for each angle
-      max_tot = 0.0;
-      for ( j=0; j<n_angles; j++ ) {
-        if (angle_weight[j]>0) {
-          max_value[j] = 0.0f;
-          shift_I[j]=0;
-          for (i=0;i<ceil(max_shift/dz);i++) {
-            if (ccor_seis_cpp_r[j][i]*polarity > max_value[j]) {
-              max_value[j] = ccor_seis_cpp_r[j][i]*polarity;
-              shift_I[j] = i;
+        int polarity_c=-1;
+        if (sum_c > 0)
+          polarity_c=1;
+
+        // Find maximum correlation and corresponding shift for each angle
+        float max_tot_c = 0.0;
+        for (int a=0; a<n_angles; a++ ) {
+          const fftw_real * ccor = ccor_c + a*rnzp;
+          if (angle_weight[a]>0) {
+            float & max_value_c = cand_max_value[c][a];
+            int   & shift_I_c   = cand_shift_I[c][a];
+            for (int i1=0;i1<ceil(max_shift/dz_c);i1++) {
+              if (ccor[i1]*polarity_c > max_value_c) {
+                max_value_c = ccor[i1]*polarity_c;
+                shift_I_c = i1;
+              }
             }
-          }
-          for (i=0;i<floor(max_shift/dz);i++) {
-            if (ccor_seis_cpp_r[j][nzp-1-i]*polarity > max_value[j]) {
-              max_value[j] = ccor_seis_cpp_r[j][nzp-1-i]*polarity;
-              shift_I[j] = -1-i;
+            for (int i1=0;i1<floor(max_shift/dz_c);i1++) {
+              if (ccor[nzp-1-i1]*polarity_c > max_value_c) {
+                max_value_c = ccor[nzp-1-i1]*polarity_c;
+                shift_I_c = -1-i1;
+              }
             }
+            max_tot_c += angle_weight[a]*max_value_c; //Find weighted total maximum correlation
           }
-          max_tot += angle_weight[j]*max_value[j]; //Find weighted total maximum correlation
         }
+        cand_polarity[c] = polarity_c;
+        cand_max_tot[c]  = max_tot_c;
       }
+    }
+  }
 
-      if (max_tot > max_value_tot) {
-        max_value_tot = max_tot;
-        polarityMax = polarity;
-        i_move       = i_offset[k];
-        j_move       = j_offset[l];
-        for (m=0; m<n_angles; m++) {
-          shift_I_max[m]   = shift_I[m];
-          max_value_max[m] = max_value[m];
-          for (i=0;i<rnzp;i++)
-            ccor_seis_cpp_Max_r[m][i] = ccor_seis_cpp_r[m][i];
-        }
-      }
+  // Pick the best location in search order, so that ties are resolved as in a serial search.
+  int best = -1;
+  for (int c = 0; c < n_cand; c++) {
+    dz = cand_dz[c];
+    if (cand_max_tot[c] > max_value_tot) {
+      max_value_tot = cand_max_tot[c];
+      polarityMax   = cand_polarity[c];
+      i_move        = i_offset[cand_k[c]];
+      j_move        = j_offset[cand_l[c]];
+      best          = c;
+    }
+  }
+
+  for (i=0; i<n_angles; i++) {
+    for (j=0;j<rnzp;j++)
+      ccor_seis_cpp_r[i][j] = 0.0;
+  }
+  if (best >= 0) {
+    for (i=0; i<n_angles; i++) {
+      shift_I_max[i]   = cand_shift_I[best][i];
+      max_value_max[i] = cand_max_value[best][i];
+    }
+    std::vector<fftw_real> seis_best_r(n_angles*rnzp);
+    std::vector<fftw_real> ccor_best_r(n_angles*rnzp);
+    CorrelateWithReflections(seis_cube_small, &cand_k[best], &cand_l[best], 1, cpp_c, n_angles, start, length, nzp,
+                             seis_log, seis_data, &seis_best_r[0], &ccor_best_r[0]);
+    for (i=0; i<n_angles; i++) {
+      for (j=0;j<rnzp;j++)
+        ccor_seis_cpp_r[i][j] = ccor_best_r[i*rnzp + j];
     }
   }
 
   for (i=0; i<n_angles; i++) {
     shift_I[i] = shift_I_max[i];
     max_value[i] = max_value_max[i];
-    for (j=0;j<rnzp;j++)
-      ccor_seis_cpp_r[i][j] = ccor_seis_cpp_Max_r[i][j];
   }
   polarity = polarityMax;
 
@@ -2549,21 +2604,59 @@ void BlockedLogsCommon::FindOptimalWellLocation(std::vector<SeismicStorage *> &
   k_move = shift;
 
   for ( j=0; j<n_angles; j++ ) {
-    delete [] ccor_seis_cpp_Max_r[j];
     delete [] ccor_seis_cpp_r[j];
     delete [] cor_cpp_r[j];
-    delete [] seis_r[j];
     delete [] cpp_r[j];
   }
 
 
-  delete [] ccor_seis_cpp_Max_r;
   delete [] ccor_seis_cpp_r;
   delete [] cor_cpp_r;
-  delete [] seis_r;
   delete [] cpp_r;
 }
 
+void BlockedLogsCommon::CorrelateWithReflections(const std::vector<NRLib::Grid<float> > & seis_cube_small,
+                                                 const int                              * k,
+                                                 const int                              * l,
+                                                 int                                      n_cand,
+                                                 fftw_complex                          ** cpp_c,
+                                                 int                                      n_angles,
+                                                 int                                      start,
+                                                 int                                      length,
+                                                 int                                      nzp,
+                                                 std::vector<double>                    & seis_log,
+                                                 std::vector<double>                    & seis_data,
+                                                 fftw_real                              * seis_r,
+                                                 fftw_real                              * ccor_seis_cpp_r) const
+{
+  int            cnzp     = nzp/2+1;
+  int            rnzp     = 2*cnzp;
+  int            n_traces = n_cand*n_angles;
+  fftw_complex * seis_c   = reinterpret_cast<fftw_complex*>(seis_r);
+  fftw_complex * ccor_c   = reinterpret_cast<fftw_complex*>(ccor_seis_cpp_r);
+
+  for (int c = 0; c < n_cand; c++) {
+    for (int j = 0; j < n_angles; j++) {
+      for (int m=0; m<static_cast<int>(n_blocks_); m++)
+        seis_log[m] = seis_cube_small[j](k[c],l[c],m);
+
+      GetVerticalTrend(seis_log, seis_data);
+      FillInSeismic(seis_data,start,length,seis_r + (c*n_angles + j)*rnzp,nzp);
+    }
+  }
+
+  FFTPlanCache::RealToComplex1DMany(seis_r,nzp,n_traces);
+  for (int t = 0; t < n_traces; t++)
+    EstimateCor(seis_c + t*cnzp,cpp_c[t % n_angles],ccor_c + t*cnzp,cnzp);
+  FFTPlanCache::ComplexToReal1DMany(ccor_c,nzp,n_traces);
+
+  for (int t = 0; t < n_traces; t++) {
+    fftw_real * ccor_r = ccor_seis_cpp_r + t*rnzp;
+    for (int i=0; i<nzp; i++)
+      ccor_r[i] /= nzp;
+  }
+}
+
 void BlockedLogsCommon::GetVerticalTrendLimited(const std::vector<double>          & log,
                                                 std::vector<double>                & trend,
                                                 const std::vector<Surface *>       & limits) const{
@@ -228,7 +228,17 @@ public:
 
   // OTHER FUNCTIONS -----------------------------------
 
-  void                                   FindOptimalWellLocation(std::vector<SeismicStorage *> & seismic_data,
+  // Seismic traces around the well, for offsets up to i_max_offset and j_max_offset. Reading
+  // the seismic is not thread safe, so this is done before FindOptimalWellLocation.
+  void                                   GetSeismicAroundWell(std::vector<SeismicStorage *>     & seismic_data,
+                                                              const Simbox                      * estimation_simbox,
+                                                              int                                 n_angles,
+                                                              int                                 i_max_offset,
+                                                              int                                 j_max_offset,
+                                                              std::vector<NRLib::Grid<float> >  & seis_cube_small) const;
+
+  // Only reads seis_cube_small and the blocked logs, so several wells may be searched concurrently.
+  void                                   FindOptimalWellLocation(const std::vector<NRLib::Grid<float> > & seis_cube_small,
                                                                  const Simbox                  * estimation_simbox,
                                                                  const Simbox                  & inversion_simbox,
                                                                  const NRLib::Matrix           & refl_coef,
@@ -238,10 +248,27 @@ public:
                                                                  int                             i_max_offset,
                                                                  int                             j_max_offset,
                                                                  const std::vector<Surface *>  & limits,
+                                                                 int                             n_threads,
                                                                  int                           & i_move,
                                                                  int                           & j_move,
                                                                  float                         & k_move) const;
 
+  // Cross correlation of the seismic at offsets (k[c],l[c]) with the reflection coefficients, for each
+  // candidate c and angle. All n_cand*n_angles traces go through one multi-trace FFT in each direction.
+  void                                   CorrelateWithReflections(const std::vector<NRLib::Grid<float> > & seis_cube_small,
+                                                                  const int                              * k,
+                                                                  const int                              * l,
+                                                                  int                                      n_cand,
+                                                                  fftw_complex                          ** cpp_c,
+                                                                  int                                      n_angles,
+                                                                  int                                      start,
+                                                                  int                                      length,
+                                                                  int                                      nzp,
+                                                                  std::vector<double>                    & seis_log,
+                                                                  std::vector<double>                    & seis_data,
+                                                                  fftw_real                              * seis_r,
+                                                                  fftw_real                              * ccor_seis_cpp_r) const;
+
   void                                   EstimateCor(fftw_complex * var1_c,
                                                      fftw_complex * var2_c,
                                                      fftw_complex * ccor_1_2_c,
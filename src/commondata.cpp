@@ -5,9 +5,13 @@
 #include <math.h>
 #define _USE_MATH_DEFINES
 
+#include <map>
+
 #include "src/commondata.h"
 #include "src/fftgrid.h"
 #include "src/fftfilegrid.h"
+#include "src/fftplancache.h"
+#include "src/profiler.h"
 #include "src/wavelet.h"
 #include "src/wavelet1D.h"
 #include "src/wavelet3D.h"
@@ -15,10 +19,15 @@
 #include "nrlib/segy/segy.hpp"
 #include "nrlib/segy/segytrace.hpp"
 #include "rplib/distributionsrock.h"
+#include "rplib/forwardmodeltable.h"
 
 #include "lib/timekit.hpp"
 #include "src/timings.h"
 
+#ifdef PARALLEL
+#include <omp.h>
+#endif
+
 CommonData::CommonData(ModelSettings * model_settings,
                        InputFiles    * input_files):
   outer_temp_simbox_(false),
@@ -4854,16 +4863,17 @@ bool  CommonData::OptimizeWellLocations(ModelSettings
   std::vector<float> angle_weight(n_angles);
   std::string buffer;
 
+  // Find the wells to move and their angle weights.
+  std::vector<int>                 move_wells;
+  std::vector<std::vector<float> > move_weights;
   for (int w = 0 ; w < static_cast<int>(n_wells) ; w++) {
     if (wells[w]->IsDeviated())
       continue;
     std::string well_name = wells[w]->GetWellName();
-    std::map<std::string, BlockedLogsCommon * >::iterator it = mapped_blocked_logs.find(well_name);
-    if (it == mapped_blocked_logs.end()) {
+    if (mapped_blocked_logs.find(well_name) == mapped_blocked_logs.end()) {
       err_text += "Blocked log not found for well  " + wells[w]->GetWellName() + "\n";
       break;
     }
-    BlockedLogsCommon * bl = it->second;
     n_move_angles = model_settings->getNumberOfWellAngles(w);
 
     if ( n_move_angles==0 )
@@ -4889,40 +4899,86 @@ bool  CommonData::OptimizeWellLocations(ModelSettings
     if ( sum == 0 )
       continue;
 
-    i_max_offset = static_cast<int>(std::ceil(max_offset/dx));
-    j_max_offset = static_cast<int>(std::ceil(max_offset/dy));
-
-    bl->FindOptimalWellLocation(seismic_data[0], estimation_simbox, inversion_simbox, reflection_matrix[0], n_angles,angle_weight,
-                                max_shift,i_max_offset,j_max_offset, well_move_interval,i_move,j_move,k_move);
-
-    delta_X = i_move*dx*cos(angle) - j_move*dy*sin(angle);
-    delta_Y = i_move*dx*sin(angle) + j_move*dy*cos(angle);
-    MoveWell(*(wells[w]), estimation_simbox,delta_X,delta_Y,k_move);
-    // delete old blocked well and create new
-    bool is_inside = true;
-    delete bl;
-    mapped_blocked_logs.erase(it);
-    mapped_blocked_logs.insert(std::pair<std::string, BlockedLogsCommon *>(well_name, new BlockedLogsCommon(wells[w], continuous_logs_to_be_blocked_, discrete_logs_to_be_blocked_,
-                                                                                                            estimation_simbox, model_settings->getRunFromPanel(), false, is_inside, err_text) ) );
-    if (is_inside == false) {
-      err_text += "The well " + well_name + " does not pass through the inversion area after optimization of the well location.\n";
-      TaskList::addTask("Well "+ well_name +" does not pass through the inversion area after optimization of the well location. Either remove the well or expand the area.\n");
-      return false;
-    }
-    std::stringstream entry;
-      entry
-        << std::fixed
-        << std::left     << "  "
-        << std::setw(14) << wells[w]->GetWellName() << " "
-        << std::right
-        << std::setprecision(2)
-        << std::setw(11) << k_move  << " "
-        << std::setw(12) << i_move  << " "
-        << std::setw(11) << delta_X << " "
-        << std::setw(8)  << j_move  << " "
-        << std::setw(11) << delta_Y << " "
-        << "\n";
-    buffer += entry.str();
+    move_wells.push_back(w);
+    move_weights.push_back(angle_weight);
+  }
+
+  i_max_offset = static_cast<int>(std::ceil(max_offset/dx));
+  j_max_offset = static_cast<int>(std::ceil(max_offset/dy));
+
+  //
+  // The wells are handled in groups of one well per thread. The seismic around each well in a
+  // group is read first, as seismic access is not thread safe. The wells of the group are then
+  // searched concurrently, and finally moved and reblocked in their original order.
+  //
+  int n_threads    = model_settings->getNumberOfThreads();
+  int n_move_wells = static_cast<int>(move_wells.size());
+
+  for (int first = 0 ; first < n_move_wells ; first += n_threads) {
+    int n_group = std::min(n_threads, n_move_wells - first);
+
+    std::vector<std::vector<NRLib::Grid<float> > > seis_cubes(n_group);
+    for (int g = 0 ; g < n_group ; g++) {
+      BlockedLogsCommon * bl = mapped_blocked_logs.find(wells[move_wells[first + g]]->GetWellName())->second;
+      bl->GetSeismicAroundWell(seismic_data[0], estimation_simbox, n_angles, i_max_offset, j_max_offset, seis_cubes[g]);
+    }
+
+    // With a single well in the group, its offsets are searched in parallel instead.
+    int n_offset_threads = (n_group > 1 ? 1 : n_threads);
+
+    std::vector<int>   i_moves(n_group, 0);
+    std::vector<int>   j_moves(n_group, 0);
+    std::vector<float> k_moves(n_group, 0.0f);
+    int g;
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_group) if(n_group > 1)
+#endif
+    for (g = 0 ; g < n_group ; g++) {
+      const BlockedLogsCommon * bl = mapped_blocked_logs.find(wells[move_wells[first + g]]->GetWellName())->second;
+      bl->FindOptimalWellLocation(seis_cubes[g], estimation_simbox, inversion_simbox, reflection_matrix[0], n_angles, move_weights[first + g],
+                                  max_shift,i_max_offset,j_max_offset, well_move_interval, n_offset_threads,
+                                  i_moves[g],j_moves[g],k_moves[g]);
+    }
+
+    for (g = 0 ; g < n_group ; g++) {
+      int         w         = move_wells[first + g];
+      std::string well_name = wells[w]->GetWellName();
+      std::map<std::string, BlockedLogsCommon * >::iterator it = mapped_blocked_logs.find(well_name);
+      BlockedLogsCommon * bl = it->second;
+
+      i_move = i_moves[g];
+      j_move = j_moves[g];
+      k_move = k_moves[g];
+
+      delta_X = i_move*dx*cos(angle) - j_move*dy*sin(angle);
+      delta_Y = i_move*dx*sin(angle) + j_move*dy*cos(angle);
+      MoveWell(*(wells[w]), estimation_simbox,delta_X,delta_Y,k_move);
+      // delete old blocked well and create new
+      bool is_inside = true;
+      delete bl;
+      mapped_blocked_logs.erase(it);
+      mapped_blocked_logs.insert(std::pair<std::string, BlockedLogsCommon *>(well_name, new BlockedLogsCommon(wells[w], continuous_logs_to_be_blocked_, discrete_logs_to_be_blocked_,
+                                                                                                              estimation_simbox, model_settings->getRunFromPanel(), false, is_inside, err_text) ) );
+      if (is_inside == false) {
+        err_text += "The well " + well_name + " does not pass through the inversion area after optimization of the well location.\n";
+        TaskList::addTask("Well "+ well_name +" does not pass through the inversion area after optimization of the well location. Either remove the well or expand the area.\n");
+        return false;
+      }
+      std::stringstream entry;
+        entry
+          << std::fixed
+          << std::left     << "  "
+          << std::setw(14) << wells[w]->GetWellName() << " "
+          << std::right
+          << std::setprecision(2)
+          << std::setw(11) << k_move  << " "
+          << std::setw(12) << i_move  << " "
+          << std::setw(11) << delta_X << " "
+          << std::setw(8)  << j_move  << " "
+          << std::setw(11) << delta_Y << " "
+          << "\n";
+      buffer += entry.str();
+    }
   }
 
   LogKit::LogFormatted(LogKit::Low,"\n");
@@ -5278,6 +5334,10 @@ bool CommonData::SetupRockPhysics(const ModelSettings
 
   (void) multiple_interval_grid;
 
+  ForwardModelTable::SetUseTables(model_settings->getUseForwardModelTables());
+  if (model_settings->getUseForwardModelTables() == true)
+    LogKit::LogFormatted(LogKit::Low, "\nServing rock physics forward models from interpolation tables where available.\n");
+
   std::string err_text = "";
   int n_intervals = multiple_interval_grid->GetNIntervals();
 
@@ -5429,7 +5489,7 @@ bool CommonData::SetupRockPhysics(const ModelSettings
               std::vector<DistributionWithTrend *> reservoir_variable(0);
               if (n_vintages > 0)
                 reservoir_variable = res_var_vintage[t];
-              rock[t]->CompleteTopLevelObject(reservoir_variable, tmp_err_txt);
+              rock[t]->CompleteTopLevelObject(reservoir_variable, model_settings->getNumberOfThreads(), tmp_err_txt);
 
               std::vector<bool> has_trends = rock[t]->HasTrend();
               bool              has_trend = false;
@@ -6355,7 +6415,12 @@ CommonData::ReadSegyFile(const std::string                 & file_name,
                  missing_traces_padding,
                  dead_traces_simbox,
                  dead_traces_map,
-                 grid_type);
+                 grid_type,
+                 false, //scale
+                 true,  //is_segy
+                 false, //is_storm
+                 false, //is_seismic
+                 model_settings->getNumberOfThreads());
       if (stormgrid_tmp != NULL)
        delete stormgrid_tmp;
       if (fft_grid_tmp != NULL)
@@ -6463,8 +6528,11 @@ void CommonData::FillInData(NRLib::Grid<float>  * grid_new,
                             bool                  scale,
                             bool                  is_segy,
                             bool                  is_storm,
-                            bool                  is_seismic) const
+                            bool                  is_seismic,
+                            int                   n_threads) const
 {
+  Profiler::Region region("Resampling");
+
   //Resample to either a NRLib::Grid or a FFTGrid.
   //The one resampled to needs to be defined outside this function, and the other needs to be sent in as an empty grid.
   float res_fac = 10.0; //Degree of refinement, must be integer.
@@ -6534,19 +6602,41 @@ void CommonData::FillInData(NRLib::Grid<float>  * grid_new,
   int mt = static_cast<int>(res_fac)*nt;           // Use four times the sampling density for the fine-meshed data
 
   //
-  // Create FFT plans
+  // Create FFT plans. The plans are shared between the threads below.
   //
-  rfftwnd_plan fftplan1 = rfftwnd_create_plan(1, &nt, FFTW_REAL_TO_COMPLEX, FFTW_ESTIMATE | FFTW_IN_PLACE);
-  rfftwnd_plan fftplan2 = rfftwnd_create_plan(1, &mt, FFTW_COMPLEX_TO_REAL, FFTW_ESTIMATE | FFTW_IN_PLACE);
+  rfftwnd_plan fftplan1 = rfftwnd_create_plan(1, &nt, FFTW_REAL_TO_COMPLEX, FFTW_ESTIMATE | FFTW_IN_PLACE | FFTW_THREADSAFE);
+  rfftwnd_plan fftplan2 = rfftwnd_create_plan(1, &mt, FFTW_COMPLEX_TO_REAL, FFTW_ESTIMATE | FFTW_IN_PLACE | FFTW_THREADSAFE);
+
+  // The guard zone smoothing length is given in ms, and is scaled to the data unit once.
+  // Before the traces were resampled in parallel, the scaling was repeated for every
+  // trace. For sgri input (scalevert = 0.001) only the first trace was then smoothed
+  // over the full guard zone, and the rest were hardly smoothed at all. Other input
+  // has scalevert = 1, and is not affected.
+  smooth_length *= scalevert;
 
   //
   // Do resampling
   //
-  missing_traces_simbox  = 0; // Part of simbox is outside seismic data
-  missing_traces_padding = 0; // Part of padding is outside seismic data
-  dead_traces_simbox     = 0; // Simbox is inside seismic data but trace is missing
-
+  int n_missing_simbox  = 0; // Part of simbox is outside seismic data
+  int n_missing_padding = 0; // Part of padding is outside seismic data
+  int n_dead_simbox     = 0; // Simbox is inside seismic data but trace is missing
+  int n_traces_done     = 0;
+  bool stop             = false;
+
+  // Traces are independent, so rows are resampled in parallel when the
+  // target grid can be accessed by index. For other grid types than DATA
+  // the loop is stopped at the first missing trace, which is kept serial.
+  bool run_parallel = n_threads > 1 && grid_type == DATA && (is_nrlib_grid || !fft_grid_new->isFile());
+  if (!run_parallel)
+    n_threads = 1;
+
+#ifdef PARALLEL
+  int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(n_threads) firstprivate(n_samples, dz_data, dz_min) reduction(+:n_missing_simbox, n_missing_padding, n_dead_simbox)
+#endif
   for (int j = 0; j < nyp; j++) {
+    if (stop)
+      continue;
     for (int i = 0; i < rnxp; i++) {
       int refi = GetFillNumber(i, nx, nxp); // Find index (special treatment for padding)
       int refj = GetFillNumber(j, ny, nyp); // Find index (special treatment for padding)
@@ -6663,7 +6753,6 @@ void CommonData::FillInData(NRLib::Grid<float>  * grid_new,
 
           std::vector<float> grid_trace(nzp);
 
-          smooth_length*=scalevert;
           if (grid_type == DATA) {
             SmoothTraceInGuardZone(data_trace,
                                    dz_data,
@@ -6744,7 +6833,7 @@ void CommonData::FillInData(NRLib::Grid<float>  * grid_new,
               SetTrace(0.0f, fft_grid_new, i, j);
           }
 
-          dead_traces_simbox++;
+          n_dead_simbox++;
           (*dead_traces_map)(i,j) = true;
         }
       }
@@ -6755,24 +6844,35 @@ void CommonData::FillInData(NRLib::Grid<float>  * grid_new,
           SetTrace(0.0f, fft_grid_new, i, j);
 
         if (i < nx && j < ny)
-          missing_traces_simbox++;
+          n_missing_simbox++;
         else
-          missing_traces_padding++; //Won't happen with NRLib::Grid
+          n_missing_padding++; //Won't happen with NRLib::Grid
       }
 
-      if (rnxp*j + i + 1 >= static_cast<int>(nextMonitor)) {
+      if (grid_type != DATA && n_missing_simbox > 0) {
+        stop = true; //Breaking double loop.
+        break;
+      }
+    }
+
+#ifdef PARALLEL
+#pragma omp critical(fill_in_data_monitor)
+#endif
+    {
+      n_traces_done += rnxp;
+      while (n_traces_done >= static_cast<int>(nextMonitor) && nextMonitor <= static_cast<float>(nyp*rnxp)) {
         nextMonitor += monitorSize;
         printf("^");
-        fflush(stdout);
-      }
-      if (grid_type != DATA && missing_traces_simbox > 0) {
-        i = rnxp-1; //Breaking double loop.
-        j = nyp-1;
       }
+      fflush(stdout);
     }
   }
   LogKit::LogFormatted(LogKit::Low,"\n");
 
+  missing_traces_simbox  = n_missing_simbox;
+  missing_traces_padding = n_missing_padding;
+  dead_traces_simbox     = n_dead_simbox;
+
   fftwnd_destroy_plan(fftplan1);
   fftwnd_destroy_plan(fftplan2);
 }
@@ -7173,7 +7273,9 @@ CommonData::ReadStormFile(const std::string                 & file_name,
                    grid_type,
                    scale,
                    false, //is_segy
-                   true); //is_storm
+                   true,  //is_storm
+                   false, //is_seismic
+                   model_settings->getNumberOfThreads());
 
         if (segy_tmp != NULL)
          delete segy_tmp;
@@ -8539,6 +8641,7 @@ bool CommonData::SetupPriorCorrelation(const ModelSettings
                                              prior_facies_[i],
                                              trend_cubes[i],
                                              prior_param_cov[i],
+                                             model_settings->getNumberOfThreads(),
                                              err_text);
         }
 
@@ -9031,6 +9134,7 @@ void  CommonData::CalculateCovarianceFromRockPhysics(const std::vector<Distribut
                                                      const std::vector<float>                         & probability,
                                                      const CravaTrend                                 & trend_cubes,
                                                      NRLib::Matrix                                    & param_cov,
+                                                     int                                                n_threads,
                                                      std::string                                      & err_txt) const{
 
   LogKit::LogFormatted(LogKit::Low,"\nGenerating covariances from rock physics\n");
@@ -9058,7 +9162,16 @@ void  CommonData::CalculateCovarianceFromRockPhysics(const std::vector<Distribut
     const int ny = trend_cube_size[1];
     const int nz = trend_cube_size[2];
 
-    int modulus = 100;
+    // Sample the trend cubes on a regular sub-grid, one cell in every
+    // sample_step_xy x sample_step_xy x sample_step_z block (about one cell in 100).
+    const int sample_step_xy = 5;
+    const int sample_step_z  = 4;
+
+    // Many cells share the same trend position (e.g. when a trend only
+    // varies with depth), so the number of sampled cells is counted per
+    // distinct position, and the covariance is evaluated once per position.
+    typedef std::map<std::pair<double, double>, int> Position_Count_Type;
+    Position_Count_Type position_count;
 
     float monitorSize = std::max(1.0f, static_cast<float>(nz)*0.02f);
     float nextMonitor = monitorSize;
@@ -9067,33 +9180,14 @@ void  CommonData::CalculateCovarianceFromRockPhysics(const std::vector<Distribut
       << "\n  |    |    |    |    |    |    |    |    |    |    |  "
       << "\n  ^";
 
-
-    // Local storage for summed combined variances
-    NRLib::Grid2D<double> sumVariance(3,3,0);
-
     int n_samples = 0;
 
     for (int k = 0; k < nz; k++) {
-      for (int j = 0; j < ny; j++) {
-        for (int i = 0; i < nx; i++) {
-
-          if ( ( (i+1)*(j+1)*(k+1) ) % modulus == 0) {
-
+      if (k % sample_step_z == 0) {
+        for (int j = 0; j < ny; j += sample_step_xy) {
+          for (int i = 0; i < nx; i += sample_step_xy) {
             std::vector<double> trend_position = trend_cubes.GetTrendPosition(i,j,k);
-
-            NRLib::Grid2D<double> sigma_sum(3,3,0);
-
-            CalculateCovarianceInTrendPosition(rock_distribution,
-                                               probability,
-                                               trend_position,
-                                               sigma_sum);
-
-
-            for (size_t a=0; a<3; a++) {
-              for (size_t b=0; b<3; b++)
-                sumVariance(a,b) += sigma_sum(a,b);
-            }
-
+            position_count[std::make_pair(trend_position[0], trend_position[1])]++;
             n_samples++;
           }
         }
@@ -9107,6 +9201,45 @@ void  CommonData::CalculateCovarianceFromRockPhysics(const std::vector<Distribut
       }
     }
 
+    const int n_positions = static_cast<int>(position_count.size());
+
+    std::vector<std::vector<double> > trend_positions(n_positions, std::vector<double>(2));
+    std::vector<int>                  counts(n_positions);
+
+    int p = 0;
+    for (Position_Count_Type::const_iterator it = position_count.begin(); it != position_count.end(); ++it, ++p) {
+      trend_positions[p][0] = it->first.first;
+      trend_positions[p][1] = it->first.second;
+      counts[p]             = it->second;
+    }
+
+    // The positions are independent. Each result is stored and summed in
+    // position order afterwards, so the result does not depend on the number of threads.
+    std::vector<NRLib::Grid2D<double> > sigma_sums(n_positions, NRLib::Grid2D<double>(3,3,0));
+
+#ifdef PARALLEL
+    int chunk_size = 16;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(n_threads) if(n_threads > 1 && n_positions > chunk_size)
+#endif
+    for (p = 0; p < n_positions; p++) {
+      CalculateCovarianceInTrendPosition(rock_distribution,
+                                         probability,
+                                         trend_positions[p],
+                                         sigma_sums[p]);
+    }
+
+    // Local storage for summed combined variances
+    NRLib::Grid2D<double> sumVariance(3,3,0);
+
+    for (p = 0; p < n_positions; p++) {
+      for (size_t a=0; a<3; a++) {
+        for (size_t b=0; b<3; b++)
+          sumVariance(a,b) += counts[p]*sigma_sums[p](a,b);
+      }
+    }
+
+    LogKit::LogFormatted(LogKit::Low,"\n\nCovariance evaluated in %d distinct trend positions from %d sampled cells.\n", n_positions, n_samples);
+
     if (n_samples > 0) {
       for (int i=0; i<3; i++) {
         for (int j=0; j<3; j++)
@@ -10913,6 +11046,11 @@ void CommonData::SetDebugLevel(ModelSettings * model_settings) const
   FFTGrid::setOutputFlags(model_settings->getOutputGridFormat(),
                           model_settings->getOutputGridDomain());
 
+  //Set up the FFT plans shared by all FFTGrids and wavelets.
+  FFTPlanCache::SetNumberOfThreads(model_settings->getNumberOfThreads());
+  if (model_settings->getFFTWisdomFile() != "")
+    FFTPlanCache::ReadWisdom(model_settings->getFFTWisdomFile());
+
 }
 
 //
@@ -22,6 +22,7 @@
 #include "src/cravatrend.h"
 #include "src/multiintervalgrid.h"
 #include "src/definitions.h"
+#include "src/fftplancache.h"
 
 class MultiIntervalGrid;
 class CravaTrend;
@@ -240,9 +241,8 @@ public:
     //
     // Transform to Fourier domain
     //
-    rfftwnd_plan p1 = rfftwnd_create_plan(1, &nt, FFTW_REAL_TO_COMPLEX, FFTW_ESTIMATE | FFTW_IN_PLACE);
-    rfftwnd_one_real_to_complex(p1, rAmp, cAmp);
-    fftwnd_destroy_plan(p1);
+    // Cached plans, as this is called for every trace when combining multizone grids.
+    FFTPlanCache::RealToComplex1D(rAmp, cAmp, nt);
 
     //for (int i=0 ; i<cnt ; i++) {
     //  printf("i=%2d, cAmp.re[i]=%11.4f  cAmp.im[i]=%11.4f\n",i,cAmp[i].re,cAmp[i].im);
@@ -279,9 +279,7 @@ public:
     //
     // Backtransform to time domain
     //
-    rfftwnd_plan p2 = rfftwnd_create_plan(1, &nt, FFTW_COMPLEX_TO_REAL, FFTW_ESTIMATE | FFTW_IN_PLACE);
-    rfftwnd_one_complex_to_real(p2, cAmp, rAmp);
-    fftwnd_destroy_plan(p2);
+    FFTPlanCache::ComplexToReal1D(cAmp, rAmp, nt);
 
     float scale= float(1.0/nt);
     for (i = 0; i < rnt; i++) {
@@ -350,7 +348,8 @@ public:
                                 bool                  scale    = false,
                                 bool                  is_segy  = true,
                                 bool                  is_storm = false,
-                                bool                  is_seismic = false) const;
+                                bool                  is_seismic = false,
+                                int                   n_threads  = 1) const;
 
   void               GetCorrGradIJ(float         & corr_grad_I,
                                    float         & corr_grad_J,
@@ -1046,6 +1045,7 @@ private:
                                                         const std::vector<float>                         & probability,
                                                         const CravaTrend                                 & trend_cubes,
                                                         NRLib::Matrix                                    & param_cov,
+                                                        int                                                n_threads,
                                                         std::string                                      & err_txt) const;
 
   void               CalculateCovarianceInTrendPosition(const std::vector<DistributionsRock *> & rock_distribution,
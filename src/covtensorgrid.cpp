@@ -0,0 +1,25 @@
+/***************************************************************************
+*      Copyright (C) 2008 by Norwegian Computing Center and Statoil        *
+***************************************************************************/
+
+#include "src/covtensorgrid.h"
+#include "src/fftgrid.h"
+
+CovTensorGrid::CovTensorGrid(int nxp,
+                             int nyp,
+                             int nzp)
+: cnxp_(nxp/2 + 1),
+  nyp_(nyp),
+  nzp_(nzp)
+{
+  size_ = nElements_*static_cast<size_t>(cnxp_)*static_cast<size_t>(nyp_)*static_cast<size_t>(nzp_);
+
+  FFTGrid::addExternalMemory(size_*sizeof(fftw_complex));
+  values_ = static_cast<fftw_complex*>(fftw_malloc(size_*sizeof(fftw_complex)));
+}
+
+CovTensorGrid::~CovTensorGrid()
+{
+  fftw_free(values_);
+  FFTGrid::removeExternalMemory(size_*sizeof(fftw_complex));
+}
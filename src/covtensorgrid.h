@@ -0,0 +1,53 @@
+/***************************************************************************
+*      Copyright (C) 2008 by Norwegian Computing Center and Statoil        *
+***************************************************************************/
+
+#ifndef COVTENSORGRID_H
+#define COVTENSORGRID_H
+
+#include <stddef.h>
+
+#include "fftw.h"
+
+//
+// The six elements of a 3x3 (Vp, Vs, Rho) matrix for each cell of a complex
+// (Fourier domain) grid, stored together. The elements of a cell are read in
+// one go, instead of from six grids far apart in memory as when each element
+// has its own FFTGrid.
+//
+// The element order is up to the user. AVOInversion stores the lower
+// triangular Cholesky factor of the posterior covariance used in simulation
+// row by row, 00, 10, 11, 20, 21, 22. The values only live in the Fourier
+// domain, so the grid has no FFT.
+//
+class CovTensorGrid
+{
+public:
+  CovTensorGrid(int nxp, int nyp, int nzp);
+  ~CovTensorGrid();
+
+  static const int     nElements_ = 6;
+
+  int                  getCNxp() const { return cnxp_ ;}
+  int                  getNyp()  const { return nyp_  ;}
+  int                  getNzp()  const { return nzp_  ;}
+
+  // The six elements of complex cell (i,j,k), 0 <= i < nxp/2+1.
+  fftw_complex       * getCell(int i, int j, int k)       { return values_ + getCellIndex(i, j, k) ;}
+  const fftw_complex * getCell(int i, int j, int k) const { return values_ + getCellIndex(i, j, k) ;}
+
+private:
+  CovTensorGrid(const CovTensorGrid &);
+  CovTensorGrid & operator=(const CovTensorGrid &);
+
+  size_t               getCellIndex(int i, int j, int k) const
+                       { return nElements_*(static_cast<size_t>(i) + static_cast<size_t>(cnxp_)*(static_cast<size_t>(j) + static_cast<size_t>(nyp_)*static_cast<size_t>(k))) ;}
+
+  int                  cnxp_;
+  int                  nyp_;
+  int                  nzp_;
+  size_t               size_;     // Number of complex values
+  fftw_complex       * values_;
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include "src/modelgeneral.h"
 #include "src/timings.h"
 #include "lib/timekit.hpp"
+#include "nrlib/exception/exception.hpp"
 
 CravaResult::CravaResult():
 cov_vp_(NULL),
@@ -45,7 +46,8 @@ block_grid_(NULL),
 facies_prob_undef_(NULL),
 quality_grid_(NULL),
 write_crava_(false),
-n_intervals_(1)
+n_intervals_(1),
+n_threads_(1)
 {
 }
 
@@ -220,6 +222,7 @@ void CravaResult::CombineResults(ModelSettings                        * model_se
   MultiIntervalGrid * multi_interval_grid     = common_data->GetMultipleIntervalGrid();
   Simbox & output_simbox                      = common_data->GetOutputSimbox();
   n_intervals_                                = multi_interval_grid->GetNIntervals();
+  n_threads_                                  = model_settings->getNumberOfThreads();
 
   //Rapport
   if (n_intervals_ > 1 || output_simbox.getnz() != multi_interval_grid->GetIntervalSimbox(0)->getnz()) {
@@ -293,12 +296,15 @@ void CravaResult::CombineResults(ModelSettings                        * model_se
       }
     }
 
-    LogKit::LogFormatted(LogKit::Low,"\n Vp ");
-    CombineResult(post_vp_,  post_vp_intervals,  multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
-    LogKit::LogFormatted(LogKit::Low,"\n Vs ");
-    CombineResult(post_vs_,  post_vs_intervals,  multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
-    LogKit::LogFormatted(LogKit::Low,"\n Rho ");
-    CombineResult(post_rho_, post_rho_intervals, multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
+    std::vector<StormContGrid *>         post_grids(3);
+    std::vector<std::vector<FFTGrid *> > post_intervals(3);
+    post_grids[0] = post_vp_;  post_intervals[0] = post_vp_intervals;
+    post_grids[1] = post_vs_;  post_intervals[1] = post_vs_intervals;
+    post_grids[2] = post_rho_; post_intervals[2] = post_rho_intervals;
+    std::vector<std::vector<NRLib::Grid<float> *> > dummy_grids_nrlib;
+
+    LogKit::LogFormatted(LogKit::Low,"\n Vp, Vs and Rho ");
+    CombineResult(post_grids, post_intervals, multi_interval_grid, zone_prob_grid, dummy_grids_nrlib, missing_map);
 
     //Add predicted logs from resampled grid
     if (n_intervals_ > 1 || output_simbox.getnz() != multi_interval_grid->GetIntervalSimbox(0)->getnz()) {
@@ -326,12 +332,12 @@ void CravaResult::CombineResults(ModelSettings                        * model_se
         post_vs_kriged_intervals[i]  = seismic_parameters_intervals[i].GetPostVsKriged();
         post_rho_kriged_intervals[i] = seismic_parameters_intervals[i].GetPostRhoKriged();
       }
-      LogKit::LogFormatted(LogKit::Low,"\n Vp kriged ");
-      CombineResult(post_vp_kriged_,  post_vp_kriged_intervals,  multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
-      LogKit::LogFormatted(LogKit::Low,"\n Vs kriged ");
-      CombineResult(post_vs_kriged_,  post_vs_kriged_intervals,  multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
-      LogKit::LogFormatted(LogKit::Low,"\n Rho kriged ");
-      CombineResult(post_rho_kriged_, post_rho_kriged_intervals, multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
+      post_grids[0] = post_vp_kriged_;  post_intervals[0] = post_vp_kriged_intervals;
+      post_grids[1] = post_vs_kriged_;  post_intervals[1] = post_vs_kriged_intervals;
+      post_grids[2] = post_rho_kriged_; post_intervals[2] = post_rho_kriged_intervals;
+
+      LogKit::LogFormatted(LogKit::Low,"\n Vp, Vs and Rho kriged ");
+      CombineResult(post_grids, post_intervals, multi_interval_grid, zone_prob_grid, dummy_grids_nrlib, missing_map);
     }
   }
 
@@ -342,15 +348,19 @@ void CravaResult::CombineResults(ModelSettings                        * model_se
     background_vs_  = new StormContGrid(output_simbox, nx, ny, nz_output);
     background_rho_ = new StormContGrid(output_simbox, nx, ny, nz_output);
 
-    LogKit::LogFormatted(LogKit::Low,"\n Vp ");
-    CombineResult(background_vp_,  background_vp_intervals_,  multi_interval_grid, zone_prob_grid, dummy_grids,
-                  missing_map, model_settings->getFilterMultizoneModel(), model_settings->getMaxHzBackground());
-    LogKit::LogFormatted(LogKit::Low,"\n Vs ");
-    CombineResult(background_vs_,  background_vs_intervals_,  multi_interval_grid, zone_prob_grid, dummy_grids,
-                  missing_map, model_settings->getFilterMultizoneModel(), model_settings->getMaxHzBackground());
-    LogKit::LogFormatted(LogKit::Low,"\n Rho ");
-    CombineResult(background_rho_, background_rho_intervals_, multi_interval_grid, zone_prob_grid, dummy_grids,
+    std::vector<StormContGrid *>         background_grids(3);
+    std::vector<std::vector<FFTGrid *> > background_intervals(3);
+    background_grids[0] = background_vp_;  background_intervals[0] = background_vp_intervals_;
+    background_grids[1] = background_vs_;  background_intervals[1] = background_vs_intervals_;
+    background_grids[2] = background_rho_; background_intervals[2] = background_rho_intervals_;
+    std::vector<std::vector<NRLib::Grid<float> *> > dummy_grids_nrlib;
+
+    LogKit::LogFormatted(LogKit::Low,"\n Vp, Vs and Rho ");
+    CombineResult(background_grids, background_intervals, multi_interval_grid, zone_prob_grid, dummy_grids_nrlib,
                   missing_map, model_settings->getFilterMultizoneModel(), model_settings->getMaxHzBackground());
+    background_vp_intervals_  = background_intervals[0];
+    background_vs_intervals_  = background_intervals[1];
+    background_rho_intervals_ = background_intervals[2];
   }
   else { //These background grids are not used later if we are not going to write them to file
     for (size_t i = 0; i < background_vp_intervals_.size(); i++) {
@@ -409,18 +419,18 @@ void CravaResult::CombineResults(ModelSettings                        * model_se
       //if (!model_settings->getForwardModeling())
       //  seismic_parameters_intervals[i].FFTCovGrids();
     }
-    LogKit::LogFormatted(LogKit::Low,"\n Vp ");
-    CombineResult(cov_vp_,        cov_vp_intervals,        multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
-    LogKit::LogFormatted(LogKit::Low,"\n Vs ");
-    CombineResult(cov_vs_,        cov_vs_intervals,        multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
-    LogKit::LogFormatted(LogKit::Low,"\n Rho ");
-    CombineResult(cov_rho_,       cov_rho_intervals,       multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
-    LogKit::LogFormatted(LogKit::Low,"\n VpVs ");
-    CombineResult(cr_cov_vp_vs_,  cr_cov_vp_vs_intervals,  multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
-    LogKit::LogFormatted(LogKit::Low,"\n VpRho ");
-    CombineResult(cr_cov_vp_rho_, cr_cov_vp_rho_intervals, multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
-    LogKit::LogFormatted(LogKit::Low,"\n VsRho ");
-    CombineResult(cr_cov_vs_rho_, cr_cov_vs_rho_intervals, multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
+    std::vector<StormContGrid *>         cov_grids(6);
+    std::vector<std::vector<FFTGrid *> > cov_intervals(6);
+    cov_grids[0] = cov_vp_;        cov_intervals[0] = cov_vp_intervals;
+    cov_grids[1] = cov_vs_;        cov_intervals[1] = cov_vs_intervals;
+    cov_grids[2] = cov_rho_;       cov_intervals[2] = cov_rho_intervals;
+    cov_grids[3] = cr_cov_vp_vs_;  cov_intervals[3] = cr_cov_vp_vs_intervals;
+    cov_grids[4] = cr_cov_vp_rho_; cov_intervals[4] = cr_cov_vp_rho_intervals;
+    cov_grids[5] = cr_cov_vs_rho_; cov_intervals[5] = cr_cov_vs_rho_intervals;
+    std::vector<std::vector<NRLib::Grid<float> *> > dummy_grids_nrlib;
+
+    LogKit::LogFormatted(LogKit::Low,"\n Vp, Vs, Rho, VpVs, VpRho and VsRho ");
+    CombineResult(cov_grids, cov_intervals, multi_interval_grid, zone_prob_grid, dummy_grids_nrlib, missing_map);
   }
 
   //Facies prob
@@ -542,12 +552,15 @@ void CravaResult::CombineResults(ModelSettings                        * model_se
         simulations_seed1_intervals[i] = seismic_parameters_intervals[i].GetSimulationSeed1(j);
         simulations_seed2_intervals[i] = seismic_parameters_intervals[i].GetSimulationSeed2(j);
       }
-      LogKit::LogFormatted(LogKit::Low,"\n seed0 " + NRLib::ToString(j) + " ");
-      CombineResult(simulations_seed0_[j], simulations_seed0_intervals, multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
-      LogKit::LogFormatted(LogKit::Low,"\n seed1 " + NRLib::ToString(j) + " ");
-      CombineResult(simulations_seed1_[j], simulations_seed1_intervals, multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
-      LogKit::LogFormatted(LogKit::Low,"\n seed2 " + NRLib::ToString(j) + " ");
-      CombineResult(simulations_seed2_[j], simulations_seed2_intervals, multi_interval_grid, zone_prob_grid, dummy_grids, missing_map);
+      std::vector<StormContGrid *>         simulation_grids(3);
+      std::vector<std::vector<FFTGrid *> > simulation_intervals(3);
+      simulation_grids[0] = simulations_seed0_[j]; simulation_intervals[0] = simulations_seed0_intervals;
+      simulation_grids[1] = simulations_seed1_[j]; simulation_intervals[1] = simulations_seed1_intervals;
+      simulation_grids[2] = simulations_seed2_[j]; simulation_intervals[2] = simulations_seed2_intervals;
+      std::vector<std::vector<NRLib::Grid<float> *> > dummy_grids_nrlib;
+
+      LogKit::LogFormatted(LogKit::Low,"\n seed0, seed1 and seed2 " + NRLib::ToString(j) + " ");
+      CombineResult(simulation_grids, simulation_intervals, multi_interval_grid, zone_prob_grid, dummy_grids_nrlib, missing_map);
 
     }
   }
@@ -665,33 +678,64 @@ void CravaResult::CombineResult(StormContGrid                    *& final_grid,
                                 bool                                apply_filter, //filter combined grid to a maxHz
                                 float                               max_hz)
 {
-  int nx = static_cast<int>(final_grid->GetNI());
-  int ny = static_cast<int>(final_grid->GetNJ());
-  int nz = static_cast<int>(final_grid->GetNK());
+  std::vector<StormContGrid *>                    final_grids(1, final_grid);
+  std::vector<std::vector<FFTGrid *> >            grids(1, interval_grids);
+  std::vector<std::vector<NRLib::Grid<float> *> > grids_nrlib;
+  if (interval_grids_nrlib.size() > 0)
+    grids_nrlib.push_back(interval_grids_nrlib);
+
+  CombineResult(final_grids,
+                grids,
+                multi_interval_grid,
+                zone_probability,
+                grids_nrlib,
+                missing_map,
+                apply_filter,
+                max_hz);
+
+  interval_grids = grids[0];
+}
+
+void CravaResult::CombineResult(std::vector<StormContGrid *>                    & final_grids,
+                                std::vector<std::vector<FFTGrid *> >            & interval_grids,       //vector grids, vector intervals
+                                MultiIntervalGrid                               * multi_interval_grid,
+                                const std::vector<StormContGrid>                & zone_probability,
+                                std::vector<std::vector<NRLib::Grid<float> *> > & interval_grids_nrlib, //Optional, send in an empty vector if FFTGrids are used
+                                NRLib::Grid2D<bool>                             * missing_map,          //NULL if no missing.
+                                bool                                              apply_filter,         //filter combined grids to a maxHz
+                                float                                             max_hz)
+{
+  bool use_nrlib_grids = false;
+  if (interval_grids_nrlib.size() > 0)
+    use_nrlib_grids = true;
+
+  int n_grids = static_cast<int>(final_grids.size());
+  int nx      = static_cast<int>(final_grids[0]->GetNI());
+  int ny      = static_cast<int>(final_grids[0]->GetNJ());
+  int nz      = static_cast<int>(final_grids[0]->GetNK());
 
   //If output simbox has the same size as the result grid there is no need to resample
-  if (n_intervals_ == 1 && static_cast<int>(final_grid->GetNK()) == multi_interval_grid->GetIntervalSimbox(0)->getnz()) {
+  if (n_intervals_ == 1 && nz == multi_interval_grid->GetIntervalSimbox(0)->getnz()) {
 
-    if (interval_grids_nrlib.size() > 0) {
-      FFTGrid * tmp_grid = new FFTGrid(interval_grids_nrlib[0], nx, ny, nz);
-      CreateStormGrid(*final_grid, tmp_grid);
-    }
-    else
-      CreateStormGrid(*final_grid, interval_grids[0]);
+    for (int g = 0; g < n_grids; g++) {
+      if (use_nrlib_grids) {
+        FFTGrid * tmp_grid = new FFTGrid(interval_grids_nrlib[g][0], nx, ny, nz);
+        CreateStormGrid(*final_grids[g], tmp_grid);
+      }
+      else
+        CreateStormGrid(*final_grids[g], interval_grids[g][0]);
 
-    if (missing_map != NULL)
-      SetMissingInGrid(*final_grid, missing_map);
+      if (missing_map != NULL)
+        SetMissingInGrid(*final_grids[g], missing_map);
+    }
 
     LogKit::LogFormatted(LogKit::Low,"ok");
     return;
   }
 
-  bool use_nrlib_grids = false;
-  if (interval_grids_nrlib.size() > 0)
-    use_nrlib_grids = true;
-
   float monitor_size = std::max(1.0f, static_cast<float>(nx*ny)*0.02f);
   float next_monitor = monitor_size;
+  int   n_done       = 0;
   printf("\n  0%%       20%%       40%%       60%%       80%%      100%%");
   printf("\n  |    |    |    |    |    |    |    |    |    |    |");
   printf("\n  ^");
@@ -699,7 +743,7 @@ void CravaResult::CombineResult(StormContGrid                    *& final_grid,
   std::vector<int> nz_old(n_intervals_);
   for(size_t zone=0;zone<nz_old.size();zone++) {
     if (use_nrlib_grids == false)
-      nz_old[zone] = interval_grids[zone]->getNzp();
+      nz_old[zone] = interval_grids[0][zone]->getNzp();
     else
       nz_old[zone] = CommonData::FindClosestFactorableNumber(multi_interval_grid->GetIntervalSimbox(static_cast<int>(zone))->getnz()+100);
   }
@@ -712,106 +756,157 @@ void CravaResult::CombineResult(StormContGrid                    *& final_grid,
                          small_plans,
                          big_plans);
 
-  //Resample
-  for (int i = 0; i < nx; i++) {
-    for (int j = 0; j < ny; j++) {
+  //Traces are independent, so they are resampled in parallel. The downscaling plans are
+  //read-only and shared, while each thread has its own trace buffers. File grids are not
+  //safe for concurrent reading and are resampled by one thread.
+#ifdef PARALLEL
+  int  n_threads   = n_threads_;
+  bool in_parallel = true;
+  for (int g = 0; g < n_grids && use_nrlib_grids == false; g++) {
+    for (int zone = 0; zone < n_intervals_; zone++) {
+      if (interval_grids[g][zone]->isFile())
+        in_parallel = false;
+    }
+  }
+#pragma omp parallel num_threads(n_threads) if(in_parallel && n_threads > 1)
+#endif
+  {
+    std::vector<fftw_real *> rAmpData(n_intervals_);
+    std::vector<fftw_real *> rAmpFine(n_intervals_);
+    for (int zone = 0; zone < n_intervals_; zone++) {
+      int rnt = 2*(nz_old[zone]/2 + 1);
+      int rmt = 2*(nz_old[zone]*scale/2 + 1);
+      rAmpData[zone] = static_cast<fftw_real*>(fftw_malloc(sizeof(float)*rnt));
+      rAmpFine[zone] = static_cast<fftw_real*>(fftw_malloc(sizeof(float)*rmt));
+    }
+
+    std::vector<float>               old_trace;
+    std::vector<std::vector<float> > new_traces(n_intervals_);    //Finely interpolated values
+    std::vector<float>               combined_trace(nz);
+    std::vector<float>               filtered_trace(nz);
+    std::vector<double>              rel_index(nz*n_intervals_);  //Relative position in each interval, shared by all grids
+
+    int i;
+#ifdef PARALLEL
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (i = 0; i < nx; i++) {
+      for (int j = 0; j < ny; j++) {
 
-      //Combine vectors for each interval to one trace in stormgrid
-      std::vector<float> combined_trace(nz);
+        bool missing = (missing_map != NULL && (*missing_map)(i,j) == true);
 
-      if (missing_map != NULL && (*missing_map)(i,j) == true) {
-        for (int k = 0; k < nz; k++)
-          combined_trace[k] = RMISSING;
-      }
-      else {
-        std::vector<std::vector<float> > new_traces(n_intervals_); //Finely interpolated values
-
-        //Resample each trace to new nz
-        for (int zone = 0; zone < n_intervals_; zone++) {
-          std::vector<float> old_trace;
-          if (use_nrlib_grids == false) {
-            FFTGrid * interval_grid  = interval_grids[zone];
-            old_trace = interval_grid->getRealTrace(i, j); //old_trace is changed below.
-          }
-          else {
-            old_trace = GetNRLibGridTrace(interval_grids_nrlib[zone], i, j);
+        if (missing == false) {
+          for (int k = 0; k < nz; k++) {
+            double global_x = 0.0;
+            double global_y = 0.0;
+            double global_z = 0.0;
+
+            final_grids[0]->FindCenterOfCell(i, j, k, global_x, global_y, global_z);
+            for (int zone = 0; zone < n_intervals_; zone++) {
+              if(zone_probability[zone](i,j,k) > 0) {
+                Simbox * z_simbox = multi_interval_grid->GetIntervalSimbox(zone);
+                double dummy1, dummy2, rel;
+                z_simbox->getInterpolationIndexes(global_x, global_y, global_z, dummy1, dummy2, rel);
+                rel -= 0.5; //First half grid cell is outside interpolation vector.
+                rel /= static_cast<double>(z_simbox->getnz()-1);
+                if(rel < 0)
+                  rel = 0;
+                else if(rel > 1)
+                  rel = 1;
+                rel_index[k*n_intervals_ + zone] = rel;
+              }
+            }
           }
-          int prepad_size = static_cast<int>(old_trace.size());
-          AddPadding(old_trace, nz_old[zone]);
-
-          new_traces[zone].resize(nz_old[zone]*scale);
+        }
 
-          DownscaleTrace(old_trace,
-                         new_traces[zone],
-                         scale,
-                         prepad_size,
-                         small_plans[zone],
-                         big_plans[zone]);
+        for (int g = 0; g < n_grids; g++) {
 
-        } //n_intervals
+          //Combine vectors for each interval to one trace in stormgrid
+          if (missing == true) {
+            for (int k = 0; k < nz; k++)
+              combined_trace[k] = RMISSING;
+          }
+          else {
+            //Resample each trace to new nz
+            for (int zone = 0; zone < n_intervals_; zone++) {
+              if (use_nrlib_grids == false)
+                old_trace = interval_grids[g][zone]->getRealTrace(i, j); //old_trace is changed below.
+              else
+                old_trace = GetNRLibGridTrace(interval_grids_nrlib[g][zone], i, j);
+
+              int prepad_size = static_cast<int>(old_trace.size());
+              AddPadding(old_trace, nz_old[zone]);
+
+              DownscaleTrace(old_trace,
+                             new_traces[zone],
+                             scale,
+                             prepad_size,
+                             small_plans[zone],
+                             big_plans[zone],
+                             rAmpData[zone],
+                             rAmpFine[zone]);
+
+            } //n_intervals
+
+            for (int k = 0; k < nz; k++) {
+              double value = 0;
+              for (int zone = 0; zone < n_intervals_; zone++) {
+                if(zone_probability[zone](i,j,k) > 0) {
+                  int index = static_cast<int>(floor(0.5+rel_index[k*n_intervals_ + zone]*(new_traces[zone].size()-1))); //0 to first item, 1 to last item.
+                  value += zone_probability[zone](i,j,k)*new_traces[zone][index];
+                }
+              }
+              combined_trace[k] = static_cast<float>(value);
+            }
 
-        for (int k = 0; k < nz; k++) {
-          double global_x = 0.0;
-          double global_y = 0.0;
-          double global_z = 0.0;
-
-          double value = 0;
-          final_grid->FindCenterOfCell(i, j, k, global_x, global_y, global_z);
-          for (int zone = 0; zone < n_intervals_; zone++) {
-            if(zone_probability[zone](i,j,k) > 0) {
-              Simbox * z_simbox = multi_interval_grid->GetIntervalSimbox(zone);
-              double dummy1, dummy2, rel_index;
-              z_simbox->getInterpolationIndexes(global_x, global_y, global_z, dummy1, dummy2, rel_index);
-              rel_index -= 0.5; //First half grid cell is outside interpolation vector.
-              rel_index /= static_cast<double>(z_simbox->getnz()-1);
-              if(rel_index < 0)
-                rel_index = 0;
-              else if(rel_index > 1)
-                rel_index = 1;
-
-              int index = static_cast<int>(floor(0.5+rel_index*(new_traces[zone].size()-1))); //0 to first item, 1 to last item.
-              value += zone_probability[zone](i,j,k)*new_traces[zone][index];
+            //Filter background grids
+            if (apply_filter == true) {
+              double lz = final_grids[g]->GetLZ();
+              double dz = lz/nz;
+              CommonData::ApplyFilter(filtered_trace,
+                                      combined_trace,
+                                      nz,
+                                      dz,
+                                      max_hz);
+
+              for (int k = 0; k < nz; k++) {
+                combined_trace[k] = filtered_trace[k];
+              }
             }
           }
-          combined_trace[k] = static_cast<float>(value);
-        }
-
-        //Filter background grids
-        if (apply_filter == true) {
-
-          std::vector<float> filtered_trace(nz);
-          double lz = final_grid->GetLZ();
-          double dz = lz/nz;
-          CommonData::ApplyFilter(filtered_trace,
-                                  combined_trace,
-                                  nz,
-                                  dz,
-                                  max_hz);
 
           for (int k = 0; k < nz; k++) {
-            combined_trace[k] = filtered_trace[k];
+            (*final_grids[g])(i,j,k) = combined_trace[k];
           }
-        }
-      }
-
-      for (int k = 0; k < nz; k++) {
-        (*final_grid)(i,j,k) = combined_trace[k];
-      }
+        } //n_grids
+      } //ny
 
       // Log progress
-      if (ny*i + j + 1 >= static_cast<int>(next_monitor)) {
-        next_monitor += monitor_size;
-        printf("^");
+#ifdef PARALLEL
+#pragma omp critical(combine_result_progress)
+#endif
+      {
+        n_done += ny;
+        while (n_done >= static_cast<int>(next_monitor) && next_monitor <= nx*ny) {
+          next_monitor += monitor_size;
+          printf("^");
+        }
         fflush(stdout);
       }
+    } //nx
 
-    } //ny
-  } //nx
+    for (int zone = 0; zone < n_intervals_; zone++) {
+      fftw_free(rAmpData[zone]);
+      fftw_free(rAmpFine[zone]);
+    }
+  }
 
   if (use_nrlib_grids == false) {
-    for (size_t i = 0; i < interval_grids.size(); i++) {
-      delete interval_grids[i];
-      interval_grids[i] = NULL;
+    for (int g = 0; g < n_grids; g++) {
+      for (size_t i = 0; i < interval_grids[g].size(); i++) {
+        delete interval_grids[g][i];
+        interval_grids[g][i] = NULL;
+      }
     }
   }
 
@@ -821,7 +916,6 @@ void CravaResult::CombineResult(StormContGrid                    *& final_grid,
   }
 }
 
-
 void
 CravaResult::CombineVerticalTrends(MultiIntervalGrid                         * multiple_interval_grid,
                                    CommonData                                * common_data,
@@ -1523,12 +1617,14 @@ void CravaResult::WriteResults(ModelSettings           * model_settings,
     std::string file_name_vprho = IO::PrefixPosterior() + IO::PrefixCrossCovariance() + "VpRho";
     std::string file_name_vsrho = IO::PrefixPosterior() + IO::PrefixCrossCovariance() + "VsRho";
 
-    ParameterOutput::WriteFile(model_settings, cov_vp_,        file_name_vp,    IO::PathToCorrelations(), &simbox, false, "Posterior covariance for Vp");
-    ParameterOutput::WriteFile(model_settings, cov_vs_,        file_name_vs,    IO::PathToCorrelations(), &simbox, false, "Posterior covariance for Vs");
-    ParameterOutput::WriteFile(model_settings, cov_rho_,       file_name_rho,   IO::PathToCorrelations(), &simbox, false, "Posterior covariance for density");
-    ParameterOutput::WriteFile(model_settings, cr_cov_vp_vs_,  file_name_vpvs,  IO::PathToCorrelations(), &simbox, false, "Posterior cross-covariance for (Vp,Vs)");
-    ParameterOutput::WriteFile(model_settings, cr_cov_vp_rho_, file_name_vprho, IO::PathToCorrelations(), &simbox, false, "Posterior cross-covariance for (Vp,density)");
-    ParameterOutput::WriteFile(model_settings, cr_cov_vs_rho_, file_name_vsrho, IO::PathToCorrelations(), &simbox, false, "Posterior cross-covariance for (Vs,density)");
+    std::vector<ParameterOutput::GridFile> grid_files;
+    grid_files.push_back(ParameterOutput::GridFile(cov_vp_,        file_name_vp,    IO::PathToCorrelations(), false, "Posterior covariance for Vp"));
+    grid_files.push_back(ParameterOutput::GridFile(cov_vs_,        file_name_vs,    IO::PathToCorrelations(), false, "Posterior covariance for Vs"));
+    grid_files.push_back(ParameterOutput::GridFile(cov_rho_,       file_name_rho,   IO::PathToCorrelations(), false, "Posterior covariance for density"));
+    grid_files.push_back(ParameterOutput::GridFile(cr_cov_vp_vs_,  file_name_vpvs,  IO::PathToCorrelations(), false, "Posterior cross-covariance for (Vp,Vs)"));
+    grid_files.push_back(ParameterOutput::GridFile(cr_cov_vp_rho_, file_name_vprho, IO::PathToCorrelations(), false, "Posterior cross-covariance for (Vp,density)"));
+    grid_files.push_back(ParameterOutput::GridFile(cr_cov_vs_rho_, file_name_vsrho, IO::PathToCorrelations(), false, "Posterior cross-covariance for (Vs,density)"));
+    ParameterOutput::WriteFiles(model_settings, &simbox, grid_files);
 
     if (write_crava_) {
       std::string file_name_vp    = IO::makeFullFileName(IO::PathToCorrelations(), IO::PrefixPosterior() + IO::PrefixCovariance() + "Vp");
@@ -1572,10 +1668,13 @@ void CravaResult::WriteResults(ModelSettings           * model_settings,
         base_name += "Rock_Physics_";
     }
 
+    std::vector<ParameterOutput::GridFile> grid_files;
+    std::string path = IO::PathToInversionResults();
+
     if (model_settings->getOutputGridsOther() & IO::FACIESPROB_WITH_UNDEF) {
       for (int i = 0; i < n_facies; i++) {
         std::string file_name = base_name +"With_Undef_"+ facies_names[i];
-        ParameterOutput::WriteToFile(&simbox, time_depth_mapping, model_settings, facies_prob_[i], file_name, "");
+        grid_files.push_back(ParameterOutput::GridFile(facies_prob_[i], file_name, path, false, "", time_depth_mapping));
 
         if (write_crava_) {
           std::string file_name_crava = IO::makeFullFileName(IO::PathToInversionResults(), file_name);
@@ -1583,7 +1682,7 @@ void CravaResult::WriteResults(ModelSettings           * model_settings,
         }
       }
       std::string file_name = base_name + "Undef";
-      ParameterOutput::WriteToFile(&simbox, time_depth_mapping, model_settings, facies_prob_undef_, file_name, "");
+      grid_files.push_back(ParameterOutput::GridFile(facies_prob_undef_, file_name, path, false, "", time_depth_mapping));
 
       if (write_crava_) {
         std::string file_name_crava = IO::makeFullFileName(IO::PathToInversionResults(), file_name);
@@ -1594,7 +1693,7 @@ void CravaResult::WriteResults(ModelSettings           * model_settings,
     if (model_settings->getOutputGridsOther() & IO::FACIESPROB) {
       for (int i = 0; i < n_facies; i++) {
         std::string file_name = base_name + facies_names[i];
-        ParameterOutput::WriteToFile(&simbox, time_depth_mapping, model_settings, facies_prob_geo_[i], file_name, "");
+        grid_files.push_back(ParameterOutput::GridFile(facies_prob_geo_[i], file_name, path, false, "", time_depth_mapping));
 
         if (write_crava_) {
           std::string file_name_crava = IO::makeFullFileName(IO::PathToInversionResults(), file_name);
@@ -1604,7 +1703,7 @@ void CravaResult::WriteResults(ModelSettings           * model_settings,
     }
     if (model_settings->getOutputGridsOther() & IO::SEISMIC_QUALITY_GRID) {
       std::string file_name = "Seismic_Quality_Grid";
-      ParameterOutput::WriteToFile(&simbox, time_depth_mapping, model_settings, quality_grid_, file_name, "");
+      grid_files.push_back(ParameterOutput::GridFile(quality_grid_, file_name, path, false, "", time_depth_mapping));
 
       if (write_crava_) {
         std::string file_name_crava = IO::makeFullFileName(IO::PathToInversionResults(), file_name);
@@ -1614,7 +1713,7 @@ void CravaResult::WriteResults(ModelSettings           * model_settings,
     if ((model_settings->getOutputGridsOther() & IO::FACIES_LIKELIHOOD) > 0) {
       for (int i = 0; i < n_facies; i++) {
         std::string file_name = IO::PrefixLikelihood() + facies_names[i];
-        ParameterOutput::WriteToFile(&simbox, time_depth_mapping, model_settings, lh_cubes_[i], file_name, "");
+        grid_files.push_back(ParameterOutput::GridFile(lh_cubes_[i], file_name, path, false, "", time_depth_mapping));
 
         if (write_crava_) {
           std::string file_name = IO::makeFullFileName(IO::PathToInversionResults(), IO::PrefixLikelihood() + facies_names[i]);
@@ -1623,6 +1722,7 @@ void CravaResult::WriteResults(ModelSettings           * model_settings,
 
       }
     }
+    ParameterOutput::WriteFiles(model_settings, &simbox, grid_files);
   }
 
   //Simulations
@@ -1630,10 +1730,39 @@ void CravaResult::WriteResults(ModelSettings           * model_settings,
     LogKit::LogFormatted(LogKit::Low,"\nWrite Simulation Grids\n");
     int n_simulations = static_cast<int>(simulations_seed0_.size());
     bool kriging      = model_settings->getKrigingParameter() > 0;
-    for (int i = 0; i < n_simulations; i++) {
-      ParameterOutput::WriteParameters(&simbox, time_depth_mapping, model_settings, simulations_seed0_[i], simulations_seed1_[i], simulations_seed2_[i],
-                                        model_settings->getOutputGridsElastic(), i, kriging);
 
+    // The realisations are written concurrently, one realisation per thread.
+    bool        failed    = false;
+    std::string err_txt   = "";
+    int i;
+#ifdef PARALLEL
+    // Each realisation holds a derived parameter grid and a scratch copy while it is written.
+    double bytes_per_write = 0.0;
+    if (n_simulations > 0)
+      bytes_per_write = 2.0*static_cast<double>(simulations_seed0_[0]->GetN())*sizeof(float);
+    int n_threads = ParameterOutput::FindNumberOfWriters(model_settings, bytes_per_write, n_simulations);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads) if(n_threads > 1)
+#endif
+    for (i = 0; i < n_simulations; i++) {
+      try {
+        ParameterOutput::WriteParameters(&simbox, time_depth_mapping, model_settings, simulations_seed0_[i], simulations_seed1_[i], simulations_seed2_[i],
+                                          model_settings->getOutputGridsElastic(), i, kriging);
+      }
+      catch (NRLib::Exception & e) { //Rethrown outside the parallel region
+#ifdef PARALLEL
+#pragma omp critical(write_simulations)
+#endif
+        {
+          if (failed == false)
+            err_txt = e.what();
+          failed = true;
+        }
+      }
+    }
+    if (failed)
+      throw NRLib::Exception(err_txt);
+
+    for (i = 0; i < n_simulations; i++) {
       if (write_crava_) {
         std::string prefix = IO::PrefixSimulations();
         std::string suffix;
@@ -1658,6 +1787,7 @@ void CravaResult::WriteResults(ModelSettings           * model_settings,
     int n_angles = model_settings->getNumberOfAngles(0); //Only write synthetic seismic for the first vintage
     std::vector<float> angles = model_settings->getAngle(0);
 
+    std::vector<ParameterOutput::GridFile> grid_files;
     for (int i = 0; i < n_angles; i++) {
 
       float theta       = angles[i];
@@ -1670,9 +1800,10 @@ void CravaResult::WriteResults(ModelSettings           * model_settings,
       if (((model_settings->getOutputGridsSeismic() & IO::SYNTHETIC_SEISMIC_DATA) > 0) || (model_settings->getForwardModeling() == true)) {
         if (i == 0)
           LogKit::LogFormatted(LogKit::Low,"\nWrite Synthetic Seismic\n");
-        ParameterOutput::WriteFile(model_settings, synt_seismic_data_[i], file_name, IO::PathToSeismicData(), &simbox, true, sgri_label, time_depth_mapping);
+        grid_files.push_back(ParameterOutput::GridFile(synt_seismic_data_[i], file_name, IO::PathToSeismicData(), true, sgri_label, time_depth_mapping));
       }
     }
+    ParameterOutput::WriteFiles(model_settings, &simbox, grid_files);
   }
 
   //Trend Cubes
@@ -1681,10 +1812,12 @@ void CravaResult::WriteResults(ModelSettings           * model_settings,
 
     const std::vector<std::string>  & trend_cube_parameters = model_settings->getTrendCubeParameters();
 
+    std::vector<ParameterOutput::GridFile> grid_files;
     for (size_t i = 0; i < trend_cubes_.size(); i++) {
       std::string file_name = IO::PrefixTrendCubes() + trend_cube_parameters[i];
-      ParameterOutput::WriteFile(model_settings, trend_cubes_[i], file_name, IO::PathToRockPhysics(), &simbox, false, "trend cube", time_depth_mapping);
+      grid_files.push_back(ParameterOutput::GridFile(trend_cubes_[i], file_name, IO::PathToRockPhysics(), false, "trend cube", time_depth_mapping));
     }
+    ParameterOutput::WriteFiles(model_settings, &simbox, grid_files);
   }
 
   Timings::setTimeWriteResults(wall,cpu);
@@ -1704,6 +1837,7 @@ void CravaResult::WriteEstimationResults(ModelSettings * model_settings,
   blocked_logs_ = common_data->GetBlockedLogsOutput();
 
   n_intervals_ = common_data->GetMultipleIntervalGrid()->GetNIntervals();
+  n_threads_   = model_settings->getNumberOfThreads();
   if (n_intervals_ == 1 && ((model_settings->getOutputGridFormat() & IO::CRAVA) > 0))
     write_crava_ = true;
 
@@ -1774,7 +1908,7 @@ void CravaResult::WriteEstimationResults(ModelSettings * model_settings,
       int ny = simbox.getny();
       int nz = simbox.getnz();
 
-      std::vector<FFTGrid *> dummy_fft_grids;
+      std::vector<std::vector<FFTGrid *> > dummy_fft_grids;
 
       std::vector<NRLib::Grid<float> *> background_vp_intervals(n_intervals_);
       std::vector<NRLib::Grid<float> *> background_vs_intervals(n_intervals_);
@@ -1794,12 +1928,14 @@ void CravaResult::WriteEstimationResults(ModelSettings * model_settings,
         zone_prob_grid[i] = NRLib::StormContGrid(simbox, nx, ny, nz);
       multi_interval_grid->FindZoneProbGrid(zone_prob_grid);
 
-      LogKit::LogFormatted(LogKit::Low,"\n Vp");
-      CombineResult(background_vp_,  dummy_fft_grids,  multi_interval_grid, zone_prob_grid, background_vp_intervals, missing_map, model_settings->getFilterMultizoneModel(), model_settings->getMaxHzBackground());
-      LogKit::LogFormatted(LogKit::Low,"\n Vs");
-      CombineResult(background_vs_,  dummy_fft_grids,  multi_interval_grid, zone_prob_grid, background_vs_intervals, missing_map, model_settings->getFilterMultizoneModel(),model_settings->getMaxHzBackground());
-      LogKit::LogFormatted(LogKit::Low,"\n Rho");
-      CombineResult(background_rho_, dummy_fft_grids, multi_interval_grid, zone_prob_grid, background_rho_intervals, missing_map, model_settings->getFilterMultizoneModel(), model_settings->getMaxHzBackground());
+      std::vector<StormContGrid *>                    background_grids(3);
+      std::vector<std::vector<NRLib::Grid<float> *> > background_intervals(3);
+      background_grids[0] = background_vp_;  background_intervals[0] = background_vp_intervals;
+      background_grids[1] = background_vs_;  background_intervals[1] = background_vs_intervals;
+      background_grids[2] = background_rho_; background_intervals[2] = background_rho_intervals;
+
+      LogKit::LogFormatted(LogKit::Low,"\n Vp, Vs and Rho");
+      CombineResult(background_grids, dummy_fft_grids, multi_interval_grid, zone_prob_grid, background_intervals, missing_map, model_settings->getFilterMultizoneModel(), model_settings->getMaxHzBackground());
 
       for (int i = 0; i < n_intervals_; i++) {
         common_data->ReleaseBackgroundGrids(i, 0);
@@ -1981,7 +2117,8 @@ void CravaResult::WriteSeismicData(ModelSettings * model_settings,
                                 false,
                                 is_segy,
                                 is_storm,
-                                true);
+                                true,
+                                model_settings->getNumberOfThreads());
 
         delete nrlib_grid;
 
@@ -2207,20 +2344,12 @@ void CravaResult::WriteGridPackage(const ModelSettings     * model_settings,
     depth_mapping->setMappingFromVelocity(grid_vp, simbox, model_settings->getOutputGridFormat());
   }
 
-  std::string file_name_vp  = prefix + "Vp" ;
-  std::string file_name_vs  = prefix + "Vs" ;
-  std::string file_name_rho = prefix + "Rho";
-
-  if (exp_transf) {
-    ExpTransf(grid_vp);
-    ExpTransf(grid_vs);
-    ExpTransf(grid_rho);
-  }
-
-  ParameterOutput::WriteFile(model_settings, grid_vp,  file_name_vp,  path, simbox, false, "NO_LABEL", depth_mapping);
-  ParameterOutput::WriteFile(model_settings, grid_vs,  file_name_vs,  path, simbox, false, "NO_LABEL", depth_mapping);
-  ParameterOutput::WriteFile(model_settings, grid_rho, file_name_rho, path, simbox, false, "NO_LABEL", depth_mapping);
+  std::vector<ParameterOutput::GridFile> grid_files;
+  grid_files.push_back(ParameterOutput::GridFile(grid_vp,  prefix + "Vp",  path, false, "NO_LABEL", depth_mapping, exp_transf));
+  grid_files.push_back(ParameterOutput::GridFile(grid_vs,  prefix + "Vs",  path, false, "NO_LABEL", depth_mapping, exp_transf));
+  grid_files.push_back(ParameterOutput::GridFile(grid_rho, prefix + "Rho", path, false, "NO_LABEL", depth_mapping, exp_transf));
 
+  ParameterOutput::WriteFiles(model_settings, simbox, grid_files);
 }
 
 
@@ -2478,8 +2607,8 @@ CravaResult::CreateDownscalingPlans(const std::vector<int>    & nzp,
   for(size_t zone=0;zone<small_plans.size();zone++) {
     int nt = nzp[zone];;
     int mt = nt*scale;
-    small_plans[zone] = rfftwnd_create_plan(1, &nt, FFTW_REAL_TO_COMPLEX, FFTW_ESTIMATE | FFTW_IN_PLACE);
-    big_plans[zone]   = rfftwnd_create_plan(1, &mt, FFTW_COMPLEX_TO_REAL, FFTW_ESTIMATE | FFTW_IN_PLACE);
+    small_plans[zone] = rfftwnd_create_plan(1, &nt, FFTW_REAL_TO_COMPLEX, FFTW_ESTIMATE | FFTW_IN_PLACE | FFTW_THREADSAFE);
+    big_plans[zone]   = rfftwnd_create_plan(1, &mt, FFTW_COMPLEX_TO_REAL, FFTW_ESTIMATE | FFTW_IN_PLACE | FFTW_THREADSAFE);
   }
 }
 
@@ -2502,7 +2631,9 @@ CravaResult::DownscaleTrace(const std::vector<float> & trace_in,
                             int                        scale,
                             int                        prepad_size,
                             const rfftwnd_plan       & small_plan,
-                            const rfftwnd_plan       & big_plan)
+                            const rfftwnd_plan       & big_plan,
+                            fftw_real                * rAmpData, //Work buffers of length 2*(nt/2+1) and 2*(nt*scale/2+1)
+                            fftw_real                * rAmpFine)
 {
   //Assumes trace_in is already padded.
   int nt = static_cast<int>(trace_in.size());
@@ -2513,9 +2644,6 @@ CravaResult::DownscaleTrace(const std::vector<float> & trace_in,
   int cmt = mt/2 + 1;
   int rmt = 2*cmt;
 
-  fftw_real * rAmpData = static_cast<fftw_real*>(fftw_malloc(sizeof(float)*rnt));
-  fftw_real * rAmpFine = static_cast<fftw_real*>(fftw_malloc(sizeof(float)*rmt));
-
   CommonData::ResampleTrace(trace_in,
                             small_plan,
                             big_plan,
@@ -2533,9 +2661,6 @@ CravaResult::DownscaleTrace(const std::vector<float> & trace_in,
   for (size_t k = 0; k < out_len; k++) {
     trace_out[k] = rAmpFine[k];
   }
-
-  fftw_free(rAmpData);
-  fftw_free(rAmpFine);
 }
 
 NRLib::Grid2D<bool> *
@@ -42,6 +42,17 @@ public:
                      bool                                apply_filter = false,//Filter grid to a maxHz
                      float                               max_hz = 9999.0);
 
+  //As above, but for several grids on the same intervals. Each trace is visited once,
+  //and the zone weights and interval positions are shared by all grids.
+  void CombineResult(std::vector<StormContGrid *>                    & final_grids,
+                     std::vector<std::vector<FFTGrid *> >            & interval_grids,
+                     MultiIntervalGrid                               * multi_interval_grid,
+                     const std::vector<StormContGrid>                & zone_probability,
+                     std::vector<std::vector<NRLib::Grid<float> *> > & interval_grids_nrlib,
+                     NRLib::Grid2D<bool>                             * missing_surface,
+                     bool                                              apply_filter = false,
+                     float                                             max_hz = 9999.0);
+
   float GetResampledTraceValue(const std::vector<float> & resampled_trace,
                                const double             & dz_resampled,
                                const double             & top,
@@ -180,7 +191,9 @@ public:
                       int                        scale,
                       int                        prepad_size,
                       const rfftwnd_plan       & small_plan,
-                      const rfftwnd_plan       & big_plan);
+                      const rfftwnd_plan       & big_plan,
+                      fftw_real                * rAmpData,
+                      fftw_real                * rAmpFine);
 
   void AddPadding(std::vector<float> & trace,
                   int                  nzp);
@@ -285,6 +298,7 @@ private:
 
   bool                                                     write_crava_;
   int                                                      n_intervals_;
+  int                                                      n_threads_;
 };
 
 #endif
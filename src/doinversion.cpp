@@ -1,4 +1,8 @@
 #include <time.h>
+#include <math.h>
+#include <new>
+
+#include "nrlib/iotools/logkit.hpp"
 
 #include "src/avoinversion.h"
 #include "src/traveltimeinversion.h"
@@ -15,6 +19,9 @@
 #include "src/seismicparametersholder.h"
 #include "src/simbox.h"
 #include "src/gravimetricinversion.h"
+#include "src/commondata.h"
+#include "src/multiintervalgrid.h"
+#include "src/timeline.h"
 
 #include "src/doinversion.h"
 
@@ -52,6 +59,220 @@ void setupStaticModels(ModelGeneral            *& modelGeneral,
   //Add in ModelTravelTimeStatic when ready
 }
 
+bool doIntervalInversion(ModelGeneral            *& modelGeneral,
+                         ModelAVOStatic          *& modelAVOstatic,
+                         ModelSettings            * modelSettings,
+                         InputFiles               * inputFiles,
+                         SeismicParametersHolder  & seismicParameters,
+                         CommonData               * commonData,
+                         int                        i_interval)
+{
+  // Everything done here only touches this interval's data, so that
+  // intervals may be inverted concurrently. Background grids must be set up
+  // in seismicParameters before this is called.
+  const Simbox * simbox = commonData->GetMultipleIntervalGrid()->GetIntervalSimbox(i_interval);
+
+  //korrelasjonsgrid (2m)
+  float corr_grad_I = 0.0f;
+  float corr_grad_J = 0.0f;
+  commonData->GetCorrGradIJ(corr_grad_I, corr_grad_J, simbox);
+
+  float dt        = static_cast<float>(simbox->getdz());
+  float low_cut   = modelSettings->getLowCut();
+  int low_int_cut = int(floor(low_cut*(simbox->GetNZpad()*0.001*dt))); // computes the integer which corresponds to the low cut frequency.
+
+  if (!modelSettings->getForwardModeling()) {
+    LogKit::LogFormatted(LogKit::Low,"\nCorrelation parameters..\n");
+    seismicParameters.setCorrelationParameters(commonData->GetPriorCovEst(),
+                                               commonData->GetPriorParamCov(i_interval),
+                                               commonData->GetPriorAutoCov(i_interval),
+                                               commonData->GetPriorCorrT(i_interval),
+                                               commonData->GetPriorCorrXY(i_interval),
+                                               low_int_cut,
+                                               corr_grad_I,
+                                               corr_grad_J,
+                                               simbox->getnx(),
+                                               simbox->getny(),
+                                               simbox->getnz(),
+                                               simbox->GetNXpad(),
+                                               simbox->GetNYpad(),
+                                               simbox->GetNZpad(),
+                                               simbox->getdz());
+  }
+
+  //ModelGeneral, modelAVOstatic, modelGravityStatic, (modelTravelTimeStatic?)
+  LogKit::LogFormatted(LogKit::Low,"\nStatic models..\n");
+  setupStaticModels(modelGeneral,
+                    modelAVOstatic,
+                    //modelGravityStatic,
+                    modelSettings,
+                    inputFiles,
+                    seismicParameters,
+                    commonData,
+                    i_interval);
+
+  //Loop over dataset
+  //i.   ModelAVODynamic
+  //ii.  Inversion
+  //iii. Move model one time-step ahead
+
+  //Do not run avoinversion if forward modelleing or estimationmode
+  //Syntetic seismic is generated in CravaResult
+  if (!modelSettings->getForwardModeling() && !modelSettings->getEstimationMode()) {
+    int  eventType;
+    int  eventIndex;
+
+    // The time line is shared by all intervals, so each interval steps through its own copy.
+    TimeLine time_line(*modelGeneral->GetTimeLine());
+    time_line.ReSet();
+
+    double time;
+    int time_index = 0;
+    bool first     = true;
+    while(time_line.GetNextEvent(eventType, eventIndex, time) == true) {
+      if (first == false) {
+          modelGeneral->AdvanceTime(time_index, seismicParameters, modelSettings);
+          time_index++;
+      }
+      bool failed = false;
+      switch(eventType) {
+      case TimeLine::AVO : {
+        LogKit::LogFormatted(LogKit::Low,"\nAVO inversion, time lapse "+ CommonData::ConvertIntToString(time_index) +"..\n");
+        failed = doTimeLapseAVOInversion(modelSettings,
+                                         modelGeneral,
+                                         modelAVOstatic,
+                                         commonData,
+                                         seismicParameters,
+                                         eventIndex,
+                                         i_interval);
+        break;
+      }
+      case TimeLine::TRAVEL_TIME : {
+        LogKit::LogFormatted(LogKit::Low,"\nTravel time inversion, time lapse "+ CommonData::ConvertIntToString(time_index) +"..\n");
+        //failed = doTimeLapseTravelTimeInversion(modelSettings,
+        //                                        modelGeneral,
+        //                                        modelTravelTimeStatic,
+        //                                        inputFiles,
+        //                                        eventIndex,
+        //                                        seismicParameters);
+        break;
+      }
+      case TimeLine::GRAVITY : {
+        LogKit::LogFormatted(LogKit::Low,"\nGravimetric inversion, time lapse "+ CommonData::ConvertIntToString(time_index) +"..\n");
+        //failed = doTimeLapseGravimetricInversion(modelSettings,
+        //                                          modelGeneral,
+        //                                          modelGravityStatic,
+        //                                          commonData,
+        //                                          eventIndex,
+        //                                          seismicParameters);
+        break;
+      }
+      default :
+        failed = true;
+        break;
+      }
+      if(failed)
+        return(true);
+
+      first = false;
+    }
+  }
+  return(false);
+}
+
+void findIntervalBatches(std::vector<std::vector<int> > & batches,
+                         const ModelSettings            * modelSettings,
+                         const InputFiles               * inputFiles,
+                         CommonData                     * commonData)
+{
+  // Intervals are inverted concurrently in batches of one interval per thread,
+  // provided the memory estimates from ModelAVOStatic::FindNeededMemory say we
+  // can hold that many intervals at the same time. As in
+  // ModelAVOStatic::CheckAvailableMemory, this is checked by allocating the
+  // memory in chunks of one padded grid. Intervals keep their order, so that
+  // a batch is a run of consecutive intervals.
+  //
+  // The intervals of a batch run their inner parallel loops on one thread each,
+  // so a batch with fewer intervals than threads would be slower than running
+  // the intervals one by one with all threads. Such batches are therefore split
+  // into single intervals.
+  //
+  // Sampling of the rock physics for the facies probabilities draws from the
+  // global random generator, and the draws must come in the same order as in a
+  // serial run. Intervals are therefore not run concurrently in that case.
+  const MultiIntervalGrid * multi_interval_grid = commonData->GetMultipleIntervalGrid();
+  int n_intervals = multi_interval_grid->GetNIntervals();
+  int n_threads   = modelSettings->getNumberOfThreads();
+
+  bool concurrent = (n_threads > 1 && n_intervals >= n_threads         &&
+                     modelSettings->getFileGrid()            == false   &&
+                     modelSettings->getForwardModeling()     == false   &&
+                     modelSettings->getDo4DInversion()       == false   &&
+                     modelSettings->getFaciesProbFromRockPhysics() == false);
+
+  std::vector<size_t> n_chunks(n_intervals, 0);
+  std::vector<size_t> chunk_size(n_intervals, 0);
+  if (concurrent) {
+    for (int i = 0; i < n_intervals; i++) {
+      int    n_grids       = 0;
+      size_t grid_size_pad = 0;
+      float  mem0          = 0.0f;
+      float  mem1          = 0.0f;
+      float  mem1_cold     = 0.0f;
+      float  mem2          = 0.0f;
+      float  needed_mem    = ModelAVOStatic::FindNeededMemory(multi_interval_grid->GetIntervalSimbox(i),
+                                                              modelSettings,
+                                                              inputFiles,
+                                                              n_grids,
+                                                              grid_size_pad,
+                                                              mem0,
+                                                              mem1,
+                                                              mem1_cold,
+                                                              mem2);
+      chunk_size[i] = grid_size_pad;
+      n_chunks[i]   = static_cast<size_t>(ceil(needed_mem/static_cast<float>(grid_size_pad)));
+    }
+  }
+
+  batches.clear();
+  int i_interval = 0;
+  while (i_interval < n_intervals) {
+    std::vector<int>    batch(1, i_interval);
+    std::vector<char *> memchunk;
+    if (concurrent) {
+      try {
+        for (size_t c = 0; c < n_chunks[i_interval]; c++)
+          memchunk.push_back(new char[chunk_size[i_interval]]);
+        while (static_cast<int>(batch.size()) < n_threads && i_interval + static_cast<int>(batch.size()) < n_intervals) {
+          int next = i_interval + static_cast<int>(batch.size());
+          for (size_t c = 0; c < n_chunks[next]; c++)
+            memchunk.push_back(new char[chunk_size[next]]);
+          batch.push_back(next);
+        }
+      }
+      catch (std::bad_alloc& ) //Could not allocate memory for the next interval
+      {
+      }
+      for (size_t c = 0; c < memchunk.size(); c++)
+        delete [] memchunk[c];
+      if (static_cast<int>(batch.size()) < n_threads)
+        batch.resize(1);
+    }
+    batches.push_back(batch);
+    i_interval += static_cast<int>(batch.size());
+  }
+
+  if (static_cast<int>(batches.size()) < n_intervals) {
+    LogKit::LogFormatted(LogKit::Low,"\nThe %d intervals are inverted in %d batches of concurrent intervals:\n", n_intervals, static_cast<int>(batches.size()));
+    for (size_t b = 0; b < batches.size(); b++) {
+      LogKit::LogFormatted(LogKit::Low,"  Batch %d:", static_cast<int>(b) + 1);
+      for (size_t i = 0; i < batches[b].size(); i++)
+        LogKit::LogFormatted(LogKit::Low," %s", multi_interval_grid->GetIntervalName(batches[b][i]).c_str());
+      LogKit::LogFormatted(LogKit::Low,"\n");
+    }
+  }
+}
+
 bool doTimeLapseAVOInversion(ModelSettings           * modelSettings,
                              ModelGeneral            * modelGeneral,
                              ModelAVOStatic          * modelAVOstatic,
@@ -2,6 +2,7 @@
 #define DOINVERSION_H
 
 #include <stdio.h>
+#include <vector>
 
 class ModelSettings;
 class ModelAVODynamic;
@@ -12,6 +13,7 @@ class ModelGeneral;
 class InputFiles;
 class Simbox;
 class SeismicParametersHolder;
+class CommonData;
 
 void setupStaticModels(ModelGeneral            *& modelGeneral,
                        ModelAVOStatic          *& modelAVOstatic,
@@ -22,6 +24,19 @@ void setupStaticModels(ModelGeneral            *& modelGeneral,
                        CommonData               * commonData,
                        int                        i_interval);
 
+bool doIntervalInversion(ModelGeneral            *& modelGeneral,
+                         ModelAVOStatic          *& modelAVOstatic,
+                         ModelSettings            * modelSettings,
+                         InputFiles               * inputFiles,
+                         SeismicParametersHolder  & seismicParameters,
+                         CommonData               * commonData,
+                         int                        i_interval);
+
+void findIntervalBatches(std::vector<std::vector<int> > & batches,
+                         const ModelSettings            * modelSettings,
+                         const InputFiles               * inputFiles,
+                         CommonData                     * commonData);
+
 bool doTimeLapseAVOInversion(ModelSettings           * modelSettings,
                              ModelGeneral            * modelGeneral,
                              ModelAVOStatic          * modelAVOstatic,
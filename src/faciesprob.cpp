@@ -39,6 +39,10 @@
 #include "src/seismicparametersholder.h"
 #include "src/blockedlogscommon.h"
 
+#ifdef PARALLEL
+#include <omp.h>
+#endif
+
 
 FaciesProb::FaciesProb(FFTGrid                                  * vp,
                        FFTGrid                                  * vs,
@@ -1240,7 +1244,8 @@ void FaciesProb::makeFaciesProb(int                                        nFac,
     normalizeCubes(priorFaciesCubes);
 
   calculateFaciesProb(postVp, postVs, postRho, density, volume,
-                      p_undef, priorFacies, priorFaciesCubes, noiseScale, seismicLH);
+                      p_undef, priorFacies, priorFaciesCubes, noiseScale, seismicLH,
+                      modelSettings->getNumberOfThreads());
 
   for(int l=0;l<nFacies_;l++){
     if(ModelSettings::getDebugLevel() >= 1) {
@@ -1304,120 +1309,121 @@ float FaciesProb::FindDensityFromPosteriorPDF(const double
     return 0.0;
 }
 
-float FaciesProb::findDensity(float                                       vp,
-                              float                                       vs,
-                              float                                       rho,
-                              const std::vector<std::vector<FFTGrid*> > & density,
-                              int                                         facies,
-                              const std::vector<Simbox *>               & volume,
-                              const std::vector<float>                  & t,
-                              int                                         nAng)
+void FaciesProb::findDensities(float                                       vp,
+                               float                                       vs,
+                               float                                       rho,
+                               const std::vector<std::vector<FFTGrid*> > & density,
+                               const std::vector<Simbox *>               & volume,
+                               const std::vector<float>                  & t,
+                               int                                         nAng,
+                               std::vector<float>                        & dens)
 {
+  // Density of all facies in one (vp, vs, rho) point. The interpolation
+  // indexes and weights only depend on the noise level, so they are found
+  // once per noise level and shared by the facies. The density grids must
+  // be in RANDOMACCESS mode.
+  int dim    = static_cast<int>(density.size());
+  int nFac   = static_cast<int>(dens.size());
   double jFull, kFull, lFull;
 
-  int i;
-  int dim = static_cast<int>(density.size());
-  std::vector<float> value(dim);
-  for(i=0;i<dim;i++)
+  for(int l=0;l<nFac;l++)
+    dens[l] = 0.0f;
+
+  for(int i=0;i<dim;i++)
   {
-  volume[i]->getInterpolationIndexes(vp, vs, rho, jFull, kFull, lFull);
-  int j1,k1,l1;
-  int j2,k2,l2;
-  float wj,wk,wl;
-  j1=k1=l1=j2=k2=l2=0;
-  j1 = static_cast<int>(floor(jFull));
-  if(j1<0) {
-    j1 = 0;
-    j2 = 0;
-    wj = 0;
-  }
-  else if(j1>=volume[i]->getnx()-1) {
-    j1 = volume[i]->getnx()-1;
-    j2 = j1;
-    wj = 0;
-  }
-  else {
-    j2 = j1 + 1;
-    wj = static_cast<float>(jFull-j1);
-  }
+    volume[i]->getInterpolationIndexes(vp, vs, rho, jFull, kFull, lFull);
+    int j1,k1,l1;
+    int j2,k2,l2;
+    float wj,wk,wl;
+    j1 = static_cast<int>(floor(jFull));
+    if(j1<0) {
+      j1 = 0;
+      j2 = 0;
+      wj = 0;
+    }
+    else if(j1>=volume[i]->getnx()-1) {
+      j1 = volume[i]->getnx()-1;
+      j2 = j1;
+      wj = 0;
+    }
+    else {
+      j2 = j1 + 1;
+      wj = static_cast<float>(jFull-j1);
+    }
 
-  k1 = static_cast<int>(floor(kFull));
-  if(k1<0) {
-    k1 = 0;
-    k2 = 0;
-    wk = 0;
-  }
-  else if(k1>=volume[i]->getny()-1) {
-    k1 = volume[i]->getny()-1;
-    k2 = k1;
-    wk = 0;
-  }
-  else {
-    k2 = k1 + 1;
-    wk = static_cast<float>(kFull-k1);
-  }
+    k1 = static_cast<int>(floor(kFull));
+    if(k1<0) {
+      k1 = 0;
+      k2 = 0;
+      wk = 0;
+    }
+    else if(k1>=volume[i]->getny()-1) {
+      k1 = volume[i]->getny()-1;
+      k2 = k1;
+      wk = 0;
+    }
+    else {
+      k2 = k1 + 1;
+      wk = static_cast<float>(kFull-k1);
+    }
 
-  l1 = static_cast<int>(floor(lFull));
-  if(l1<0) {
-    l1 = 0;
-    l2 = 0;
-    wl = 0;
-  }
-  else if(l1>=volume[i]->getnz()-1) {
-    l1 = volume[i]->getnz()-1;
-    l2 = l1;
-    wl = 0;
-  }
-  else {
-    l2 = l1 + 1;
-    wl = static_cast<float>(lFull-l1);
-  }
-
-
-    density[i][facies]->setAccessMode(FFTGrid::RANDOMACCESS);
-    float value1 = std::max<float>(0,density[i][facies]->getRealValue(j1,k1,l1));
-    float value2 = std::max<float>(0,density[i][facies]->getRealValue(j1,k1,l2));
-    float value3 = std::max<float>(0,density[i][facies]->getRealValue(j1,k2,l1));
-    float value4 = std::max<float>(0,density[i][facies]->getRealValue(j1,k2,l2));
-    float value5 = std::max<float>(0,density[i][facies]->getRealValue(j2,k1,l1));
-    float value6 = std::max<float>(0,density[i][facies]->getRealValue(j2,k1,l2));
-    float value7 = std::max<float>(0,density[i][facies]->getRealValue(j2,k2,l1));
-    float value8 = std::max<float>(0,density[i][facies]->getRealValue(j2,k2,l2));
-    density[i][facies]->endAccess();
-    //float value=0;
-    value[i] = 0;
-    value[i] += (1.0f-wj)*(1.0f-wk)*(1.0f-wl)*value1;
-    value[i] += (1.0f-wj)*(1.0f-wk)*(     wl)*value2;
-    value[i] += (1.0f-wj)*(     wk)*(1.0f-wl)*value3;
-    value[i] += (1.0f-wj)*(     wk)*(     wl)*value4;
-    value[i] += (     wj)*(1.0f-wk)*(1.0f-wl)*value5;
-    value[i] += (     wj)*(1.0f-wk)*(     wl)*value6;
-    value[i] += (     wj)*(     wk)*(1.0f-wl)*value7;
-    value[i] += (     wj)*(     wk)*(     wl)*value8;
-  }
+    l1 = static_cast<int>(floor(lFull));
+    if(l1<0) {
+      l1 = 0;
+      l2 = 0;
+      wl = 0;
+    }
+    else if(l1>=volume[i]->getnz()-1) {
+      l1 = volume[i]->getnz()-1;
+      l2 = l1;
+      wl = 0;
+    }
+    else {
+      l2 = l1 + 1;
+      wl = static_cast<float>(lFull-l1);
+    }
 
-  int factor = 1;
-  float valuesum = 0;
-  for(i=0;i<dim;i++)
-  {
-    factor = 1;
+    float w[8];
+    w[0] = (1.0f-wj)*(1.0f-wk)*(1.0f-wl);
+    w[1] = (1.0f-wj)*(1.0f-wk)*(     wl);
+    w[2] = (1.0f-wj)*(     wk)*(1.0f-wl);
+    w[3] = (1.0f-wj)*(     wk)*(     wl);
+    w[4] = (     wj)*(1.0f-wk)*(1.0f-wl);
+    w[5] = (     wj)*(1.0f-wk)*(     wl);
+    w[6] = (     wj)*(     wk)*(1.0f-wl);
+    w[7] = (     wj)*(     wk)*(     wl);
+
+    float noiseFactor = 1.0f;
+    int factor = 1;
     for(int j=0;j<nAng;j++)
     {
       if(j>0)
         factor*=2;
       if((i & factor) > 0)
-        value[i]*=t[j];
+        noiseFactor*=t[j];
       else
-        value[i]*=(1-t[j]);
+        noiseFactor*=(1-t[j]);
     }
 
-    valuesum += value[i];
-  }
-
-  if (valuesum > 0.0)
-    return(valuesum);
-  else
-    return 0.0;
+    for(int l=0;l<nFac;l++)
+    {
+      const FFTGrid * grid = density[i][l];
+      float value = 0;
+      value += w[0]*std::max<float>(0,grid->getRealValue(j1,k1,l1));
+      value += w[1]*std::max<float>(0,grid->getRealValue(j1,k1,l2));
+      value += w[2]*std::max<float>(0,grid->getRealValue(j1,k2,l1));
+      value += w[3]*std::max<float>(0,grid->getRealValue(j1,k2,l2));
+      value += w[4]*std::max<float>(0,grid->getRealValue(j2,k1,l1));
+      value += w[5]*std::max<float>(0,grid->getRealValue(j2,k1,l2));
+      value += w[6]*std::max<float>(0,grid->getRealValue(j2,k2,l1));
+      value += w[7]*std::max<float>(0,grid->getRealValue(j2,k2,l2));
+      dens[l] += value*noiseFactor;
+    }
+  }
+
+  for(int l=0;l<nFac;l++)
+    if(!(dens[l] > 0.0))
+      dens[l] = 0.0;
 }
 
 
@@ -1915,12 +1921,11 @@ void FaciesProb::calculateFaciesProb(FFTGrid
                                      const std::vector<float>                   & priorFacies,
                                      std::vector<FFTGrid *>                     & priorFaciesCubes,
                                      const std::vector<Grid2D *>                & noiseScale,
-                                     FFTGrid                                    * seismicLH)
+                                     FFTGrid                                    * seismicLH,
+                                     int                                          nThreads)
 {
-  float * value = new float[nFacies_];
   int i,j,k,l;
   int nx, ny, nz, rnxp, nyp, nzp, smallrnxp;
-  float vp, vs, rho, sum;
 
 
   rnxp = vpgrid->getRNxp();
@@ -1966,7 +1971,6 @@ void FaciesProb::calculateFaciesProb(FFTGrid
   for(i=0;i<int(noiseScale.size());i++)
     if(noiseScale[i]!=NULL)
       nAng++;
-  std::vector<float> t(nAng);
   double maxS;
   double minS;
   std::vector<Grid2D *> tgrid(nAng);
@@ -1991,54 +1995,100 @@ void FaciesProb::calculateFaciesProb(FFTGrid
     << "\n  |    |    |    |    |    |    |    |    |    |    |  "
     << "\n  ^";
 
-  float help;
-  float dens;
-  float undefSum = p_undefined/(volume[0]->getnx()*volume[0]->getny()*volume[0]->getnz());
+  for(i=0;i<static_cast<int>(density.size());i++)
+    for(l=0;l<nFacies_;l++)
+      density[i][l]->setAccessMode(FFTGrid::RANDOMACCESS);
+
+  //
+  // The grids are read and written layer by layer through the cursors, which
+  // also works for grids on file. The densities, which dominate the cost, are
+  // evaluated for a whole layer at a time with the rows shared between threads.
+  //
+  bool  usePrior   = (priorFaciesCubes.size() != 0);
+  int   layerSize  = ny*smallrnxp;
+  float undefSum   = p_undefined/(volume[0]->getnx()*volume[0]->getny()*volume[0]->getnz());
+  std::vector<float> vpLayer(layerSize);
+  std::vector<float> vsLayer(layerSize);
+  std::vector<float> rhoLayer(layerSize);
+  std::vector<float> sumLayer(layerSize);
+  std::vector<std::vector<float> > valueLayer(nFacies_, std::vector<float>(layerSize));
+
   for(i=0;i<nzp;i++)
   {
-    for(j=0;j<nyp;j++)
+    if(i<nz)
     {
-      for(k=0;k<rnxp;k++)
+      for(j=0;j<nyp;j++)
       {
-        vp = vpgrid->getNextReal();
-        vs = vsgrid->getNextReal();
-        rho = rhogrid->getNextReal();
-        if(k<smallrnxp && j<ny && i<nz)
+        for(k=0;k<rnxp;k++)
         {
-          sum = undefSum;
-          for(l=0;l<nFacies_;l++)
+          float vp  = vpgrid->getNextReal();
+          float vs  = vsgrid->getNextReal();
+          float rho = rhogrid->getNextReal();
+          if(k<smallrnxp && j<ny)
           {
-            if(k<nx)
+            int index = j*smallrnxp + k;
+            vpLayer[index]  = vp;
+            vsLayer[index]  = vs;
+            rhoLayer[index] = rho;
+            for(l=0;l<nFacies_;l++)
             {
-              for(int angle = 0;angle<nAng;angle++)
-                t[angle] = float((*tgrid[angle])(k,j));
-              dens = findDensity(vp, vs, rho, density, l,volume, t, nAng);
+              if(usePrior)
+                valueLayer[l][index] = priorFaciesCubes[l]->getNextReal();
+              else
+                valueLayer[l][index] = priorFacies[l];
             }
-            else{
-              dens = 1.0;
-            }
-            if(priorFaciesCubes.size() != 0)
-              value[l] = priorFaciesCubes[l]->getNextReal()*dens;
-            else
-              value[l] = priorFacies[l]*dens;
-            sum = sum+value[l];
           }
+        }
+      }
+
+#ifdef PARALLEL
+      int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(nThreads)
+#endif
+      for(int jj=0;jj<ny;jj++)
+      {
+        std::vector<float> t(nAng);
+        std::vector<float> dens(nFacies_, 1.0f);
+        for(int kk=0;kk<smallrnxp;kk++)
+        {
+          int index = jj*smallrnxp + kk;
+          if(kk<nx)
+          {
+            for(int angle = 0;angle<nAng;angle++)
+              t[angle] = float((*tgrid[angle])(kk,jj));
+            findDensities(vpLayer[index], vsLayer[index], rhoLayer[index], density, volume, t, nAng, dens);
+          }
+          else
+          {
+            for(int ll=0;ll<nFacies_;ll++)
+              dens[ll] = 1.0f;
+          }
+          float sum = undefSum;
+          for(int ll=0;ll<nFacies_;ll++)
+          {
+            valueLayer[ll][index] *= dens[ll];
+            sum += valueLayer[ll][index];
+          }
+          sumLayer[index] = sum;
+        }
+      }
+
+      for(j=0;j<ny;j++)
+      {
+        for(k=0;k<smallrnxp;k++)
+        {
+          int index = j*smallrnxp + k;
           for(l=0;l<nFacies_;l++)
           {
-            help = value[l]/sum;
             if(k<nx)
-            {
-              faciesProb_[l]->setNextReal(help);
-            }
+              faciesProb_[l]->setNextReal(valueLayer[l][index]/sumLayer[index]);
             else
-            {
               faciesProb_[l]->setNextReal(RMISSING);
-            }
           }
           if(k<nx) {
-            faciesProbUndef_->setNextReal(undefSum/sum);
+            faciesProbUndef_->setNextReal(undefSum/sumLayer[index]);
             if(seismicLH != NULL)
-              seismicLH->setNextReal(sum);
+              seismicLH->setNextReal(sumLayer[index]);
           }
           else {
             faciesProbUndef_->setNextReal(RMISSING);
@@ -2057,6 +2107,13 @@ void FaciesProb::calculateFaciesProb(FFTGrid
   }
   std::cout << "\n";
 
+  for(i=0;i<static_cast<int>(density.size());i++)
+    for(l=0;l<nFacies_;l++)
+      density[i][l]->endAccess();
+
+  for(i=0;i<nAng;i++)
+    delete tgrid[i];
+
   if(priorFaciesCubes.size() != 0)
     for(i=0;i<nFacies_;i++)
     {
@@ -2070,8 +2127,6 @@ void FaciesProb::calculateFaciesProb(FFTGrid
   faciesProbUndef_->endAccess();
   if(seismicLH != NULL)
     seismicLH->endAccess();
-
-  delete [] value;
 }
 
 
@@ -2881,54 +2936,22 @@ void FaciesProb::SolveGEVProblem(double                           ** sigma_prior
 {
   //Compute transforms v1 and v2 ----------------------------------------
 
-  // Matrix inversion of sigma_prior
-  NRLib::Matrix sigma_prior_inv = NRLib::IdentityMatrix(3);
-  NRLib::SymmetricMatrix s_prior;
-  NRLib::SymmetricMatrix s_post;
-  //double **sigma_prior_inv = new double *[3];
-  //for(int i=0; i<3; i++)
-  //  sigma_prior_inv[i] = new double [3];
+  // Eigenvalues and eigenvectors of inv(sigma_prior) * sigma_posterior
+  NRLib::SymmetricMatrix s_prior(3);
+  NRLib::Matrix          s_post(3, 3);
 
   for(int i=0; i<3; i++){
-    for(int j=i; j<3; j++){
-      s_prior(i,j) = sigma_prior[i][j];
+    for(int j=0; j<3; j++){
+      if(j>=i)
+        s_prior(i,j) = sigma_prior[i][j];
       s_post(i,j) = sigma_posterior[i][j];
     }
   }
 
-  NRLib::CholeskySolve(s_prior, sigma_prior_inv);
-
-  //lib_matrCholR(3, sigma_prior);
-  //lib_matrAXeqBMatR(3, sigma_prior, sigma_prior_inv, 3);
-
-  // compute product sigma_prior_inv * sigma_posterior
-
-  //double **product_mat = new double *[3];
-
-  //for (int i=0; i<3; i++)
-  //  product_mat[i] = new double[3];
-
-  NRLib::Matrix product = sigma_prior_inv*s_post;
-
-  //lib_matr_prod(sigma_prior_inv,sigma_posterior,3,3,3,product_mat);
-
-  // compute eigenvalues of the product sigma_prior_inv * sigma_posterior
-
-  //int     * error       = new int[1];
-  //double  * eigval      = new double[3];
-  //double ** eigvec      = new double *[3];
-
-  //for(int i=0;i<3;i++)
-  //{
-  //  eigvec[i]      = new double[3];
-  //}
-
   NRLib::Vector eigval;
   NRLib::Matrix eigvec;
 
-  NRLib::ComputeEigenVectors(product, eigval, eigvec);
-
-  //lib_matr_eigen(product_mat,3,eigvec,eigval,error);
+  NRLib::ComputeGeneralizedEigenVectors(s_prior, s_post, eigval, eigvec);
 
   std::vector<int> index_keep;
 
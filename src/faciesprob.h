@@ -218,14 +218,14 @@ private:
                                             double                    & varVs,
                                             double                    & varRho);
 
-  float                  findDensity(float                                       vp,
-                                     float                                       vs,
-                                     float                                       rho,
-                                     const std::vector<std::vector<FFTGrid*> > & density,
-                                     int                                         facies,
-                                     const std::vector<Simbox *>               & volume,
-                                     const std::vector<float>                  & t,
-                                     int                                         nAng);
+  void                   findDensities(float                                       vp,
+                                       float                                       vs,
+                                       float                                       rho,
+                                       const std::vector<std::vector<FFTGrid*> > & density,
+                                       const std::vector<Simbox *>               & volume,
+                                       const std::vector<float>                  & t,
+                                       int                                         nAng,
+                                       std::vector<float>                        & dens);
 
   float                  FindDensityFromPosteriorPDF(const double                                          & vp,
                                                      const double                                          & vs,
@@ -257,7 +257,8 @@ private:
                                              const std::vector<float>     & priorFacies,
                                              std::vector<FFTGrid *>       & priorFaciesCubes,
                                              const std::vector<Grid2D *>   & noiseScale,
-                                             FFTGrid                       * seismicLH);
+                                             FFTGrid                       * seismicLH,
+                                             int                             nThreads);
 
   // shared routine for the calculateFaciesProb functions
 
@@ -8,6 +8,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <vector>
 
 #include "fftw.h"
 #include "rfftw.h"
@@ -18,6 +19,7 @@
 
 #include "src/definitions.h"
 #include "src/fftfilegrid.h"
+#include "src/profiler.h"
 #include "src/simbox.h"
 #include "src/io.h"
 
@@ -132,12 +134,12 @@ FFTFileGrid::endAccess()
   switch(accMode_)
   {
   case READ:
-    inFile_.close();
+    closeInFile();
     break;
   case READANDWRITE:
-    inFile_.close(); //Intentional fallthrough to WRITE
+    closeInFile(); //Intentional fallthrough to WRITE
   case WRITE:
-    outFile_.close();
+    closeOutFile();
     tmp = fNameIn_;
     fNameIn_ = fNameOut_;
     if(tmp != "")
@@ -303,6 +305,8 @@ int
 FFTFileGrid::square()
 {
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  if(streamSlabs(ElementwiseChain().square()))
+    return(0);
   if(accMode_ != RANDOMACCESS)
     load();
   else
@@ -317,6 +321,8 @@ int
 FFTFileGrid::expTransf()
 {
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  if(streamSlabs(ElementwiseChain().expTransf()))
+    return(0);
   if(accMode_ != RANDOMACCESS)
     load();
   else
@@ -331,6 +337,8 @@ int
 FFTFileGrid::logTransf()
 {
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  if(streamSlabs(ElementwiseChain().logTransf()))
+    return(0);
   if(accMode_ != RANDOMACCESS)
     load();
   else
@@ -345,13 +353,24 @@ int
 FFTFileGrid::collapseAndAdd(float * grid)
 {
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  assert(istransformed_==false);
+  if(accMode_ != RANDOMACCESS && fNameIn_ != "")
+  {
+    // Only the first slab is used, so there is no need to load the whole grid.
+    std::vector<fftw_real> slab(static_cast<size_t>(rnxp_)*static_cast<size_t>(nyp_));
+    NRLib::OpenRead(inFile_,fNameIn_,std::ios::in | std::ios::binary);
+    readSlab(inFile_, &slab[0]);
+    closeInFile();
+    for(int j = 0; j < nyp_; j++)
+      for(int i = 0; i < nxp_; i++)
+        grid[i + j*nxp_] += slab[i + j*rnxp_];
+    return(0);
+  }
   if(accMode_ != RANDOMACCESS)
     load();
-  else
-    modified_ = 1;
   FFTGrid::collapseAndAdd(grid);
   if(accMode_ != RANDOMACCESS)
-    save();
+    unload();
   return(0);
 }
 
@@ -386,6 +405,8 @@ void
 FFTFileGrid::multiplyByScalar(float scalar)
 {
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  if(streamSlabs(ElementwiseChain().multiplyByScalar(scalar)))
+    return;
   if(accMode_ != RANDOMACCESS)
     load();
   else
@@ -400,6 +421,8 @@ void
 FFTFileGrid::add(FFTGrid * fftGrid)
 {
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  if(streamSlabs(ElementwiseChain().add(fftGrid)))
+    return;
   if(accMode_ != RANDOMACCESS)
     load();
   else
@@ -434,6 +457,8 @@ void
 FFTFileGrid::addScalar(float scalar)
 {
  assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  if(streamSlabs(ElementwiseChain().addScalar(scalar)))
+    return;
   if(accMode_ != RANDOMACCESS)
     load();
   else
@@ -447,6 +472,8 @@ void
 FFTFileGrid::subtract(FFTGrid * fftGrid)
 {
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  if(streamSlabs(ElementwiseChain().subtract(fftGrid)))
+    return;
   if(accMode_ != RANDOMACCESS)
     load();
   else
@@ -481,6 +508,8 @@ void
 FFTFileGrid::changeSign()
 {
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  if(streamSlabs(ElementwiseChain().changeSign()))
+    return;
   if(accMode_ != RANDOMACCESS)
     load();
   else
@@ -512,6 +541,8 @@ void
 FFTFileGrid::multiply(FFTGrid * fftGrid)
 {
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  if(streamSlabs(ElementwiseChain().multiply(fftGrid)))
+    return;
   if(accMode_ != RANDOMACCESS)
     load();
   else
@@ -525,8 +556,9 @@ FFTFileGrid::multiply(FFTGrid * fftGrid)
     for(size_t i=0;i<csize_;i++)
     {
       value = fftGrid->getNextComplex();
-      cvalue_[i].re *= value.re;
-      cvalue_[i].im *= value.im;
+      fftw_complex tmp = cvalue_[i];
+      cvalue_[i].re = value.re*tmp.re - value.im*tmp.im;
+      cvalue_[i].im = value.im*tmp.re + value.re*tmp.im;
     }
   }
   else
@@ -547,6 +579,8 @@ FFTFileGrid::conjugate()
 {
   assert(istransformed_);
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  if(streamSlabs(ElementwiseChain().conjugate()))
+    return;
   if(accMode_ != RANDOMACCESS)
     load();
   else
@@ -562,7 +596,7 @@ FFTFileGrid::conjugate()
 }
 
 void
-FFTFileGrid::fillInComplexNoise(RandomGen * ranGen)
+FFTFileGrid::fillInComplexNoise(NRLib::RandomGenerator * ranGen)
 {
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
   if(accMode_ != RANDOMACCESS)
@@ -668,15 +702,12 @@ FFTFileGrid::load()
     FFTGrid::createComplexGrid();
   if(fNameIn_ != "") //Something has been saved.
   {
-    int nRead = 1;
     NRLib::OpenRead(inFile_,fNameIn_,std::ios::in | std::ios::binary);
     //Real/complex does not matter in next line, since same meory is used.
-    for(size_t i=0;((i<rsize_) && (nRead == 1));i++)
-    {
-      char * buffer = reinterpret_cast<char *>(&(rvalue_[i]));
-      inFile_.read(buffer,sizeof(float));
-    }
-    inFile_.close();
+    size_t slabSize = static_cast<size_t>(rnxp_)*static_cast<size_t>(nyp_);
+    for(int k=0;k<nzp_;k++)
+      readSlab(inFile_, rvalue_ + k*slabSize);
+    closeInFile();
   }
 }
 
@@ -686,13 +717,10 @@ FFTFileGrid::save()
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
   NRLib::OpenWrite(outFile_,fNameOut_,std::ios::out | std::ios::binary);
   //Real/complex does not matter in next line, since same meory is used.
-  int nWritten = 1;
-  for(size_t i=0;((i<rsize_) && (nWritten == 1));i++)
-  {
-    char * buffer = reinterpret_cast<char *>(&(rvalue_[i]));
-    outFile_.write(buffer,sizeof(float));
-  }
-  outFile_.close();
+  size_t slabSize = static_cast<size_t>(rnxp_)*static_cast<size_t>(nyp_);
+  for(int k=0;k<nzp_;k++)
+    writeSlab(outFile_, rvalue_ + k*slabSize);
+  closeOutFile();
   unload();
   std::string tmp = fNameIn_;
   fNameIn_ = fNameOut_;
@@ -702,11 +730,96 @@ FFTFileGrid::save()
     fNameOut_ = fNameIn_+"b";
 }
 
+void
+FFTFileGrid::applyElementwise(const ElementwiseChain & chain)
+{
+  assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
+  if(streamSlabs(chain))
+    return;
+  if(accMode_ != RANDOMACCESS)
+    load();
+  else
+    modified_ = 1;
+  FFTGrid::applyElementwise(chain);
+  if(accMode_ != RANDOMACCESS)
+    save();
+}
+
+bool
+FFTFileGrid::streamSlabs(const ElementwiseChain & chain)
+{
+  // Element-wise operations do not need the whole grid in memory. Stream
+  // the grid file through one z-slab at a time instead of load() + save().
+  // Returns false when the grid is already in memory or nothing has been
+  // saved yet, in which case the caller does the operation in memory.
+  if(accMode_ != NONE || fNameIn_ == "")
+    return(false);
+
+  size_t slabSize = static_cast<size_t>(rnxp_)*static_cast<size_t>(nyp_);
+  std::vector<fftw_real>               slab(slabSize);
+  std::vector<std::vector<fftw_real> > buffers;
+  std::vector<const fftw_real *>       operands;
+
+  beginElementwiseOperands(chain, nxp_, buffers);
+  setAccessMode(READANDWRITE);
+
+  for(int k=0;k<nzp_;k++) {
+    readSlab(inFile_, &slab[0]);
+    getElementwiseOperands(chain, istransformed_, k*slabSize, slabSize, buffers, operands);
+    applyElementwiseToBlock(chain, istransformed_, &slab[0], operands, slabSize);
+    writeSlab(outFile_, &slab[0]);
+  }
+
+  endAccess();
+  endElementwiseOperands(chain);
+
+  return(true);
+}
+
+void
+FFTFileGrid::readSlab(std::ifstream & file, fftw_real * slab) const
+{
+  size_t slabSize = static_cast<size_t>(rnxp_)*static_cast<size_t>(nyp_);
+  file.read(reinterpret_cast<char *>(slab), static_cast<std::streamsize>(slabSize*sizeof(fftw_real)));
+}
+
+void
+FFTFileGrid::writeSlab(std::ofstream & file, const fftw_real * slab) const
+{
+  size_t slabSize = static_cast<size_t>(rnxp_)*static_cast<size_t>(nyp_);
+  file.write(reinterpret_cast<const char *>(slab), static_cast<std::streamsize>(slabSize*sizeof(fftw_real)));
+}
+
+void
+FFTFileGrid::closeInFile()
+{
+  std::streamoff bytes = inFile_.tellg();
+  if(bytes > 0)
+    Profiler::AddToCounter(Profiler::FILE_BYTES_READ, static_cast<double>(bytes));
+  inFile_.close();
+}
+
+void
+FFTFileGrid::closeOutFile()
+{
+  std::streamoff bytes = outFile_.tellp();
+  if(bytes > 0)
+    Profiler::AddToCounter(Profiler::FILE_BYTES_WRITTEN, static_cast<double>(bytes));
+  outFile_.close();
+}
+
 void
 FFTFileGrid::unload()
 {
   fftw_free(rvalue_); // changed
-  nGrids_ = nGrids_ - 1;
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_count)
+#endif
+  {
+    nGrids_ = nGrids_ - 1;
+    FFTMemUse_ -= rsize_ * sizeof(fftw_real);
+    Profiler::RecordMemory(FFTMemUse_, nGrids_);
+  }
 // LogKit::LogFormatted(LogKit::Error,"\nFFTFileGrid unload: nGrids_ = %d\n",nGrids_);
   rvalue_ = NULL;
   cvalue_ = NULL;
@@ -743,11 +856,9 @@ FFTFileGrid::getRealTrace(float * value, int i, int j)
   assert(accMode_ == NONE || accMode_ == RANDOMACCESS);
   if(accMode_ != RANDOMACCESS)
     load();
-  else
-    modified_ = 1;
   FFTGrid::getRealTrace(value, i,j);
   if(accMode_ != RANDOMACCESS)
-    save();
+    unload();
 }
 
 int
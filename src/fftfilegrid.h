@@ -41,7 +41,8 @@ public:
   void         changeSign();
   void         multiply(FFTGrid* fftGrid);              // pointwise multiplication!
   void         conjugate();
-  void         fillInComplexNoise(RandomGen * ranGen);
+  void         applyElementwise(const ElementwiseChain & chain);
+  void         fillInComplexNoise(NRLib::RandomGenerator * ranGen);
   void         fftInPlace();
   void         invFFTInPlace();
   void         createRealGrid(bool add = true);
@@ -77,6 +78,11 @@ private:
   void         load();
   void         unload();
   void         save();
+  void         closeInFile();                            // Closes the file and counts the bytes read
+  void         closeOutFile();                           // Closes the file and counts the bytes written
+  bool         streamSlabs(const ElementwiseChain & chain);
+  void         readSlab(std::ifstream & file, fftw_real * slab) const;
+  void         writeSlab(std::ofstream & file, const fftw_real * slab) const;
 
   int          accMode_;
   int          modified_;   //Tells if grid is modified during RANDOMACCESS.
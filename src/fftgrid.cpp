@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <string>
+#include <list>
 
 #ifdef PARALLEL
 #include <omp.h>
@@ -27,8 +28,11 @@
 #include "nrlib/iotools/logkit.hpp"
 #include "nrlib/iotools/fileio.hpp"
 #include "nrlib/segy/segy.hpp"
+#include "nrlib/random/randomgenerator.hpp"
 
 #include "src/fftgrid.h"
+#include "src/fftplancache.h"
+#include "src/profiler.h"
 #include "src/simbox.h"
 #include "src/timings.h"
 #include "src/definitions.h"
@@ -61,6 +65,8 @@ FFTGrid::FFTGrid(int nx, int ny, int nz, int nxp, int nyp, int nzp)
   counterForSet_  = 0;
   istransformed_  = false;
   rvalue_         = NULL;
+  cold_           = false;
+  spilled_        = false;
   add_            = true;
 
   // index= i+rnxp_*j+k*rnxp_*nyp_;
@@ -93,6 +99,8 @@ FFTGrid::FFTGrid(FFTGrid * fftGrid, bool expTrans)
   counterForGet_  = fftGrid->getCounterForGet();
   counterForSet_  = fftGrid->getCounterForSet();
   add_            = fftGrid->add_;
+  cold_           = false;
+  spilled_        = false;
   istransformed_  = fftGrid->getIsTransformed();
 
   if(istransformed_ == false) {
@@ -146,6 +154,8 @@ FFTGrid::FFTGrid(const NRLib::Grid<float> * grid, int nxp, int nyp, int nzp)
   counterForSet_  = 0;
   istransformed_  = false;
   rvalue_         = NULL;
+  cold_           = false;
+  spilled_        = false;
   add_            = true;
 
   // Copied from Background::createPaddedParameter
@@ -236,6 +246,8 @@ FFTGrid::FFTGrid(const StormContGrid * grid, int nxp, int nyp, int nzp)
   counterForSet_  = 0;
   istransformed_  = false;
   rvalue_         = NULL;
+  cold_           = false;
+  spilled_        = false;
   add_            = true;
 
   // Copied from Background::createPaddedParameter
@@ -306,14 +318,29 @@ FFTGrid::FFTGrid(const StormContGrid * grid, int nxp, int nyp, int nzp)
 
 FFTGrid::~FFTGrid()
 {
+  if (cold_) {
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_spill)
+#endif
+    {
+      coldGrids_.remove(this);
+      if (spilled_)
+        remove(spillFile_.c_str());
+    }
+  }
   if (rvalue_!=NULL)
   {
-    if(add_==true)
-      nGrids_ = nGrids_ - 1;
-
     fftw_free(rvalue_); //delete rvalue_;
 
-    FFTMemUse_ -= rsize_ * sizeof(fftw_real);
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_count)
+#endif
+    {
+      if(add_==true)
+        nGrids_ = nGrids_ - 1;
+      FFTMemUse_ -= rsize_ * sizeof(fftw_real);
+      Profiler::RecordMemory(FFTMemUse_, nGrids_);
+    }
     LogKit::LogFormatted(LogKit::DebugLow,"\nFFTGrid Destructor: nGrids_ = %d",nGrids_);
   }
 }
@@ -994,7 +1021,7 @@ FFTGrid::fillInGenExpCorr(double Rx,
 
 
 void
-FFTGrid::fillInComplexNoise(RandomGen * ranGen)
+FFTGrid::fillInComplexNoise(NRLib::RandomGenerator * ranGen)
 {
   assert(ranGen);
   istransformed_ = true;
@@ -1021,13 +1048,13 @@ FFTGrid::fillInComplexNoise(RandomGen * ranGen)
       jkccind = jccind+kccind*nyp_;
       if(jkccind == jkind)             //Number is its own cc, i. e. real
       {
-        cvalue_[i].re = float(ranGen->rnorm01());
+        cvalue_[i].re = float(ranGen->Norm01());
         cvalue_[i].im = 0;
       }
       else if(jkccind > jkind)         //Have not simulated cc yet.
       {
-        cvalue_[i].re = float(std*ranGen->rnorm01());
-        cvalue_[i].im = float(std*ranGen->rnorm01());
+        cvalue_[i].re = float(std*ranGen->Norm01());
+        cvalue_[i].im = float(std*ranGen->Norm01());
       }
       else                             //Look up cc value
       {
@@ -1038,8 +1065,8 @@ FFTGrid::fillInComplexNoise(RandomGen * ranGen)
     }
     else
     {
-      cvalue_[i].re = float(std*ranGen->rnorm01());
-      cvalue_[i].im = float(std*ranGen->rnorm01());
+      cvalue_[i].re = float(std*ranGen->Norm01());
+      cvalue_[i].im = float(std*ranGen->Norm01());
     }
   }
 }
@@ -1049,8 +1076,12 @@ FFTGrid::createRealGrid(bool add)
 {
   istransformed_=false;
   add_ = add;
-  if(add==true)
+  if(add==true) {
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_count)
+#endif
     nGrids_ += 1;
+  }
   createGrid();
 }
 
@@ -1058,45 +1089,216 @@ void
 FFTGrid::createComplexGrid()
 {
   istransformed_  = true;
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_count)
+#endif
   nGrids_        += 1;
   createGrid();
 }
 
 void FFTGrid::createGrid()
 {
+  if (memoryBudget_ > 0.0)
+    spillColdGrids(rsize_ * sizeof(fftw_real));
+
   rvalue_         = static_cast<fftw_real*>(fftw_malloc(rsize_ * sizeof(fftw_real))); //new fftw_real[rsize_]; //static_cast<fftw_real*>(fftw_malloc(rsize_ * sizeof(fftw_real)));
 
   cvalue_         = reinterpret_cast<fftw_complex*>(rvalue_); //
   counterForGet_  = 0;
   counterForSet_  = 0;
 
- // LogKit::LogFormatted(LogKit::Error,"\nFFTGrid createGrid : nGrids = %d    maxGrids = %d\n",nGrids_,maxAllowedGrids_);
-  if (nGrids_ > maxAllowedGrids_) {
-    std::string text;
-    text += "\n\nERROR in FFTGrid createGrid. You have allocated too many FFTGrids. The fix";
-    text += "\nis to increase the nGrids variable calculated in Model::checkAvailableMemory().\n";
-    text += "\nDo you REALLY need to allocate more grids?\n";
-    text += "\nAre there no grids that can be released?\n";
-    if(terminateOnMaxGrid_==true)
-    {
-      LogKit::LogFormatted(LogKit::Error, text);
-      exit(1);
+  // Intervals may be inverted concurrently, so the counters are shared between threads.
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_count)
+#endif
+  {
+    maxAllocatedGrids_ = std::max(nGrids_, maxAllocatedGrids_);
+
+    FFTMemUse_ += rsize_ * sizeof(fftw_real);
+    Profiler::RecordMemory(FFTMemUse_, nGrids_);
+    if(FFTMemUse_ > maxFFTMemUse_) {
+      maxFFTMemUse_ = FFTMemUse_;
+      LogKit::LogFormatted(LogKit::DebugLow,"\nNew FFT-grid memory peak (%2d): %10.2f MB\n",nGrids_, FFTMemUse_/(1024.f*1024.f));
     }
-    else if(nGrids_ == maxAllowedGrids_+1) {
-      //NBNB-PAL: Commented out until memory handling is fixed in 4.0 release
-      //TaskList::addTask("Crava needs more memory than expected. The results are still correct. \n Norwegian Computing Center would like to have a look at your project.");
+  }
+}
+
+void
+FFTGrid::spillColdGrids(size_t bytes)
+{
+  // Grids may be allocated inside parallel regions, so errors are thrown outside the lock.
+  std::string errTxt = "";
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_spill)
+#endif
+  {
+    while (FFTMemUse_ + bytes > memoryBudget_ && !coldGrids_.empty()) {
+      FFTGrid * grid = coldGrids_.front();
+      coldGrids_.pop_front();
+      if (grid->spill(errTxt) == false) {
+        coldGrids_.push_front(grid); // Still cold and in memory
+        break;
+      }
     }
   }
-  maxAllocatedGrids_ = std::max(nGrids_, maxAllocatedGrids_);
+  if (errTxt != "")
+    throw NRLib::IOError(errTxt);
+}
 
-  FFTMemUse_ += rsize_ * sizeof(fftw_real);
-  if(FFTMemUse_ > maxFFTMemUse_) {
-    maxFFTMemUse_ = FFTMemUse_;
-    LogKit::LogFormatted(LogKit::DebugLow,"\nNew FFT-grid memory peak (%2d): %10.2f MB\n",nGrids_, FFTMemUse_/(1024.f*1024.f));
+void
+FFTGrid::addExternalMemory(size_t bytes)
+{
+  if (memoryBudget_ > 0.0)
+    spillColdGrids(bytes);
+
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_count)
+#endif
+  {
+    FFTMemUse_ += bytes;
+    Profiler::RecordMemory(FFTMemUse_, nGrids_);
+    if(FFTMemUse_ > maxFFTMemUse_) {
+      maxFFTMemUse_ = FFTMemUse_;
+      LogKit::LogFormatted(LogKit::DebugLow,"\nNew FFT-grid memory peak (%2d): %10.2f MB\n",nGrids_, FFTMemUse_/(1024.f*1024.f));
+    }
+  }
+}
+
+void
+FFTGrid::removeExternalMemory(size_t bytes)
+{
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_count)
+#endif
+  {
+    FFTMemUse_ -= bytes;
+    Profiler::RecordMemory(FFTMemUse_, nGrids_);
+  }
+}
+
+void
+FFTGrid::makeCold()
+{
+  if (isFile() || rvalue_ == NULL)
+    return;
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_spill)
+#endif
+  {
+    if (cold_ == false) {
+      cold_ = true;
+      coldGrids_.push_back(this);
+    }
+  }
+}
+
+void
+FFTGrid::makeHot()
+{
+  std::string errTxt = "";
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_spill)
+#endif
+  {
+    if (cold_ == true) {
+      if (spilled_ == false)
+        coldGrids_.remove(this);
+      if (spilled_ == false || reload(errTxt) == true)
+        cold_ = false;
+    }
+  }
+  if (errTxt != "")
+    throw NRLib::IOError(errTxt);
+}
+
+bool
+FFTGrid::spill(std::string & errTxt)
+{
+  // Called with the fftgrid_spill lock held, so errors are returned rather than thrown.
+  // The values are only freed once they are safely on disk.
+  if (spillFile_ == "") {
+    std::string baseName = IO::PrefixTmpGrids() + "cold_" + NRLib::ToString(nSpillFiles_++);
+    spillFile_ = IO::makeFullFileName(IO::PathToTmpFiles(), baseName);
+  }
+  std::ofstream file;
+  try {
+    NRLib::OpenWrite(file, spillFile_, std::ios::out | std::ios::binary);
   }
+  catch (NRLib::Exception & e) {
+    errTxt = "Could not move a cold grid to disk: " + std::string(e.what());
+    return false;
+  }
+  size_t slabSize = static_cast<size_t>(rnxp_)*static_cast<size_t>(nyp_);
+  for (int k = 0; k < nzp_ && file.good(); k++)
+    file.write(reinterpret_cast<const char *>(rvalue_ + k*slabSize), static_cast<std::streamsize>(slabSize*sizeof(fftw_real)));
+  file.flush();
+  bool ok = file.good();
+  file.close();
+  if (ok == false || file.fail()) {
+    remove(spillFile_.c_str()); // Incomplete, and the values are still in memory
+    errTxt = "Could not move a cold grid to disk: Writing to " + spillFile_ + " failed.";
+    return false;
+  }
+  Profiler::AddToCounter(Profiler::FILE_BYTES_WRITTEN, static_cast<double>(rsize_*sizeof(fftw_real)));
 
+  fftw_free(rvalue_);
+  rvalue_  = NULL;
+  cvalue_  = NULL;
+  spilled_ = true;
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_count)
+#endif
+  {
+    if(add_==true)
+      nGrids_ = nGrids_ - 1;
+    FFTMemUse_ -= rsize_ * sizeof(fftw_real);
+    Profiler::RecordMemory(FFTMemUse_, nGrids_);
+  }
+  LogKit::LogFormatted(LogKit::DebugLow,"\nFFTGrid moved to disk to stay within memory budget: %10.2f MB in memory\n", FFTMemUse_/(1024.f*1024.f));
+  return true;
+}
 
+bool
+FFTGrid::reload(std::string & errTxt)
+{
+  // Called with the fftgrid_spill lock held, so errors are returned rather than thrown.
+  // The grid is brought back regardless of the budget, since it is about to be used. The
+  // spill file is kept until all values have been read.
+  std::ifstream file;
+  try {
+    NRLib::OpenRead(file, spillFile_, std::ios::in | std::ios::binary);
+  }
+  catch (NRLib::Exception & e) {
+    errTxt = "Could not read a cold grid back from disk: " + std::string(e.what());
+    return false;
+  }
+  fftw_real * values = static_cast<fftw_real*>(fftw_malloc(rsize_ * sizeof(fftw_real)));
+  size_t slabSize = static_cast<size_t>(rnxp_)*static_cast<size_t>(nyp_);
+  for (int k = 0; k < nzp_ && file.good(); k++)
+    file.read(reinterpret_cast<char *>(values + k*slabSize), static_cast<std::streamsize>(slabSize*sizeof(fftw_real)));
+  bool ok = file.good();
+  file.close();
+  if (ok == false) {
+    fftw_free(values);
+    errTxt = "Could not read a cold grid back from disk: Reading " + spillFile_ + " failed.";
+    return false;
+  }
+  remove(spillFile_.c_str());
+  rvalue_ = values;
+  cvalue_ = reinterpret_cast<fftw_complex*>(rvalue_);
+  Profiler::AddToCounter(Profiler::FILE_BYTES_READ, static_cast<double>(rsize_*sizeof(fftw_real)));
 
+  spilled_ = false;
+#ifdef PARALLEL
+#pragma omp critical(fftgrid_count)
+#endif
+  {
+    if(add_==true)
+      nGrids_ += 1;
+    maxAllocatedGrids_ = std::max(nGrids_, maxAllocatedGrids_);
+    FFTMemUse_ += rsize_ * sizeof(fftw_real);
+    Profiler::RecordMemory(FFTMemUse_, nGrids_);
+  }
 }
 
 int
@@ -1203,6 +1405,7 @@ fftw_complex
 FFTGrid::getNextComplex()
 {
   assert(istransformed_==true);
+  assert(rvalue_ != NULL); // A cold grid moved to disk must be made hot first
   assert(counterForGet_ < csize_);
   counterForGet_  +=  1;
   if(counterForGet_ == csize_)
@@ -1220,6 +1423,7 @@ float
 FFTGrid::getNextReal()
 {
   assert(istransformed_ == false);
+  assert(rvalue_ != NULL);
   assert(counterForGet_ < rsize_);
   counterForGet_  +=  1;
   float r;
@@ -1244,6 +1448,7 @@ FFTGrid::getRealValue(int i, int j, int k, bool extSimbox) const
   float value;
 
   assert(istransformed_==false);
+  assert(rvalue_ != NULL);
 
   bool  inSimbox   = (extSimbox ? ( (i < nxp_) && (j < nyp_) && (k < nzp_)):
     ((i < nx_) && (j < ny_) && (k < nz_)));
@@ -1286,6 +1491,7 @@ float
 FFTGrid::getRealValueCyclic(int i, int j, int k) const
 {
   float value;
+  assert(rvalue_ != NULL);
   if(i<0)
     i = nxp_+i;
   if(j<0)
@@ -1342,6 +1548,7 @@ FFTGrid::getComplexValue(int i, int j, int k, bool extSimbox) const
   fftw_complex value;
 
   assert(istransformed_==true);
+  assert(rvalue_ != NULL);
 
   bool  inSimbox   = (extSimbox ? ( (i < nxp_) && (j < nyp_) && (k < nzp_)):
     ((i < nx_) && (j < ny_) && (k < nz_)));
@@ -1384,6 +1591,7 @@ float
 FFTGrid::getFirstRealValue()
 {
   assert(istransformed_==false);
+  assert(rvalue_ != NULL);
   float value = static_cast<float>(rvalue_[0]);
   return( value );
 }
@@ -1392,6 +1600,7 @@ int
 FFTGrid::setNextComplex(fftw_complex value)
 {
   assert(istransformed_==true);
+  assert(rvalue_ != NULL);
   assert(counterForSet_ < csize_);
   counterForSet_  +=  1;
   if(counterForSet_==csize_)
@@ -1408,6 +1617,7 @@ int
 FFTGrid::SetNextComplex(std::complex<double> & value)
 {
   assert(istransformed_==true);
+  assert(rvalue_ != NULL);
   assert(counterForSet_ < csize_);
   counterForSet_ += 1;
   if(counterForSet_==csize_)
@@ -1428,6 +1638,7 @@ int
 FFTGrid::setNextReal(float value)
 {
   assert(istransformed_== false);
+  assert(rvalue_ != NULL);
   assert(counterForSet_ < rsize_);
   counterForSet_  +=  1;
   if(counterForSet_==rsize_)
@@ -1445,6 +1656,7 @@ int
 FFTGrid::setRealValue(int i, int j ,int k, float  value, bool extSimbox)
 {
   assert(istransformed_== false);
+  assert(rvalue_ != NULL);
 
   bool  inSimbox   = (extSimbox ? ( (i < rnxp_) && (j < nyp_) && (k < nzp_)) : ((i < nx_) && (j < ny_) && (k < nz_)));
   bool  notMissing = ( (i > -1) && (j > -1) && (k > -1));
@@ -1476,6 +1688,7 @@ int
 FFTGrid::setComplexValue(int i, int j ,int k, fftw_complex value, bool extSimbox)
 {
   assert(istransformed_== true);
+  assert(rvalue_ != NULL);
 
   bool  inSimbox   = (extSimbox ? ( (i < nxp_) && (j < nyp_) && (k < nzp_)):
     ((i < nx_) && (j < ny_) && (k < nz_)));
@@ -1600,12 +1813,7 @@ FFTGrid::fftInPlace()
   if( cubetype_!= COVARIANCE )
     FFTGrid::multiplyByScalar(1.0f/sqrt(static_cast<float>(static_cast<size_t>(nxp_)*static_cast<size_t>(nyp_)*static_cast<size_t>(nzp_))));
 
-  int flag;
-  rfftwnd_plan plan;
-  flag = FFTW_ESTIMATE | FFTW_IN_PLACE;
-  plan= rfftw3d_create_plan(nzp_,nyp_,nxp_,FFTW_REAL_TO_COMPLEX,flag);
-  rfftwnd_one_real_to_complex(plan,rvalue_,cvalue_);
-  fftwnd_destroy_plan(plan);
+  FFTPlanCache::RealToComplex3D(rvalue_, cvalue_, nxp_, nyp_, nzp_);
   istransformed_=true;
   time(&timeend);
   LogKit::LogFormatted(LogKit::DebugLow,"\nFFT of grid type %d finished after %ld seconds \n",cubetype_, timeend-timestart);
@@ -1626,17 +1834,12 @@ FFTGrid::invFFTInPlace()
   assert(cubetype_!= CTMISSING);
 
   float scale;
-  int flag;
-  rfftwnd_plan plan;
   if(cubetype_==COVARIANCE)
     scale=float( 1.0/(static_cast<size_t>(nxp_)*static_cast<size_t>(nyp_)*static_cast<size_t>(nzp_)));
   else
     scale=float( 1.0/sqrt(float(static_cast<size_t>(nxp_)*static_cast<size_t>(nyp_)*static_cast<size_t>(nzp_))));
 
-  flag = FFTW_ESTIMATE | FFTW_IN_PLACE;
-  plan= rfftw3d_create_plan(nzp_,nyp_,nxp_,FFTW_COMPLEX_TO_REAL,flag);
-  rfftwnd_one_complex_to_real(plan,cvalue_,rvalue_);
-  fftwnd_destroy_plan(plan);
+  FFTPlanCache::ComplexToReal3D(cvalue_, rvalue_, nxp_, nyp_, nzp_);
   istransformed_=false;
 
   FFTGrid::multiplyByScalar(scale);
@@ -1772,22 +1975,212 @@ FFTGrid::multiplyByScalar(float scalar)
   }
 }
 
+void
+FFTGrid::applyElementwise(const ElementwiseChain & chain)
+{
+  std::vector<std::vector<fftw_real> > buffers;
+  std::vector<const fftw_real *>       operands;
+
+  assert(rvalue_ != NULL);
+  beginElementwiseOperands(chain, nxp_, buffers);
+
+  // Real and complex grids share memory, and rsize_ = 2*csize_.
+  for(size_t start = 0; start < rsize_; start += elementwiseBlockSize_)
+  {
+    size_t n = rsize_ - start;
+    if(n > elementwiseBlockSize_)
+      n = elementwiseBlockSize_;
+    getElementwiseOperands(chain, istransformed_, start, n, buffers, operands);
+    applyElementwiseToBlock(chain, istransformed_, rvalue_ + start, operands, n);
+  }
+
+  endElementwiseOperands(chain);
+}
+
+void
+FFTGrid::beginElementwiseOperands(const ElementwiseChain               & chain,
+                                  int                                    nxp,
+                                  std::vector<std::vector<fftw_real> > & buffers)
+{
+  // Operands stored on file can only be read sequentially, so they are buffered block by block.
+  buffers.resize(chain.getNumberOfOperations());
+  for(size_t op = 0; op < chain.getNumberOfOperations(); op++) {
+    FFTGrid * fftGrid = chain.getGrid(op);
+    if(fftGrid != NULL)
+      assert(nxp == fftGrid->getNxp());
+    if(fftGrid != NULL && fftGrid->isFile()) {
+      fftGrid->setAccessMode(READ);
+      buffers[op].resize(elementwiseBlockSize_);
+    }
+  }
+}
+
+void
+FFTGrid::getElementwiseOperands(const ElementwiseChain               & chain,
+                                bool                                   isTransformed,
+                                size_t                                 start,
+                                size_t                                 n,
+                                std::vector<std::vector<fftw_real> > & buffers,
+                                std::vector<const fftw_real *>       & operands)
+{
+  operands.assign(chain.getNumberOfOperations(), NULL);
+  for(size_t op = 0; op < chain.getNumberOfOperations(); op++) {
+    FFTGrid * fftGrid = chain.getGrid(op);
+    if(fftGrid == NULL)
+      continue;
+    assert(fftGrid->getIsTransformed() == isTransformed);
+    if(fftGrid->isFile()) {
+      if(buffers[op].size() < n)
+        buffers[op].resize(n);
+      if(isTransformed) {
+        fftw_complex * cBuffer = reinterpret_cast<fftw_complex *>(&buffers[op][0]);
+        for(size_t i = 0; i < n/2; i++)
+          cBuffer[i] = fftGrid->getNextComplex();
+      }
+      else {
+        for(size_t i = 0; i < n; i++)
+          buffers[op][i] = fftGrid->getNextReal();
+      }
+      operands[op] = &buffers[op][0];
+    }
+    else {
+      assert(fftGrid->rvalue_ != NULL); // Cold operands must be made hot first
+      operands[op] = fftGrid->rvalue_ + start;
+    }
+  }
+}
+
+void
+FFTGrid::endElementwiseOperands(const ElementwiseChain & chain)
+{
+  for(size_t op = 0; op < chain.getNumberOfOperations(); op++) {
+    FFTGrid * fftGrid = chain.getGrid(op);
+    if(fftGrid != NULL && fftGrid->isFile())
+      fftGrid->endAccess();
+  }
+}
+
+void
+FFTGrid::applyElementwiseToBlock(const ElementwiseChain               & chain,
+                                 bool                                   isTransformed,
+                                 fftw_real                            * values,
+                                 const std::vector<const fftw_real *> & operands,
+                                 size_t                                 n)
+{
+  // The loops are kept simple so that the compiler can vectorize them. For
+  // complex grids, values hold n/2 interleaved (re,im) pairs.
+  fftw_complex * cValues = reinterpret_cast<fftw_complex *>(values);
+  size_t         nc      = n/2;
+
+  for(size_t op = 0; op < chain.getNumberOfOperations(); op++) {
+    float             scalar  = chain.getScalar(op);
+    const fftw_real * operand = operands[op];
+
+    switch(chain.getOperation(op))
+    {
+    case ElementwiseChain::ADD_SCALAR:
+      assert(isTransformed == false);
+      for(size_t i = 0; i < n; i++)
+        values[i] += scalar;
+      break;
+
+    case ElementwiseChain::MULTIPLY_BY_SCALAR:
+      assert(isTransformed == false);
+      for(size_t i = 0; i < n; i++)
+        values[i] *= scalar;
+      break;
+
+    case ElementwiseChain::EXP_TRANSF:
+      assert(isTransformed == false);
+      for(size_t i = 0; i < n; i++) {
+        if(values[i] != RMISSING)
+          values[i] = float(exp(values[i]));
+      }
+      break;
+
+    case ElementwiseChain::LOG_TRANSF:
+      assert(isTransformed == false);
+      for(size_t i = 0; i < n; i++) {
+        if(values[i] == RMISSING || values[i] <= 0.0)
+          values[i] = 0;
+        else
+          values[i] = float(log(values[i]));
+      }
+      break;
+
+    case ElementwiseChain::SQUARE:
+      if(isTransformed) {
+        for(size_t i = 0; i < nc; i++) {
+          if(cValues[i].re == RMISSING || cValues[i].im == RMISSING) {
+            cValues[i].re = RMISSING;
+            cValues[i].im = RMISSING;
+          }
+          else {
+            cValues[i].re = cValues[i].re*cValues[i].re + cValues[i].im*cValues[i].im;
+            cValues[i].im = 0.0;
+          }
+        }
+      }
+      else {
+        for(size_t i = 0; i < n; i++) {
+          if(values[i] != RMISSING)
+            values[i] = float(values[i]*values[i]);
+        }
+      }
+      break;
+
+    case ElementwiseChain::CHANGE_SIGN:
+      for(size_t i = 0; i < n; i++)
+        values[i] = -values[i];
+      break;
+
+    case ElementwiseChain::CONJUGATE:
+      assert(isTransformed == true);
+      for(size_t i = 0; i < nc; i++)
+        cValues[i].im = -cValues[i].im;
+      break;
+
+    case ElementwiseChain::ADD:
+      for(size_t i = 0; i < n; i++)
+        values[i] += operand[i];
+      break;
+
+    case ElementwiseChain::SUBTRACT:
+      for(size_t i = 0; i < n; i++)
+        values[i] -= operand[i];
+      break;
+
+    case ElementwiseChain::MULTIPLY:
+      if(isTransformed) {
+        const fftw_complex * cOperand = reinterpret_cast<const fftw_complex *>(operand);
+        for(size_t i = 0; i < nc; i++) {
+          fftw_complex tmp = cValues[i];
+          cValues[i].re = cOperand[i].re*tmp.re - cOperand[i].im*tmp.im;
+          cValues[i].im = cOperand[i].im*tmp.re + cOperand[i].re*tmp.im;
+        }
+      }
+      else {
+        for(size_t i = 0; i < n; i++)
+          values[i] *= operand[i];
+      }
+      break;
+
+    default:
+      assert(false);
+    }
+  }
+}
+
 fftw_complex*
 FFTGrid::fft1DzInPlace(fftw_real*  in, int nzp)
 {
   // in is over vritten by out
   // not norm preservingtransform ifft(fft(funk))=N*funk
 
-  int flag;
-
-  rfftwnd_plan plan;
   fftw_complex* out;
   out = reinterpret_cast<fftw_complex*>(in);
 
-  flag    = FFTW_ESTIMATE | FFTW_IN_PLACE;
-  plan    = rfftwnd_create_plan(1, &nzp ,FFTW_REAL_TO_COMPLEX,flag);
-  rfftwnd_one_real_to_complex(plan,in ,out);
-  fftwnd_destroy_plan(plan);
+  FFTPlanCache::RealToComplex1D(in, out, nzp);
 
   return out;
 }
@@ -1798,15 +2191,10 @@ FFTGrid::invFFT1DzInPlace(fftw_complex* in, int nzp)
   // in is over vritten by out
   // not norm preserving transform  ifft(fft(funk))=N*funk
 
-  int flag;
-  rfftwnd_plan plan;
   fftw_real*  out;
   out = reinterpret_cast<fftw_real*>(in);
 
-  flag = FFTW_ESTIMATE | FFTW_IN_PLACE;
-  plan= rfftwnd_create_plan(1,&nzp,FFTW_COMPLEX_TO_REAL,flag);
-  rfftwnd_one_complex_to_real(plan,in,out);
-  fftwnd_destroy_plan(plan);
+  FFTPlanCache::ComplexToReal1D(in, out, nzp);
   return out;
 }
 
@@ -2660,9 +3048,10 @@ int FFTGrid::findClosestFactorableNumber(int leastint)
 
 int FFTGrid::formatFlag_        = 0;
 int FFTGrid::domainFlag_        = IO::TIMEDOMAIN;
-int FFTGrid::maxAllowedGrids_   = 1;   // One grid is allocated and deallocated before memory check.
 int FFTGrid::maxAllocatedGrids_ = 0;
 int FFTGrid::nGrids_            = 0;
-bool FFTGrid::terminateOnMaxGrid_ = false;
+double FFTGrid::memoryBudget_   = 0.0;
+std::list<FFTGrid *> FFTGrid::coldGrids_;
+int FFTGrid::nSpillFiles_       = 0;
 float FFTGrid::maxFFTMemUse_    = 0;
 float FFTGrid::FFTMemUse_       = 0;
@@ -7,7 +7,9 @@
 
 #include <assert.h>
 #include <complex>
+#include <list>
 #include <string>
+#include <vector>
 
 #include "fftw.h"
 #include "rfftw.h"
@@ -18,6 +20,9 @@ class Simbox;
 class RandomGen;
 class GridMapping;
 class SeismicParametersHolder;
+namespace NRLib {
+  class RandomGenerator;
+}
 
 class FFTGrid
 {
@@ -27,7 +32,7 @@ public:
   FFTGrid(FFTGrid * fftGrid, bool expTrans = false);
   FFTGrid(const NRLib::Grid<float> * grid, int nxp, int nyp, int nzp);
   FFTGrid(const StormContGrid * grid, int nxp, int nyp, int nzp);
-  FFTGrid() {} //Dummy constructor needed for FFTFileGrid
+  FFTGrid() : cold_(false), spilled_(false) {} //Dummy constructor needed for FFTFileGrid
   virtual ~FFTGrid();
 
   void setType(int cubeType) {cubetype_ = cubeType;}
@@ -95,7 +100,7 @@ public:
 
 
 
-  virtual void         fillInComplexNoise(RandomGen * ranGen);   // No mode/randomaccess
+  virtual void         fillInComplexNoise(NRLib::RandomGenerator * ranGen);   // No mode/randomaccess
 
   void                 fillInFromArray(float *value);
   void                 calculateStatistics();                    // min,max, avg
@@ -129,6 +134,8 @@ public:
   virtual void         changeSign();                   // No mode/randomaccess
   virtual void         multiply(FFTGrid* fftGrid);              // pointwise multiplication!
   virtual void         conjugate();                             // No mode/randomaccess
+  class                ElementwiseChain;
+  virtual void         applyElementwise(const ElementwiseChain & chain); // No mode/randomaccess, one pass for all operations
   bool                 consistentSize(int nx,int ny, int nz, int nxp, int nyp, int nzp);
   size_t               getCounterForGet() const {return(counterForGet_);}
   size_t               getCounterForSet() const {return(counterForSet_);}
@@ -155,9 +162,48 @@ public:
   enum                 gridTypes{CTMISSING, DATA, PARAMETER, COVARIANCE, VELOCITY};
   enum                 accessMode{NONE, READ, WRITE, READANDWRITE, RANDOMACCESS};
 
+  /// Chain of element-wise operations that applyElementwise() does in a single pass over
+  /// the grid, instead of one pass per operation. E.g. a = exp(a - b)*s is done by
+  ///   a->applyElementwise(FFTGrid::ElementwiseChain().subtract(b).expTransf().multiplyByScalar(s));
+  /// Each operation has the same meaning as the FFTGrid method with the same name.
+  class ElementwiseChain
+  {
+  public:
+    enum               elementwiseOperations{ADD_SCALAR, MULTIPLY_BY_SCALAR, EXP_TRANSF, LOG_TRANSF, SQUARE,
+                                             CHANGE_SIGN, CONJUGATE, ADD, SUBTRACT, MULTIPLY};
+
+    ElementwiseChain & addScalar(float scalar)        { return(push(ADD_SCALAR, scalar, NULL))        ;}
+    ElementwiseChain & multiplyByScalar(float scalar) { return(push(MULTIPLY_BY_SCALAR, scalar, NULL));}
+    ElementwiseChain & expTransf()                    { return(push(EXP_TRANSF, 0.0f, NULL))          ;}
+    ElementwiseChain & logTransf()                    { return(push(LOG_TRANSF, 0.0f, NULL))          ;}
+    ElementwiseChain & square()                       { return(push(SQUARE, 0.0f, NULL))              ;}
+    ElementwiseChain & changeSign()                   { return(push(CHANGE_SIGN, 0.0f, NULL))         ;}
+    ElementwiseChain & conjugate()                    { return(push(CONJUGATE, 0.0f, NULL))           ;}
+    ElementwiseChain & add(FFTGrid * fftGrid)         { return(push(ADD, 0.0f, fftGrid))              ;}
+    ElementwiseChain & subtract(FFTGrid * fftGrid)    { return(push(SUBTRACT, 0.0f, fftGrid))         ;}
+    ElementwiseChain & multiply(FFTGrid * fftGrid)    { return(push(MULTIPLY, 0.0f, fftGrid))         ;}
+
+    size_t             getNumberOfOperations()  const { return(operations_.size()) ;}
+    int                getOperation(size_t op)  const { return(operations_[op])    ;}
+    float              getScalar(size_t op)     const { return(scalars_[op])       ;}
+    FFTGrid          * getGrid(size_t op)       const { return(grids_[op])         ;}
+
+  private:
+    ElementwiseChain & push(int operation, float scalar, FFTGrid * fftGrid) {
+                         operations_.push_back(operation);
+                         scalars_.push_back(scalar);
+                         grids_.push_back(fftGrid);
+                         return(*this);
+                       }
+
+    std::vector<int>       operations_;
+    std::vector<float>     scalars_;
+    std::vector<FFTGrid *> grids_;     // Second operand of ADD, SUBTRACT and MULTIPLY, NULL otherwise
+  };
+
   virtual void         multiplyByScalar(float scalar);      //No mode/randomaccess
   int                  getType() const {return(cubetype_);}
-  virtual void         setAccessMode(int mode){assert(mode>=0);}
+  virtual void         setAccessMode(int mode){assert(mode>=0); if(cold_) makeHot();}
   virtual void         endAccess(){counterForGet_ = 0; counterForSet_ = 0;}
   virtual void         writeFile(const std::string              & fileName,
                                  const std::string              & subDir,
@@ -190,10 +236,24 @@ public:
   int                  getOutputFormat() {return(formatFlag_);}
   static void          setOutputDomain(int domain) {domainFlag_ = domain;}
   int                  getOutputDomain() {return(domainFlag_);}
-  static void          setMaxAllowedGrids(int maxAllowedGrids) {maxAllowedGrids_ = maxAllowedGrids ;}
-  static int           getMaxAllowedGrids()   { return maxAllowedGrids_   ;}
   static int           getMaxAllocatedGrids() { return maxAllocatedGrids_ ;}
-  static void          setTerminateOnMaxGrid(bool terminate) {terminateOnMaxGrid_ = terminate ;}
+
+  // Bytes of grid values we may hold in memory. When a new grid would exceed this, cold
+  // grids are moved to disk, least recently used first. Zero means no limit.
+  static void          setMemoryBudget(double bytes) { memoryBudget_ = bytes ;}
+  static double        getMemoryBudget()             { return memoryBudget_  ;}
+  static double        getMemoryInUse()              { return FFTMemUse_     ;}
+
+  // Grid values held outside FFTGrid, as in CovTensorGrid, are counted with the grids,
+  // so that they are included in the memory budget and the memory statistics.
+  static void          addExternalMemory(size_t bytes);
+  static void          removeExternalMemory(size_t bytes);
+
+  // Usage hints for grids in memory. A cold grid is not accessed until it is made hot again,
+  // and may meanwhile be moved to disk. makeHot(), or setAccessMode(), brings it back.
+  void                 makeCold();
+  void                 makeHot();
+  bool                 isSpilled() const { return spilled_ ;}
   static int           findClosestFactorableNumber(int leastint);
 
   static fftw_complex* fft1DzInPlace(fftw_real*  in, int nzp);
@@ -222,6 +282,10 @@ public:
 
   void                 createGrid();
 protected:
+  static void          spillColdGrids(size_t bytes);  // Move cold grids to disk until bytes more fit in the budget.
+  bool                 spill(std::string & errTxt);   // False, with the values kept in memory, if writing fails.
+  bool                 reload(std::string & errTxt);  // False, with the spill file kept, if reading fails.
+
   //int                setPaddingSize(int n, float p);
   int                  getFillNumber(int i, int n, int np );
 
@@ -242,6 +306,26 @@ protected:
   void                 writeSegyFromStorm(Simbox * simbox, StormContGrid *data, std::string fileName);
   void                 makeDepthCubeForSegy(Simbox *simbox,const std::string & fileName);
 
+  /// Supporting functions for applyElementwise. Operands are fetched and the chain applied
+  /// one block of values at a time, so that the block stays in cache for all operations.
+  static void          beginElementwiseOperands(const ElementwiseChain               & chain,
+                                                int                                    nxp,
+                                                std::vector<std::vector<fftw_real> > & buffers);
+  static void          getElementwiseOperands(const ElementwiseChain               & chain,
+                                              bool                                   isTransformed,
+                                              size_t                                 start,
+                                              size_t                                 n,
+                                              std::vector<std::vector<fftw_real> > & buffers,
+                                              std::vector<const fftw_real *>       & operands);
+  static void          endElementwiseOperands(const ElementwiseChain & chain);
+  static void          applyElementwiseToBlock(const ElementwiseChain             & chain,
+                                               bool                                 isTransformed,
+                                               fftw_real                          * values,
+                                               const std::vector<const fftw_real *> & operands,
+                                               size_t                               n);
+
+  static const size_t  elementwiseBlockSize_ = 4096; // Number of reals per block in applyElementwise
+
   int                  cubetype_;          // see enum gridtypes above
   float                theta_;             // angle in angle gather (case of data)
   float                scale_;             // To keep track of the scalings after fourier transforms
@@ -273,12 +357,18 @@ protected:
   static int           formatFlag_;        // Decides format of output (see ModelSettings).
   static int           domainFlag_;        // Decides domain of output (see ModelSettings).
 
-  static int           maxAllowedGrids_;   // The maximum number of grids we are allowed to allocate.
   static int           maxAllocatedGrids_; // The maximum number of grids that has actually been allocated.
   static int           nGrids_;            // The actually number of grids allocated (varies as crava runs).
-  static bool          terminateOnMaxGrid_; // If true, terminate when we try to allocate more than maxAllowedGrids.
   bool                 add_;                // Tells whether we should change nGrids_ or not
 
+  bool                 cold_;               // Set by makeCold(). The grid may be moved to disk.
+  bool                 spilled_;            // The values of a cold grid are on disk, in spillFile_.
+  std::string          spillFile_;
+
+  static double        memoryBudget_;       // See setMemoryBudget().
+  static std::list<FFTGrid *> coldGrids_;   // Cold grids still in memory, least recently used first.
+  static int           nSpillFiles_;        // Number used for generating spill file names.
+
   static float         maxFFTMemUse_;
   static float         FFTMemUse_;
 
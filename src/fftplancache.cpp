@@ -0,0 +1,277 @@
+/***************************************************************************
+*      Copyright (C) 2008 by Norwegian Computing Center and Statoil        *
+***************************************************************************/
+
+#include <stdio.h>
+
+#ifdef PARALLEL
+#include <omp.h>
+#endif
+
+#include "nrlib/iotools/logkit.hpp"
+
+#include "src/definitions.h"
+#include "src/fftplancache.h"
+#include "src/profiler.h"
+
+std::map<FFTPlanCache::PlanKey, rfftwnd_plan> FFTPlanCache::real_plans_;
+std::map<FFTPlanCache::PlanKey, fftw_plan>    FFTPlanCache::complex_plans_;
+int                                           FFTPlanCache::n_threads_   = 1;
+std::string                                   FFTPlanCache::wisdom_file_ = "";
+
+bool
+FFTPlanCache::PlanKey::operator<(const PlanKey & k) const
+{
+  if (rank_ != k.rank_) return rank_ < k.rank_;
+  if (nxp_  != k.nxp_ ) return nxp_  < k.nxp_;
+  if (nyp_  != k.nyp_ ) return nyp_  < k.nyp_;
+  if (nzp_  != k.nzp_ ) return nzp_  < k.nzp_;
+  return dir_ < k.dir_;
+}
+
+//-------------------------------------------------------------------------------
+void
+FFTPlanCache::ReadWisdom(const std::string & file_name)
+{
+  wisdom_file_ = file_name;
+
+  FILE * file = fopen(file_name.c_str(), "r");
+  if (file == NULL) {
+    LogKit::LogFormatted(LogKit::Low,"\nFFT wisdom file \'%s\' does not exist yet. It will be created.\n", file_name.c_str());
+    return;
+  }
+  if (fftw_import_wisdom_from_file(file) == FFTW_SUCCESS)
+    LogKit::LogFormatted(LogKit::Low,"\nFFT wisdom read from file \'%s\'.\n", file_name.c_str());
+  else
+    LogKit::LogFormatted(LogKit::Warning,"\nWARNING: Could not read FFT wisdom from file \'%s\'. Plans will be measured.\n", file_name.c_str());
+  fclose(file);
+}
+
+//-------------------------------------------------------------------------------
+void
+FFTPlanCache::WriteWisdom(void)
+{
+  if (wisdom_file_ == "")
+    return;
+
+  FILE * file = fopen(wisdom_file_.c_str(), "w");
+  if (file == NULL) {
+    LogKit::LogFormatted(LogKit::Warning,"\nWARNING: Could not write FFT wisdom to file \'%s\'.\n", wisdom_file_.c_str());
+    return;
+  }
+  fftw_export_wisdom_to_file(file);
+  fclose(file);
+}
+
+//-------------------------------------------------------------------------------
+void
+FFTPlanCache::RealToComplex3D(fftw_real    * in,
+                              fftw_complex * out,
+                              int            nxp,
+                              int            nyp,
+                              int            nzp)
+{
+  Profiler::AddFFT(nxp*nyp*nzp);
+
+  if (n_threads_ <= 1 || nzp < 2) {
+    rfftwnd_plan plan = GetRealPlan(3, nxp, nyp, nzp, FFTW_REAL_TO_COMPLEX);
+    rfftwnd_one_real_to_complex(plan, in, out);
+    return;
+  }
+
+  //
+  // Transform each z-slab in the (x,y)-plane, then transform the z-columns.
+  // In the in-place storage a complex slab occupies as many bytes as a real one.
+  //
+  rfftwnd_plan slab_plan = GetRealPlan(2, nxp, nyp, 1, FFTW_REAL_TO_COMPLEX);
+  fftw_plan    z_plan    = GetComplexPlan(nzp, FFTW_FORWARD);
+  int          n_cols    = (nxp/2 + 1)*nyp;
+
+#ifdef PARALLEL
+  int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(n_threads_)
+#endif
+  for (int k = 0; k < nzp; k++) {
+    size_t offset = static_cast<size_t>(k)*static_cast<size_t>(n_cols);
+    rfftwnd_one_real_to_complex(slab_plan, in + 2*offset, out + offset);
+  }
+
+#ifdef PARALLEL
+#pragma omp parallel for schedule(static, 1) num_threads(n_threads_)
+#endif
+  for (int t = 0; t < n_threads_; t++) {
+    int first = static_cast<int>((static_cast<size_t>(n_cols)*t)/n_threads_);
+    int last  = static_cast<int>((static_cast<size_t>(n_cols)*(t + 1))/n_threads_);
+    if (last > first)
+      fftw(z_plan, last - first, out + first, n_cols, 1, NULL, 0, 0);
+  }
+}
+
+//-------------------------------------------------------------------------------
+void
+FFTPlanCache::ComplexToReal3D(fftw_complex * in,
+                              fftw_real    * out,
+                              int            nxp,
+                              int            nyp,
+                              int            nzp)
+{
+  Profiler::AddFFT(nxp*nyp*nzp);
+
+  if (n_threads_ <= 1 || nzp < 2) {
+    rfftwnd_plan plan = GetRealPlan(3, nxp, nyp, nzp, FFTW_COMPLEX_TO_REAL);
+    rfftwnd_one_complex_to_real(plan, in, out);
+    return;
+  }
+
+  //
+  // Reverse order of RealToComplex3D: z-columns first, then each z-slab.
+  //
+  rfftwnd_plan slab_plan = GetRealPlan(2, nxp, nyp, 1, FFTW_COMPLEX_TO_REAL);
+  fftw_plan    z_plan    = GetComplexPlan(nzp, FFTW_BACKWARD);
+  int          n_cols    = (nxp/2 + 1)*nyp;
+
+#ifdef PARALLEL
+#pragma omp parallel for schedule(static, 1) num_threads(n_threads_)
+#endif
+  for (int t = 0; t < n_threads_; t++) {
+    int first = static_cast<int>((static_cast<size_t>(n_cols)*t)/n_threads_);
+    int last  = static_cast<int>((static_cast<size_t>(n_cols)*(t + 1))/n_threads_);
+    if (last > first)
+      fftw(z_plan, last - first, in + first, n_cols, 1, NULL, 0, 0);
+  }
+
+#ifdef PARALLEL
+  int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(n_threads_)
+#endif
+  for (int k = 0; k < nzp; k++) {
+    size_t offset = static_cast<size_t>(k)*static_cast<size_t>(n_cols);
+    rfftwnd_one_complex_to_real(slab_plan, in + offset, out + 2*offset);
+  }
+}
+
+//-------------------------------------------------------------------------------
+void
+FFTPlanCache::RealToComplex1D(fftw_real    * in,
+                              fftw_complex * out,
+                              int            nzp)
+{
+  Profiler::AddFFT(nzp);
+  rfftwnd_plan plan = GetRealPlan(1, 1, 1, nzp, FFTW_REAL_TO_COMPLEX);
+  rfftwnd_one_real_to_complex(plan, in, out);
+}
+
+//-------------------------------------------------------------------------------
+void
+FFTPlanCache::ComplexToReal1D(fftw_complex * in,
+                              fftw_real    * out,
+                              int            nzp)
+{
+  Profiler::AddFFT(nzp);
+  rfftwnd_plan plan = GetRealPlan(1, 1, 1, nzp, FFTW_COMPLEX_TO_REAL);
+  rfftwnd_one_complex_to_real(plan, in, out);
+}
+
+//-------------------------------------------------------------------------------
+void
+FFTPlanCache::RealToComplex1DMany(fftw_real * in,
+                                  int         nzp,
+                                  int         n_traces)
+{
+  Profiler::AddFFT(nzp, n_traces);
+  rfftwnd_plan plan = GetRealPlan(1, 1, 1, nzp, FFTW_REAL_TO_COMPLEX);
+  rfftwnd_real_to_complex(plan, n_traces, in, 1, 2*(nzp/2 + 1), NULL, 0, 0);
+}
+
+//-------------------------------------------------------------------------------
+void
+FFTPlanCache::ComplexToReal1DMany(fftw_complex * in,
+                                  int            nzp,
+                                  int            n_traces)
+{
+  Profiler::AddFFT(nzp, n_traces);
+  rfftwnd_plan plan = GetRealPlan(1, 1, 1, nzp, FFTW_COMPLEX_TO_REAL);
+  rfftwnd_complex_to_real(plan, n_traces, in, 1, nzp/2 + 1, NULL, 0, 0);
+}
+
+//-------------------------------------------------------------------------------
+void
+FFTPlanCache::DestroyPlans(void)
+{
+  std::map<PlanKey, rfftwnd_plan>::iterator it;
+  for (it = real_plans_.begin(); it != real_plans_.end(); it++)
+    rfftwnd_destroy_plan(it->second);
+  real_plans_.clear();
+
+  std::map<PlanKey, fftw_plan>::iterator jt;
+  for (jt = complex_plans_.begin(); jt != complex_plans_.end(); jt++)
+    fftw_destroy_plan(jt->second);
+  complex_plans_.clear();
+}
+
+//-------------------------------------------------------------------------------
+rfftwnd_plan
+FFTPlanCache::GetRealPlan(int            rank,
+                          int            nxp,
+                          int            nyp,
+                          int            nzp,
+                          fftw_direction dir)
+{
+  rfftwnd_plan plan = NULL;
+  PlanKey      key(rank, nxp, nyp, nzp, dir);
+
+  // The FFTW planner is not reentrant, so both lookup and planning are serialised.
+#ifdef PARALLEL
+#pragma omp critical(fft_plan_cache)
+#endif
+  {
+    std::map<PlanKey, rfftwnd_plan>::iterator it = real_plans_.find(key);
+    if (it != real_plans_.end())
+      plan = it->second;
+    else {
+      int flags = GetPlanFlags();
+      if (rank == 3)
+        plan = rfftw3d_create_plan(nzp, nyp, nxp, dir, flags);
+      else if (rank == 2)
+        plan = rfftw2d_create_plan(nyp, nxp, dir, flags);
+      else
+        plan = rfftwnd_create_plan(1, &nzp, dir, flags);
+      real_plans_[key] = plan;
+    }
+  }
+  return plan;
+}
+
+//-------------------------------------------------------------------------------
+fftw_plan
+FFTPlanCache::GetComplexPlan(int            nzp,
+                             fftw_direction dir)
+{
+  fftw_plan plan = NULL;
+  PlanKey   key(1, 1, 1, nzp, dir);
+
+#ifdef PARALLEL
+#pragma omp critical(fft_plan_cache)
+#endif
+  {
+    std::map<PlanKey, fftw_plan>::iterator it = complex_plans_.find(key);
+    if (it != complex_plans_.end())
+      plan = it->second;
+    else {
+      plan = fftw_create_plan(nzp, dir, GetPlanFlags());
+      complex_plans_[key] = plan;
+    }
+  }
+  return plan;
+}
+
+//-------------------------------------------------------------------------------
+int
+FFTPlanCache::GetPlanFlags(void)
+{
+  // FFTW_THREADSAFE makes the plans read-only, so that they can be shared between threads.
+  if (wisdom_file_ != "")
+    return FFTW_MEASURE | FFTW_USE_WISDOM | FFTW_IN_PLACE | FFTW_THREADSAFE;
+  else
+    return FFTW_ESTIMATE | FFTW_IN_PLACE | FFTW_THREADSAFE;
+}
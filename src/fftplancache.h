@@ -0,0 +1,74 @@
+/***************************************************************************
+*      Copyright (C) 2008 by Norwegian Computing Center and Statoil        *
+***************************************************************************/
+
+#ifndef FFTPLANCACHE_H
+#define FFTPLANCACHE_H
+
+#include <map>
+#include <string>
+
+#include "fftw.h"
+#include "rfftw.h"
+
+//
+// Keeps the FFTW plans used by FFTGrid and Wavelet alive for the whole run,
+// so that each combination of grid size and direction is planned only once.
+//
+// The plans are made read-only (FFTW_THREADSAFE), so a cached plan may be
+// executed by several threads at the same time. When more than one thread is
+// allowed, the in-place 3D transforms are split into z-slabs (2D transforms)
+// and z-columns (1D transforms) that are distributed among the threads. This
+// is the same sequence of 1D transforms as the full 3D plan performs, so the
+// result does not depend on the number of threads.
+//
+// If a wisdom file is given, plans are measured (FFTW_MEASURE) instead of
+// estimated, and the accumulated wisdom is written back at the end of the run.
+//
+class FFTPlanCache
+{
+public:
+  static void          SetNumberOfThreads(int n_threads)   { n_threads_ = n_threads ;}
+  static int           GetNumberOfThreads(void)            { return n_threads_      ;}
+
+  static void          ReadWisdom(const std::string & file_name);
+  static void          WriteWisdom(void);
+
+  static void          RealToComplex3D(fftw_real * in, fftw_complex * out, int nxp, int nyp, int nzp);
+  static void          ComplexToReal3D(fftw_complex * in, fftw_real * out, int nxp, int nyp, int nzp);
+
+  static void          RealToComplex1D(fftw_real * in, fftw_complex * out, int nzp);
+  static void          ComplexToReal1D(fftw_complex * in, fftw_real * out, int nzp);
+
+  // n_traces 1D transforms with one plan and one call. The traces are stored one after
+  // another, each padded to 2*(nzp/2+1) reals, and are transformed in place.
+  static void          RealToComplex1DMany(fftw_real * in, int nzp, int n_traces);
+  static void          ComplexToReal1DMany(fftw_complex * in, int nzp, int n_traces);
+
+  static void          DestroyPlans(void);
+
+private:
+  struct PlanKey
+  {
+    PlanKey(int rank, int nxp, int nyp, int nzp, int dir) : rank_(rank), nxp_(nxp), nyp_(nyp), nzp_(nzp), dir_(dir) {}
+    bool operator<(const PlanKey & k) const;
+
+    int rank_;
+    int nxp_;
+    int nyp_;
+    int nzp_;
+    int dir_;
+  };
+
+  static rfftwnd_plan  GetRealPlan(int rank, int nxp, int nyp, int nzp, fftw_direction dir);
+  static fftw_plan     GetComplexPlan(int nzp, fftw_direction dir);
+  static int           GetPlanFlags(void);
+
+  static std::map<PlanKey, rfftwnd_plan> real_plans_;      // rfftwnd plans for rank 1, 2 and 3
+  static std::map<PlanKey, fftw_plan>    complex_plans_;   // 1D complex plans used along z in threaded 3D transforms
+
+  static int                             n_threads_;       // Number of threads allowed in 3D transforms
+  static std::string                     wisdom_file_;     // Empty if wisdom is not used
+};
+
+#endif
@@ -131,8 +131,7 @@ GravimetricInversion::GravimetricInversion(ModelGeneral            *  modelGener
 
   // Covariance of new parameter
   FFTGrid * cov_rho_total = new FFTGrid(cov_rho_static);
-  cov_rho_total->add(cov_rho_current);
-  cov_rho_total->subtract(cov_rhorho_static_current);
+  cov_rho_total->applyElementwise(FFTGrid::ElementwiseChain().add(cov_rho_current).subtract(cov_rhorho_static_current));
 
   cov_rho_total            ->setAccessMode(FFTGrid::READANDWRITE);
   cov_rhorho_static_current->setAccessMode(FFTGrid::READ);
@@ -488,8 +487,8 @@ void
 {
   assert(log_mean->getIsTransformed() == false);
 
-  log_mean->addScalar(0.5f*sigma_squared);  // \mu_{log rho^c} + 0.5*\sigma^2
-  log_mean->expTransf();  //exp{\mu_{log rho^c} + 0.5*\sigma^2}. Finished transformation.
+  // exp{\mu_{log rho^c} + 0.5*\sigma^2}
+  log_mean->applyElementwise(FFTGrid::ElementwiseChain().addScalar(0.5f*sigma_squared).expTransf());
 }
 
 void
@@ -497,9 +496,7 @@ void
 {
   assert(log_cov->getIsTransformed() == false);
 
-  log_cov->expTransf();
-  log_cov->addScalar(-1);
-  log_cov->multiplyByScalar(mean*mean);
+  log_cov->applyElementwise(FFTGrid::ElementwiseChain().expTransf().addScalar(-1).multiplyByScalar(mean*mean));
 }
 
 void
@@ -507,9 +504,7 @@ void
 {
   assert(log_cov->getIsTransformed() == false);
 
-  log_cov->expTransf();
-  log_cov->addScalar(-1);
-  log_cov->multiplyByScalar(mean_a*mean_b);
+  log_cov->applyElementwise(FFTGrid::ElementwiseChain().expTransf().addScalar(-1).multiplyByScalar(mean_a*mean_b));
 }
 
 void
@@ -517,8 +512,7 @@ void
 {
   assert(mean->getIsTransformed() == false);
 
-  mean->logTransf();
-  mean->addScalar(-0.5f*sigma_squared);
+  mean->applyElementwise(FFTGrid::ElementwiseChain().logTransf().addScalar(-0.5f*sigma_squared));
 }
 
 void
@@ -526,9 +520,7 @@ void
 {
   assert(cov->getIsTransformed() == false);
 
-  cov->multiplyByScalar(1.0f/(mean*mean));
-  cov->addScalar(1);
-  cov->logTransf();
+  cov->applyElementwise(FFTGrid::ElementwiseChain().multiplyByScalar(1.0f/(mean*mean)).addScalar(1).logTransf());
 }
 
 void
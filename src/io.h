@@ -39,6 +39,7 @@ public:
   inline static  std::string    FileDebug(void)                    { return std::string("debug")                    ;}
   inline static  std::string    FileError(void)                    { return std::string("error")                    ;}
   inline static  std::string    FileTasks(void)                    { return std::string("tasks")                    ;}
+  inline static  std::string    FileProfile(void)                  { return std::string("profile")                  ;}
   inline static  std::string    FileParameterAutoCov()             { return std::string("Parameter_Autocovariance") ;}
   inline static  std::string    FileParameterCov(void)             { return std::string("Parameter_Covariance")     ;}
   inline static  std::string    FileLateralCorr(void)              { return std::string("Lateral_Correlation")      ;}
@@ -90,6 +91,7 @@ public:
 
   inline static  std::string    SuffixGeneralData(void)            { return std::string(".dat")                     ;}
   inline static  std::string    SuffixTextFiles(void)              { return std::string(".txt")                     ;}
+  inline static  std::string    SuffixJsonFiles(void)              { return std::string(".json")                    ;}
   inline static  std::string    SuffixCrava(void)                  { return std::string(".crava")                   ;}
   inline static  std::string    SuffixAsciiFiles(void)             { return std::string(".ascii")                   ;}
   inline static  std::string    SuffixAsciiIrapClassic(void)       { return std::string(".irap")                    ;}
@@ -178,7 +180,8 @@ public:
                              ROCK_PHYSICS        =  8,
                              ERROR_FILE          = 16,
                              TASK_FILE           = 32,
-                             ROCK_PHYSICS_TRENDS = 64};
+                             ROCK_PHYSICS_TRENDS = 64,
+                             PROFILE_TRACE       = 128};
 
   enum           outputWavelets{WELL_WAVELETS    = 1,
                                 GLOBAL_WAVELETS  = 2,
@@ -6,6 +6,10 @@
 #include <math.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <vector>
+
+#include "nrlib/exception/exception.hpp"
 #include "nrlib/iotools/logkit.hpp"
 
 #include "src/krigingadmin.h"
@@ -26,7 +30,8 @@ CKrigingAdmin::CKrigingAdmin(const Simbox      & simbox,
                              CovGridSeparated  & covCrAlphaRho,
                              CovGridSeparated  & covCrBetaRho,
                              int                 dataTarget,
-                             bool                backgroundModel) :
+                             bool                backgroundModel,
+                             int                 nThreads) :
   simbox_(simbox),
   trendAlpha_(0),
   trendBeta_(0),
@@ -40,6 +45,7 @@ CKrigingAdmin::CKrigingAdmin(const Simbox      & simbox,
   pBWellPt_(pBWellPt),
   noData_(noData),
   dataTarget_(dataTarget),
+  nThreads_(nThreads),
   backgroundModel_(backgroundModel)
 {
   Init(); // Common init
@@ -49,9 +55,6 @@ CKrigingAdmin::~CKrigingAdmin(void)
 {
   delete pBWellGrid_;
 
-  delete [] pIndexAlpha_;
-  delete [] pIndexBeta_;
-  delete [] pIndexRho_;
   int i;
   for (i = 0; i < GetSmoothBlockNx() - 2; i++) {
     delete [] ppKrigSmoothWeightsX_[i];
@@ -70,8 +73,6 @@ CKrigingAdmin::~CKrigingAdmin(void)
 }
 
 void CKrigingAdmin::Init() {
-  i_ = j_ = k_ = 0;
-
   //
   // Create indicator grid having 1.0f if data in cell and -1.0f if no data in cell
   // I wonder why Bjørn didn't choose and int grid with 1s and 0s instead?
@@ -93,8 +94,8 @@ void CKrigingAdmin::Init() {
   }
   noValid_ = noValidAlpha_ + noValidBeta_ + noValidRho_;
 
-  noKrigedCells_ = noKrigedVariables_ = totalNoDataInCurrKrigBlock_= noEmptyDataBlocks_ = 0;
-  sizeAlpha_ = sizeBeta_ = sizeRho_ = 0;
+  noKrigedCells_ = noKrigedVariables_ = noEmptyDataBlocks_ = 0;
+  cachedFactorBytes_ = 0.0;
   rangeAlphaX_ = rangeAlphaY_ = rangeAlphaZ_ = 0;
   rangeBetaX_ = rangeBetaY_ = rangeBetaZ_ = 0;
   rangeRhoX_ = rangeRhoY_ = rangeRhoZ_ = 0;
@@ -149,19 +150,6 @@ void CKrigingAdmin::Init() {
     ppKrigSmoothWeightsZ_[i] = new double[GetSmoothBlockNz()];
   }
 
-  const int sizeMaxBlock =
-    (dxBlock_ + 2*static_cast<int>(ceil(rangeX_))) *
-    (dyBlock_ + 2*static_cast<int>(ceil(rangeY_))) *
-    (dzBlock_ + 2*static_cast<int>(ceil(rangeZ_)));
-
-  int maxAlphaData2 = std::min(noValidAlpha_, sizeMaxBlock);
-  int maxBetaData2  = std::min(noValidBeta_, sizeMaxBlock);
-  int maxRhoData2   = std::min(noValidRho_, sizeMaxBlock);
-
-  pIndexAlpha_ = new int[maxAlphaData2];
-  pIndexBeta_ = new int[maxBetaData2];
-  pIndexRho_  = new int[maxRhoData2];
-
   Require(dxBlockExt_ <= rangeX_ && dyBlockExt_ <= rangeY_ && dzBlockExt_ <= rangeZ_,
     "dxBlockExt_ <= rangeX_ && dyBlockExt_ <= rangeY_ && dzBlockExt_ <= rangeZ_");
 
@@ -172,30 +160,64 @@ void CKrigingAdmin::KrigAll(Gamma gamma, bool doSmoothing) {
   // basic set of neighbourhoods
   noCholeskyDecomp_ = noSolvedMatrixEq_ = 0;
   noRMissing_ = 0;
-  const int nxBlock = NBlocks(dxBlock_, simbox_.getnx());
-  const int nyBlock = NBlocks(dyBlock_, simbox_.getny());
-  const int nzBlock = NBlocks(dzBlock_, simbox_.getnz());
 
   monitorSize_ = int(3*simbox_.getnx()*simbox_.getny()*simbox_.getnz()*0.02);
   monitorSize_ = std::max(1,monitorSize_);
 
-  // loop over all kriging blocks
-  int i,j,k;
-  for (k = 0; k < nzBlock; k++) {
-    int k1 = k*dzBlock_;
-    for (j = 0; j < nyBlock; j++) {
-      int j1 = j*dyBlock_;
-      for (i = 0; i < nxBlock; i++) {
-   //     LogKit::LogFormatted(LogKit::DebugLow,"%d %d %d : %d %d %d\n",i, j, k, nxBlock, nyBlock, nzBlock);
-        int i1 = i*dxBlock_;
-        currBlock_ = CBox(i1, j1, k1, i1 + dxBlock_ - 1, j1 + dyBlock_ - 1, k1 + dzBlock_ - 1, &simbox_);
-        currDataBox_ = CBox(i1 - dxBlockExt_, j1 - dyBlockExt_, k1 - dzBlockExt_,
-          i1 + dxBlock_ + dxBlockExt_ - 1, j1 + dyBlock_ + dyBlockExt_ - 1, k1 + dzBlock_ + dzBlockExt_ - 1,
-          &simbox_);
-        KrigBlock(gamma);
-      } // end i
-    } // end j
-  } // end k
+  FFTGrid * pGrid = 0;
+
+  switch(gamma) {
+  case ALPHA_KRIG :
+    pGrid = trendAlpha_;
+    break;
+  case BETA_KRIG :
+    pGrid = trendBeta_;
+    break;
+  case RHO_KRIG :
+    pGrid = trendRho_;
+    break;
+  default :
+    Require(false, "switch failed");
+  } // end switch
+
+  if (blockOrder_[gamma].empty())
+    PlanBlocks(gamma);
+
+  std::vector<KrigBlockData> & blocks = blocks_[gamma];
+  const std::vector<int>     & order  = blockOrder_[gamma];
+  const int                    nBlocks = static_cast<int>(order.size());
+
+  // Each cell belongs to one block only, so the result does not depend on the order. File
+  // grids flag modifications on every write, and are kriged by one thread. The blocks keep
+  // their own counts, so the threads share nothing but the error text.
+  bool        failed = false;
+  std::string errTxt = "";
+  int o;
+#ifdef PARALLEL
+  int nThreads = (pGrid->isFile() ? 1 : nThreads_);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(nThreads) if(nThreads > 1)
+#endif
+  for (o = 0; o < nBlocks; o++) {
+    try {
+      KrigBlock(gamma, *pGrid, blocks[order[o]]);
+    }
+    catch (NRLib::Exception & e) { //Rethrown outside the parallel region
+#ifdef PARALLEL
+#pragma omp critical(kriging_error)
+#endif
+      {
+        if (failed == false)
+          errTxt = e.what();
+        failed = true;
+      }
+    }
+  }
+  if (failed)
+    throw NRLib::Exception(errTxt);
+
+  for (o = 0; o < nBlocks; o++)
+    UpdateProgress(blocks[order[o]]);
+
   noKrigedVariables_++;
   if (!backgroundModel_ && doSmoothing==true) {
     //LogKit::LogFormatted(LogKit::Low,"SmoothKrigedResult start\n");
@@ -206,6 +228,59 @@ void CKrigingAdmin::KrigAll(Gamma gamma, bool doSmoothing) {
 
 }
 
+void CKrigingAdmin::PlanBlocks(Gamma gamma)
+{
+  const int nxBlock = NBlocks(dxBlock_, simbox_.getnx());
+  const int nyBlock = NBlocks(dyBlock_, simbox_.getny());
+  const int nzBlock = NBlocks(dzBlock_, simbox_.getnz());
+  const int nBlocks = nxBlock*nyBlock*nzBlock;
+
+  std::vector<KrigBlockData> & blocks = blocks_[gamma];
+  blocks.resize(nBlocks);
+
+  // Find the data neighbourhood of every kriging block. The blocks are independent, and
+  // the search only reads the well data.
+  int b;
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic, 16) num_threads(nThreads_) if(nThreads_ > 1)
+#endif
+  for (b = 0; b < nBlocks; b++) {
+    int i1 = (b % nxBlock)*dxBlock_;
+    int j1 = ((b / nxBlock) % nyBlock)*dyBlock_;
+    int k1 = (b / (nxBlock*nyBlock))*dzBlock_;
+    blocks[b].block   = CBox(i1, j1, k1, i1 + dxBlock_ - 1, j1 + dyBlock_ - 1, k1 + dzBlock_ - 1, &simbox_);
+    blocks[b].dataBox = CBox(i1 - dxBlockExt_, j1 - dyBlockExt_, k1 - dzBlockExt_,
+      i1 + dxBlock_ + dxBlockExt_ - 1, j1 + dyBlock_ + dyBlockExt_ - 1, k1 + dzBlock_ + dzBlockExt_ - 1,
+      &simbox_);
+    FindDataInDataBlockLoop(gamma, blocks[b]);
+  }
+
+  // Krige the most expensive blocks first, so that the dynamic schedule ends with small
+  // blocks. The cost is dominated by the Cholesky factorisation and the kriging vectors.
+  std::vector<std::pair<double, int> > cost(nBlocks);
+  for (b = 0; b < nBlocks; b++) {
+    double n     = static_cast<double>(blocks[b].GetNoData());
+    double cells = static_cast<double>(blocks[b].block.GetNx()*blocks[b].block.GetNy()*blocks[b].block.GetNz());
+    cost[b]      = std::make_pair(-(n*n*n/3.0 + cells*n), b);
+  }
+  std::sort(cost.begin(), cost.end());
+
+  // Keep the Cholesky factors of the most expensive blocks for later kriging calls, as
+  // long as they fit within the memory budget shared by all three variables.
+  std::vector<int> & order = blockOrder_[gamma];
+  order.resize(nBlocks);
+  for (b = 0; b < nBlocks; b++) {
+    KrigBlockData & data  = blocks[cost[b].second];
+    double          n     = static_cast<double>(data.GetNoData());
+    double          bytes = n*n*sizeof(double);
+    if (n > 0 && cachedFactorBytes_ + bytes <= maxCachedFactorsMB_*1024.0*1024.0) {
+      data.keepFactor     = true;
+      cachedFactorBytes_ += bytes;
+    }
+    order[b] = cost[b].second;
+  }
+}
+
 void CKrigingAdmin::KrigAll(FFTGrid& trendAlpha, FFTGrid& trendBeta, FFTGrid& trendRho, SeismicParametersHolder & seismicParameters,
                             bool trendsAlreadySubtracted, int debugflag, bool doSmoothing) {
   Require(!trendAlpha.getIsTransformed()
@@ -213,6 +288,8 @@ void CKrigingAdmin::KrigAll(FFTGrid& trendAlpha, FFTGrid& trendBeta, FFTGrid& tr
           && !trendRho.getIsTransformed(),
           "!trendAlpha.getIsTransformed() && !trendBeta.getIsTransformed() && !trendRho.getIsTransformed()");
 
+  noKrigedCells_ = noKrigedVariables_ = noEmptyDataBlocks_ = 0;
+
   if (!trendsAlreadySubtracted)
     SubtractTrends(trendAlpha, trendBeta, trendRho);
   if(debugflag>0)
@@ -274,105 +351,94 @@ void CKrigingAdmin::KrigAll(FFTGrid& trendAlpha, FFTGrid& trendBeta, FFTGrid& tr
   LogKit::LogFormatted(LogKit::DebugHigh,"KrigAll finished\n");
 }
 
-void CKrigingAdmin::KrigBlock(Gamma gamma)
+void CKrigingAdmin::KrigBlock(Gamma           gamma,
+                              FFTGrid       & grid,
+                              KrigBlockData & data)
 {
-  // search for neighbours
-  LogKit::LogFormatted(LogKit::DebugHigh,"FindDataInDataBlockLoop(gamma) called next\n");
-  FindDataInDataBlockLoop(gamma);
-  LogKit::LogFormatted(LogKit::DebugHigh,"sizeAlpha_: %d\n", sizeAlpha_);
-  LogKit::LogFormatted(LogKit::DebugHigh,"sizeBeta_: %d\n", sizeBeta_);
-  LogKit::LogFormatted(LogKit::DebugHigh,"sizeRho_: %d\n", sizeRho_);
-  LogKit::LogFormatted(LogKit::DebugHigh,"totalNoDataInCurrKrigBlock_: %d\n", totalNoDataInCurrKrigBlock_);
-  //FindDataInDataBlock(gamma); //DEBUG
-
   int iMin, jMin, kMin, iMax, jMax, kMax;
-  currBlock_.GetMin(iMin, jMin, kMin); currBlock_.GetMax(iMax, jMax, kMax);
-  if (!totalNoDataInCurrKrigBlock_) {
-    int cellsInBlock = (kMax - kMin + 1)*(jMax - jMin + 1)*(iMax - iMin + 1);
-    int i;
-    for (i=noKrigedCells_ ; i<noKrigedCells_+cellsInBlock ; i++) {
-      if (noKrigedCells_ > 0 && i%monitorSize_ == 0) {
-        printf("^");
-        fflush(stdout);
-      }
-    }
-    noKrigedCells_ += cellsInBlock;
-    noEmptyDataBlocks_++;
-    return;
-  }
+  data.block.GetMin(iMin, jMin, kMin); data.block.GetMax(iMax, jMax, kMax);
 
-  int n = sizeAlpha_ + sizeBeta_ + sizeRho_;
+  int n = data.GetNoData();
 
-  NRLib::Matrix krigMatrix(n, n);
-  NRLib::Vector residual(n);
+  data.nSolved  = 0;
+  data.nMissing = 0;
+  data.nDecomp  = 0;
+
+  if (n == 0)
+    return;
 
-  // Set kriging matrix based on data finds
+  // The kriging matrix only depends on the data locations and the covariances, so a
+  // kept factor is valid for all later calls.
+  NRLib::SymmetricMatrix   localFactor;
+  NRLib::SymmetricMatrix & K = (data.keepFactor ? data.factor : localFactor);
 
-  SetMatrix(krigMatrix,
-            residual,
-            gamma);
+  if (!data.factorized) {
+    NRLib::Matrix krigMatrix(n, n);
 
-  NRLib::SymmetricMatrix K(n);
+    // Set kriging matrix based on data finds
+    SetMatrix(krigMatrix, data);
 
-  for (int j = 0 ; j < n ; j++) {
-    for (int i = 0 ; i <= j ; i++) {
-      K(i,j) = krigMatrix(i,j);
+    K.resize(n);
+    for (int j = 0 ; j < n ; j++) {
+      for (int i = 0 ; i <= j ; i++) {
+        K(i,j) = krigMatrix(i,j);
+      }
     }
+    // NBNB-PAL: Add try/catch loop around CholeskyFactorize call with a regularization term.
+    NRLib::CholeskyFactorize(K);
+    data.factorized = data.keepFactor;
+    data.nDecomp    = 1;
   }
 
-  FFTGrid * pGrid = 0;
-
-  switch(gamma) {
-  case ALPHA_KRIG :
-    pGrid = trendAlpha_;
-    break;
-  case BETA_KRIG :
-    pGrid = trendBeta_;
-    break;
-  case RHO_KRIG :
-    pGrid = trendRho_;
-    break;
-  default :
-    Require(false, "switch failed");
-  } // end switch
+  NRLib::Vector residual(n);
+  SetResidual(residual, data);
 
   NRLib::Vector x(n);
-  // NBNB-PAL: Add try/catch loop around CholeskySolve call with a regularization term.
-  NRLib::CholeskySolve(K, residual, x);
+  NRLib::CholeskySolveFactorized(K, residual, x);
 
   NRLib::Vector kVec(n);
 
-  for (k_ = kMin; k_ <= kMax; k_++) {
-    for (j_ = jMin; j_ <= jMax; j_++) {
-      for (i_ = iMin; i_ <= iMax; i_++) {
+  for (int k = kMin; k <= kMax; k++) {
+    for (int j = jMin; j <= jMax; j++) {
+      for (int i = iMin; i <= iMax; i++) {
 
         // set kriging vector
-        SetKrigVector(kVec, gamma);
+        SetKrigVector(kVec, gamma, i, j, k, data);
 
         // kriging;
-        float result = pGrid->getRealValue(i_, j_, k_);
+        float result = grid.getRealValue(i, j, k);
         if (result == RMISSING) {
-          noRMissing_++;
+          data.nMissing++;
         }
         else {
           result += static_cast<float>(kVec * x);
 
-          if(pGrid->setRealValue(i_, j_, k_, result))
+          if(grid.setRealValue(i, j, k, result))
             Require(false, "pGrid->setRealValue failed"); // something is serious wrong...
 
-          noSolvedMatrixEq_++;
-        }
-
-        noKrigedCells_++;
-        // return result
-        if (noKrigedCells_%monitorSize_ == 0) {
-          printf("^");
-          fflush(stdout);
+          data.nSolved++;
         }
       } // end for i
     } // end for j
   } // end for k
+}
 
+void CKrigingAdmin::UpdateProgress(const KrigBlockData & data)
+{
+  int nCells = data.block.GetNx()*data.block.GetNy()*data.block.GetNz();
+
+  for (int i = noKrigedCells_ + 1; i <= noKrigedCells_ + nCells; i++) {
+    if (i%monitorSize_ == 0) {
+      printf("^");
+      fflush(stdout);
+    }
+  }
+  noKrigedCells_     += nCells;
+  noSolvedMatrixEq_  += data.nSolved;
+  noRMissing_        += data.nMissing;
+  noCholeskyDecomp_  += data.nDecomp;
+  if (data.GetNoData() == 0)
+    noEmptyDataBlocks_++;
 }
 
 FFTGrid* CKrigingAdmin::CreateValidGrid() const
@@ -438,8 +504,10 @@ CKrigingAdmin::SubtractTrends(FFTGrid& trend_alpha, FFTGrid& trend_beta, FFTGrid
 }
 
 CKrigingAdmin::DataBoxSize
-CKrigingAdmin::FindDataInDataBlock(Gamma gamma, const CBox & dataBox) {
-  sizeAlpha_ = sizeBeta_ = sizeRho_ = totalNoDataInCurrKrigBlock_ = 0;
+CKrigingAdmin::FindDataInDataBlock(Gamma gamma, const CBox & dataBox, KrigBlockData & data) const {
+  data.indexAlpha.clear();
+  data.indexBeta.clear();
+  data.indexRho.clear();
   const int countTotalMin = int(dataTarget_*(1.0f - maxDataTolerance_/100.0f));
   const int countTotalMax = int(dataTarget_*(1.0f + maxDataTolerance_/100.0f));
 
@@ -451,37 +519,37 @@ CKrigingAdmin::FindDataInDataBlock(Gamma gamma, const CBox & dataBox) {
       pBWellPt_[i]->IsValidObs(validA, validB, validR);
       switch (gamma) {
       case ALPHA_KRIG :
-        if (validA && ++totalNoDataInCurrKrigBlock_)
-          pIndexAlpha_[sizeAlpha_++] = i;
+        if (validA)
+          data.indexAlpha.push_back(i);
         else {
-          if (validB && ++totalNoDataInCurrKrigBlock_)
-            pIndexBeta_[sizeBeta_++] = i;
+          if (validB)
+            data.indexBeta.push_back(i);
 
-          if (validR && ++totalNoDataInCurrKrigBlock_)
-            pIndexRho_[sizeRho_++] = i;
+          if (validR)
+            data.indexRho.push_back(i);
         }
         break;
 
       case BETA_KRIG :
-        if (validB && ++totalNoDataInCurrKrigBlock_)
-          pIndexBeta_[sizeBeta_++] = i;
+        if (validB)
+          data.indexBeta.push_back(i);
         else {
-          if (validA && ++totalNoDataInCurrKrigBlock_)
-            pIndexAlpha_[sizeAlpha_++] = i;
+          if (validA)
+            data.indexAlpha.push_back(i);
 
-          if (validR && ++totalNoDataInCurrKrigBlock_)
-            pIndexRho_[sizeRho_++] = i;
+          if (validR)
+            data.indexRho.push_back(i);
         }
         break;
       case RHO_KRIG :
-        if (validR && ++totalNoDataInCurrKrigBlock_)
-          pIndexRho_[sizeRho_++] = i;
+        if (validR)
+          data.indexRho.push_back(i);
         else {
-          if (validA && ++totalNoDataInCurrKrigBlock_)
-            pIndexAlpha_[sizeAlpha_++] = i;
+          if (validA)
+            data.indexAlpha.push_back(i);
 
-          if (validB && ++totalNoDataInCurrKrigBlock_)
-            pIndexBeta_[sizeBeta_++] = i;
+          if (validB)
+            data.indexBeta.push_back(i);
         }
         break;
 
@@ -492,28 +560,26 @@ CKrigingAdmin::FindDataInDataBlock(Gamma gamma, const CBox & dataBox) {
       // early exit
     } // end if
   } // end i
-  LogKit::LogFormatted(LogKit::DebugHigh,"Found %d data. (%d, %d)\n", totalNoDataInCurrKrigBlock_,
-    countTotalMin, countTotalMax);
-  if (totalNoDataInCurrKrigBlock_ <= countTotalMax && totalNoDataInCurrKrigBlock_ >= countTotalMin)
+  int totalNoData = data.GetNoData();
+  if (totalNoData <= countTotalMax && totalNoData >= countTotalMin)
     return DBS_RIGHT;
-  if (totalNoDataInCurrKrigBlock_ < countTotalMin)
+  if (totalNoData < countTotalMin)
     return DBS_TOO_SMALL;
-  else {//(totalNoDataInCurrKrigBlock_ > countTotalMax)
+  else {//(totalNoData > countTotalMax)
     return DBS_TOO_BIG;
   }
 }
 
 
-void CKrigingAdmin::FindDataInDataBlockLoop(Gamma gamma) {
-  int counter = 0;
+void CKrigingAdmin::FindDataInDataBlockLoop(Gamma gamma, KrigBlockData & data) const {
   DataBoxSize currDataBoxSize, startDataboxSize, testDataBoxSize;
-  currDataBoxSize = FindDataInDataBlock(gamma, currDataBox_);
+  currDataBoxSize = FindDataInDataBlock(gamma, data.dataBox, data);
   startDataboxSize = currDataBoxSize;
-  //CBox minDataBox = currBlock_;
-  CBox minDataBox = currDataBox_;
+  //CBox minDataBox = data.block;
+  CBox minDataBox = data.dataBox;
   int iMin,iMax,jMin,jMax,kMin,kMax;
-  currBlock_.GetMin(iMin,jMin,kMin);
-  currBlock_.GetMax(iMax,jMax,kMax);
+  data.block.GetMin(iMin,jMin,kMin);
+  data.block.GetMax(iMax,jMax,kMax);
   CBox maxDataBox(iMin-int(rangeX_),jMin-int(rangeY_),kMin-int(rangeZ_),
     iMax+int(rangeX_),jMax+int(rangeY_),kMax+int(rangeZ_));
 
@@ -522,18 +588,18 @@ void CKrigingAdmin::FindDataInDataBlockLoop(Gamma gamma) {
     // NBNB-PAL: Nothing to do here? I put in this switch option to avoid a crash (CRA-75)
     break;
   case DBS_TOO_SMALL:
-    testDataBoxSize = FindDataInDataBlock(gamma, maxDataBox);
+    testDataBoxSize = FindDataInDataBlock(gamma, maxDataBox, data);
     if(testDataBoxSize != DBS_TOO_BIG)
     {
-      currDataBox_ = maxDataBox;
+      data.dataBox = maxDataBox;
       currDataBoxSize = DBS_RIGHT;
     }
     break;
   case DBS_TOO_BIG:
-    testDataBoxSize = FindDataInDataBlock(gamma, minDataBox);
+    testDataBoxSize = FindDataInDataBlock(gamma, minDataBox, data);
     if(testDataBoxSize != DBS_TOO_SMALL)
     {
-      currDataBox_ = minDataBox;
+      data.dataBox = minDataBox;
       currDataBoxSize = DBS_RIGHT;
     }
     break;
@@ -546,30 +612,27 @@ void CKrigingAdmin::FindDataInDataBlockLoop(Gamma gamma) {
   while (currDataBoxSize != DBS_RIGHT) {
     switch (currDataBoxSize) {
     case DBS_TOO_SMALL :
-      minDataBox = currDataBox_;
-      currDataBox_.ModifyBox(maxDataBox);
+      minDataBox = data.dataBox;
+      data.dataBox.ModifyBox(maxDataBox);
       break;
     case DBS_TOO_BIG :
-      maxDataBox = currDataBox_;
-      currDataBox_.ModifyBox(minDataBox);
+      maxDataBox = data.dataBox;
+      data.dataBox.ModifyBox(minDataBox);
       break;
     default :
       Require(false, "switch failed");
       break;
 
     } // end switch
-    counter++;
-    //if (currDataBoxSize != startDataboxSize || counter++ >= maxDataBlockLoopCounter_ || prevDataBox == currDataBox_)
-    //if (currDataBoxSize != startDataboxSize || prevDataBox == currDataBox_)
-    if(currDataBox_ == maxDataBox || currDataBox_ == minDataBox)
+    //if (currDataBoxSize != startDataboxSize || counter++ >= maxDataBlockLoopCounter_ || prevDataBox == data.dataBox)
+    //if (currDataBoxSize != startDataboxSize || prevDataBox == data.dataBox)
+    if(data.dataBox == maxDataBox || data.dataBox == minDataBox)
       break;
 
-    currDataBoxSize = FindDataInDataBlock(gamma, currDataBox_);
+    currDataBoxSize = FindDataInDataBlock(gamma, data.dataBox, data);
 
   } // end while
-  currDataBox_.ModifyBox(currDataBox_, &simbox_); //Does not modify, only truncates.
-
-  LogKit::LogFormatted(LogKit::DebugHigh,"FindDataInDataBlock iterations: %d\n", counter);
+  data.dataBox.ModifyBox(data.dataBox, &simbox_); //Does not modify, only truncates.
 }
 
 
@@ -580,26 +643,27 @@ int CKrigingAdmin::NBlocks(int dBlocks, int lSBox) const {
   return lSBox/dBlocks + 1;
 }
 
-void CKrigingAdmin::SetMatrix(NRLib::Matrix & krigMatrix,
-                              NRLib::Vector & residual,
-                              Gamma           gamma) {
-  assert(gamma >= 0);
-  if (!totalNoDataInCurrKrigBlock_)
+void CKrigingAdmin::SetMatrix(NRLib::Matrix       & krigMatrix,
+                              const KrigBlockData & data) const {
+  if (data.GetNoData() == 0)
     return;
+  const int sizeAlpha = static_cast<int>(data.indexAlpha.size());
+  const int sizeBeta  = static_cast<int>(data.indexBeta.size());
+  const int sizeRho   = static_cast<int>(data.indexRho.size());
   int a, b, r;
 
   // set Kriging Matrix
   // for alpha kriging
   int a2, b2, r2;
   // first row
-  for (a = 0; a < sizeAlpha_; a++) {
+  for (a = 0; a < sizeAlpha; a++) {
     int krigRowIndex = a;
-    int indexA = pIndexAlpha_[a];
+    int indexA = data.indexAlpha[a];
     int i,j,k;
     pBWellPt_[indexA]->GetIJK(i, j, k);
     // K_aa
-    for (a2 = 0; a2 < sizeAlpha_; a2++) {
-      int indexA2 = pIndexAlpha_[a2];
+    for (a2 = 0; a2 < sizeAlpha; a2++) {
+      int indexA2 = data.indexAlpha[a2];
       int i2, j2, k2;
       pBWellPt_[indexA2]->GetIJK(i2, j2, k2);
 
@@ -607,106 +671,120 @@ void CKrigingAdmin::SetMatrix(NRLib::Matrix & krigMatrix,
     } // end a2
 
     // K_ab
-    for (b2 = 0; b2 < sizeBeta_; b2++) {
-      int indexB2 = pIndexBeta_[b2];
+    for (b2 = 0; b2 < sizeBeta; b2++) {
+      int indexB2 = data.indexBeta[b2];
       int i2, j2, k2;
       pBWellPt_[indexB2]->GetIJK(i2, j2, k2);
-      krigMatrix(krigRowIndex, b2 + sizeAlpha_) = covCrAlphaBeta_.GetGamma2(i, j, k, i2, j2, k2);
+      krigMatrix(krigRowIndex, b2 + sizeAlpha) = covCrAlphaBeta_.GetGamma2(i, j, k, i2, j2, k2);
     } // end b2
 
     // K_ar
-    for (r2 = 0; r2 < sizeRho_; r2++) {
-      int indexR2 = pIndexRho_[r2];
+    for (r2 = 0; r2 < sizeRho; r2++) {
+      int indexR2 = data.indexRho[r2];
       int i2, j2, k2;
       pBWellPt_[indexR2]->GetIJK(i2, j2, k2);
-      krigMatrix(krigRowIndex, r2 + sizeAlpha_ + sizeBeta_) = covCrAlphaRho_.GetGamma2(i, j, k, i2, j2, k2);
+      krigMatrix(krigRowIndex, r2 + sizeAlpha + sizeBeta) = covCrAlphaRho_.GetGamma2(i, j, k, i2, j2, k2);
     } // end r2
   }// end a
 
   // second row
-  for (b = 0; b < sizeBeta_; b++) {
-    int krigRowIndex = b + sizeAlpha_;
-    int indexB = pIndexBeta_[b];
+  for (b = 0; b < sizeBeta; b++) {
+    int krigRowIndex = b + sizeAlpha;
+    int indexB = data.indexBeta[b];
     int i,j,k;
     pBWellPt_[indexB]->GetIJK(i, j, k);
     // K_ba
-    for (a2 = 0; a2 < sizeAlpha_; a2++) {
-      int indexA2 = pIndexAlpha_[a2];
+    for (a2 = 0; a2 < sizeAlpha; a2++) {
+      int indexA2 = data.indexAlpha[a2];
       int i2, j2, k2;
       pBWellPt_[indexA2]->GetIJK(i2, j2, k2);
       krigMatrix(krigRowIndex,a2) = covCrAlphaBeta_.GetGamma2(i2, j2, k2, i, j, k); // flip
     } // end a2
 
     // K_bb
-    for (b2 = 0; b2 < sizeBeta_; b2++) {
-      int indexB2 = pIndexBeta_[b2];
+    for (b2 = 0; b2 < sizeBeta; b2++) {
+      int indexB2 = data.indexBeta[b2];
       int i2, j2, k2;
       pBWellPt_[indexB2]->GetIJK(i2, j2, k2);
-      krigMatrix(krigRowIndex, b2 + sizeAlpha_) = covBeta_.GetGamma2(i, j, k, i2, j2, k2);
+      krigMatrix(krigRowIndex, b2 + sizeAlpha) = covBeta_.GetGamma2(i, j, k, i2, j2, k2);
     } // end b2
 
     // K_br
-    for (r2 = 0; r2 < sizeRho_; r2++) {
-      int indexR2 = pIndexRho_[r2];
+    for (r2 = 0; r2 < sizeRho; r2++) {
+      int indexR2 = data.indexRho[r2];
       int i2, j2, k2;
       pBWellPt_[indexR2]->GetIJK(i2, j2, k2);
-      krigMatrix(krigRowIndex,r2 + sizeAlpha_ + sizeBeta_) = covCrBetaRho_.GetGamma2(i, j, k, i2, j2, k2);
+      krigMatrix(krigRowIndex,r2 + sizeAlpha + sizeBeta) = covCrBetaRho_.GetGamma2(i, j, k, i2, j2, k2);
     } // end r2
   }// end b
   // third row
-  for (r = 0; r < sizeRho_; r++) {
-    int krigRowIndex = r + sizeAlpha_ + sizeBeta_;
-    int indexR = pIndexRho_[r];
+  for (r = 0; r < sizeRho; r++) {
+    int krigRowIndex = r + sizeAlpha + sizeBeta;
+    int indexR = data.indexRho[r];
     int i,j,k;
     pBWellPt_[indexR]->GetIJK(i, j, k);
     // K_ra
-    for (a2 = 0; a2 < sizeAlpha_; a2++) {
-      int indexA2 = pIndexAlpha_[a2];
+    for (a2 = 0; a2 < sizeAlpha; a2++) {
+      int indexA2 = data.indexAlpha[a2];
       int i2, j2, k2;
       pBWellPt_[indexA2]->GetIJK(i2, j2, k2);
       krigMatrix(krigRowIndex, a2) = covCrAlphaRho_.GetGamma2(i2, j2, k2, i, j, k); // flip
     } // end a2
 
     // K_rb
-    for (b2 = 0; b2 < sizeBeta_; b2++) {
-      int indexB2 = pIndexBeta_[b2];
+    for (b2 = 0; b2 < sizeBeta; b2++) {
+      int indexB2 = data.indexBeta[b2];
       int i2, j2, k2;
       pBWellPt_[indexB2]->GetIJK(i2, j2, k2);
-      krigMatrix(krigRowIndex, b2  + sizeAlpha_) = covCrBetaRho_.GetGamma2(i2, j2, k2, i, j, k); // flip
+      krigMatrix(krigRowIndex, b2  + sizeAlpha) = covCrBetaRho_.GetGamma2(i2, j2, k2, i, j, k); // flip
     } // end b2
 
     // K_rr
-    for (r2 = 0; r2 < sizeRho_; r2++) {
-      int indexR2 = pIndexRho_[r2];
+    for (r2 = 0; r2 < sizeRho; r2++) {
+      int indexR2 = data.indexRho[r2];
       int i2, j2, k2;
       pBWellPt_[indexR2]->GetIJK(i2, j2, k2);
-      krigMatrix(krigRowIndex, r2 + sizeAlpha_ + sizeBeta_) = covRho_.GetGamma2(i, j, k, i2, j2, k2);
+      krigMatrix(krigRowIndex, r2 + sizeAlpha + sizeBeta) = covRho_.GetGamma2(i, j, k, i2, j2, k2);
     } // end r2
   }// end r
+}
+
+void CKrigingAdmin::SetResidual(NRLib::Vector       & residual,
+                                const KrigBlockData & data) const {
+  const int sizeAlpha = static_cast<int>(data.indexAlpha.size());
+  const int sizeBeta  = static_cast<int>(data.indexBeta.size());
+  const int sizeRho   = static_cast<int>(data.indexRho.size());
+  int a, b, r;
 
-  // Also calulates the kriging data vector
-  for (a = 0; a < sizeAlpha_; a++) {
-    int indexA = pIndexAlpha_[a];
+  for (a = 0; a < sizeAlpha; a++) {
+    int indexA = data.indexAlpha[a];
     residual(a) = pBWellPt_[indexA]->GetAlpha();
   } // end a
 
-  for (b = 0; b < sizeBeta_; b++) {
-    int indexB = pIndexBeta_[b];
-    residual(sizeAlpha_ + b) = pBWellPt_[indexB]->GetBeta();
+  for (b = 0; b < sizeBeta; b++) {
+    int indexB = data.indexBeta[b];
+    residual(sizeAlpha + b) = pBWellPt_[indexB]->GetBeta();
   } // end b
 
-  for (r = 0; r < sizeRho_; r++) {
-    int indexR = pIndexRho_[r];
-    residual(sizeAlpha_ + sizeBeta_ + r) = pBWellPt_[indexR]->GetRho();
+  for (r = 0; r < sizeRho; r++) {
+    int indexR = data.indexRho[r];
+    residual(sizeAlpha + sizeBeta + r) = pBWellPt_[indexR]->GetRho();
   } // end r
 
 }
 
-void CKrigingAdmin::SetKrigVector(NRLib::Vector & k,
-                                  Gamma           gamma)
+void CKrigingAdmin::SetKrigVector(NRLib::Vector       & kVec,
+                                  Gamma                 gamma,
+                                  int                   i,
+                                  int                   j,
+                                  int                   k,
+                                  const KrigBlockData & data) const
 {
+  const int sizeAlpha = static_cast<int>(data.indexAlpha.size());
+  const int sizeBeta  = static_cast<int>(data.indexBeta.size());
+  const int sizeRho   = static_cast<int>(data.indexRho.size());
   int offsetB1, offsetR1;
-  offsetB1 = sizeAlpha_; offsetR1 = sizeAlpha_ + sizeBeta_;
+  offsetB1 = sizeAlpha; offsetR1 = sizeAlpha + sizeBeta;
   const CovGridSeparated *pA = NULL, *pB = NULL, *pR = NULL;
   bool flipA = false, flipB = false, flipR = false;
   switch(gamma) {
@@ -735,29 +813,29 @@ void CKrigingAdmin::SetKrigVector(NRLib::Vector & k,
 
   // k_a
   int a2;
-  for (a2 = 0; a2 < sizeAlpha_; a2++) {
-    int indexA2 = pIndexAlpha_[a2];
+  for (a2 = 0; a2 < sizeAlpha; a2++) {
+    int indexA2 = data.indexAlpha[a2];
     int i2, j2, k2;
     pBWellPt_[indexA2]->GetIJK(i2, j2, k2);
-    k(a2) = (!flipA ? pA->GetGamma2(i_, j_, k_, i2, j2, k2) : pA->GetGamma2(i2, j2, k2, i_, j_, k_));
+    kVec(a2) = (!flipA ? pA->GetGamma2(i, j, k, i2, j2, k2) : pA->GetGamma2(i2, j2, k2, i, j, k));
   } // end a2
 
   // k_b
   int b2;
-  for (b2 = 0; b2 < sizeBeta_; b2++) {
-    int indexB2 = pIndexBeta_[b2];
+  for (b2 = 0; b2 < sizeBeta; b2++) {
+    int indexB2 = data.indexBeta[b2];
     int i2, j2, k2;
     pBWellPt_[indexB2]->GetIJK(i2, j2, k2);
-    k(b2 + offsetB1) = (!flipB ? pB->GetGamma2(i_, j_, k_, i2, j2, k2) : pB->GetGamma2(i2, j2, k2, i_, j_, k_));
+    kVec(b2 + offsetB1) = (!flipB ? pB->GetGamma2(i, j, k, i2, j2, k2) : pB->GetGamma2(i2, j2, k2, i, j, k));
   } // end b2
 
   // k_r
   int r2;
-  for (r2 = 0; r2 < sizeRho_; r2++) {
-    int indexR2 = pIndexRho_[r2];
+  for (r2 = 0; r2 < sizeRho; r2++) {
+    int indexR2 = data.indexRho[r2];
     int i2, j2, k2;
     pBWellPt_[indexR2]->GetIJK(i2, j2, k2);
-    k(r2 + offsetR1) = (!flipR ? pR->GetGamma2(i_, j_, k_, i2, j2, k2) : pR->GetGamma2(i2, j2, k2, i_, j_, k_));
+    kVec(r2 + offsetR1) = (!flipR ? pR->GetGamma2(i, j, k, i2, j2, k2) : pR->GetGamma2(i2, j2, k2, i, j, k));
   } // end r2
 }
 
@@ -11,6 +11,8 @@ class CBWellPt;
 class Simbox;
 class CovGridSeparated;
 
+#include <vector>
+
 #include "nrlib/flens/nrlib_flens.hpp"
 
 #include "src/box.h"
@@ -28,29 +30,50 @@ public:
                 CovGridSeparated& covCrAlphaRho,
                 CovGridSeparated& covCrBetaRho,
                 int  dataTarget = 200,
-                bool backgroundModel = false);
+                bool backgroundModel = false,
+                int  nThreads = 1);
   ~CKrigingAdmin(void);
   enum Gamma {ALPHA_KRIG, BETA_KRIG, RHO_KRIG};
   void KrigAll(FFTGrid& trendAlpha, FFTGrid& trendBeta, FFTGrid& trendRho, SeismicParametersHolder & seismicParameters,
                bool trendsAlreadySubtracted = false, int debugFlag = 0, bool doSmoothing = false);
 
 private:
+  // Kriging block with its data neighbourhood and the well data found there.
+  struct KrigBlockData {
+    KrigBlockData() : keepFactor(false), factorized(false), nSolved(0), nMissing(0), nDecomp(0) {}
+    CBox                   block;
+    CBox                   dataBox;
+    std::vector<int>       indexAlpha, indexBeta, indexRho; // indexes into pBWellPt_
+    bool                   keepFactor;                      // keep the Cholesky factor of the kriging matrix
+    bool                   factorized;                      // factor holds the Cholesky factor
+    NRLib::SymmetricMatrix factor;
+    int                    nSolved, nMissing, nDecomp;      // counts from the last KrigBlock call
+    int                    GetNoData() const { return static_cast<int>(indexAlpha.size() + indexBeta.size() + indexRho.size()); }
+  };
+
   void            Init();
   void            KrigAll(Gamma gamma, bool doSmoothing = false);
-  void            KrigBlock(Gamma gamma);
+  void            PlanBlocks(Gamma gamma);
+  void            KrigBlock(Gamma gamma, FFTGrid & grid, KrigBlockData & data);
+  void            UpdateProgress(const KrigBlockData & data);
   /* Finds the data by using the following rule: Cokriging 3 variables X,Y,Z.
   If you are doing kriging on X. Then for each well obs: if you have info on X use it and
   ignore the two others Y,Z. Else use info on Y and Z.
   */
   void            SubtractTrends(FFTGrid& trend_alpha, FFTGrid& trend_beta, FFTGrid& trend_rho);
-  void            FindDataInDataBlockLoop(Gamma gamma);
-  DataBoxSize     FindDataInDataBlock(Gamma gamma, const CBox & dataBlock);
+  void            FindDataInDataBlockLoop(Gamma gamma, KrigBlockData & data) const;
+  DataBoxSize     FindDataInDataBlock(Gamma gamma, const CBox & dataBlock, KrigBlockData & data) const;
   int             NBlocks(int dBlocks, int lSBox) const;
-  void            SetMatrix(NRLib::Matrix & krigMatrix,
-                            NRLib::Vector & residual,
-                            Gamma           gamma);
-  void            SetKrigVector(NRLib::Vector & k,
-                                Gamma           gamma);
+  void            SetMatrix(NRLib::Matrix       & krigMatrix,
+                            const KrigBlockData & data) const;
+  void            SetResidual(NRLib::Vector       & residual,
+                              const KrigBlockData & data) const;
+  void            SetKrigVector(NRLib::Vector       & kVec,
+                                Gamma                 gamma,
+                                int                   i,
+                                int                   j,
+                                int                   k,
+                                const KrigBlockData & data) const;
   void            EstimateSizeOfBlock();
   void            EstimateSizeOfBlock2();
   float           CalcCPUTime(float dxBlock, float dyBlockExt, float& nd, bool& rapidInc);
@@ -75,16 +98,13 @@ private:
   CovGridSeparated &covAlpha_, &covBeta_, &covRho_, &covCrAlphaBeta_, &covCrAlphaRho_, &covCrBetaRho_;
   FFTGrid       * pBWellGrid_; // a "bool" grid that says "true" (1.0f), (or NOT -1.0f) if there is at least one blocked valid well data in the cell
   CBWellPt     ** pBWellPt_;
-  CBox            currDataBox_, currBlock_;                  // current data neightbourhood and kriging area
   int             dxBlock_, dyBlock_, dzBlock_;              // number of cells to define a kriging block
   int             dxBlockExt_, dyBlockExt_, dzBlockExt_;     // number of additional cells to reach data neighbourhood
-  int             i_, j_, k_;                                // current kriging indexes
-  int           * pIndexAlpha_, *pIndexBeta_, *pIndexRho_;  // holds an array of indexes into pBWells_
-  int             sizeAlpha_, sizeBeta_, sizeRho_;           // current sizes
   int             noValidAlpha_, noValidBeta_, noValidRho_;  // number of valid a, b og r data
   int             noValid_;                                  // total number of valid data
   int             noData_;                                   // number kriging data (blocks)
   int             dataTarget_;                               // target values
+  int             nThreads_;                                 // number of threads used for kriging blocks
   int             noKrigedCells_;                            // number of actually kriged cells
   int             noEmptyDataBlocks_;                        // number of empty datablocks
   int             noKrigedVariables_;                        // number of kriged variables so far
@@ -98,11 +118,14 @@ private:
   enum            { maxDataTolerance_         = 10,          // in % of dataTarget_
                     maxDataBlockLoopCounter_  =  7,          // ca. max number of attempts to find a right data block neighbourhood, not used
                     maxCholeskyLoopCounter_   = 20,          // max number of attempts to cholesky decomposition
-                    switchFailed_             =  1};         // assert flag
+                    switchFailed_             =  1,          // assert flag
+                    maxCachedFactorsMB_       = 1024};       // memory for Cholesky factors kept between kriging calls
 
-  int             totalNoDataInCurrKrigBlock_;               // total number of data in current kriging block
   int             noSolvedMatrixEq_;                         // total number of times we have actually solved the matrix eq, for debug
   int              noRMissing_;                               // total number of times we have missing real values
+  std::vector<KrigBlockData> blocks_[3];                     // kriging blocks for each variable, found on first use
+  std::vector<int> blockOrder_[3];                           // kriging order of blocks_, most expensive first
+  double          cachedFactorBytes_;                        // memory used by kept Cholesky factors
   bool            failed2EstimateRange_, failed2EstimateDefaultDataBoxAndBlock_;             // bool flags if we failed 2 estimate true
   bool            backgroundModel_;
   int             dxSmoothBlock_, dySmoothBlock_, dzSmoothBlock_;                            // normal value is 2, data size is 2*n + 2
@@ -156,7 +156,8 @@ ModelAVODynamic::ModelAVODynamic(ModelSettings          *& model_settings,
                               scale,
                               is_segy,
                               is_storm,
-                              true);
+                              true,
+                              model_settings->getNumberOfThreads());
 
       seis_cubes_[i]->endAccess();
 
@@ -93,12 +93,17 @@ ModelAVOStatic::~ModelAVOStatic(void)
   //}
 }
 
-void
-ModelAVOStatic::CheckAvailableMemory(const Simbox     * time_simbox,
-                                     ModelSettings    * model_settings,
-                                     const InputFiles * input_files)
+float
+ModelAVOStatic::FindNeededMemory(const Simbox        * time_simbox,
+                                 const ModelSettings * model_settings,
+                                 const InputFiles    * input_files,
+                                 int                 & n_grids,
+                                 size_t              & grid_size_pad,
+                                 float               & mem0,
+                                 float               & mem1,
+                                 float               & mem1_cold,
+                                 float               & mem2)
 {
-  LogKit::WriteHeader("Estimating amount of memory needed");
   //
   // Find the size of first seismic volume
   //
@@ -116,7 +121,7 @@ ModelAVOStatic::CheckAvailableMemory(const Simbox     * time_simbox,
                                      time_simbox->GetNXpad(),
                                      time_simbox->GetNYpad(),
                                      time_simbox->GetNZpad());
-  size_t grid_size_pad = static_cast<size_t>(4)*dummy_grid->getrsize();
+  grid_size_pad = static_cast<size_t>(4)*dummy_grid->getrsize();
 
   delete dummy_grid;
   dummy_grid = new FFTGrid(time_simbox->getnx(),
@@ -140,15 +145,16 @@ ModelAVOStatic::CheckAvailableMemory(const Simbox     * time_simbox,
   int n_grid_compute      = 1;                                      // Computation grid, padded (for convenience)
   int n_grid_file_mode    = 1;                                      // One grid for intermediate file storage
 
-  int n_grids;
   size_t grid_mem;
+  size_t grid_mem_cold;
   if (model_settings->getForwardModeling() == true) {
     if (model_settings->getFileGrid())  // Use disk buffering
       n_grids = n_grid_file_mode;
     else
       n_grids = n_grid_parameters + 1;
 
-    grid_mem = n_grids*grid_size_pad;
+    grid_mem      = n_grids*grid_size_pad;
+    grid_mem_cold = grid_mem;
   }
   else {
     if (model_settings->getFileGrid()) { // Use disk buffering
@@ -162,7 +168,8 @@ ModelAVOStatic::CheckAvailableMemory(const Simbox     * time_simbox,
         n_grids = 2*n_grid_parameters;
       }
 
-      grid_mem = n_grids*grid_size_pad;
+      grid_mem      = n_grids*grid_size_pad;
+      grid_mem_cold = grid_mem;
     }
     else {
       //baseP and baseU are the padded and unpadde grids allocated at each peak.
@@ -179,9 +186,11 @@ ModelAVOStatic::CheckAvailableMemory(const Simbox     * time_simbox,
 
       size_t peak_grid_mem = peak_1P*grid_size_pad + peak_1U*grid_size_base; //First peak must be currently largest.
       int peak_n_grid = peak_1P;                                             //Also in number of padded grids
+      size_t peak_cold_mem = peak_grid_mem;                                  //Peak if cold grids are moved to disk.
 
       if (model_settings->getNumberOfSimulations() > 0) { //Second possible peak when simulating.
-        int peak_2P = base_P + 3; //Three extra parameter grids for simulated parameters.
+        int n_sim_batch = std::max(1, std::min(model_settings->getNumberOfThreads(), model_settings->getNumberOfSimulations()));
+        int peak_2P = base_P + 3*n_sim_batch + 6; //Three extra parameter grids per concurrent realisation, and the Cholesky factor of the covariance.
         if (model_settings->getUseLocalNoise(0) == true &&
            (model_settings->getEstimateFaciesProb() == false || model_settings->getFaciesProbRelative() == false))
           peak_2P -= n_grid_background; //Background grids are released before simulation in this case.
@@ -198,6 +207,10 @@ ModelAVOStatic::CheckAvailableMemory(const Simbox     * time_simbox,
         size_t peak_2_mem = peak_2P*grid_size_pad + peak_2U*grid_size_base;
         if (peak_2_mem > peak_grid_mem)
           peak_grid_mem = peak_2_mem;
+
+        size_t peak_2_cold_mem = peak_2_mem - n_grid_covariances*grid_size_pad; //Covariances are cold while simulating.
+        if (peak_2_cold_mem > peak_cold_mem)
+          peak_cold_mem = peak_2_cold_mem;
       }
 
       if (model_settings->getEstimateFaciesProb() == true) {//Third possible peak when computing facies prob.
@@ -209,22 +222,43 @@ ModelAVOStatic::CheckAvailableMemory(const Simbox     * time_simbox,
         size_t peak_3_mem = peak_3P*grid_size_pad + peak_3U*grid_size_base + 2000000*n_grid_histograms; //These are 2MB when Vs is used.
         if (peak_3_mem > peak_grid_mem)
           peak_grid_mem = peak_3_mem;
+        if (peak_3_mem > peak_cold_mem)
+          peak_cold_mem = peak_3_mem;
       }
-      n_grids  = peak_n_grid;
-      grid_mem = peak_grid_mem;
+      n_grids       = peak_n_grid;
+      grid_mem      = peak_grid_mem;
+      grid_mem_cold = peak_cold_mem;
     }
   }
-  FFTGrid::setMaxAllowedGrids(n_grids);
-  //if (model_settings->getDebugFlag()>0)
-  //    FFTGrid::setTerminateOnMaxGrid(true); NBNB Ragnar: Temporary until count is ok.
 
   int   work_size   = 2500 + static_cast<int>( 0.65*grid_size_pad); //Size of memory used beyond grids.
 
-  float mem0        = 4.0f * work_size;
-  float mem1        = static_cast<float>(grid_mem);
-  float mem2        = static_cast<float>(model_settings->getNumberOfAngles(0))*grid_size_pad + mem_one_seis; //Peak memory when reading seismic, overestimated.
+  mem0 = 4.0f * work_size;
+  mem1 = static_cast<float>(grid_mem);
+  mem1_cold = static_cast<float>(grid_mem_cold);
+  mem2 = static_cast<float>(model_settings->getNumberOfAngles(0))*grid_size_pad + mem_one_seis; //Peak memory when reading seismic, overestimated.
 
-  float needed_mem   = mem0 + std::max(mem1, mem2);
+  return(mem0 + std::max(mem1, mem2));
+}
+
+void
+ModelAVOStatic::CheckAvailableMemory(const Simbox     * time_simbox,
+                                     ModelSettings    * model_settings,
+                                     const InputFiles * input_files)
+{
+  LogKit::WriteHeader("Estimating amount of memory needed");
+
+  int    n_grids       = 0;
+  size_t grid_size_pad = 0;
+  float  mem0          = 0.0f;
+  float  mem1          = 0.0f;
+  float  mem1_cold     = 0.0f;
+  float  mem2          = 0.0f;
+  float  needed_mem    = FindNeededMemory(time_simbox, model_settings, input_files, n_grids, grid_size_pad, mem0, mem1, mem1_cold, mem2);
+
+  float budget = static_cast<float>(model_settings->getMemoryBudget()*1024.0*1024.0);
+  if (budget > 0.0f)
+    FFTGrid::setMemoryBudget(budget - mem0);
 
   float mega_bytes   = needed_mem/(1024.f*1024.f);
   float giga_bytes   = mega_bytes/1024.f;
@@ -240,27 +274,43 @@ ModelAVOStatic::CheckAvailableMemory(const Simbox     * time_simbox,
 
   if (mem2>mem1)
     LogKit::LogFormatted(LogKit::Low,"\n This estimate is too high because seismic data are cut to fit the internal grid\n");
+  // Intervals inverted concurrently share model_settings.
+#ifdef PARALLEL
+#pragma omp critical(check_available_memory)
+#endif
   if (!model_settings->getFileGrid()) {
-    //
-    // Check if we can hold everything in memory.
-    //
-    model_settings->setFileGrid(false);
-    char ** memchunk  = new char*[n_grids];
-
-    int i = 0;
-    try {
-      for(i = 0 ; i < n_grids ; i++)
-        memchunk[i] = new char[static_cast<size_t>(grid_size_pad)];
-    }
-    catch (std::bad_alloc& ) //Could not allocate memory
-    {
-      model_settings->setFileGrid(true);
-      LogKit::LogFormatted(LogKit::Low,"Not enough memory to hold all grids. Using file storage.\n");
+    if (budget > 0.0f) {
+      //
+      // Check if we can stay within the memory budget, moving cold grids to disk if need be.
+      //
+      if (mem0 + std::max(mem1_cold, mem2) > budget) {
+        model_settings->setFileGrid(true);
+        LogKit::LogFormatted(LogKit::Low,"Not enough memory within the memory budget to hold all grids. Using file storage.\n");
+      }
+      else if (needed_mem > budget)
+        LogKit::LogFormatted(LogKit::Low,"Grids that are not needed for a while will be moved to disk to stay within the memory budget.\n");
     }
+    else {
+      //
+      // Check if we can hold everything in memory.
+      //
+      char ** memchunk  = new char*[n_grids];
+
+      int i = 0;
+      try {
+        for(i = 0 ; i < n_grids ; i++)
+          memchunk[i] = new char[static_cast<size_t>(grid_size_pad)];
+      }
+      catch (std::bad_alloc& ) //Could not allocate memory
+      {
+        model_settings->setFileGrid(true);
+        LogKit::LogFormatted(LogKit::Low,"Not enough memory to hold all grids. Using file storage.\n");
+      }
 
-    for(int j=0 ; j<i ; j++)
-      delete [] memchunk[j];
-    delete [] memchunk;
+      for(int j=0 ; j<i ; j++)
+        delete [] memchunk[j];
+      delete [] memchunk;
+    }
   }
 }
 
@@ -46,6 +46,19 @@ public:
                                         int nxp, int nyp, int nzp,
                                         bool file_grid);
 
+  // Estimated peak memory (bytes) of inverting one interval. mem0 is for entities
+  // other than grids, mem1 for the n_grids internal grids, and mem2 for reading seismic.
+  // mem1_cold is the peak for the internal grids when cold grids are moved to disk.
+  static float            FindNeededMemory(const Simbox        * time_simbox,
+                                           const ModelSettings * model_settings,
+                                           const InputFiles    * input_files,
+                                           int                 & n_grids,
+                                           size_t              & grid_size_pad,
+                                           float               & mem0,
+                                           float               & mem1,
+                                           float               & mem1_cold,
+                                           float               & mem2);
+
 private:
 
   void             CheckAvailableMemory(const Simbox              * time_simbox,
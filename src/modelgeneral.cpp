@@ -125,6 +125,7 @@ ModelGeneral::ModelGeneral(ModelSettings           *& model_settings,
         NRLib::Matrix initial_cov(6,6);
 
         SetupState4D(seismic_parameters, simbox_, state4d_, initial_mean, initial_cov);
+        state4d_.setNumberOfThreads(model_settings->getNumberOfThreads());
 
         time_evolution_ = TimeEvolution(10000, *time_line_, rock_distributions_.begin()->second); //NBNB OK 10000->1000 for speed during testing
         time_evolution_.SetInitialMean(initial_mean);
@@ -162,6 +162,7 @@ ModelSettings::ModelSettings(void)
   otherFlag_               =        0;
   debugFlag_               =        0;
   fileGrid_                =    false;
+  memoryBudget_            =      0.0;
   waveletFormatManual_     =    false;
   useVerticalVariogram_    =    false;
   do4DInversion_           =    false;
@@ -178,6 +179,7 @@ ModelSettings::ModelSettings(void)
   estimateFaciesProb_      =    false;
   faciesProbRelative_      =     true;
   faciesProbFromRockPhysics_=   false;
+  useForwardModelTables_   =    false;
   noVsFaciesProb_          =    false;
   useFilterForProb_        =     true;
   faciesLogGiven_          =    false;
@@ -192,6 +194,7 @@ ModelSettings::ModelSettings(void)
   snapGridToSeismicData_   =    false;
   wellGradientFromSeismic_ =    false;
   writeAsciiSurfaces_      =    false;
+  fftWisdomFile_           =       "";
 
   priorFaciesProbGiven_    = ModelSettings::FACIES_FROM_WELLS;
 
@@ -184,6 +184,7 @@ public:
   int                              getDebugFlag(void)                   const { return debugFlag_                                 ;}
   static int                       getDebugLevel(void)                        { return debugFlag_                                 ;}
   bool                             getFileGrid(void)                    const { return fileGrid_                                  ;}
+  double                           getMemoryBudget(void)                const { return memoryBudget_                              ;}
   bool                             getEstimationMode(void)              const { return estimationMode_                            ;}
   bool                             getForwardModeling(void)             const { return forwardModeling_                           ;}
   bool                             getGenerateSeismicAfterInv(void)     const { return generateSeismicAfterInv_                   ;}
@@ -195,6 +196,7 @@ public:
   bool                             getEstimateFaciesProb(void)          const { return estimateFaciesProb_                        ;}
   bool                             getFaciesProbRelative(void)          const { return faciesProbRelative_                        ;}
   bool                             getFaciesProbFromRockPhysics(void)   const { return faciesProbFromRockPhysics_                 ;}
+  bool                             getUseForwardModelTables(void)       const { return useForwardModelTables_                     ;}
   bool                             getNoVsFaciesProb(void)              const { return noVsFaciesProb_                            ;}
   bool                             getUseFilterForFaciesProb()          const { return useFilterForProb_                          ;}
   bool                             getFaciesLogGiven(void)              const { return faciesLogGiven_                            ;}
@@ -214,6 +216,7 @@ public:
   double                           getGradientSmoothingRange(void)      const { return gradientSmoothingRange_                    ;}
   bool                             getEstimateWellGradientFromSeismic() const { return wellGradientFromSeismic_                   ;}
   bool                             getWriteAsciiSurfaces(void)          const { return writeAsciiSurfaces_                        ;}
+  const std::string              & getFFTWisdomFile(void)               const { return fftWisdomFile_                             ;}
   int                              getLogLevel(void)                    const { return logLevel_                                  ;}
   bool                             getErrorFileFlag()                   const { return ((otherFlag_ & IO::ERROR_FILE)>0)          ;}
   bool                             getTaskFileFlag()                    const { return ((otherFlag_ & IO::TASK_FILE)>0)           ;}
@@ -430,6 +433,7 @@ public:
   void setOtherOutputFlag(int otherFlag)                  { otherFlag_                = otherFlag                ;}
   void setDebugFlag(int debugFlag)                        { debugFlag_                = debugFlag                ;}
   void setFileGrid(bool fileGrid)                         { fileGrid_                 = fileGrid                 ;}
+  void setMemoryBudget(double memoryBudget)               { memoryBudget_             = memoryBudget             ;}
   void setEstimationMode(bool estimationMode)             { estimationMode_           = estimationMode           ;}
   void setForwardModeling(bool forwardModeling)           { forwardModeling_          = forwardModeling          ;}
   void setGenerateSeismicAfterInv( bool generateSeismic)  { generateSeismicAfterInv_  = generateSeismic          ;}
@@ -440,6 +444,7 @@ public:
   void setEstimateFaciesProb(bool estFaciesProb)          { estimateFaciesProb_       = estFaciesProb            ;}
   void setFaciesProbRelative(bool faciesProbRel)          { faciesProbRelative_       = faciesProbRel            ;}
   void setFaciesProbFromRockPhysics(bool rockPhysics)     { faciesProbFromRockPhysics_= rockPhysics              ;}
+  void setUseForwardModelTables(bool useTables)           { useForwardModelTables_    = useTables                ;}
   void setNoVsFaciesProb(bool noVsFaciesProb)             { noVsFaciesProb_           = noVsFaciesProb           ;}
   void setUseFilterForFaciesProb(bool useFilterForProb)   { useFilterForProb_         = useFilterForProb         ;}
   void setFaciesLogGiven(bool faciesLogGiven)             { faciesLogGiven_           = faciesLogGiven           ;}
@@ -547,6 +552,7 @@ public:
   void setGradientSmoothingRange(double smoothingRange)   { gradientSmoothingRange_   = smoothingRange           ;}
   void setEstimateWellGradientFromSeismic(bool estimate)  { wellGradientFromSeismic_  = estimate                 ;}
   void setWriteAsciiSurfaces(bool write_ascii)            { writeAsciiSurfaces_       = write_ascii              ;}
+  void setFFTWisdomFile(const std::string & file_name)    { fftWisdomFile_            = file_name                ;}
 
   void MakeSureDzIsSetIfNeeded(InputFiles & input_files,
                                std::string & err_txt);
@@ -807,6 +813,7 @@ private:
   int                               waveletFormatFlag_;          ///< Decides wavelet output format
   int                               otherFlag_;                  ///< Decides output beyond grids and wells.
   bool                              fileGrid_;                   ///< Indicator telling if grids are to be kept on file
+  double                            memoryBudget_;               ///< Maximum memory usage in MB. Zero if not given.
   bool                              outputGridsDefault_;         ///< Indicator telling if grid output has been actively controlled
   bool                              waveletFormatManual_;        ///< True if wavelet format is decided in the model file
   bool                              useVerticalVariogram_;       ///< True if a vertical variogram is used to estimate temporal correlation
@@ -818,6 +825,7 @@ private:
   bool                              estimateFaciesProb_;         ///< Shall facies probabilites be estimated?
   bool                              faciesProbRelative_;         ///< Use relative elastic parameters for facies prob estimation?
   bool                              faciesProbFromRockPhysics_;  ///< Calculate facies probabilities using rock physics models
+  bool                              useForwardModelTables_;      ///< Serve rock physics forward models from interpolation tables
   bool                              noVsFaciesProb_;             ///< Do not use Vs for faciesprob.
   bool                              useFilterForProb_;           ///< Use filtered logs for facies probs, otherwise, use sampled inversion.
   bool                              faciesLogGiven_;
@@ -843,6 +851,7 @@ private:
   float                             seismicQualityGridRange_;    ///< Radius value from well-points where wells are used in Seismic Quality Grids
   float                             seismicQualityGridValue_;    ///< Value between wells if range is used.
   bool                              writeAsciiSurfaces_;         ///< If true, ascii format will be added when surfaces are written
+  std::string                       fftWisdomFile_;              ///< FFTW wisdom is read from and written to this file. Empty if not used.
 
   std::map<std::string, bool>       topConformCorrelation_;      ///< Should top correlation direction be equal to the top inversion surface per interval
   std::map<std::string, bool>       baseConformCorrelation_;     ///< Should base correlation direction be equal to the base inversion surface per interval
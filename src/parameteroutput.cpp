@@ -11,6 +11,7 @@
 #include "src/io.h"
 #include "lib/utils.h"
 #include "fft/include/fftw.h"
+#include "nrlib/exception/exception.hpp"
 
 void
 ParameterOutput::WriteParameters(const Simbox        * simbox,
@@ -25,7 +26,6 @@ ParameterOutput::WriteParameters(const Simbox        * simbox,
 {
   std::string prefix;
   std::string suffix;
-  std::string file_name;
 
   if(sim_num >= 0) {
     prefix = IO::PrefixSimulations();
@@ -39,65 +39,153 @@ ParameterOutput::WriteParameters(const Simbox        * simbox,
   if(kriged)
     suffix = "_Kriged"+suffix;
 
-  if((output_flag & IO::MURHO) > 0) {
-    file_name = prefix+"MuRho"+suffix;
-    ComputeMuRho(simbox, time_depth_mapping, model_settings, vp, vs, rho, file_name);
-  }
-  if((output_flag & IO::LAMBDARHO) > 0) {
-    file_name = prefix+"LambdaRho"+suffix;
-    ComputeLambdaRho(simbox, time_depth_mapping, model_settings, vp, vs, rho, file_name);
-  }
-  if((output_flag & IO::LAMELAMBDA) > 0) {
-    file_name = prefix+"LameLambda"+suffix;
-    ComputeLameLambda(simbox, time_depth_mapping, model_settings, vp, vs, rho, file_name);
-  }
-  if((output_flag & IO::LAMEMU) > 0) {
-    file_name = prefix+"LameMu"+suffix;
-    ComputeLameMu(simbox, time_depth_mapping,  model_settings, vs, rho, file_name);
-  }
-  if((output_flag & IO::POISSONRATIO) > 0) {
-    file_name = prefix+"PoissonRatio"+suffix;
-    ComputePoissonRatio(simbox, time_depth_mapping, model_settings, vp, vs, file_name);
-  }
-  if((output_flag & IO::AI) > 0) {
-    file_name = prefix+"AI"+suffix;
-    ComputeAcousticImpedance(simbox, time_depth_mapping, model_settings, vp, rho, file_name);
-  }
-  if((output_flag & IO::SI) > 0) {
-    file_name = prefix+"SI"+suffix;
-    ComputeShearImpedance(simbox, time_depth_mapping, model_settings, vs, rho, file_name);
-  }
-  if((output_flag & IO::VPVSRATIO) > 0) {
-    file_name = prefix+"VpVsRatio"+suffix;
-    ComputeVpVsRatio(simbox, time_depth_mapping, model_settings, vp, vs, file_name);
+  // The derived parameters are computed from the logarithmic grids, so they are all written
+  // before vp, vs and rho are transformed. Each step writes its grids concurrently.
+  std::vector<int> derived;
+  if((output_flag & IO::MURHO) > 0)
+    derived.push_back(IO::MURHO);
+  if((output_flag & IO::LAMBDARHO) > 0)
+    derived.push_back(IO::LAMBDARHO);
+  if((output_flag & IO::LAMELAMBDA) > 0)
+    derived.push_back(IO::LAMELAMBDA);
+  if((output_flag & IO::LAMEMU) > 0)
+    derived.push_back(IO::LAMEMU);
+  if((output_flag & IO::POISSONRATIO) > 0)
+    derived.push_back(IO::POISSONRATIO);
+  if((output_flag & IO::AI) > 0)
+    derived.push_back(IO::AI);
+  if((output_flag & IO::SI) > 0)
+    derived.push_back(IO::SI);
+  if((output_flag & IO::VPVSRATIO) > 0)
+    derived.push_back(IO::VPVSRATIO);
+
+  int         n_derived = static_cast<int>(derived.size());
+  bool        failed    = false;
+  std::string err_txt   = "";
+  int d;
+#ifdef PARALLEL
+  // A derived parameter holds its own grid and a scratch copy while it is written.
+  double bytes_per_write = 2.0*static_cast<double>(vp->GetN())*sizeof(float);
+  int    n_threads       = FindNumberOfWriters(model_settings, bytes_per_write, n_derived);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads) if(n_threads > 1)
+#endif
+  for (d = 0; d < n_derived; d++) {
+    try {
+      switch (derived[d]) {
+      case IO::MURHO:
+        ComputeMuRho(simbox, time_depth_mapping, model_settings, vp, vs, rho, prefix+"MuRho"+suffix);
+        break;
+      case IO::LAMBDARHO:
+        ComputeLambdaRho(simbox, time_depth_mapping, model_settings, vp, vs, rho, prefix+"LambdaRho"+suffix);
+        break;
+      case IO::LAMELAMBDA:
+        ComputeLameLambda(simbox, time_depth_mapping, model_settings, vp, vs, rho, prefix+"LameLambda"+suffix);
+        break;
+      case IO::LAMEMU:
+        ComputeLameMu(simbox, time_depth_mapping,  model_settings, vs, rho, prefix+"LameMu"+suffix);
+        break;
+      case IO::POISSONRATIO:
+        ComputePoissonRatio(simbox, time_depth_mapping, model_settings, vp, vs, prefix+"PoissonRatio"+suffix);
+        break;
+      case IO::AI:
+        ComputeAcousticImpedance(simbox, time_depth_mapping, model_settings, vp, rho, prefix+"AI"+suffix);
+        break;
+      case IO::SI:
+        ComputeShearImpedance(simbox, time_depth_mapping, model_settings, vs, rho, prefix+"SI"+suffix);
+        break;
+      case IO::VPVSRATIO:
+        ComputeVpVsRatio(simbox, time_depth_mapping, model_settings, vp, vs, prefix+"VpVsRatio"+suffix);
+        break;
+      }
+    }
+    catch (NRLib::Exception & e) { //Rethrown outside the parallel region
+#ifdef PARALLEL
+#pragma omp critical(parameter_output)
+#endif
+      {
+        if (failed == false)
+          err_txt = e.what();
+        failed = true;
+      }
+    }
   }
-  if((output_flag & IO::VP) > 0) {
-    file_name = prefix+"Vp"+suffix;
-
-    ExpTransf(vp);
-    WriteToFile(simbox, time_depth_mapping, model_settings, vp, file_name, "Inverted Vp");
-    //if (sim_num < 0) //prediction, need grid unharmed.
-    //  vp->logTransf();
+  if (failed)
+    throw NRLib::Exception(err_txt);
+
+  std::vector<GridFile> grid_files;
+  if((output_flag & IO::VP) > 0)
+    grid_files.push_back(GridFile(vp, prefix+"Vp"+suffix, IO::PathToInversionResults(), false, "Inverted Vp", time_depth_mapping, true));
+  if((output_flag & IO::VS) > 0)
+    grid_files.push_back(GridFile(vs, prefix+"Vs"+suffix, IO::PathToInversionResults(), false, "Inverted Vs", time_depth_mapping, true));
+  if((output_flag & IO::RHO) > 0)
+    grid_files.push_back(GridFile(rho, prefix+"Rho"+suffix, IO::PathToInversionResults(), false, "Inverted density", time_depth_mapping, true));
+
+  WriteFiles(model_settings, simbox, grid_files);
+}
 
+void
+ParameterOutput::WriteFiles(const ModelSettings         * model_settings,
+                            const Simbox                * simbox,
+                            const std::vector<GridFile> & grid_files)
+{
+  int         n_files   = static_cast<int>(grid_files.size());
+  bool        failed    = false;
+  std::string err_txt   = "";
+  int f;
+#ifdef PARALLEL
+  double bytes_per_write = 0.0;
+  for (f = 0; f < n_files; f++)
+    bytes_per_write = std::max(bytes_per_write, static_cast<double>(grid_files[f].grid->GetN())*sizeof(float));
+  int n_threads = FindNumberOfWriters(model_settings, bytes_per_write, n_files);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads) if(n_threads > 1)
+#endif
+  for (f = 0; f < n_files; f++) {
+    const GridFile & grid_file = grid_files[f];
+    try {
+      if (grid_file.exp_transf)
+        ExpTransf(grid_file.grid);
+      WriteFile(model_settings,
+                grid_file.grid,
+                grid_file.file_name,
+                grid_file.sub_dir,
+                simbox,
+                grid_file.is_seismic,
+                grid_file.label,
+                grid_file.depth_map);
+    }
+    catch (NRLib::Exception & e) { //Rethrown outside the parallel region
+#ifdef PARALLEL
+#pragma omp critical(parameter_output)
+#endif
+      {
+        if (failed == false)
+          err_txt = e.what();
+        failed = true;
+      }
+    }
   }
-  if((output_flag & IO::VS) > 0) {
-    file_name = prefix+"Vs"+suffix;
-
-    ExpTransf(vs);
-    WriteToFile(simbox, time_depth_mapping, model_settings, vs, file_name, "Inverted Vs");
-    //if (sim_num < 0) //prediction, need grid unharmed.
-    //  vs->logTransf();
+  if (failed)
+    throw NRLib::Exception(err_txt);
+}
 
+int
+ParameterOutput::FindNumberOfWriters(const ModelSettings * model_settings,
+                                     double                bytes_per_write,
+                                     int                   n_writes)
+{
+  int n_writers = std::max(std::min(model_settings->getNumberOfThreads(), n_writes), 1);
+
+  double budget = FFTGrid::getMemoryBudget();
+  if (budget > 0.0 && n_writers > 1 && bytes_per_write > 0.0) {
+    double free_bytes = budget - FFTGrid::getMemoryInUse();
+    int    n_fit      = static_cast<int>(free_bytes/bytes_per_write);
+    if (n_fit < n_writers) {
+      n_writers = std::max(n_fit, 1);
+      LogKit::LogFormatted(LogKit::Medium, "\nWriting %d grids at a time to stay within the memory budget.\n", n_writers);
+    }
   }
-  if((output_flag & IO::RHO) > 0) {
-    file_name = prefix+"Rho"+suffix;
-
-    ExpTransf(rho);
-    WriteToFile(simbox, time_depth_mapping, model_settings, rho, file_name, "Inverted density");
-    //if (sim_num < 0) //prediction, need grid unharmed.
-    //  rho->logTransf();
 
-  }
+  return n_writers;
 }
 
 void
@@ -448,18 +536,16 @@ ParameterOutput::WriteFile(const ModelSettings     * model_settings,
         const std::string header = simbox->getStormHeader(1, simbox->getnx(), simbox->getny(), simbox->getnz(), false, false);
         output->SetFormat(NRLib::StormContGrid::STORM_BINARY);
         std::string file_name_storm = file_name + IO::SuffixStormBinary();
-        LogKit::LogFormatted(LogKit::Low," Writing STORM file "+file_name_storm+"...");
         output->WriteToFile(file_name_storm, header, false);
-        LogKit::LogFormatted(LogKit::Low,"done\n");
+        LogKit::LogFormatted(LogKit::Low," Writing STORM file "+file_name_storm+"...done\n");
       }
 
       if ((format_flag & IO::ASCII) > 0) {
         output->SetFormat(NRLib::StormContGrid::STORM_ASCII);
         const std::string header = simbox->getStormHeader(1, simbox->getnx(), simbox->getny(), simbox->getnz(), false, true);
         std::string file_name_ascii = file_name + IO::SuffixGeneralData();
-        LogKit::LogFormatted(LogKit::Low," Writing ASCII file "+file_name_ascii+"...");
         output->WriteToFile(file_name_ascii, header, true);
-        LogKit::LogFormatted(LogKit::Low,"done\n");
+        LogKit::LogFormatted(LogKit::Low," Writing ASCII file "+file_name_ascii+"...done\n");
       }
 
       //SEGY, SGRI CRAVA are never resampled in time.
@@ -467,7 +553,6 @@ ParameterOutput::WriteFile(const ModelSettings     * model_settings,
         const TraceHeaderFormat * thf = model_settings->getTraceHeaderFormatOutput();
         float z0 = model_settings->getOutputOffset();
         std::string file_name_segy = file_name + IO::SuffixSegy();
-        LogKit::LogFormatted(LogKit::Low," Writing SEGY file "+file_name_segy+"...");
 
         //Take nz from segy if output_dz = segy_dz, otherwise a nz is calculated
         float output_dz = 0.0;
@@ -489,7 +574,7 @@ ParameterOutput::WriteFile(const ModelSettings     * model_settings,
                                *thf,
                                is_seismic);
 
-        LogKit::LogFormatted(LogKit::Low,"done\n");
+        LogKit::LogFormatted(LogKit::Low," Writing SEGY file "+file_name_segy+"...done\n");
 
         delete segy;
       }
@@ -497,9 +582,8 @@ ParameterOutput::WriteFile(const ModelSettings     * model_settings,
         std::string file_name_sgri   = file_name + IO::SuffixSgri();
         std::string file_name_header = file_name + IO::SuffixSgriHeader();
 
-        LogKit::LogFormatted(LogKit::Low," Writing SGRI header file "+ file_name_header + "...");
         output->WriteToSgriFile(file_name_sgri, file_name_header, label, simbox->getdz());
-        LogKit::LogFormatted(LogKit::Low,"done\n");
+        LogKit::LogFormatted(LogKit::Low," Writing SGRI header file "+file_name_header+"...done\n");
 
       }
     }
@@ -520,9 +604,8 @@ ParameterOutput::WriteFile(const ModelSettings     * model_settings,
           int ny = static_cast<int>(output->GetNJ());
           int nz = static_cast<int>(output->GetNK());
           std::string header = depth_map->getSimbox()->getStormHeader(FFTGrid::PARAMETER, nx, ny, nz, false, false);
-          LogKit::LogFormatted(LogKit::Low," Writing STORM file "+file_name_storm+"...");
           output->WriteToFile(file_name_storm, header, false);
-          LogKit::LogFormatted(LogKit::Low,"done\n");
+          LogKit::LogFormatted(LogKit::Low," Writing STORM file "+file_name_storm+"...done\n");
         }
         if ((format_flag & IO::ASCII) > 0) {
           output->SetFormat(NRLib::StormContGrid::STORM_ASCII);
@@ -530,10 +613,9 @@ ParameterOutput::WriteFile(const ModelSettings     * model_settings,
           int nx = static_cast<int>(output->GetNI());
           int ny = static_cast<int>(output->GetNJ());
           int nz = static_cast<int>(output->GetNK());
-          LogKit::LogFormatted(LogKit::Low," Writing ASCII file "+file_name_ascii+"...");
           std::string header = depth_map->getSimbox()->getStormHeader(FFTGrid::PARAMETER, nx, ny, nz, false, true);
           output->WriteToFile(file_name_ascii, header, true);
-          LogKit::LogFormatted(LogKit::Low,"done\n");
+          LogKit::LogFormatted(LogKit::Low," Writing ASCII file "+file_name_ascii+"...done\n");
         }
         /* Not supposed to be part of CRAVA.
         if ((format_flag & IO::SEGY) >0) {
@@ -556,11 +638,10 @@ ParameterOutput::WriteFile(const ModelSettings     * model_settings,
 
           std::string file_name_segy = file_name + IO::SuffixSegy();
 
-          LogKit::LogFormatted(LogKit::Low," Writing SEGY file "+file_name_segy+"...");
           SegY * segy = new SegY(storm_cube_depth, &geometry, z0, file_name_segy, true);
           delete segy;
           delete storm_cube_depth;
-          LogKit::LogFormatted(LogKit::Low,"done\n");
+          LogKit::LogFormatted(LogKit::Low," Writing SEGY file "+file_name_segy+"...done\n");
         }
         */
       }
@@ -625,9 +706,8 @@ ParameterOutput::WriteResampledStormCube(const StormContGrid * storm_grid,
     int ny = static_cast<int>(storm_grid->GetNJ());
     header = gridmapping->getSimbox()->getStormHeader(FFTGrid::PARAMETER, nx, ny, nz, 0, 1);
     outgrid->SetFormat(StormContGrid::STORM_ASCII);
-    LogKit::LogFormatted(LogKit::Low," Writing ASCII file "+gf_name+"...");
     outgrid->WriteToFile(gf_name, header);
-    LogKit::LogFormatted(LogKit::Low,"done\n");
+    LogKit::LogFormatted(LogKit::Low," Writing ASCII file "+gf_name+"...done\n");
   }
 
   if ((format & IO::STORM) > 0) {
@@ -636,9 +716,8 @@ ParameterOutput::WriteResampledStormCube(const StormContGrid * storm_grid,
     int ny = static_cast<int>(storm_grid->GetNJ());
     header = gridmapping->getSimbox()->getStormHeader(FFTGrid::PARAMETER, nx, ny, nz, 0, 0);
     outgrid->SetFormat(StormContGrid::STORM_BINARY);
-    LogKit::LogFormatted(LogKit::Low," Writing STORM file "+gf_name+"...");
     outgrid->WriteToFile(gf_name,header);
-    LogKit::LogFormatted(LogKit::Low,"done\n");
+    LogKit::LogFormatted(LogKit::Low," Writing STORM file "+gf_name+"...done\n");
   }
   if((format & IO::SEGY) > 0 && is_depth == false) {
     gf_name =  file_name + IO::SuffixSegy();
@@ -648,7 +727,6 @@ ParameterOutput::WriteResampledStormCube(const StormContGrid * storm_grid,
                           simbox->getILStepX(), simbox->getILStepY(),
                           simbox->getXLStepX(), simbox->getXLStepY(),
                           simbox->getAngle());
-    LogKit::LogFormatted(LogKit::Low," Writing SEGY file "+gf_name+"...");
 
     //Take nz from segy if output_dz = segy_dz, otherwise a nz is calculated
     float dz_output = 0.0;
@@ -657,7 +735,7 @@ ParameterOutput::WriteResampledStormCube(const StormContGrid * storm_grid,
 
     SegY * segy = new SegY(outgrid, &geometry, z0, dz_output, nz_output, gf_name, true);
     delete segy;
-    LogKit::LogFormatted(LogKit::Low,"done\n");
+    LogKit::LogFormatted(LogKit::Low," Writing SEGY file "+gf_name+"...done\n");
 
   }
   delete outgrid;
@@ -6,6 +6,7 @@
 #define PARAMETEROUTPUT_H
 
 #include <string>
+#include <vector>
 
 #include "src/definitions.h"
 #include "libs/fft/include/fftw.h"
@@ -17,6 +18,27 @@ class GridMapping;
 class ParameterOutput
 {
 public:
+  // A grid for WriteFiles(), with the arguments WriteFile() would take.
+  struct GridFile {
+    GridFile(StormContGrid       * grid_in,
+             const std::string   & file_name_in,
+             const std::string   & sub_dir_in,
+             bool                  is_seismic_in = false,
+             const std::string   & label_in      = "NO_LABEL",
+             const GridMapping   * depth_map_in  = NULL,
+             bool                  exp_transf_in = false)
+      : grid(grid_in), file_name(file_name_in), sub_dir(sub_dir_in), is_seismic(is_seismic_in),
+        label(label_in), depth_map(depth_map_in), exp_transf(exp_transf_in) {}
+
+    StormContGrid     * grid;
+    std::string         file_name;
+    std::string         sub_dir;
+    bool                is_seismic;
+    std::string         label;
+    const GridMapping * depth_map;
+    bool                exp_transf;  // Take the exponential of the grid before it is written.
+  };
+
   //Conventions for writeParameters:
   // simNum = -1 indicates prediction, otherwise filename ends with n+1.
   // All grids are in normal domain, and on log scale.
@@ -50,6 +72,18 @@ public:
                             const GridMapping       * depth_map = NULL,
                             bool                      padding = false);
 
+  // Writes the grids concurrently, one grid per thread. The grids must be distinct.
+  // The writes overlap each other, not the inversion, which is done before output starts.
+  static void     WriteFiles(const ModelSettings         * model_settings,
+                             const Simbox                * simbox,
+                             const std::vector<GridFile> & grid_files);
+
+  // Number of writes to run at once. Each write holds scratch copies of its grid, so with a
+  // memory budget (<maximum-memory-usage>) only as many writes run as there is room for.
+  static int      FindNumberOfWriters(const ModelSettings * model_settings,
+                                      double                bytes_per_write,
+                                      int                   n_writes);
+
 private:
 
   static void      ComputeAcousticImpedance(const Simbox        * simbox,
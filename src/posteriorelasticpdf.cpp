@@ -77,50 +77,16 @@ void PosteriorElasticPDF::SolveGEVProblem(NRLib::Matrix           & sigma_prior,
 {
   //Compute transforms v1 and v2 ----------------------------------------
 
-  // Matrix inversion of sigma_prior
-  //double **sigma_prior_inv = new double *[3];
-  //for(int i=0; i<3; i++)
-  //  sigma_prior_inv[i] = new double [3];
-  NRLib::Matrix sigma_pri_inv = NRLib::IdentityMatrix(3);
-
-  NRLib::SymmetricMatrix sym_mat;
+  // Eigenvalues and eigenvectors of inv(sigma_prior) * sigma_posterior
+  NRLib::SymmetricMatrix sym_mat(3);
   for(int i=0; i<3; i++)
     for(int j=i; j<3; j++)
       sym_mat(i,j) = sigma_prior(i,j);
 
-
-
-  NRLib::CholeskySolve(sym_mat, sigma_pri_inv);
-
-  //lib_matrCholR(3, sigma_prior);
-  //lib_matrAXeqBMatR(3, sigma_prior, sigma_prior_inv, 3);
-
-  // compute product sigma_prior_inv * sigma_posterior
-
-  //double **product_mat = new double *[3];
-
-  //for (int i=0; i<3; i++)
-  //  product_mat[i] = new double[3];
-
-  //lib_matr_prod(sigma_prior_inv,sigma_posterior,3,3,3,product_mat);
-
-  NRLib::Matrix product = sigma_pri_inv*sigma_post;
-
-  // compute eigenvalues of the product sigma_prior_inv * sigma_posterior
-
-  //int     * error       = new int[1];
-  //double  * eigval      = new double[3];
   NRLib::Vector eigval(3, 0);
   NRLib::Matrix eigvec(3,3,0);
-  //double ** eigvec      = new double *[3];
-
-  //for(int i=0;i<3;i++)
-  //{
-  //  eigvec[i]      = new double[3];
-  //}
 
-  NRLib::ComputeEigenVectors(product, eigval, eigvec);
-  //lib_matr_eigen(product_mat,3,eigvec,eigval,error);
+  NRLib::ComputeGeneralizedEigenVectors(sym_mat, sigma_post, eigval, eigvec);
 
   std::vector<int> index_keep;
 
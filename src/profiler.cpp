@@ -0,0 +1,305 @@
+/***************************************************************************
+*      Copyright (C) 2008 by Norwegian Computing Center and Statoil        *
+***************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <fstream>
+#include <iomanip>
+
+#include "fftw.h"
+#include "fftw-int.h"
+
+#include "nrlib/iotools/fileio.hpp"
+#include "nrlib/iotools/logkit.hpp"
+
+#include "src/profiler.h"
+
+#ifdef PARALLEL
+#include <omp.h>
+#endif
+
+static fftw_time profiler_start_time = fftw_get_time();
+
+//-------------------------------------------------------------------------------
+Profiler::Region::Region(const std::string & name,
+                         const std::string & tag)
+  : name_(name),
+    tag_(tag),
+    stack_(0),
+    thread_(GetThread()),
+    start_(0.0)
+{
+  bool in_parallel = InParallel();
+
+#ifdef PARALLEL
+#pragma omp critical(profiler)
+#endif
+  {
+    stack_ = (in_parallel ? thread_ + 1 : 0);
+    if (static_cast<int>(stacks_.size()) <= stack_)
+      stacks_.resize(stack_ + 1);
+
+    std::string parent = "";
+    if (!stacks_[stack_].empty())
+      parent = stacks_[stack_].back();
+    else if (!stacks_[0].empty())
+      parent = stacks_[0].back();
+
+    path_ = (parent == "" ? name_ : parent + "/" + name_);
+    if (tag_ != "")
+      path_ += " [" + tag_ + "]";
+    stacks_[stack_].push_back(path_);
+
+    for (int c = 0; c < N_COUNTERS; c++)
+      counters_[c] = Profiler::counters_[c];
+  }
+  start_ = GetTime();
+}
+
+//-------------------------------------------------------------------------------
+Profiler::Region::~Region(void)
+{
+  double end = GetTime();
+
+#ifdef PARALLEL
+#pragma omp critical(profiler)
+#endif
+  {
+    stacks_[stack_].pop_back();
+
+    Stats & stats = stats_[path_];
+    stats.calls += 1;
+    stats.wall  += end - start_;
+    for (int c = 0; c < N_COUNTERS; c++)
+      stats.counters[c] += Profiler::counters_[c] - counters_[c];
+
+    if (events_.size() < max_events_) {
+      Event event;
+      event.name     = name_;
+      event.tag      = tag_;
+      event.path     = path_;
+      event.thread   = thread_;
+      event.start    = start_;
+      event.duration = end - start_;
+      for (int c = 0; c < N_COUNTERS; c++)
+        event.counters[c] = Profiler::counters_[c] - counters_[c];
+      events_.push_back(event);
+    }
+    else
+      events_dropped_ = true;
+  }
+}
+
+//-------------------------------------------------------------------------------
+void
+Profiler::AddToCounter(Counter counter,
+                       double  value)
+{
+#ifdef PARALLEL
+#pragma omp atomic
+#endif
+  counters_[counter] += value;
+}
+
+//-------------------------------------------------------------------------------
+void
+Profiler::AddFFT(int n_points,
+                 int n_transforms)
+{
+  // The usual estimate for a real transform of size N is 2.5 N log2(N) flops.
+  double n     = static_cast<double>(n_points);
+  double flops = (n > 1.0 ? 2.5*n*log(n)/log(2.0) : 0.0)*n_transforms;
+  AddToCounter(FFT_TRANSFORMS, static_cast<double>(n_transforms));
+  AddToCounter(FFT_FLOPS, flops);
+}
+
+//-------------------------------------------------------------------------------
+void
+Profiler::RecordMemory(double bytes,
+                       int    n_grids)
+{
+  double time = GetTime();
+
+#ifdef PARALLEL
+#pragma omp critical(profiler)
+#endif
+  {
+    if (bytes > peak_memory_) {
+      peak_memory_ = bytes;
+      peak_grids_  = n_grids;
+    }
+    if (memory_.size() < max_events_) {
+      MemorySample sample;
+      sample.time    = time;
+      sample.bytes   = bytes;
+      sample.n_grids = n_grids;
+      memory_.push_back(sample);
+    }
+    else
+      events_dropped_ = true;
+  }
+}
+
+//-------------------------------------------------------------------------------
+void
+Profiler::ReportAll(LogKit::MessageLevels logLevel)
+{
+  if (stats_.empty())
+    return;
+
+  const double mega = 1024.0*1024.0;
+
+  LogKit::WriteHeader("Profile", logLevel);
+
+  LogKit::LogFormatted(logLevel,"\nRegion                                             Calls  Real time       FFTs    GFlop    MB read  MB written");
+  LogKit::LogFormatted(logLevel,"\n----------------------------------------------------------------------------------------------------------------\n");
+
+  std::map<std::string, Stats>::const_iterator it;
+  for (it = stats_.begin(); it != stats_.end(); ++it) {
+    const std::string & path  = it->first;
+    const Stats       & stats = it->second;
+
+    // Indent the last part of the path by the nesting depth
+    size_t depth = 0;
+    size_t last  = 0;
+    for (size_t i = 0; i < path.size(); i++) {
+      if (path[i] == '/') {
+        depth++;
+        last = i + 1;
+      }
+    }
+    std::string text = std::string(2*depth, ' ') + path.substr(last);
+    if (text.size() > 48)
+      text = text.substr(0, 45) + "...";
+
+    LogKit::LogFormatted(logLevel,"%-48s %7d %10.2f %10.0f %8.2f %10.1f %11.1f\n",
+                         text.c_str(), stats.calls, stats.wall,
+                         stats.counters[FFT_TRANSFORMS], stats.counters[FFT_FLOPS]*1.0e-9,
+                         stats.counters[FILE_BYTES_READ]/mega, stats.counters[FILE_BYTES_WRITTEN]/mega);
+  }
+  LogKit::LogFormatted(logLevel,  "----------------------------------------------------------------------------------------------------------------\n");
+  LogKit::LogFormatted(logLevel,"%-48s %7s %10s %10.0f %8.2f %10.1f %11.1f\n", "Total", "", "",
+                       counters_[FFT_TRANSFORMS], counters_[FFT_FLOPS]*1.0e-9,
+                       counters_[FILE_BYTES_READ]/mega, counters_[FILE_BYTES_WRITTEN]/mega);
+  LogKit::LogFormatted(logLevel,"\nPeak FFT-grid memory: %.1f MB in %d grids\n", peak_memory_/mega, peak_grids_);
+}
+
+//-------------------------------------------------------------------------------
+void
+Profiler::WriteTrace(const std::string & file_name)
+{
+  std::ofstream file;
+  NRLib::OpenWrite(file, file_name);
+  file << std::fixed << std::setprecision(3);
+
+  // Times are given in microseconds
+  file << "{\n\"traceEvents\": [\n";
+  file << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"CRAVA\"}}";
+
+  for (size_t i = 0; i < events_.size(); i++) {
+    const Event & event = events_[i];
+    file << ",\n{\"name\": ";
+    WriteJsonString(file, event.tag == "" ? event.name : event.name + " [" + event.tag + "]");
+    file << ", \"cat\": \"region\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+         << ", \"ts\": " << 1.0e6*event.start << ", \"dur\": " << 1.0e6*event.duration
+         << ", \"args\": {\"path\": ";
+    WriteJsonString(file, event.path);
+    if (event.tag != "") {
+      file << ", \"tag\": ";
+      WriteJsonString(file, event.tag);
+    }
+    file << ", ";
+    WriteCounterArgs(file, event.counters);
+    file << "}}";
+  }
+
+  for (size_t i = 0; i < memory_.size(); i++) {
+    file << ",\n{\"name\": \"FFT-grid memory\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << 1.0e6*memory_[i].time
+         << ", \"args\": {\"MB\": " << memory_[i].bytes/(1024.0*1024.0) << ", \"grids\": " << memory_[i].n_grids << "}}";
+  }
+
+  file << "\n],\n\"displayTimeUnit\": \"ms\",\n\"otherData\": {";
+  WriteCounterArgs(file, counters_);
+  file << ", \"peak_memory_MB\": " << peak_memory_/(1024.0*1024.0)
+       << ", \"peak_grids\": " << peak_grids_
+       << ", \"events_dropped\": " << (events_dropped_ ? "true" : "false") << "}\n}\n";
+
+  file.close();
+}
+
+//-------------------------------------------------------------------------------
+double
+Profiler::GetTime(void)
+{
+  return fftw_time_to_sec(fftw_time_diff(fftw_get_time(), profiler_start_time));
+}
+
+//-------------------------------------------------------------------------------
+int
+Profiler::GetThread(void)
+{
+#ifdef PARALLEL
+  // Loops nested inside concurrently inverted intervals run in inactive
+  // teams, so the thread is identified at the innermost active level.
+  for (int level = omp_get_level(); level > 0; level--) {
+    if (omp_get_team_size(level) > 1)
+      return omp_get_ancestor_thread_num(level);
+  }
+  return 0;
+#else
+  return 0;
+#endif
+}
+
+//-------------------------------------------------------------------------------
+bool
+Profiler::InParallel(void)
+{
+#ifdef PARALLEL
+  return (omp_in_parallel() != 0);
+#else
+  return false;
+#endif
+}
+
+//-------------------------------------------------------------------------------
+void
+Profiler::WriteJsonString(std::ostream      & out,
+                          const std::string & text)
+{
+  out << '"';
+  for (size_t i = 0; i < text.size(); i++) {
+    char c = text[i];
+    if (c == '"' || c == '\\')
+      out << '\\' << c;
+    else if (static_cast<unsigned char>(c) < 0x20) {
+      char buffer[8];
+      sprintf(buffer, "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(c)));
+      out << buffer;
+    }
+    else
+      out << c;
+  }
+  out << '"';
+}
+
+//-------------------------------------------------------------------------------
+void
+Profiler::WriteCounterArgs(std::ostream & out,
+                           const double * counters)
+{
+  out << "\"fft_transforms\": "     << counters[FFT_TRANSFORMS]
+      << ", \"fft_flops\": "        << counters[FFT_FLOPS]
+      << ", \"bytes_read\": "       << counters[FILE_BYTES_READ]
+      << ", \"bytes_written\": "    << counters[FILE_BYTES_WRITTEN];
+}
+
+std::map<std::string, Profiler::Stats>   Profiler::stats_;
+std::vector<std::vector<std::string> >   Profiler::stacks_(1);
+std::vector<Profiler::Event>             Profiler::events_;
+std::vector<Profiler::MemorySample>      Profiler::memory_;
+double                                   Profiler::counters_[Profiler::N_COUNTERS] = {0.0, 0.0, 0.0, 0.0};
+double                                   Profiler::peak_memory_    = 0.0;
+int                                      Profiler::peak_grids_     = 0;
+bool                                     Profiler::events_dropped_ = false;
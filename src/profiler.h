@@ -0,0 +1,112 @@
+/***************************************************************************
+*      Copyright (C) 2008 by Norwegian Computing Center and Statoil        *
+***************************************************************************/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "src/definitions.h"
+#include "nrlib/iotools/logkit.hpp"
+
+//
+// Hierarchical timing of a run, complementing the flat summary in Timings.
+//
+// A Profiler::Region measures the wall time from its construction to its
+// destruction. A region opened while another region is open is nested below
+// it. Regions opened on the threads of a parallel loop are nested below the
+// innermost region that was open when the loop started. A region may be
+// tagged, typically with the interval name, and each tag gets its own entry.
+//
+// The counters (FFTs, estimated FFT flops and FFTFileGrid I/O) may be updated
+// from any thread. Each region records how much they increased while it was
+// open, which includes work done by other threads in the meantime. FFTGrid
+// reports its memory use, which gives a memory timeline.
+//
+// The summary is written to the log. The full trace can also be written in
+// the Chrome trace event format, which chrome://tracing and Perfetto read.
+//
+class Profiler
+{
+public:
+  enum Counter { FFT_TRANSFORMS     = 0,
+                 FFT_FLOPS          = 1,
+                 FILE_BYTES_READ    = 2,
+                 FILE_BYTES_WRITTEN = 3,
+                 N_COUNTERS         = 4 };
+
+  class Region
+  {
+  public:
+    Region(const std::string & name,
+           const std::string & tag = "");
+    ~Region(void);
+
+  private:
+    Region(const Region &);
+    Region & operator=(const Region &);
+
+    std::string  name_;
+    std::string  tag_;
+    std::string  path_;
+    int          stack_;                      ///< Stack this region was pushed on
+    int          thread_;
+    double       start_;
+    double       counters_[N_COUNTERS];       ///< Counter values when the region was opened
+  };
+
+  static void    AddToCounter(Counter counter, double value);
+  static void    AddFFT(int n_points, int n_transforms = 1);
+  static void    RecordMemory(double bytes, int n_grids);
+
+  static void    ReportAll(LogKit::MessageLevels logLevel);
+  static void    WriteTrace(const std::string & file_name);
+
+private:
+  struct Stats
+  {
+    int          calls;
+    double       wall;
+    double       counters[N_COUNTERS];
+  };
+
+  struct Event
+  {
+    std::string  name;
+    std::string  tag;
+    std::string  path;
+    int          thread;
+    double       start;
+    double       duration;
+    double       counters[N_COUNTERS];
+  };
+
+  struct MemorySample
+  {
+    double       time;
+    double       bytes;
+    int          n_grids;
+  };
+
+  static double  GetTime(void);
+  static int     GetThread(void);
+  static bool    InParallel(void);
+  static void    WriteJsonString(std::ostream & out, const std::string & text);
+  static void    WriteCounterArgs(std::ostream & out, const double * counters);
+
+  static const size_t                          max_events_ = 200000;  ///< Older events are kept, newer dropped
+
+  static std::map<std::string, Stats>          stats_;          ///< Accumulated per region path (and tag)
+  static std::vector<std::vector<std::string> > stacks_;        ///< Open regions. [0] is serial, [1+t] is thread t in parallel loops
+  static std::vector<Event>                    events_;
+  static std::vector<MemorySample>             memory_;
+  static double                                counters_[N_COUNTERS];
+  static double                                peak_memory_;
+  static int                                   peak_grids_;
+  static bool                                  events_dropped_;
+};
+
+#endif
@@ -304,19 +304,18 @@ RockPhysicsInversion4D::SolveGEVProblem(NRLib::Matrix sigma_prior,
                                         NRLib::Matrix & vOut){
   //Compute transforms v1, v2, v3 and v4  ----------------------------------------
 
-  // computing filter
-  NRLib::SymmetricMatrix  sigma_priorInv(6);
+  // computing components of the filter I - inv(sigma_prior)*sigma_posterior. These
+  // are the eigenvectors of inv(sigma_prior)*sigma_posterior, with eigenvalues 1 - lambda.
+  NRLib::SymmetricMatrix  sigma_priorSym(6);
   for(int i=0;i<6;i++)
     for(int j=0;j<=i;j++)
-      sigma_priorInv(j,i)=sigma_prior(i,j);
+      sigma_priorSym(j,i)=sigma_prior(i,j);
 
-  NRLib::CholeskyInvert(sigma_priorInv);
-  NRLib::Matrix eye = NRLib::IdentityMatrix(6);
-  NRLib::Matrix filter = eye- sigma_priorInv*sigma_posterior;
-  // computing components
   NRLib::Vector eigen_values(6);
   NRLib::Matrix eigen_vectors(6,6);
-  NRLib::ComputeEigenVectors( filter ,eigen_values,eigen_vectors);
+  NRLib::ComputeGeneralizedEigenVectors(sigma_priorSym, sigma_posterior, eigen_values, eigen_vectors);
+  for(int i=0;i<6;i++)
+    eigen_values(i) = 1.0 - eigen_values(i);
 
   // extracting four best components
   std::vector<int> current_index(6);
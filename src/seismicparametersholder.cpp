@@ -428,6 +428,34 @@ SeismicParametersHolder::FFTAllGrids()
 }
 //-----------------------------------------------------------------------------------------
 
+void
+SeismicParametersHolder::makeCovGridsCold()
+{
+  // The grids may be freed by the next grid allocation. Callers must not touch them until
+  // makeCovGridsHot(); CKrigingAdmin and the simulation Cholesky cache copy what they need.
+  covVp_     ->makeCold();
+  covVs_     ->makeCold();
+  covRho_    ->makeCold();
+  crCovVpVs_ ->makeCold();
+  crCovVpRho_->makeCold();
+  crCovVsRho_->makeCold();
+}
+
+//-----------------------------------------------------------------------------------------
+
+void
+SeismicParametersHolder::makeCovGridsHot()
+{
+  covVp_     ->makeHot();
+  covVs_     ->makeHot();
+  covRho_    ->makeHot();
+  crCovVpVs_ ->makeHot();
+  crCovVpRho_->makeHot();
+  crCovVsRho_->makeHot();
+}
+
+//-----------------------------------------------------------------------------------------
+
 void
 SeismicParametersHolder::invFFTCovGrids()
 {
@@ -484,7 +512,44 @@ SeismicParametersHolder::FFTCovGrids()
 void
 SeismicParametersHolder::getNextParameterCovariance(fftw_complex **& parVar) const
 {
+  fftw_complex iiTmp = covVp_     ->getNextComplex();
+  fftw_complex jjTmp = covVs_     ->getNextComplex();
+  fftw_complex kkTmp = covRho_    ->getNextComplex();
+  fftw_complex ijTmp = crCovVpVs_ ->getNextComplex();
+  fftw_complex ikTmp = crCovVpRho_->getNextComplex();
+  fftw_complex jkTmp = crCovVsRho_->getNextComplex();
 
+  setParameterCovariance(parVar, iiTmp, jjTmp, kkTmp, ijTmp, ikTmp, jkTmp);
+}
+
+//--------------------------------------------------------------------
+void
+SeismicParametersHolder::getParameterCovariance(fftw_complex **& parVar,
+                                                int              i,
+                                                int              j,
+                                                int              k) const
+{
+  // Random access version of getNextParameterCovariance(), (i,j,k) is a complex grid cell.
+  fftw_complex iiTmp = covVp_     ->getComplexValue(i, j, k, true);
+  fftw_complex jjTmp = covVs_     ->getComplexValue(i, j, k, true);
+  fftw_complex kkTmp = covRho_    ->getComplexValue(i, j, k, true);
+  fftw_complex ijTmp = crCovVpVs_ ->getComplexValue(i, j, k, true);
+  fftw_complex ikTmp = crCovVpRho_->getComplexValue(i, j, k, true);
+  fftw_complex jkTmp = crCovVsRho_->getComplexValue(i, j, k, true);
+
+  setParameterCovariance(parVar, iiTmp, jjTmp, kkTmp, ijTmp, ikTmp, jkTmp);
+}
+
+//--------------------------------------------------------------------
+void
+SeismicParametersHolder::setParameterCovariance(fftw_complex **& parVar,
+                                                fftw_complex     iiTmp,
+                                                fftw_complex     jjTmp,
+                                                fftw_complex     kkTmp,
+                                                fftw_complex     ijTmp,
+                                                fftw_complex     ikTmp,
+                                                fftw_complex     jkTmp) const
+{
   fftw_complex ii;
   fftw_complex jj;
   fftw_complex kk;
@@ -492,13 +557,6 @@ SeismicParametersHolder::getNextParameterCovariance(fftw_complex **& parVar) con
   fftw_complex ik;
   fftw_complex jk;
 
-  fftw_complex iiTmp = covVp_     ->getNextComplex();
-  fftw_complex jjTmp = covVs_     ->getNextComplex();
-  fftw_complex kkTmp = covRho_    ->getNextComplex();
-  fftw_complex ijTmp = crCovVpVs_ ->getNextComplex();
-  fftw_complex ikTmp = crCovVpRho_->getNextComplex();
-  fftw_complex jkTmp = crCovVsRho_->getNextComplex();
-
   if(priorVar0_(0,0) != 0)
     iiTmp.re = iiTmp.re / static_cast<float>(priorVar0_(0,0));
 
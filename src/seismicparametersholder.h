@@ -73,6 +73,12 @@ public:
   void                          FFTAllGrids();
   void                          updatePriorVar();
 
+  // After makeCovGridsCold() the covariance grids may be moved to disk, and their values are
+  // gone. Nothing may read or write them, not even through GetCovVp() and friends, until
+  // makeCovGridsHot() has been called. Debug builds assert on access to a grid on disk.
+  void                          makeCovGridsCold();
+  void                          makeCovGridsHot();
+
   void SetPostVp(FFTGrid * vp)                               { postVp_  = new FFTGrid(vp)                           ;}
   void SetPostVs(FFTGrid * vs)                               { postVs_  = new FFTGrid(vs)                           ;}
   void SetPostRho(FFTGrid * rho)                             { postRho_ = new FFTGrid(rho)                          ;}
@@ -163,6 +169,11 @@ public:
 
   void                          getNextParameterCovariance(fftw_complex **& parVar) const;
 
+  void                          getParameterCovariance(fftw_complex **& parVar,
+                                                       int              i,
+                                                       int              j,
+                                                       int              k) const;
+
   void                          findParameterVariances(fftw_complex **& parVar,
                                                        fftw_complex     ii,
                                                        fftw_complex     jj,
@@ -183,6 +194,14 @@ public:
   void                          releaseExpGrids() const;
 
 private:
+  void                          setParameterCovariance(fftw_complex **& parVar,
+                                                       fftw_complex     iiTmp,
+                                                       fftw_complex     jjTmp,
+                                                       fftw_complex     kkTmp,
+                                                       fftw_complex     ijTmp,
+                                                       fftw_complex     ikTmp,
+                                                       fftw_complex     jkTmp) const;
+
   void                          createCorrGrids(int nx, int ny, int nz, int nxp, int nyp, int nzp, bool fileGrid);
 
   void                          InitializeCorrelations(bool                                  cov_estimated,
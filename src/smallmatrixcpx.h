@@ -0,0 +1,295 @@
+/***************************************************************************
+*      Copyright (C) 2008 by Norwegian Computing Center and Statoil        *
+***************************************************************************/
+
+#ifndef SMALLMATRIXCPX_H
+#define SMALLMATRIXCPX_H
+
+#include <math.h>
+#include <stddef.h>
+
+#include "fftw.h"
+
+//
+// Complex matrix kernels for the small systems that are solved in every
+// Fourier cell of the inversion (ntheta angles, 3 elastic parameters).
+//
+// The dimensions are template parameters, so all loops have compile-time
+// trip counts that the compiler can unroll and vectorise, and the temporary
+// matrices are kept on the stack. Each kernel performs the same floating
+// point operations in the same order as the lib_matr routine it replaces,
+// so the results are identical to those of the generic code.
+//
+class SmallMatrixCpx
+{
+public:
+  enum                 { maxDim = 10 };
+
+  typedef int       (* PosteriorUpdate)(fftw_complex * const * K,
+                                        fftw_complex * const * parVar,
+                                        fftw_complex * const * errVar,
+                                        fftw_complex         * ijkMean,
+                                        fftw_complex         * ijkData,
+                                        fftw_complex         * ijkRes);
+
+  // Returns the posterior update for ntheta angles, or NULL if ntheta is
+  // larger than maxDim and the generic lib_matr code must be used.
+  static PosteriorUpdate GetPosteriorUpdate(int ntheta);
+
+  // Updates the prior covariance parVar and mean ijkMean with the data ijkData,
+  // given the forward operator K (N x 3) and the error covariance errVar (N x N).
+  // ijkRes is reduced by the data explained by the posterior mean. Returns the
+  // Cholesky flag; if it is non-zero nothing is updated.
+  template <int N>
+  static int           UpdatePosterior(fftw_complex * const * K,
+                                       fftw_complex * const * parVar,
+                                       fftw_complex * const * errVar,
+                                       fftw_complex         * ijkMean,
+                                       fftw_complex         * ijkData,
+                                       fftw_complex         * ijkRes);
+
+  // outmat = mat1*mat2 for an N1 x N2 and an N2 x N3 matrix.
+  template <int N1, int N2, int N3, typename M1, typename M2, typename M3>
+  static void          Prod(const M1 & mat1, const M2 & mat2, M3 & outmat);
+
+  // outmat = mat1*mat2' for an N1 x N2 and an N3 x N2 matrix.
+  template <int N1, int N2, int N3, typename M1, typename M2, typename M3>
+  static void          ProdAdjoint(const M1 & mat1, const M2 & mat2, M3 & outmat);
+
+  // Cholesky factorisation of the Hermitian N x N matrix mat, as lib_matrCholCpx.
+  template <int N, typename M>
+  static int           Chol(M & mat);
+
+  // Solves (LL')X = B for the N x NB matrix B, as lib_matrAXeqBMatCpx.
+  template <int N, int NB, typename ML, typename MB>
+  static void          AXeqBMat(const ML & L, MB & B);
+};
+
+//--------------------------------------------------------------------
+template <int N1, int N2, int N3, typename M1, typename M2, typename M3>
+inline void
+SmallMatrixCpx::Prod(const M1 & mat1, const M2 & mat2, M3 & outmat)
+{
+  for (int i = 0; i < N1; i++) {
+    for (int j = 0; j < N3; j++) {
+      fftw_complex x;
+      x.re = 0.0;
+      x.im = 0.0;
+      for (int k = 0; k < N2; k++) {
+        x.re += mat1[i][k].re*mat2[k][j].re - mat1[i][k].im*mat2[k][j].im;
+        x.im += mat1[i][k].im*mat2[k][j].re + mat1[i][k].re*mat2[k][j].im;
+      }
+      outmat[i][j] = x;
+    }
+  }
+}
+
+//--------------------------------------------------------------------
+template <int N1, int N2, int N3, typename M1, typename M2, typename M3>
+inline void
+SmallMatrixCpx::ProdAdjoint(const M1 & mat1, const M2 & mat2, M3 & outmat)
+{
+  for (int i = 0; i < N1; i++) {
+    for (int j = 0; j < N3; j++) {
+      fftw_complex x;
+      x.re = 0.0;
+      x.im = 0.0;
+      for (int k = 0; k < N2; k++) {
+        x.re += mat1[i][k].re*mat2[j][k].re + mat1[i][k].im*mat2[j][k].im;
+        x.im += mat1[i][k].im*mat2[j][k].re - mat1[i][k].re*mat2[j][k].im;
+      }
+      outmat[i][j] = x;
+    }
+  }
+}
+
+//--------------------------------------------------------------------
+template <int N, typename M>
+inline int
+SmallMatrixCpx::Chol(M & mat)
+{
+  const double tol    = 1e-20;
+  float        factor = mat[0][0].re;
+  if (factor <= 0)
+    return 1;
+
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      mat[i][j].re = mat[i][j].re/factor;
+      mat[i][j].im = mat[i][j].im/factor;
+    }
+  }
+
+  for (int i = 0; i < N; i++) {
+    if (mat[i][i].re <= tol)
+      return 1;
+
+    for (int j = 0; j < i; j++) {
+      fftw_complex r;
+      r.re = 0.0;
+      r.im = 0.0;
+      for (int k = 0; k < j; k++) {
+        r.re +=  (mat[i][k].re * mat[j][k].re) + (mat[i][k].im * mat[j][k].im);
+        r.im += -(mat[i][k].re * mat[j][k].im) + (mat[i][k].im * mat[j][k].re);
+      }
+      float help   = mat[j][j].re*mat[j][j].re + mat[j][j].im*mat[j][j].im;
+      mat[i][j].re = ((mat[i][j].re - r.re)*mat[j][j].re + (mat[i][j].im - r.im)*mat[j][j].im)/help;
+      mat[i][j].im = ((mat[i][j].im - r.im)*mat[j][j].re - (mat[i][j].re - r.re)*mat[j][j].im)/help;
+    }
+
+    float r = 0.0;
+    for (int k = 0; k < i; k++)
+      r += (mat[i][k].re * mat[i][k].re) + (mat[i][k].im * mat[i][k].im);
+    r = mat[i][i].re - r;
+    if (r <= tol)
+      return 1;
+
+    mat[i][i].re = static_cast<float>(sqrt(static_cast<double>(r)));
+    mat[i][i].im = 0.0;
+  }
+
+  float sqrtFactor = static_cast<float>(sqrt(static_cast<double>(factor)));
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j <= i; j++) {
+      mat[i][j].re *= sqrtFactor;
+      mat[i][j].im *= sqrtFactor;
+    }
+  }
+  return 0;
+}
+
+//--------------------------------------------------------------------
+template <int N, int NB, typename ML, typename MB>
+inline void
+SmallMatrixCpx::AXeqBMat(const ML & L, MB & B)
+{
+  for (int c = 0; c < NB; c++) {
+    for (int i = 0; i < N; i++) {
+      fftw_complex x = B[i][c];
+      for (int j = 0; j < i; j++) {
+        x.re -= (B[j][c].re * L[i][j].re - B[j][c].im * L[i][j].im);
+        x.im -= (B[j][c].im * L[i][j].re + B[j][c].re * L[i][j].im);
+      }
+      float help = L[i][i].re*L[i][i].re + L[i][i].im*L[i][i].im;
+      B[i][c].re = (x.re*L[i][i].re + x.im*L[i][i].im)/help;
+      B[i][c].im = (x.im*L[i][i].re - x.re*L[i][i].im)/help;
+    }
+
+    for (int i = N - 1; i >= 0; i--) {
+      fftw_complex x = B[i][c];
+      for (int j = N - 1; j > i; j--) {
+        x.re = x.re - ( B[j][c].re * L[j][i].re + B[j][c].im * L[j][i].im);
+        x.im = x.im - (-B[j][c].re * L[j][i].im + B[j][c].im * L[j][i].re);
+      }
+      float help = L[i][i].re*L[i][i].re + L[i][i].im*L[i][i].im;
+      B[i][c].re = (x.re*L[i][i].re - x.im*L[i][i].im)/help;
+      B[i][c].im = (x.im*L[i][i].re + x.re*L[i][i].im)/help;
+    }
+  }
+}
+
+//--------------------------------------------------------------------
+template <int N>
+int
+SmallMatrixCpx::UpdatePosterior(fftw_complex * const * K,
+                                fftw_complex * const * parVar,
+                                fftw_complex * const * errVar,
+                                fftw_complex         * ijkMean,
+                                fftw_complex         * ijkData,
+                                fftw_complex         * ijkRes)
+{
+  fftw_complex KS[N][3];
+  fftw_complex margVar[N][N];
+
+  Prod<N, 3, 3>(K, parVar, KS);                         // KS = K*S
+  ProdAdjoint<N, 3, N>(KS, K, margVar);                 // margVar = K*S*K'
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      margVar[i][j].re += errVar[i][j].re;
+      margVar[i][j].im += errVar[i][j].im;
+    }
+  }
+
+  int cholFlag = Chol<N>(margVar);
+  if (cholFlag != 0)
+    return cholFlag;                                    // Posterior is identical to prior
+
+  fftw_complex KScc[3][N];
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < 3; j++) {
+      KScc[j][i].re =  KS[i][j].re;
+      KScc[j][i].im = -KS[i][j].im;
+    }
+  }
+
+  AXeqBMat<N, 3>(margVar, KS);                          // KS = margVar^-1*K*S
+
+  fftw_complex reduceVar[3][3];
+  Prod<3, N, 3>(KScc, KS, reduceVar);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      parVar[i][j].re -= reduceVar[i][j].re;
+      parVar[i][j].im -= reduceVar[i][j].im;
+    }
+  }
+
+  for (int i = 0; i < N; i++) {                         // ijkData -= K*ijkMean
+    fftw_complex x;
+    x.re = 0.0;
+    x.im = 0.0;
+    for (int j = 0; j < 3; j++) {
+      x.re += K[i][j].re*ijkMean[j].re - K[i][j].im*ijkMean[j].im;
+      x.im += K[i][j].im*ijkMean[j].re + K[i][j].re*ijkMean[j].im;
+    }
+    ijkData[i].re -= x.re;
+    ijkData[i].im -= x.im;
+  }
+
+  for (int i = 0; i < 3; i++) {                         // ijkMean += (KS)'*ijkData
+    fftw_complex x;
+    x.re = 0.0;
+    x.im = 0.0;
+    for (int j = 0; j < N; j++) {
+      x.re +=  KS[j][i].re*ijkData[j].re + KS[j][i].im*ijkData[j].im;
+      x.im += -KS[j][i].im*ijkData[j].re + KS[j][i].re*ijkData[j].im;
+    }
+    ijkMean[i].re += x.re;
+    ijkMean[i].im += x.im;
+  }
+
+  for (int i = 0; i < N; i++) {                         // ijkRes -= K*ijkMean
+    fftw_complex x;
+    x.re = 0.0;
+    x.im = 0.0;
+    for (int j = 0; j < 3; j++) {
+      x.re += K[i][j].re*ijkMean[j].re - K[i][j].im*ijkMean[j].im;
+      x.im += K[i][j].im*ijkMean[j].re + K[i][j].re*ijkMean[j].im;
+    }
+    ijkData[i] = x;
+    ijkRes[i].re -= x.re;
+    ijkRes[i].im -= x.im;
+  }
+
+  return 0;
+}
+
+//--------------------------------------------------------------------
+inline SmallMatrixCpx::PosteriorUpdate
+SmallMatrixCpx::GetPosteriorUpdate(int ntheta)
+{
+  switch (ntheta) {
+  case  1 : return &UpdatePosterior< 1>;
+  case  2 : return &UpdatePosterior< 2>;
+  case  3 : return &UpdatePosterior< 3>;
+  case  4 : return &UpdatePosterior< 4>;
+  case  5 : return &UpdatePosterior< 5>;
+  case  6 : return &UpdatePosterior< 6>;
+  case  7 : return &UpdatePosterior< 7>;
+  case  8 : return &UpdatePosterior< 8>;
+  case  9 : return &UpdatePosterior< 9>;
+  case 10 : return &UpdatePosterior<10>;
+  default : return NULL;
+  }
+}
+
+#endif
@@ -2,9 +2,13 @@
 *      Copyright (C) 2008 by Norwegian Computing Center and Statoil        *
 ***************************************************************************/
 
+#include <algorithm>
+
 #include "src/spatialwellfilter.h"
 #include "src/spatialrealwellfilter.h"
 #include "avoinversion.h"
+#include "src/fftgrid.h"
+#include "nrlib/exception/exception.hpp"
 
 
 SpatialRealWellFilter::SpatialRealWellFilter()
@@ -129,7 +133,6 @@ SpatialRealWellFilter::fillValuesInSigmapost(double    ** sigmapost,
                                              int          ni,
                                              int          nj)
 {
-  covgrid->setAccessMode(FFTGrid::RANDOMACCESS);
   for (int l1=0 ; l1<n ; l1++) {
     int i1 = ipos[l1];
     int j1 = jpos[l1];
@@ -144,7 +147,6 @@ SpatialRealWellFilter::fillValuesInSigmapost(double    ** sigmapost,
 
     }
   }
-  covgrid->endAccess();
 }
 
 void SpatialRealWellFilter::setPriorSpatialCorr(FFTGrid             * parSpatialCorr,
@@ -185,7 +187,8 @@ void SpatialRealWellFilter::doFiltering(std::map<std::string, BlockedLogsCommon
                                         int                                        nAngles,
                                         const AVOInversion                       * avoInversionResult,
                                         const std::vector<Grid2D *>              & noiseScale,
-                                        SeismicParametersHolder                  & seismicParameters)
+                                        SeismicParametersHolder                  & seismicParameters,
+                                        int                                        nThreads)
 {
   LogKit::WriteHeader("Creating spatial multi-parameter filter");
 
@@ -194,11 +197,7 @@ void SpatialRealWellFilter::doFiltering(std::map<std::string, BlockedLogsCommon
 
   std::vector<NRLib::Matrix> sigmaeVpRho;
 
-  double ** sigmapost;
-  double ** sigmapri;
-
   int lastn = 0;
-  int n = 0;
   int nDim = 1;
   for(int i=0;i<nAngles;i++)
     nDim *= 2;
@@ -214,152 +213,112 @@ void SpatialRealWellFilter::doFiltering(std::map<std::string, BlockedLogsCommon
     }
   }
 
-  NRLib::Matrix priorCov0 = avoInversionResult->getPriorVar0();
-
-  bool no_wells_filtered = true;
+  //
+  // Find the wells to filter. The largest wells are filtered first, so that the
+  // dynamic schedule ends with the small ones.
+  //
+  std::vector<BlockedLogsCommon *>    wells;
+  std::vector<int>                    wellNr;
+  std::vector<std::pair<int, int> >   order;
   int w1 = 0;
-
   for(std::map<std::string, BlockedLogsCommon *>::const_iterator it = blocked_logs.begin(); it != blocked_logs.end(); it++) {
-    std::map<std::string, BlockedLogsCommon *>::const_iterator iter = blocked_logs.find(it->first);
-    BlockedLogsCommon * blocked_log = iter->second;
-
-    n = blocked_log->GetNumberOfBlocks();
-
-    if (blocked_log->GetUseForFiltering() == true)
-    {
+    BlockedLogsCommon * blocked_log = it->second;
+    if (blocked_log->GetUseForFiltering() == true) {
       LogKit::LogFormatted(LogKit::Low,"\nFiltering well "+blocked_log->GetWellName());
-      no_wells_filtered = false;
-
-      sigmapost = new double * [3*n];
-      for(int i=0;i<3*n;i++)
-        sigmapost[i] = new double[3*n];
-
-      sigmapri = new double * [3*n];
-      for(int i=0;i<3*n;i++)
-        sigmapri[i] = new double[3*n];
-
-      const std::vector<int> & ipos = blocked_log->GetIposVector();
-      const std::vector<int> & jpos = blocked_log->GetJposVector();
-      const std::vector<int> & kpos = blocked_log->GetKposVector();
-
-      float regularization = Definitions::SpatialFilterRegularisationValue();
-
-      // Fill the upper triangular submatrices
-      fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], seismicParameters.GetCovVp()     , n, 0  , 0   );
-      fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], seismicParameters.GetCovVs()     , n, n  , n   );
-      fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], seismicParameters.GetCovRho()    , n, 2*n, 2*n );
-      fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], seismicParameters.GetCrCovVpVs() , n, 0  , n   );
-      fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], seismicParameters.GetCrCovVpRho(), n, 0  , 2*n );
-      fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], seismicParameters.GetCrCovVsRho(), n, n, 2*n   );
-
-      for(int l1=0 ; l1 < n ; l1++) {
-        for(int l2=0 ; l2 < n ; l2++) {
-          //sigmapost[l2 + n  ][l1      ] = sigmapost[l1      ][l2 + n  ];
-          //sigmapost[l2 + 2*n][l1      ] = sigmapost[l1      ][l2 + 2*n];
-          //sigmapost[l2 + 2*n][l1 +   n] = sigmapost[l1 + n  ][l2 + 2*n];
-          sigmapri [l1      ][l2      ] = prior_cov_vp_[w1](l1,l2);//priorCov0(0,0)*priorSpatialCorr_[w1][l1][l2];
-          //sigmapri [l2      ][l1      ] = sigmapri [l1      ][l2      ];
-          sigmapri [l1 + n  ][l2 + n  ] = prior_cov_vs_[w1](l1,l2);//priorCov0(1,1)*priorSpatialCorr_[w1][l1][l2];
-          //sigmapri [l2 + n  ][l1 + n  ] = sigmapri [l1 + n  ][l2 + n  ];
-          sigmapri [l1 + 2*n][l2 + 2*n] = prior_cov_rho_[w1](l1,l2);//priorCov0(2,2)*priorSpatialCorr_[w1][l1][l2];
-          //sigmapri [l2 + 2*n][l1 + 2*n] = sigmapri [l1 + 2*n][l2 + 2*n];
-          if(l1==l2)
-          {
-            sigmapost[l1      ][l2      ] += regularization*sigmapost[l1      ][l2      ]/sigmapri[l1      ][l2      ];
-            sigmapost[l1 + n  ][l2 + n  ] += regularization*sigmapost[l1 + n  ][l2 + n  ]/sigmapri[l1 + n  ][l2 + n  ];
-            sigmapost[l1 + 2*n][l2 + 2*n] += regularization*sigmapost[l1 + 2*n][l2 + 2*n]/sigmapri[l1 + 2*n][l2 + 2*n];
-            sigmapri [l1      ][l2      ] += regularization;
-            sigmapri [l1 + n  ][l2 + n  ] += regularization;
-            sigmapri [l1 + 2*n][l2 + 2*n] += regularization;
-          }
-          // submat (0,1)
-          sigmapri[l1      ][l2 + n  ] = prior_cov_vpvs_[w1](l1,l2);
-          sigmapri[l2      ][l1 + n  ] = prior_cov_vpvs_[w1](l2,l1);
-          // submat(1,0)
-          //sigmapri[l1 + n  ][l2      ];//priorCov0(1,0)*priorSpatialCorr_[w1][l1][l2];
-          //sigmapri[l2 + n  ][l2      ];
-          // submat(0,2)
-          sigmapri[l1      ][l2+2*n  ]  = prior_cov_vprho_[w1](l1,l2);//priorCov0(2,0)*priorSpatialCorr_[w1][l1][l2];
-          sigmapri[l2      ][l1+2*n  ]  = prior_cov_vprho_[w1](l2,l1);//priorCov0(2,0)*priorSpatialCorr_[w1][l1][l2];
-          // submat(2,0)
-          //sigmapri[l1 + 2*n][l2      ] = sigmapri[l2][l1+2*n];
-          //sigmapri[l2 + 2*n][l1      ] = sigmapri[l1][l2+2*n];
-          // submat(1,2)
-          sigmapri[l1 + n  ][l2 + 2*n] = prior_cov_vsrho_[w1](l1,l2);//priorCov0(2,1)*priorSpatialCorr_[w1][l1][l2];
-          sigmapri[l2 + n  ][l1 + 2*n] = prior_cov_vsrho_[w1](l2,l1);//priorCov0(2,1)*priorSpatialCorr_[w1][l1][l2];
-          // submat(2,1)
-          //sigmapri[l2 + 2*n][l1 + n] = sigmapri[l1 + n  ][l2 + 2*n];
-          //sigmapri[l1 + 2*n][l2+n] = sigmapri[l2 + n  ][l1 + 2*n];
-        }
-      }
-
-      NRLib::SymmetricMatrix Sprior(3*n);
-      NRLib::SymmetricMatrix Spost(3*n);
-
-      for(int i = 0 ; i < 3*n ; i++)
-        for(int j = i ; j < 3*n ; j++)
-          Sprior(i,j) = sigmapri[i][j];
-
-      for(int i = 0 ; i < 3*n ; i++)
-        for(int j = i ; j < 3*n ; j++)
-          Spost(i,j) = sigmapost[i][j];
-
-      if(useVpRhoFilter == true) //Only additional
-        doVpRhoFiltering(sigmaeVpRho,
-                         sigmapri,
-                         sigmapost,
-                         n,
-                         blocked_log); //Must do before Cholesky of sigmapri.
-
-
-      //NRLib::WriteMatrixToFile("Sprior_2014.dat", Sprior);
-      //NRLib::WriteMatrixToFile("Spost_2014.dat", Spost);
+      order.push_back(std::make_pair(-blocked_log->GetNumberOfBlocks(), static_cast<int>(wells.size())));
+      wells.push_back(blocked_log);
+      wellNr.push_back(w1);
+      lastn += blocked_log->GetNumberOfBlocks();
+    }
+    w1++;
+  }
+  std::sort(order.begin(), order.end());
+
+  int nWells = static_cast<int>(wells.size());
+
+  NRLib::Matrix zero3(3,3);
+  NRLib::Matrix zero2(2,2);
+  NRLib::InitializeMatrix(zero3, 0.0);
+  NRLib::InitializeMatrix(zero2, 0.0);
+  std::vector<NRLib::Matrix> wellSigmae(nWells, zero3);
+  std::vector<NRLib::Matrix> wellSigmaeVpRho(nWells, zero2);
+
+  std::vector<FFTGrid *> covGrids(6);
+  covGrids[0] = seismicParameters.GetCovVp();
+  covGrids[1] = seismicParameters.GetCovVs();
+  covGrids[2] = seismicParameters.GetCovRho();
+  covGrids[3] = seismicParameters.GetCrCovVpVs();
+  covGrids[4] = seismicParameters.GetCrCovVpRho();
+  covGrids[5] = seismicParameters.GetCrCovVsRho();
+
+  // Grids on file only support sequential access, so the wells are then filtered one at a time.
+  for (int i = 0 ; i < 6 && nWells > 0 ; i++) {
+    covGrids[i]->setAccessMode(FFTGrid::RANDOMACCESS);
+    if (covGrids[i]->isFile())
+      nThreads = 1;
+  }
 
-      //
-      // Filter = I - Sigma_post * inv(Sigma_prior)
-      //
-      NRLib::Matrix I = NRLib::IdentityMatrix(3*n);
-      NRLib::CholeskySolve(Sprior, I);
+  bool        failed = false;
+  std::string errTxt = "";
 
-      NRLib::Matrix Aw = Spost * I;
-      //NRLib::WriteMatrixToFile("SpostxSpriinv_2014.dat", Aw);
-      Aw = Aw * (-1);
-      for(int i=0 ; i<3*n ; i++) {
-        Aw(i,i) += 1.0;
+#ifdef PARALLEL
+#pragma omp parallel num_threads(nThreads) if(nThreads > 1 && nWells > 1)
+#endif
+  {
+    FilterWorkspace workspace;
+
+    int w;
+#ifdef PARALLEL
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (w = 0 ; w < nWells ; w++) {
+      int wellIndex = order[w].second;
+      try {
+        filterWell(wells[wellIndex],
+                   wellNr[wellIndex],
+                   useVpRhoFilter,
+                   covGrids,
+                   workspace,
+                   wellSigmae[wellIndex],
+                   wellSigmaeVpRho[wellIndex]);
       }
-
-      if(useVpRhoFilter == false) { //Save time, since below is not needed then.
-        updateSigmaE(sigmae_[0],
-                     Aw,
-                     Spost,
-                     n);
+      catch (NRLib::Exception & e) { //Rethrown outside the parallel region
+#ifdef PARALLEL
+#pragma omp critical(spatial_well_filter)
+#endif
+        {
+          if (failed == false)
+            errTxt = e.what();
+          failed = true;
+        }
       }
+    }
+  }
 
-      //NRLib::WriteMatrixToFile("Aw_2014.dat", Aw);
-
-      //NRLib::Vector eigenvalues(3*n);
-      //NRLib::Matrix eigenvectors(3*n, 3*n);
-      //NRLib::ComputeEigenVectors(Aw, eigenvalues, eigenvectors);
+  for (int i = 0 ; i < 6 && nWells > 0 ; i++)
+    covGrids[i]->endAccess();
 
-      calculateFilteredLogs(Aw,
-                            blocked_log,
-                            n,
-                            true);
+  if (failed)
+    throw NRLib::Exception(errTxt);
 
-      lastn += n;
+  // The contributions are added in well order, so the result does not depend on the number of threads.
+  if (nWells > 0 && useVpRhoFilter == true)
+    sigmaeVpRho.resize(static_cast<int>(sigmae_.size()), zero2);
 
-      for(int i=0;i<3*n;i++)
-      {
-        delete [] sigmapost[i];
-        delete [] sigmapri[i];
-      }
-      delete [] sigmapri;
-      delete [] sigmapost;
+  for (int w = 0 ; w < nWells ; w++) {
+    if(useVpRhoFilter == false) {
+      for (int i = 0 ; i < 3 ; i++)
+        for (int j = 0 ; j <= i ; j++)
+          sigmae_[0](i,j) += wellSigmae[w](i,j);
+    }
+    else {
+      for (int i = 0 ; i < 2 ; i++)
+        for (int j = 0 ; j <= i ; j++)
+          sigmaeVpRho[0](i,j) += wellSigmaeVpRho[w](i,j);
     }
-    w1++;
   }
 
-  if(no_wells_filtered == false)
+  if(nWells > 0)
     completeSigmaE(sigmae_,
                    lastn,
                    avoInversionResult,
@@ -371,9 +330,118 @@ void SpatialRealWellFilter::doFiltering(std::map<std::string, BlockedLogsCommon
                         avoInversionResult,
                         noiseScale);
 
-  if (no_wells_filtered) {
+  if (nWells == 0) {
     LogKit::LogFormatted(LogKit::Low,"\nNo wells have been filtered.\n");
   }
 
   Timings::setTimeFiltering(wall,cpu);
 }
+
+//-------------------------------------------------------------------------------
+void SpatialRealWellFilter::filterWell(BlockedLogsCommon            * blocked_log,
+                                       int                            w1,
+                                       bool                           useVpRhoFilter,
+                                       const std::vector<FFTGrid *> & covGrids,
+                                       FilterWorkspace              & workspace,
+                                       NRLib::Matrix                & sigmae,
+                                       NRLib::Matrix                & sigmaeVpRho)
+{
+  int n = blocked_log->GetNumberOfBlocks();
+
+  workspace.resize(3*n);
+  double ** sigmapost = &workspace.postRows[0];
+  double ** sigmapri  = &workspace.priRows[0];
+
+  const std::vector<int> & ipos = blocked_log->GetIposVector();
+  const std::vector<int> & jpos = blocked_log->GetJposVector();
+  const std::vector<int> & kpos = blocked_log->GetKposVector();
+
+  float regularization = Definitions::SpatialFilterRegularisationValue();
+
+  // Fill the upper triangular submatrices
+  fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], covGrids[0], n, 0  , 0   );
+  fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], covGrids[1], n, n  , n   );
+  fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], covGrids[2], n, 2*n, 2*n );
+  fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], covGrids[3], n, 0  , n   );
+  fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], covGrids[4], n, 0  , 2*n );
+  fillValuesInSigmapost(sigmapost, &ipos[0], &jpos[0], &kpos[0], covGrids[5], n, n, 2*n   );
+
+  for(int l1=0 ; l1 < n ; l1++) {
+    for(int l2=0 ; l2 < n ; l2++) {
+      sigmapri [l1      ][l2      ] = prior_cov_vp_[w1](l1,l2);
+      sigmapri [l1 + n  ][l2 + n  ] = prior_cov_vs_[w1](l1,l2);
+      sigmapri [l1 + 2*n][l2 + 2*n] = prior_cov_rho_[w1](l1,l2);
+      if(l1==l2)
+      {
+        sigmapost[l1      ][l2      ] += regularization*sigmapost[l1      ][l2      ]/sigmapri[l1      ][l2      ];
+        sigmapost[l1 + n  ][l2 + n  ] += regularization*sigmapost[l1 + n  ][l2 + n  ]/sigmapri[l1 + n  ][l2 + n  ];
+        sigmapost[l1 + 2*n][l2 + 2*n] += regularization*sigmapost[l1 + 2*n][l2 + 2*n]/sigmapri[l1 + 2*n][l2 + 2*n];
+        sigmapri [l1      ][l2      ] += regularization;
+        sigmapri [l1 + n  ][l2 + n  ] += regularization;
+        sigmapri [l1 + 2*n][l2 + 2*n] += regularization;
+      }
+      // submat (0,1)
+      sigmapri[l1      ][l2 + n  ] = prior_cov_vpvs_[w1](l1,l2);
+      sigmapri[l2      ][l1 + n  ] = prior_cov_vpvs_[w1](l2,l1);
+      // submat(0,2)
+      sigmapri[l1      ][l2+2*n  ]  = prior_cov_vprho_[w1](l1,l2);
+      sigmapri[l2      ][l1+2*n  ]  = prior_cov_vprho_[w1](l2,l1);
+      // submat(1,2)
+      sigmapri[l1 + n  ][l2 + 2*n] = prior_cov_vsrho_[w1](l1,l2);
+      sigmapri[l2 + n  ][l1 + 2*n] = prior_cov_vsrho_[w1](l2,l1);
+    }
+  }
+
+  NRLib::SymmetricMatrix Sprior(3*n);
+  NRLib::SymmetricMatrix Spost(3*n);
+
+  for(int i = 0 ; i < 3*n ; i++)
+    for(int j = i ; j < 3*n ; j++)
+      Sprior(i,j) = sigmapri[i][j];
+
+  for(int i = 0 ; i < 3*n ; i++)
+    for(int j = i ; j < 3*n ; j++)
+      Spost(i,j) = sigmapost[i][j];
+
+  if(useVpRhoFilter == true) //Only additional
+    doVpRhoFiltering(sigmaeVpRho,
+                     sigmapri,
+                     sigmapost,
+                     n,
+                     blocked_log); //Must do before Cholesky of sigmapri.
+
+  //
+  // Filter = I - Sigma_post * inv(Sigma_prior)
+  //
+  NRLib::Matrix Aw;
+  NRLib::Matrix SpostFull;
+  computeFilter(Aw, SpostFull, Sprior, Spost);
+
+  if(useVpRhoFilter == false) { //Save time, since below is not needed then.
+    updateSigmaE(sigmae,
+                 Aw,
+                 SpostFull,
+                 n);
+  }
+
+  calculateFilteredLogs(Aw,
+                        blocked_log,
+                        n,
+                        true);
+}
+
+//-------------------------------------------------------------------------------
+void SpatialRealWellFilter::FilterWorkspace::resize(int m)
+{
+  size_t size = static_cast<size_t>(m)*static_cast<size_t>(m);
+  if (pri.size() < size) {
+    pri.resize(size);
+    post.resize(size);
+  }
+  priRows.resize(m);
+  postRows.resize(m);
+  for (int i = 0 ; i < m ; i++) {
+    priRows[i]  = &pri[static_cast<size_t>(i)*m];
+    postRows[i] = &post[static_cast<size_t>(i)*m];
+  }
+}
@@ -48,10 +48,27 @@ public:
                                       int                                        nAngles,
                                       const AVOInversion                       * avoInversionResult,
                                       const std::vector<Grid2D *>              & noiseScale,
-                                      SeismicParametersHolder                  & seismicParameters);
+                                      SeismicParametersHolder                  & seismicParameters,
+                                      int                                        nThreads = 1);
 
 
 private:
+  // Covariance matrices of one well, reused between the wells filtered by a thread.
+  struct FilterWorkspace {
+    std::vector<double>    pri;
+    std::vector<double>    post;
+    std::vector<double *>  priRows;
+    std::vector<double *>  postRows;
+    void                   resize(int m);
+  };
+
+  void filterWell(BlockedLogsCommon            * blocked_log,
+                  int                            w1,
+                  bool                           useVpRhoFilter,
+                  const std::vector<FFTGrid *> & covGrids,
+                  FilterWorkspace              & workspace,
+                  NRLib::Matrix                & sigmae,
+                  NRLib::Matrix                & sigmaeVpRho);
 
   void adjustDiagSigma(NRLib::Matrix & sigmae);
 
@@ -68,20 +68,66 @@ void SpatialWellFilter::updateSigmaE(NRLib::Matrix       & sigmae,
                                      int                   n)
 //------------------------------------------------------------------
 {
-  NRLib::Matrix sigmaeW = Filter * PostCov;
-
+  // Only the diagonals of the 3x3 blocks of Filter*PostCov are needed.
   for(int i=0 ; i < n ; i++)
   {
-    sigmae(0,0) += sigmaeW(i      , i      );
-    sigmae(1,0) += sigmaeW(i +   n, i      );
-    sigmae(2,0) += sigmaeW(i + 2*n, i      );
-    sigmae(1,1) += sigmaeW(i +   n, i +   n);
-    sigmae(2,1) += sigmaeW(i + 2*n, i +   n);
-    sigmae(2,2) += sigmaeW(i + 2*n, i + 2*n);
+    sigmae(0,0) += getProductElement(Filter, PostCov, i      , i      );
+    sigmae(1,0) += getProductElement(Filter, PostCov, i +   n, i      );
+    sigmae(2,0) += getProductElement(Filter, PostCov, i + 2*n, i      );
+    sigmae(1,1) += getProductElement(Filter, PostCov, i +   n, i +   n);
+    sigmae(2,1) += getProductElement(Filter, PostCov, i + 2*n, i +   n);
+    sigmae(2,2) += getProductElement(Filter, PostCov, i + 2*n, i + 2*n);
   }
   // sigmae Is normalized (1/n) in completeSigmaE, Here well by well is added.
 }
 
+//------------------------------------------------------------------
+double SpatialWellFilter::getProductElement(const NRLib::Matrix & A,
+                                            const NRLib::Matrix & B,
+                                            int                   i,
+                                            int                   j)
+//------------------------------------------------------------------
+{
+  double sum = 0.0;
+  for(int k=0 ; k < A.numCols() ; k++)
+    sum += A(i,k)*B(k,j);
+  return sum;
+}
+
+//------------------------------------------------------------------
+void SpatialWellFilter::computeFilter(NRLib::Matrix                & Aw,
+                                      NRLib::Matrix                & SpostFull,
+                                      const NRLib::SymmetricMatrix & Sprior,
+                                      const NRLib::SymmetricMatrix & Spost)
+//------------------------------------------------------------------
+{
+  //
+  // Filter = I - Sigma_post * inv(Sigma_prior) = I - (inv(Sigma_prior) * Sigma_post)^T
+  //
+  // Solving with Sigma_post as right hand side avoids forming inv(Sigma_prior) and
+  // multiplying it by Sigma_post.
+  //
+  int m = Spost.dim();
+
+  SpostFull.resize(m, m);
+  for(int j = 0 ; j < m ; j++) {
+    for(int i = 0 ; i <= j ; i++) {
+      SpostFull(i,j) = Spost(i,j);
+      SpostFull(j,i) = Spost(i,j);
+    }
+  }
+
+  NRLib::Matrix X = SpostFull;
+  NRLib::CholeskySolve(Sprior, X);
+
+  Aw.resize(m, m);
+  for(int j = 0 ; j < m ; j++) {
+    for(int i = 0 ; i < m ; i++)
+      Aw(i,j) = -X(j,i);
+    Aw(j,j) += 1.0;
+  }
+}
+
 //-------------------------------------------------------------------------------
 void SpatialWellFilter::completeSigmaE(std::vector<NRLib::Matrix>  & sigmae,
                                        int                           lastn,
@@ -240,7 +286,7 @@ SpatialWellFilter::computeSigmaEAdjusted(NRLib::Matrix & sigmae,
   sigmaEAdj = T1 * T2;                             // sigmaEAdj = sqrt(sigmaETmp*sigmaE0^-1)*sigmae*sqrt(sigmaE0^-1*sigmaETmp)
 }
 
-void SpatialWellFilter::doVpRhoFiltering(std::vector<NRLib::Matrix> &  sigmaeVpRho,
+void SpatialWellFilter::doVpRhoFiltering(NRLib::Matrix              &  sigmaeVpRho,
                                          double                     ** sigmapri,
                                          double                     ** sigmapost,
                                          const int                     n,
@@ -278,52 +324,28 @@ void SpatialWellFilter::doVpRhoFiltering(std::vector<NRLib::Matrix> &  sigmaeVpR
       Spost2(i,j) = tmp2(i,j);
 
   NRLib::Matrix Aw;
-  NRLib::Matrix I = NRLib::IdentityMatrix(m);
-  NRLib::CholeskySolve(Sprior2, I);
-  Aw = Spost2 * I;
-  Aw = Aw * (-1);
-  for(int i=0 ; i<m ; i++) {
-    Aw(i,i) += 1.0;
-  }
+  NRLib::Matrix Spost2Full;
+  computeFilter(Aw, Spost2Full, Sprior2, Spost2);
 
   calculateFilteredLogs(Aw, blockedLogs, n, false);
 
   updateSigmaEVpRho(sigmaeVpRho,
                     Aw,
-                    Spost2,
-                    static_cast<int>(sigmae_.size()),
+                    Spost2Full,
                     n);
 }
 
 //---------------------------------------------------------------------------------
-void SpatialWellFilter::updateSigmaEVpRho(std::vector<NRLib::Matrix> & sigmaeVpRho,
+void SpatialWellFilter::updateSigmaEVpRho(NRLib::Matrix              & sigmaeVpRho,
                                           const NRLib::Matrix        & Aw,
                                           const NRLib::Matrix        & Spost,
-                                          int                          nDim,
                                           int                          n)
 //---------------------------------------------------------------------------------
 {
-  if (sigmaeVpRho.size() == 0) { // then first time alocate memory
-    sigmaeVpRho.resize(nDim);
-
-    NRLib::Matrix sigmae(2, 2);
-    NRLib::InitializeMatrix(sigmae, 0.0);
-
-    for (int k=0 ; k < nDim ; k++) {
-      sigmaeVpRho[k] = sigmae;
-    }
-  }
-
-  NRLib::Matrix sigma = Aw * Spost;
-
-  //
-  // NBNB-PAL: Bug? frsteindeksen p sigmaeVpRho[0][0][0] str
-  // stille hele tiden. Det er ingen n-avhengighet.
-  //
   for(int i=0 ; i < n ; i++) {
-    sigmaeVpRho[0](0,0) += sigma(i    , i    );
-    sigmaeVpRho[0](1,0) += sigma(i + n, i    );
-    sigmaeVpRho[0](1,1) += sigma(i + n, i + n);
+    sigmaeVpRho(0,0) += getProductElement(Aw, Spost, i    , i    );
+    sigmaeVpRho(1,0) += getProductElement(Aw, Spost, i + n, i    );
+    sigmaeVpRho(1,1) += getProductElement(Aw, Spost, i + n, i + n);
   }
 }
 
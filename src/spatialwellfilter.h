@@ -30,7 +30,7 @@ public:
 
 protected:
 
-  void doVpRhoFiltering(std::vector<NRLib::Matrix>      & sigmaeVpRho,
+  void doVpRhoFiltering(NRLib::Matrix                   & sigmaeVpRho,
                         double                         ** sigmapri,
                         double                         ** sigmapost,
                         const int                         n,
@@ -46,12 +46,23 @@ protected:
                     const NRLib::Matrix                 & PostCov,
                     int                                   n);
 
-  void updateSigmaEVpRho(std::vector<NRLib::Matrix>     & sigmaeVpRho,
+  void updateSigmaEVpRho(NRLib::Matrix                  & sigmaeVpRho,
                          const NRLib::Matrix            & Aw,
                          const NRLib::Matrix            & Spost,
-                         int                              nDim,
                          int                              n);
 
+  // Element (i,j) of A*B.
+  static double getProductElement(const NRLib::Matrix   & A,
+                                  const NRLib::Matrix   & B,
+                                  int                     i,
+                                  int                     j);
+
+  // Aw = I - Spost*inv(Sprior). SpostFull returns Spost with both triangles filled.
+  static void computeFilter(NRLib::Matrix                & Aw,
+                            NRLib::Matrix                & SpostFull,
+                            const NRLib::SymmetricMatrix & Sprior,
+                            const NRLib::SymmetricMatrix & Spost);
+
   void completeSigmaEVpRho(std::vector<NRLib::Matrix>   & sigmaeVpRho,
                            int                            lastn,
                            const AVOInversion           * avoInversionResult,
@@ -10,6 +10,9 @@
 #include <string>
 #include "src/vario.h"
 #include "src/fftgrid.h"
+#include "src/smallmatrixcpx.h"
+
+const int State4D::symIndex_[3][3] = {{0, 1, 2}, {1, 3, 4}, {2, 4, 5}};
 
 State4D::State4D()
 {
@@ -34,6 +37,8 @@ State4D::State4D()
     sigma_static_dynamic_[i] = NULL;
 
   velocity_relative_to_base_ = NULL;
+
+  n_threads_ = 1;
 }
 
 State4D::~State4D()
@@ -161,26 +166,26 @@ void State4D::merge(SeismicParametersHolder & current_state )
   int nyp = mu[0]->getNyp();
   int cnxp = mu[0]->getCNxp();
 
-  fftw_complex*  muFullPrior=new fftw_complex[6];
-  fftw_complex*  muCurrentPrior=new fftw_complex[3];
+  bool sequential = needsSequentialAccess(mu);
+
+  int k;
+#ifdef PARALLEL
+  int n_threads  = n_threads_;
+  int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(n_threads) if(!sequential && n_threads > 1)
+#endif
+  for (k = 0; k < nzp; k++) {
+    fftw_complex muFullPrior[6];
+    fftw_complex muCurrentPrior;
 
-  for (int k = 0; k < nzp; k++) {
     for (int j = 0; j < nyp; j++) {
       for (int i = 0; i < cnxp; i++) {
-         muFullPrior[0] = mu_static_[0]->getNextComplex();
-         muFullPrior[1] = mu_static_[1]->getNextComplex();
-         muFullPrior[2] = mu_static_[2]->getNextComplex();
-         muFullPrior[3] = mu_dynamic_[0]->getNextComplex();
-         muFullPrior[4] = mu_dynamic_[1]->getNextComplex();
-         muFullPrior[5] = mu_dynamic_[2]->getNextComplex();
+         getCell(i, j, k, sequential, muFullPrior, NULL);
          for(int l=0;l<3;l++){
-           muCurrentPrior[l].re =muFullPrior[l].re+muFullPrior[l+3].re;
-           muCurrentPrior[l].im =muFullPrior[l].im+muFullPrior[l+3].im;
+           muCurrentPrior.re =muFullPrior[l].re+muFullPrior[l+3].re;
+           muCurrentPrior.im =muFullPrior[l].im+muFullPrior[l+3].im;
+           setCellValue(mu[l], i, j, k, sequential, muCurrentPrior);
          }
-
-         mu[0]->setNextComplex(muCurrentPrior[0]);
-         mu[1]->setNextComplex(muCurrentPrior[1]);
-         mu[2]->setNextComplex(muCurrentPrior[2]);
       }
     }
   }
@@ -192,9 +197,6 @@ void State4D::merge(SeismicParametersHolder & current_state )
     mu_dynamic_[i]->endAccess();
   }
 
-  delete [] muFullPrior;
-  delete [] muCurrentPrior;
-
   //Merge covariances
   std::vector<FFTGrid *> sigma(6);
   sigma[0]=current_state.GetCovVp();
@@ -223,48 +225,25 @@ void State4D::mergeCov(std::vector<FFTGrid * > & sigma)
   for(int i = 0; i<9; i++)
     sigma_static_dynamic_[i]->setAccessMode(FFTGrid::READ);
 
-  std::vector<std::vector<fftw_complex> > sigmaFullPrior(6);
-  for(int i=0;i<6;i++)
-    sigmaFullPrior[i].resize(6);
-
-  std::vector<std::vector<fftw_complex> > sigmaCurrentPrior(3);
-  for(int i=0;i<3;i++)
-    sigmaCurrentPrior[i].resize(3);
-
   int nzp = sigma[0]->getNzp();
   int nyp = sigma[0]->getNyp();
   int cnxp = sigma[0]->getCNxp();
 
-  for (int k = 0; k < nzp; k++) {
+  bool sequential = needsSequentialAccess(sigma);
+
+  int k;
+#ifdef PARALLEL
+  int n_threads  = n_threads_;
+  int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(n_threads) if(!sequential && n_threads > 1)
+#endif
+  for (k = 0; k < nzp; k++) {
+    fftw_complex sigmaFullPrior[6][6];
+    fftw_complex sigmaCurrentPrior[3][3];
+
     for (int j = 0; j < nyp; j++) {
       for (int i = 0; i < cnxp; i++) {
-         sigmaFullPrior[0][0] = sigma_static_static_[0]->getNextComplex();
-         sigmaFullPrior[0][1] = sigma_static_static_[1]->getNextComplex();
-         sigmaFullPrior[0][2] = sigma_static_static_[2]->getNextComplex();
-         sigmaFullPrior[0][3] = sigma_static_dynamic_[0]->getNextComplex();
-         sigmaFullPrior[0][4] = sigma_static_dynamic_[1]->getNextComplex();
-         sigmaFullPrior[0][5] = sigma_static_dynamic_[2]->getNextComplex();
-         sigmaFullPrior[1][1] = sigma_static_static_[3]->getNextComplex();
-         sigmaFullPrior[1][2] = sigma_static_static_[4]->getNextComplex();
-         sigmaFullPrior[1][3] = sigma_static_dynamic_[3]->getNextComplex();
-         sigmaFullPrior[1][4] = sigma_static_dynamic_[4]->getNextComplex();
-         sigmaFullPrior[1][5] = sigma_static_dynamic_[5]->getNextComplex();
-         sigmaFullPrior[2][2] = sigma_static_static_[5]->getNextComplex();
-         sigmaFullPrior[2][3] = sigma_static_dynamic_[6]->getNextComplex();
-         sigmaFullPrior[2][4] = sigma_static_dynamic_[7]->getNextComplex();
-         sigmaFullPrior[2][5] = sigma_static_dynamic_[8]->getNextComplex();
-         sigmaFullPrior[3][3] = sigma_dynamic_dynamic_[0]->getNextComplex();
-         sigmaFullPrior[3][4] = sigma_dynamic_dynamic_[1]->getNextComplex();
-         sigmaFullPrior[3][5] = sigma_dynamic_dynamic_[2]->getNextComplex();
-         sigmaFullPrior[4][4] = sigma_dynamic_dynamic_[3]->getNextComplex();
-         sigmaFullPrior[4][5] = sigma_dynamic_dynamic_[4]->getNextComplex();
-         sigmaFullPrior[5][5] = sigma_dynamic_dynamic_[5]->getNextComplex();
-         for(int l=0;l<6;l++)
-           for(int m=l+1;m<6;m++)
-           {
-             sigmaFullPrior[m][l].re=sigmaFullPrior[l][m].re;
-             sigmaFullPrior[m][l].im=-sigmaFullPrior[l][m].im;
-           }
+         getCell(i, j, k, sequential, NULL, sigmaFullPrior);
 
          for(int l=0;l<3;l++)
            for(int m=0;m<3;m++){
@@ -277,12 +256,12 @@ void State4D::mergeCov(std::vector<FFTGrid * > & sigma)
              sigmaCurrentPrior[l][m].im += sigmaFullPrior[l+3][m  ].im;
              sigmaCurrentPrior[l][m].im += sigmaFullPrior[l  ][m+3].im;
            }
-         sigma[0]->setNextComplex(sigmaCurrentPrior[0][0]);
-         sigma[1]->setNextComplex(sigmaCurrentPrior[0][1]);
-         sigma[2]->setNextComplex(sigmaCurrentPrior[0][2]);
-         sigma[3]->setNextComplex(sigmaCurrentPrior[1][1]);
-         sigma[4]->setNextComplex(sigmaCurrentPrior[1][2]);
-         sigma[5]->setNextComplex(sigmaCurrentPrior[2][2]);
+         setCellValue(sigma[0], i, j, k, sequential, sigmaCurrentPrior[0][0]);
+         setCellValue(sigma[1], i, j, k, sequential, sigmaCurrentPrior[0][1]);
+         setCellValue(sigma[2], i, j, k, sequential, sigmaCurrentPrior[0][2]);
+         setCellValue(sigma[3], i, j, k, sequential, sigmaCurrentPrior[1][1]);
+         setCellValue(sigma[4], i, j, k, sequential, sigmaCurrentPrior[1][2]);
+         setCellValue(sigma[5], i, j, k, sequential, sigmaCurrentPrior[2][2]);
       }
     }
   }
@@ -344,83 +323,49 @@ void State4D::split(SeismicParametersHolder & current_state )
   int nyp = mu[0]->getNyp();
   int cnxp = mu[0]->getCNxp();
 
-  fftw_complex*  muFullPrior=new fftw_complex[6];
-  fftw_complex*  muFullPosterior=new fftw_complex[6];
-  fftw_complex*  muCurrentPrior=new fftw_complex[3];
-  fftw_complex*  muCurrentPosterior=new fftw_complex[3];
-
-  fftw_complex** sigmaFullPrior          = new fftw_complex*[6];
-  fftw_complex** sigmaFullPosterior      = new fftw_complex*[6];
-  fftw_complex** sigmaFullVsCurrentPrior = new fftw_complex*[6];
-  fftw_complex** adjointSandwich         = new fftw_complex*[6];
-
-  for(int i=0;i<6;i++)
-  {
-    sigmaFullPrior[i]          = new fftw_complex[6];
-    sigmaFullVsCurrentPrior[i] = new fftw_complex[3];
-    sigmaFullPosterior[i]      = new fftw_complex[6];
-    adjointSandwich[i]         = new fftw_complex[3];
-  }
-
-  fftw_complex** sigmaCurrentPrior       = new fftw_complex*[3];
-  fftw_complex** sigmaCurrentPriorChol   = new fftw_complex*[3];
-  fftw_complex** sigmaCurrentPosterior   = new fftw_complex*[3];
-  fftw_complex** sandwich                = new fftw_complex*[3];
-  fftw_complex** helper                  = new fftw_complex*[3];
+  std::vector<FFTGrid *> current(mu);
+  current.insert(current.end(), sigma.begin(), sigma.end());
+  bool sequential = needsSequentialAccess(current);
 
-  for(int i=0;i<3;i++)
-  {
-    sigmaCurrentPrior[i]     = new fftw_complex[3];
-    sigmaCurrentPriorChol[i] = new fftw_complex[3];
-    sigmaCurrentPosterior[i] = new fftw_complex[3];
-    sandwich[i]              = new fftw_complex[6];
-    helper[i]                = new fftw_complex[6];
-  }
   int counter =0;
-  for (int k = 0; k < nzp; k++) {
+  int k;
+#ifdef PARALLEL
+  int n_threads  = n_threads_;
+  int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(n_threads) if(!sequential && n_threads > 1)
+#endif
+  for (k = 0; k < nzp; k++) {
+    fftw_complex muFullPrior[6];
+    fftw_complex muFullPosterior[6];
+    fftw_complex muCurrentPrior[3];
+    fftw_complex muCurrentPosterior[3];
+
+    fftw_complex sigmaFullPrior[6][6];
+    fftw_complex sigmaFullPosterior[6][6];
+    fftw_complex sigmaFullVsCurrentPrior[6][3];
+    fftw_complex adjointSandwich[6][3];
+
+    fftw_complex sigmaCurrentPrior[3][3];
+    fftw_complex sigmaCurrentPriorChol[3][3];
+    fftw_complex sigmaCurrentPosterior[3][3];
+    fftw_complex sandwich[3][6];
+    fftw_complex helper[3][6];
+
     for (int j = 0; j < nyp; j++) {
       for (int i = 0; i < cnxp; i++) {
          // reading from grids
-         muFullPrior[0] = mu_static_[0]->getNextComplex();
-         muFullPrior[1] = mu_static_[1]->getNextComplex();
-         muFullPrior[2] = mu_static_[2]->getNextComplex();
-         muFullPrior[3] = mu_dynamic_[0]->getNextComplex();
-         muFullPrior[4] = mu_dynamic_[1]->getNextComplex();
-         muFullPrior[5] = mu_dynamic_[2]->getNextComplex();
-
-
-         sigmaFullPrior[0][0] = sigma_static_static_[0]->getNextComplex();
-         sigmaFullPrior[0][1] = sigma_static_static_[1]->getNextComplex();
-         sigmaFullPrior[0][2] = sigma_static_static_[2]->getNextComplex();
-         sigmaFullPrior[0][3] = sigma_static_dynamic_[0]->getNextComplex();
-         sigmaFullPrior[0][4] = sigma_static_dynamic_[1]->getNextComplex();
-         sigmaFullPrior[0][5] = sigma_static_dynamic_[2]->getNextComplex();
-         sigmaFullPrior[1][1] = sigma_static_static_[3]->getNextComplex();
-         sigmaFullPrior[1][2] = sigma_static_static_[4]->getNextComplex();
-         sigmaFullPrior[1][3] = sigma_static_dynamic_[3]->getNextComplex();
-         sigmaFullPrior[1][4] = sigma_static_dynamic_[4]->getNextComplex();
-         sigmaFullPrior[1][5] = sigma_static_dynamic_[5]->getNextComplex();
-         sigmaFullPrior[2][2] = sigma_static_static_[5]->getNextComplex();
-         sigmaFullPrior[2][3] = sigma_static_dynamic_[6]->getNextComplex();
-         sigmaFullPrior[2][4] = sigma_static_dynamic_[7]->getNextComplex();
-         sigmaFullPrior[2][5] = sigma_static_dynamic_[8]->getNextComplex();
-         sigmaFullPrior[3][3] = sigma_dynamic_dynamic_[0]->getNextComplex();
-         sigmaFullPrior[3][4] = sigma_dynamic_dynamic_[1]->getNextComplex();
-         sigmaFullPrior[3][5] = sigma_dynamic_dynamic_[2]->getNextComplex();
-         sigmaFullPrior[4][4] = sigma_dynamic_dynamic_[3]->getNextComplex();
-         sigmaFullPrior[4][5] = sigma_dynamic_dynamic_[4]->getNextComplex();
-         sigmaFullPrior[5][5] = sigma_dynamic_dynamic_[5]->getNextComplex();
-
-         muCurrentPosterior[0]=mu[0]->getNextComplex();
-         muCurrentPosterior[1]=mu[1]->getNextComplex();
-         muCurrentPosterior[2]=mu[2]->getNextComplex();
-
-         sigmaCurrentPosterior[0][0]=sigma[0]->getNextComplex();
-         sigmaCurrentPosterior[0][1]=sigma[1]->getNextComplex();
-         sigmaCurrentPosterior[0][2]=sigma[2]->getNextComplex();
-         sigmaCurrentPosterior[1][1]=sigma[3]->getNextComplex();
-         sigmaCurrentPosterior[1][2]=sigma[4]->getNextComplex();
-         sigmaCurrentPosterior[2][2]=sigma[5]->getNextComplex();
+         getCell(i, j, k, sequential, muFullPrior, sigmaFullPrior);
+
+         muCurrentPosterior[0]=getCellValue(mu[0], i, j, k, sequential);
+         muCurrentPosterior[1]=getCellValue(mu[1], i, j, k, sequential);
+         muCurrentPosterior[2]=getCellValue(mu[2], i, j, k, sequential);
+
+         sigmaCurrentPosterior[0][0]=getCellValue(sigma[0], i, j, k, sequential);
+         sigmaCurrentPosterior[0][1]=getCellValue(sigma[1], i, j, k, sequential);
+         sigmaCurrentPosterior[0][2]=getCellValue(sigma[2], i, j, k, sequential);
+         sigmaCurrentPosterior[1][1]=getCellValue(sigma[3], i, j, k, sequential);
+         sigmaCurrentPosterior[1][2]=getCellValue(sigma[4], i, j, k, sequential);
+         sigmaCurrentPosterior[2][2]=getCellValue(sigma[5], i, j, k, sequential);
          // compleating matrixes
          sigmaCurrentPosterior[1][0].re =  sigmaCurrentPosterior[0][1].re;
          sigmaCurrentPosterior[1][0].im = -sigmaCurrentPosterior[0][1].im;
@@ -429,13 +374,6 @@ void State4D::split(SeismicParametersHolder & current_state )
          sigmaCurrentPosterior[2][1].re =  sigmaCurrentPosterior[1][2].re;
          sigmaCurrentPosterior[2][1].im = -sigmaCurrentPosterior[1][2].im;
 
-         for(int l=0;l<6;l++)
-           for(int m=l+1;m<6;m++)
-           {
-             sigmaFullPrior[m][l].re = sigmaFullPrior[l][m].re;
-             sigmaFullPrior[m][l].im = -sigmaFullPrior[l][m].im;
-           }
-
          // computing derived quantities
 
          for(int l=0;l<3;l++){
@@ -457,72 +395,89 @@ void State4D::split(SeismicParametersHolder & current_state )
 
         // computing: sandwich= inv(sigmaCurrentPrior)*sigmaCurrentVsFullPrior=inv(sigmaCurrentPrior)*adjoint(sigmaFullVsCurrentPrior);
 
-         lib_matrCopyCpx(sigmaCurrentPrior, 3, 3, sigmaCurrentPriorChol);
-         lib_matrAdjoint(sigmaFullVsCurrentPrior, 6, 3,sandwich); // here sandwich = adjoint(sigmaFullVsCurrentPrior);
+         for(int l=0;l<3;l++)
+           for(int m=0;m<3;m++)
+             sigmaCurrentPriorChol[l][m] = sigmaCurrentPrior[l][m];
+         for(int l=0;l<6;l++)
+           for(int m=0;m<3;m++){ // here sandwich = adjoint(sigmaFullVsCurrentPrior);
+             sandwich[m][l].re =  sigmaFullVsCurrentPrior[l][m].re;
+             sandwich[m][l].im = -sigmaFullVsCurrentPrior[l][m].im;
+           }
 
-         int flag=lib_matrCholCpx(3, sigmaCurrentPriorChol);                        // these two lines  returns
+         int flag=SmallMatrixCpx::Chol<3>(sigmaCurrentPriorChol);                   // these two lines  returns
 
          if(flag==0){
-           lib_matrAXeqBMatCpx(3, sigmaCurrentPriorChol, sandwich, 6);       // sandwich= inv(sigmaCurrentPrior)*adjoint(sigmaFullVsCurrentPrior);
+           SmallMatrixCpx::AXeqBMat<3, 6>(sigmaCurrentPriorChol, sandwich);         // sandwich= inv(sigmaCurrentPrior)*adjoint(sigmaFullVsCurrentPrior);
 
            // computing: sigmaFullPosterior = sigmaFullPrior + adjoint(sandwich)*(sigmaCurrentPosterior-sigmaCurrentPrior)*(sandwich);
 
-           lib_matrSubtMatCpx(sigmaCurrentPrior, 3, 3,sigmaCurrentPosterior);// sigmaCurrentPosterior contains the difference to sigmaCurrentPrior
+           for(int l=0;l<3;l++)
+             for(int m=0;m<3;m++){ // sigmaCurrentPosterior contains the difference to sigmaCurrentPrior
+               sigmaCurrentPosterior[l][m].re -= sigmaCurrentPrior[l][m].re;
+               sigmaCurrentPosterior[l][m].im -= sigmaCurrentPrior[l][m].im;
+             }
 
-           lib_matrProdCpx(sigmaCurrentPosterior, sandwich, 3, 3, 6, helper);  // helper= (sigmaCurrentPosterior-sigmaCurrentPrior)*(sandwich);
-           lib_matrAdjoint(sandwich,3,6,adjointSandwich);
-           lib_matrProdCpx(adjointSandwich, helper, 6, 3, 6, sigmaFullPosterior); // here: sigmaFullPosterior =adjoint(sandwich*)(sigmaCurrentPosterior-sigmaCurrentPrior)*(sandwich);
-           lib_matrAddMatCpx(sigmaFullPrior, 6, 6, sigmaFullPosterior); // Final computation
+           SmallMatrixCpx::Prod<3, 3, 6>(sigmaCurrentPosterior, sandwich, helper);  // helper= (sigmaCurrentPosterior-sigmaCurrentPrior)*(sandwich);
+           for(int l=0;l<3;l++)
+             for(int m=0;m<6;m++){
+               adjointSandwich[m][l].re =  sandwich[l][m].re;
+               adjointSandwich[m][l].im = -sandwich[l][m].im;
+             }
+           SmallMatrixCpx::Prod<6, 3, 6>(adjointSandwich, helper, sigmaFullPosterior); // here: sigmaFullPosterior =adjoint(sandwich*)(sigmaCurrentPosterior-sigmaCurrentPrior)*(sandwich);
+           for(int l=0;l<6;l++)
+             for(int m=0;m<6;m++){ // Final computation
+               sigmaFullPosterior[l][m].re += sigmaFullPrior[l][m].re;
+               sigmaFullPosterior[l][m].im += sigmaFullPrior[l][m].im;
+             }
 
            // computing: muFullPosterior = muFullPrior + adjoint(sandwich)*(muCurrentPosterior-muCurrentPrior)
-           lib_matrSubtVecCpx(muCurrentPrior, 3, muCurrentPosterior);// muCurrentPosterior contains: (muCurrentPosterior-muCurrentPrior)
-           lib_matrProdMatVecCpx(adjointSandwich, muCurrentPosterior, 6, 3, muFullPosterior); //muFullPosterior=sandwich*(muCurrentPosterior-muCurrentPrior)
-           lib_matrAddVecCpx( muFullPrior, 6, muFullPosterior);
+           for(int l=0;l<3;l++){ // muCurrentPosterior contains: (muCurrentPosterior-muCurrentPrior)
+             muCurrentPosterior[l].re -= muCurrentPrior[l].re;
+             muCurrentPosterior[l].im -= muCurrentPrior[l].im;
+           }
+           for(int l=0;l<6;l++){ //muFullPosterior=sandwich*(muCurrentPosterior-muCurrentPrior)
+             fftw_complex x;
+             x.re = 0.0;
+             x.im = 0.0;
+             for(int m=0;m<3;m++){
+               x.re += adjointSandwich[l][m].re*muCurrentPosterior[m].re - adjointSandwich[l][m].im*muCurrentPosterior[m].im;
+               x.im += adjointSandwich[l][m].im*muCurrentPosterior[m].re + adjointSandwich[l][m].re*muCurrentPosterior[m].im;
+             }
+             muFullPosterior[l].re = x.re + muFullPrior[l].re;
+             muFullPosterior[l].im = x.im + muFullPrior[l].im;
+           }
          }else
          {
-          // /*
+#ifdef PARALLEL
+#pragma omp critical(state4d_split_shortcut)
+#endif
+          {
           counter++;
           if(counter==100)
           {
-            lib_matrDumpCpx("priorFull", sigmaFullPrior, 6,6);
-            lib_matrDumpCpx("priorCurrent", sigmaCurrentPrior, 3,3);
-            lib_matrDumpCpx("posteriorCurrent", sigmaCurrentPosterior, 3,3); // */
+            fftw_complex * priorFull[6];
+            fftw_complex * priorCurrent[3];
+            fftw_complex * posteriorCurrent[3];
+            for(int l=0;l<6;l++)
+              priorFull[l] = sigmaFullPrior[l];
+            for(int l=0;l<3;l++){
+              priorCurrent[l]     = sigmaCurrentPrior[l];
+              posteriorCurrent[l] = sigmaCurrentPosterior[l];
+            }
+            lib_matrDumpCpx("priorFull", priorFull, 6,6);
+            lib_matrDumpCpx("priorCurrent", priorCurrent, 3,3);
+            lib_matrDumpCpx("posteriorCurrent", posteriorCurrent, 3,3);
           }
-           lib_matrCopyCpx(sigmaFullPrior, 6, 6, sigmaFullPosterior);
-           for(int l=0;l<6;l++)
+          }
+           for(int l=0;l<6;l++){
              muFullPosterior[l]= muFullPrior[l];
-
+             for(int m=0;m<6;m++)
+               sigmaFullPosterior[l][m] = sigmaFullPrior[l][m];
+           }
          }
 
         // writing to grids
-         sigma_static_static_[0]->setNextComplex(  sigmaFullPosterior[0][0]);
-         sigma_static_static_[1]->setNextComplex(  sigmaFullPosterior[0][1]);
-         sigma_static_static_[2]->setNextComplex(  sigmaFullPosterior[0][2]);
-         sigma_static_dynamic_[0]->setNextComplex( sigmaFullPosterior[0][3]);
-         sigma_static_dynamic_[1]->setNextComplex( sigmaFullPosterior[0][4]);
-         sigma_static_dynamic_[2]->setNextComplex( sigmaFullPosterior[0][5]);
-         sigma_static_static_[3]->setNextComplex(  sigmaFullPosterior[1][1]);
-         sigma_static_static_[4]->setNextComplex(  sigmaFullPosterior[1][2]);
-         sigma_static_dynamic_[3]->setNextComplex( sigmaFullPosterior[1][3]);
-         sigma_static_dynamic_[4]->setNextComplex( sigmaFullPosterior[1][4]);
-         sigma_static_dynamic_[5]->setNextComplex( sigmaFullPosterior[1][5]);
-         sigma_static_static_[5]->setNextComplex(  sigmaFullPosterior[2][2]);
-         sigma_static_dynamic_[6]->setNextComplex( sigmaFullPosterior[2][3]);
-         sigma_static_dynamic_[7]->setNextComplex( sigmaFullPosterior[2][4]);
-         sigma_static_dynamic_[8]->setNextComplex( sigmaFullPosterior[2][5]);
-         sigma_dynamic_dynamic_[0]->setNextComplex(sigmaFullPosterior[3][3]);
-         sigma_dynamic_dynamic_[1]->setNextComplex(sigmaFullPosterior[3][4]);
-         sigma_dynamic_dynamic_[2]->setNextComplex(sigmaFullPosterior[3][5]);
-         sigma_dynamic_dynamic_[3]->setNextComplex(sigmaFullPosterior[4][4]);
-         sigma_dynamic_dynamic_[4]->setNextComplex(sigmaFullPosterior[4][5]);
-         sigma_dynamic_dynamic_[5]->setNextComplex(sigmaFullPosterior[5][5]);
-
-         mu_static_[0]->setNextComplex( muFullPosterior[0]);
-         mu_static_[1]->setNextComplex( muFullPosterior[1]);
-         mu_static_[2]->setNextComplex( muFullPosterior[2]);
-         mu_dynamic_[0]->setNextComplex(muFullPosterior[3]);
-         mu_dynamic_[1]->setNextComplex(muFullPosterior[4]);
-         mu_dynamic_[2]->setNextComplex(muFullPosterior[5]);
+         setCell(i, j, k, sequential, muFullPosterior, sigmaFullPosterior);
       }
     }
   }
@@ -544,38 +499,6 @@ void State4D::split(SeismicParametersHolder & current_state )
 
   for(int i = 0; i<9; i++)
     sigma_static_dynamic_[i]->endAccess();
-
-
-  for(int i=0;i<6;i++)
-  {
-    delete [] adjointSandwich[i];
-    delete [] sigmaFullPrior[i];
-    delete [] sigmaFullVsCurrentPrior[i];
-    delete [] sigmaFullPosterior[i];
-  }
-  for(int i=0;i<3;i++)
-  {
-    delete [] sandwich[i];
-    delete [] helper[i];
-    delete [] sigmaCurrentPrior[i];
-    delete [] sigmaCurrentPriorChol[i];
-    delete [] sigmaCurrentPosterior[i];
-  }
-
-  delete [] muFullPrior;
-  delete [] muFullPosterior;
-  delete [] muCurrentPrior;
-  delete [] muCurrentPosterior;
-
-  delete [] sandwich;
-  delete [] helper;
-  delete [] adjointSandwich;
-  delete [] sigmaFullPrior;
-  delete [] sigmaFullPosterior;
-  delete [] sigmaFullVsCurrentPrior;
-  delete [] sigmaCurrentPrior;
-  delete [] sigmaCurrentPriorChol;
-  delete [] sigmaCurrentPosterior;
 }
 
 void    State4D::updateWithSingleParameter(FFTGrid  *Epost, FFTGrid *CovPost, int parameterNumber)
@@ -609,70 +532,40 @@ void    State4D::updateWithSingleParameter(FFTGrid  *Epost, FFTGrid *CovPost, in
   int nyp = Epost->getNyp();
   int cnxp = Epost->getCNxp();
 
-  fftw_complex*  muFullPrior=new fftw_complex[6];
-  fftw_complex*  muFullPosterior=new fftw_complex[6];
-  fftw_complex   muCurrentPrior;
-  fftw_complex   muCurrentPosterior;
-  double   sigmaCurrentPrior ;
-  double   sigmaCurrentPosterior ;
-
-  fftw_complex** sigmaFullPrior          = new fftw_complex*[6];
-  fftw_complex** sigmaFullPosterior      = new fftw_complex*[6];
-  fftw_complex*  sigmaFullVsCurrentPrior = new fftw_complex[6];
+  std::vector<FFTGrid *> current(2);
+  current[0] = Epost;
+  current[1] = CovPost;
+  bool sequential = needsSequentialAccess(current);
+
+  int k;
+#ifdef PARALLEL
+  int n_threads  = n_threads_;
+  int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(n_threads) if(!sequential && n_threads > 1)
+#endif
+  for (k = 0; k < nzp; k++) {
+    fftw_complex muFullPrior[6];
+    fftw_complex muFullPosterior[6];
+    fftw_complex muCurrentPrior;
+    fftw_complex muCurrentPosterior;
+    double       sigmaCurrentPrior;
+    double       sigmaCurrentPosterior;
+
+    fftw_complex sigmaFullPrior[6][6];
+    fftw_complex sigmaFullPosterior[6][6];
+    fftw_complex sigmaFullVsCurrentPrior[6];
 
-  for(int i=0;i<6;i++)
-  {
-    sigmaFullPrior[i]          = new fftw_complex[6];
-    sigmaFullPosterior[i]      = new fftw_complex[6];
-  }
-
-  for (int k = 0; k < nzp; k++) {
     for (int j = 0; j < nyp; j++) {
       for (int i = 0; i < cnxp; i++) {
          // reading from grids
-         muFullPrior[0] = mu_static_[0]->getNextComplex();
-         muFullPrior[1] = mu_static_[1]->getNextComplex();
-         muFullPrior[2] = mu_static_[2]->getNextComplex();
-         muFullPrior[3] = mu_dynamic_[0]->getNextComplex();
-         muFullPrior[4] = mu_dynamic_[1]->getNextComplex();
-         muFullPrior[5] = mu_dynamic_[2]->getNextComplex();
-
-         sigmaFullPrior[0][0] = sigma_static_static_[0]->getNextComplex();
-         sigmaFullPrior[0][1] = sigma_static_static_[1]->getNextComplex();
-         sigmaFullPrior[0][2] = sigma_static_static_[2]->getNextComplex();
-         sigmaFullPrior[0][3] = sigma_static_dynamic_[0]->getNextComplex();
-         sigmaFullPrior[0][4] = sigma_static_dynamic_[1]->getNextComplex();
-         sigmaFullPrior[0][5] = sigma_static_dynamic_[2]->getNextComplex();
-         sigmaFullPrior[1][1] = sigma_static_static_[3]->getNextComplex();
-         sigmaFullPrior[1][2] = sigma_static_static_[4]->getNextComplex();
-         sigmaFullPrior[1][3] = sigma_static_dynamic_[3]->getNextComplex();
-         sigmaFullPrior[1][4] = sigma_static_dynamic_[4]->getNextComplex();
-         sigmaFullPrior[1][5] = sigma_static_dynamic_[5]->getNextComplex();
-         sigmaFullPrior[2][2] = sigma_static_static_[5]->getNextComplex();
-         sigmaFullPrior[2][3] = sigma_static_dynamic_[6]->getNextComplex();
-         sigmaFullPrior[2][4] = sigma_static_dynamic_[7]->getNextComplex();
-         sigmaFullPrior[2][5] = sigma_static_dynamic_[8]->getNextComplex();
-         sigmaFullPrior[3][3] = sigma_dynamic_dynamic_[0]->getNextComplex();
-         sigmaFullPrior[3][4] = sigma_dynamic_dynamic_[1]->getNextComplex();
-         sigmaFullPrior[3][5] = sigma_dynamic_dynamic_[2]->getNextComplex();
-         sigmaFullPrior[4][4] = sigma_dynamic_dynamic_[3]->getNextComplex();
-         sigmaFullPrior[4][5] = sigma_dynamic_dynamic_[4]->getNextComplex();
-         sigmaFullPrior[5][5] = sigma_dynamic_dynamic_[5]->getNextComplex();
-
-         // compleating matrixes
-         for(int l=0;l<6;l++)
-           for(int m=l+1;m<6;m++)
-           {
-             sigmaFullPrior[m][l].re = sigmaFullPrior[l][m].re;
-             sigmaFullPrior[m][l].im = -sigmaFullPrior[l][m].im;
-           }
+         getCell(i, j, k, sequential, muFullPrior, sigmaFullPrior);
 
          // getting Prior for Parameter
           muCurrentPrior=muFullPrior[parameterNumber];
           sigmaCurrentPrior = static_cast<double>(sigmaFullPrior[parameterNumber][parameterNumber].re);
          // getting posterior for Parameter
-         muCurrentPosterior = Epost->getNextComplex();
-         sigmaCurrentPosterior=static_cast<double>(CovPost->getNextComplex().re);
+         muCurrentPosterior = getCellValue(Epost, i, j, k, sequential);
+         sigmaCurrentPosterior=static_cast<double>(getCellValue(CovPost, i, j, k, sequential).re);
 
          // getting correlation between Parameter and others
          for(int l=0;l<6;l++){
@@ -707,41 +600,15 @@ void    State4D::updateWithSingleParameter(FFTGrid  *Epost, FFTGrid *CovPost, in
              }
          }else
          {
-           lib_matrCopyCpx(sigmaFullPrior, 6, 6, sigmaFullPosterior);
-
-           for(int l=0;l<6;l++)
-              muFullPosterior[l]= muFullPrior[l];
+           for(int l=0;l<6;l++){
+             muFullPosterior[l]= muFullPrior[l];
+             for(int m=0;m<6;m++)
+               sigmaFullPosterior[l][m] = sigmaFullPrior[l][m];
+           }
          }
 
         // writing to grids
-         sigma_static_static_[0]->setNextComplex(  sigmaFullPosterior[0][0]);
-         sigma_static_static_[1]->setNextComplex(  sigmaFullPosterior[0][1]);
-         sigma_static_static_[2]->setNextComplex(  sigmaFullPosterior[0][2]);
-         sigma_static_dynamic_[0]->setNextComplex( sigmaFullPosterior[0][3]);
-         sigma_static_dynamic_[1]->setNextComplex( sigmaFullPosterior[0][4]);
-         sigma_static_dynamic_[2]->setNextComplex( sigmaFullPosterior[0][5]);
-         sigma_static_static_[3]->setNextComplex(  sigmaFullPosterior[1][1]);
-         sigma_static_static_[4]->setNextComplex(  sigmaFullPosterior[1][2]);
-         sigma_static_dynamic_[3]->setNextComplex( sigmaFullPosterior[1][3]);
-         sigma_static_dynamic_[4]->setNextComplex( sigmaFullPosterior[1][4]);
-         sigma_static_dynamic_[5]->setNextComplex( sigmaFullPosterior[1][5]);
-         sigma_static_static_[5]->setNextComplex(  sigmaFullPosterior[2][2]);
-         sigma_static_dynamic_[6]->setNextComplex( sigmaFullPosterior[2][3]);
-         sigma_static_dynamic_[7]->setNextComplex( sigmaFullPosterior[2][4]);
-         sigma_static_dynamic_[8]->setNextComplex( sigmaFullPosterior[2][5]);
-         sigma_dynamic_dynamic_[0]->setNextComplex(sigmaFullPosterior[3][3]);
-         sigma_dynamic_dynamic_[1]->setNextComplex(sigmaFullPosterior[3][4]);
-         sigma_dynamic_dynamic_[2]->setNextComplex(sigmaFullPosterior[3][5]);
-         sigma_dynamic_dynamic_[3]->setNextComplex(sigmaFullPosterior[4][4]);
-         sigma_dynamic_dynamic_[4]->setNextComplex(sigmaFullPosterior[4][5]);
-         sigma_dynamic_dynamic_[5]->setNextComplex(sigmaFullPosterior[5][5]);
-
-         mu_static_[0]->setNextComplex( muFullPosterior[0]);
-         mu_static_[1]->setNextComplex( muFullPosterior[1]);
-         mu_static_[2]->setNextComplex( muFullPosterior[2]);
-         mu_dynamic_[0]->setNextComplex(muFullPosterior[3]);
-         mu_dynamic_[1]->setNextComplex(muFullPosterior[4]);
-         mu_dynamic_[2]->setNextComplex(muFullPosterior[5]);
+         setCell(i, j, k, sequential, muFullPosterior, sigmaFullPosterior);
       }
     }
   }
@@ -763,19 +630,6 @@ void    State4D::updateWithSingleParameter(FFTGrid  *Epost, FFTGrid *CovPost, in
   for(int i = 0; i<9; i++)
     sigma_static_dynamic_[i]->endAccess();
 
-
-  for(int i=0;i<6;i++)
-  {
-    delete [] sigmaFullPrior[i];
-    delete [] sigmaFullPosterior[i];
-  }
-
-  delete [] muFullPrior;
-  delete [] muFullPosterior;
-
-  delete [] sigmaFullPrior;
-  delete [] sigmaFullPosterior;
-  delete [] sigmaFullVsCurrentPrior;
   LogKit::LogFormatted(LogKit::Low, "done.\n");
 
 }
@@ -806,77 +660,40 @@ void State4D::evolve(int                   time_step,
   const NRLib::Vector mean_correction_term = timeEvolution.getMeanCorrectionTerm(time_step);
   const NRLib::Matrix cov_correction_term  = timeEvolution.getCovarianceCorrectionTerm(time_step);
 
-   // Holders of FFTGrid pointers
-  std::vector<FFTGrid *> mu(6);
-
-  std::vector<FFTGrid *> sigma(21);
-  // Check the order of the grids here:
-  // The order is used later in set-up of symmetric sigma matrix
-
-
-  mu[0] = getMuVpStatic(); //mu_static_Alpha
-  mu[1] = getMuVsStatic(); //mu_static_Beta
-  mu[2] = getMuRhoStatic(); //mu_static_Rho
-  mu[3] = getMuVpDynamic(); //mu_dynamic_Alpha
-  mu[4] = getMuVsDynamic(); //mu_dynamic_Beta
-  mu[5] = getMuRhoDynamic(); //mu_dynamic_Rho
-
-  // Note the order of the grids here: The order is used other places in code.
-  sigma[0]  = getCovVpVpStaticStatic(); //cov_ss_AlphaStatic AlphaStatic
-  sigma[1]  = getCovVpVsStaticStatic();  //cov_ss_AlphaStaticBetaStatic
-  sigma[2]  = getCovVpRhoStaticStatic();  //cov_ss_AlphaStaticRhoStatic
-  sigma[3]  = getCovVsVsStaticStatic(); //cov_ss_BetaStaticBetaStatic
-  sigma[4]  = getCovVsRhoStaticStatic(); //cov_ss_BetaStaticRhoStatic
-  sigma[5]  = getCovRhoRhoStaticStatic(); //cov_ss_RhoStaticRhoStatic
-  sigma[6]  = getCovVpVpDynamicDynamic(); //cov_dd_AlphaDynamicAlphaDynamic
-  sigma[7]  = getCovVpVsDynamicDynamic(); //cov_dd_AlphaDynamicBetaDynamic
-  sigma[8]  = getCovVpRhoDynamicDynamic(); //cov_dd_AlphaDynamicRhoDynamic
-  sigma[9]  = getCovVsVsDynamicDynamic(); //cov_dd_BetaDynamicBetaDynamic
-  sigma[10] = getCovVsRhoDynamicDynamic(); //cov_dd_BetaDynamicRhoDynamic
-  sigma[11] = getCovRhoRhoDynamicDynamic(); //cov_dd_RhoDynamicRhoDynamic
-
-  sigma[12] = getCovVpVpStaticDynamic(); //cov_sd_AlphaStaticAlphaDynamic
-  sigma[13] = getCovVpVsStaticDynamic();  //cov_sd_AlphaStaticBetaDynamic
-  sigma[14] = getCovVpRhoStaticDynamic(); //cov_sd_AlphaStaticRhoDynamic
-  sigma[15] = getCovVsVpStaticDynamic();  //cov_sd_BetaStaticAlphaDynamic
-  sigma[16] = getCovVsVsStaticDynamic();  //cov_sd_BetaStaticBetaDynamic
-  sigma[17] = getCovVsRhoStaticDynamic(); //cov_sd_BetaStaticRhoDynamic
-  sigma[18] = getCovRhoVpStaticDynamic(); //cov_sd_RhoStaticAlphaDynamic
-  sigma[19] = getCovRhoVsStaticDynamic(); //cov_sd_RhoStaticBetaDynamic
-  sigma[20] = getCovRhoRhoStaticDynamic();  //cov_sd_RhoStaticRhoDynamic
+  // Copied to plain arrays, so that the cells are evolved without allocations.
+  double E[6][6];
+  double C[6][6];
+  double m_corr[6];
+  for (int d1 = 0; d1 < 6; d1++) {
+    m_corr[d1] = mean_correction_term(d1);
+    for (int d2 = 0; d2 < 6; d2++) {
+      E[d1][d2] = evolution_matrix(d1, d2);
+      C[d1][d2] = cov_correction_term(d1, d2);
+    }
+  }
 
   // We assume FFT transformed grids
-  for(int i = 0; i<6; i++)
+  assert(allGridsAreTransformed());
+  for(int i = 0; i<3; i++)
   {
-    assert(mu[i]->getIsTransformed());
-    mu[i]->setAccessMode(FFTGrid::READANDWRITE);
+    mu_static_[i]->setAccessMode(FFTGrid::READANDWRITE);
+    mu_dynamic_[i]->setAccessMode(FFTGrid::READANDWRITE);
   }
-  for(int i = 0; i<21; i++)
+  for(int i = 0; i<6; i++)
   {
-    assert(sigma[i]->getIsTransformed());
-    sigma[i]->setAccessMode(FFTGrid::READANDWRITE);
+    sigma_static_static_[i]->setAccessMode(FFTGrid::READANDWRITE);
+    sigma_dynamic_dynamic_[i]->setAccessMode(FFTGrid::READANDWRITE);
   }
+  for(int i = 0; i<9; i++)
+    sigma_static_dynamic_[i]->setAccessMode(FFTGrid::READANDWRITE);
 
-  NRLib::Vector mu_real(6);
-  NRLib::Vector mu_imag(6);
-  NRLib::Vector mu_real_next(6);
-  NRLib::Vector mu_imag_next(6);
-
-  NRLib::Matrix sigma_real(6,6);
-  NRLib::Matrix sigma_imag(6,6);
-  NRLib::Matrix sigma_real_next(6,6);
-  NRLib::Matrix sigma_imag_next(6,6);
-  NRLib::Matrix tmp(6,6);
-
-  fftw_complex get_value,return_value;
-
-  int nz   = mu[0]->getNz();
-  int ny   = mu[0]->getNy();
-  int nx   = mu[0]->getNx();
-  int nzp  = mu[0]->getNzp();
-  int nyp  = mu[0]->getNyp();
-  int nxp  = mu[0]->getNxp();
-  int cnxp = mu[0]->getCNxp();
+  int nz   = mu_static_[0]->getNz();
+  int ny   = mu_static_[0]->getNy();
+  int nx   = mu_static_[0]->getNx();
+  int nzp  = mu_static_[0]->getNzp();
+  int nyp  = mu_static_[0]->getNyp();
+  int nxp  = mu_static_[0]->getNxp();
+  int cnxp = mu_static_[0]->getCNxp();
 
 
    FFTGrid timeIncSpatialCorr=FFTGrid( nx,  ny,  nz,  nxp,  nyp,  nzp);
@@ -895,112 +712,200 @@ void State4D::evolve(int                   time_step,
 
    timeIncSpatialCorr.fftInPlace();
    timeIncSpatialCorr.setAccessMode(FFTGrid::READ);
+
+  bool sequential = needsSequentialAccess(std::vector<FFTGrid *>());
+
   // Iterate through all points in the grid and perform forward transition in time
-  for (int k = 0; k < nzp; k++) {
+  int k;
+#ifdef PARALLEL
+  int n_threads  = n_threads_;
+  int chunk_size = 1;
+#pragma omp parallel for schedule(dynamic, chunk_size) num_threads(n_threads) if(!sequential && n_threads > 1)
+#endif
+  for (k = 0; k < nzp; k++) {
+    fftw_complex mu[6];
+    fftw_complex sigma[6][6];
+    double       tmp_real[6][6];
+    double       tmp_imag[6][6];
+
     for (int j = 0; j < nyp; j++) {
       for (int i = 0; i < cnxp; i++) {
 
-        fftw_complex ijkLambda = timeIncSpatialCorr.getNextComplex();
+        fftw_complex ijkLambda = getCellValue(&timeIncSpatialCorr, i, j, k, sequential);
         float realTocomplexScaleFactor =  (i==0 && j==0 && k==0 )? float(std::sqrt(double(nxp*nyp*nzp))): 0.0f;  // note add a constant in real domain is
                                                                                                                  // just a value on the 0,0,0 in fft domain
                                                                                                                  // is for the mean what  ijkLambda is for the covariance
 
-        // Set up vectors from the FFT grids
-        for (int d = 0; d < 6; d++) {
-          get_value  = mu[d]->getNextComplex();
-          mu_real(d) = get_value.re;
-          mu_imag(d) = get_value.im;
-        }
+        // The full (static, dynamic) mean and Hermitian covariance of the cell.
+        getCell(i, j, k, sequential, mu, sigma);
 
         // Evolve values
-        mu_real_next = evolution_matrix*mu_real + mean_correction_term* realTocomplexScaleFactor; // last term is only for (0,0,0 ) coefficient see above
-        mu_imag_next = evolution_matrix*mu_imag;
-
-        // Update values in the FFT-grids
-        for (int d = 0; d < 6; d++) {
-          return_value.re = static_cast<float>(mu_real_next(d));
-          return_value.im = static_cast<float>(mu_imag_next(d));
-          mu[d]->setNextComplex(return_value);
+        // mu_next = E*mu + m_corr*realTocomplexScaleFactor, the last term is only for (0,0,0 ) coefficient see above
+        fftw_complex mu_next[6];
+        for (int d1 = 0; d1 < 6; d1++) {
+          double re = m_corr[d1]*realTocomplexScaleFactor;
+          double im = 0.0;
+          for (int d2 = 0; d2 < 6; d2++) {
+            re += E[d1][d2]*mu[d2].re;
+            im += E[d1][d2]*mu[d2].im;
+          }
+          mu_next[d1].re = static_cast<float>(re);
+          mu_next[d1].im = static_cast<float>(im);
         }
-        // Set up matrices from the FFT-grids.
-        // Note: Here we assume a specific order of the elements in the sigma-vector.
-        // Static and dynamic parts.
-        int counter = 0;
-        for (int d1 = 0; d1 < 3; d1++) {
-          for (int d2 = d1; d2 < 3; d2++) {
-            get_value  = sigma[counter]->getNextComplex();
-            sigma_real(d1, d2) = get_value.re;
-            sigma_imag(d1, d2) = get_value.im;
-            get_value  = sigma[counter+6]->getNextComplex();
-            sigma_real(d1+3, d2+3) = get_value.re;  // d1+3 and d2+3 due to block structure of matrix
-            sigma_imag(d1+3, d2+3) = get_value.im;
-
-            counter++;
-
-            //Enforcing symmetry of overall matrix.
-            // (Hermitian symmetry Hence  - for imaginary part)
-            if (d1 != d2) {
-              sigma_real(d2, d1) = sigma_real(d1, d2);
-              sigma_imag(d2 ,d1) = -sigma_imag(d1, d2);
-
-              sigma_real(d2+3, d1+3) = sigma_real(d1+3, d2+3);
-              sigma_imag(d2+3 ,d1+3) = -sigma_imag(d1+3, d2+3);
+
+        // sigma_next = E*sigma*E' + C*ijkLambda.re
+        for (int d1 = 0; d1 < 6; d1++) {
+          for (int d2 = 0; d2 < 6; d2++) {
+            double re = 0.0;
+            double im = 0.0;
+            for (int d3 = 0; d3 < 6; d3++) {
+              re += E[d1][d3]*sigma[d3][d2].re;
+              im += E[d1][d3]*sigma[d3][d2].im;
             }
+            tmp_real[d1][d2] = re;
+            tmp_imag[d1][d2] = im;
           }
         }
-        // Static-dynamic covariance.
-        counter = 12;
-        for (int d1 = 0; d1 < 3; d1++) {
-          for (int d2 = 3; d2 < 6; d2++) {
-            get_value=sigma[counter]->getNextComplex();
-            sigma_real(d1, d2) = get_value.re;
-            sigma_imag(d1, d2) = get_value.im;
-            counter++;
-
-            //Enforcing symmetry of overall matrix. (Hermitian symmetry Hence  - for imaginary part)
-            sigma_real(d2, d1) = sigma_real(d1, d2);
-            sigma_imag(d2 ,d1) = -sigma_imag(d1, d2);
+        for (int d1 = 0; d1 < 6; d1++) {
+          for (int d2 = d1; d2 < 6; d2++) { // Only the upper triangle is stored
+            double re = C[d1][d2]*ijkLambda.re;
+            double im = 0.0;
+            for (int d3 = 0; d3 < 6; d3++) {
+              re += tmp_real[d1][d3]*E[d2][d3];
+              im += tmp_imag[d1][d3]*E[d2][d3];
+            }
+            sigma[d1][d2].re = static_cast<float>(re);
+            sigma[d1][d2].im = static_cast<float>(im);
           }
         }
-        // Evolve values.
-        tmp = (evolution_matrix*sigma_real);
-        sigma_real_next = tmp*transpose(evolution_matrix) + cov_correction_term *ijkLambda.re;
 
-        tmp = evolution_matrix*sigma_imag;
-        sigma_imag_next = tmp*transpose(evolution_matrix);
+        // Update values in the FFT-grids
+        setCell(i, j, k, sequential, mu_next, sigma);
+      }
+    }
+  }
 
-        counter = 0;
-        for (int d1 = 0; d1 < 3; d1++) {// Update values in the FFT-grids.
-          for (int d2 = d1; d2 < 3; d2++) {// Static and dynamic parts.
-            return_value.re = static_cast<float>(sigma_real_next(d1, d2));
-            return_value.im = static_cast<float>(sigma_imag_next(d1, d2));
-            sigma[counter]->setNextComplex(return_value);
+  timeIncSpatialCorr.endAccess();
 
-            return_value.re = static_cast<float>(sigma_real_next(d1+3, d2+3));  //d1+3 and d2+3 due to block structure of matrix
-            return_value.im = static_cast<float>(sigma_imag_next(d1+3, d2+3));
-            sigma[counter+6]->setNextComplex(return_value);
+  for(int i = 0; i<3; i++)
+  {
+    mu_static_[i]->endAccess();
+    mu_dynamic_[i]->endAccess();
+  }
+  for(int i = 0; i<6; i++)
+  {
+    sigma_static_static_[i]->endAccess();
+    sigma_dynamic_dynamic_[i]->endAccess();
+  }
+  for(int i = 0; i<9; i++)
+    sigma_static_dynamic_[i]->endAccess();
+}
 
-            counter++;
-          }
-        }
-        // Static-dynamic covariance.
-        counter = 12;
-        for (int d1 = 0; d1 < 3; d1++) {
-          for (int d2 = 3; d2 < 6; d2++) {
-            return_value.re = static_cast<float>(sigma_real_next(d1, d2));
-            return_value.im = static_cast<float>(sigma_imag_next(d1, d2));
-            sigma[counter]->setNextComplex(return_value);
-            counter++;
-          }
-        }
+bool
+State4D::needsSequentialAccess(const std::vector<FFTGrid *> & grids)
+{
+  // Grids on file only support sequential access, see FFTGrid::getNextComplex().
+  bool sequential = false;
+
+  for(int i = 0; i<3; i++)
+    sequential = sequential || mu_static_[i]->isFile() || mu_dynamic_[i]->isFile();
+  for(int i = 0; i<6; i++)
+    sequential = sequential || sigma_static_static_[i]->isFile() || sigma_dynamic_dynamic_[i]->isFile();
+  for(int i = 0; i<9; i++)
+    sequential = sequential || sigma_static_dynamic_[i]->isFile();
+  for(size_t i = 0; i<grids.size(); i++)
+    sequential = sequential || grids[i]->isFile();
+
+  return sequential;
+}
+
+void
+State4D::getCell(int            i,
+                 int            j,
+                 int            k,
+                 bool           sequential,
+                 fftw_complex * mu,
+                 fftw_complex (*sigma)[6]) const
+{
+  if (mu != NULL) {
+    for (int l = 0; l < 3; l++) {
+      mu[l]   = getCellValue(mu_static_[l],  i, j, k, sequential);
+      mu[l+3] = getCellValue(mu_dynamic_[l], i, j, k, sequential);
+    }
+  }
+
+  if (sigma != NULL) {
+    for (int l = 0; l < 3; l++) {
+      for (int m = l; m < 3; m++) {
+        sigma[l  ][m  ] = getCellValue(sigma_static_static_[symIndex_[l][m]],   i, j, k, sequential);
+        sigma[l+3][m+3] = getCellValue(sigma_dynamic_dynamic_[symIndex_[l][m]], i, j, k, sequential);
+      }
+      for (int m = 0; m < 3; m++)
+        sigma[l][m+3] = getCellValue(sigma_static_dynamic_[3*l + m], i, j, k, sequential);
+    }
+
+    // Hermitian symmetry, hence - for the imaginary part
+    for (int l = 0; l < 6; l++) {
+      for (int m = l + 1; m < 6; m++) {
+        sigma[m][l].re =  sigma[l][m].re;
+        sigma[m][l].im = -sigma[l][m].im;
       }
     }
   }
+}
 
-  for(int i = 0; i<6; i++)
-    mu[i]->endAccess();
-  for(int i = 0; i<21; i++)
-    sigma[i]->endAccess();
+void
+State4D::setCell(int                  i,
+                 int                  j,
+                 int                  k,
+                 bool                 sequential,
+                 const fftw_complex * mu,
+                 const fftw_complex (*sigma)[6])
+{
+  if (mu != NULL) {
+    for (int l = 0; l < 3; l++) {
+      setCellValue(mu_static_[l],  i, j, k, sequential, mu[l]);
+      setCellValue(mu_dynamic_[l], i, j, k, sequential, mu[l+3]);
+    }
+  }
+
+  if (sigma != NULL) {
+    for (int l = 0; l < 3; l++) {
+      for (int m = l; m < 3; m++) {
+        setCellValue(sigma_static_static_[symIndex_[l][m]],   i, j, k, sequential, sigma[l  ][m  ]);
+        setCellValue(sigma_dynamic_dynamic_[symIndex_[l][m]], i, j, k, sequential, sigma[l+3][m+3]);
+      }
+      for (int m = 0; m < 3; m++)
+        setCellValue(sigma_static_dynamic_[3*l + m], i, j, k, sequential, sigma[l][m+3]);
+    }
+  }
+}
+
+fftw_complex
+State4D::getCellValue(FFTGrid * grid,
+                      int       i,
+                      int       j,
+                      int       k,
+                      bool      sequential)
+{
+  if (sequential)
+    return grid->getNextComplex();
+  else
+    return grid->getComplexValue(i, j, k, true);
+}
+
+void
+State4D::setCellValue(FFTGrid            * grid,
+                      int                  i,
+                      int                  j,
+                      int                  k,
+                      bool                 sequential,
+                      const fftw_complex & value)
+{
+  if (sequential)
+    grid->setNextComplex(value);
+  else
+    grid->setComplexValue(i, j, k, value, true);
 }
 
 bool
@@ -5,6 +5,8 @@
 #include <map>
 #include <nrlib/flens/nrlib_flens.hpp>
 
+#include "fftw.h"
+
 class SeismicParametersHolder;
 class FFTGrid;
 class TimeEvolution;
@@ -19,6 +21,11 @@ class Simbox;
 //   sigma_static (6 grids)
 //   sigma_dynamic (6 grids)
 //   sigma_static_dynamic (9 grids, no symmetry)
+//
+// merge, split, updateWithSingleParameter and evolve work on one Fourier cell at a time,
+// reading the full (static, dynamic) 6-vector mean and 6x6 Hermitian covariance of the cell
+// into fixed-size arrays, see getCell(). When all grids are in memory the cells are processed
+// in parallel over k.
 
 // NB: Naming convensions open for dissucion.
 
@@ -57,6 +64,8 @@ public:
 
   bool   isActive() const {return(mu_static_.size() > 0);}
 
+  void   setNumberOfThreads(int n_threads) { n_threads_ = n_threads; }
+
   // Suggestions for get-functions. Not yet used. Naming etc to be decided later when actual in use.
   FFTGrid * getMuVpStatic(void)  const { return mu_static_[0]; }
   FFTGrid * getMuVsStatic(void)  const { return mu_static_[1]; }
@@ -100,6 +109,23 @@ public:
 
 private:
   bool allGridsAreTransformed();
+
+  // True if any of the state grids, or of grids, is on file and must be accessed sequentially.
+  bool needsSequentialAccess(const std::vector<FFTGrid *> & grids);
+
+  // Reads/writes the mean (vp, vs, rho static, vp, vs, rho dynamic) and covariance of cell
+  // (i,j,k). NULL arguments are skipped. getCell() fills the full Hermitian covariance,
+  // setCell() only uses its upper triangle. With sequential access the next cell of each grid
+  // is used, as with FFTGrid::getNextComplex(), and the cells must be visited in grid order.
+  void getCell(int i, int j, int k, bool sequential, fftw_complex * mu, fftw_complex (*sigma)[6]) const;
+  void setCell(int i, int j, int k, bool sequential, const fftw_complex * mu, const fftw_complex (*sigma)[6]);
+
+  static fftw_complex getCellValue(FFTGrid * grid, int i, int j, int k, bool sequential);
+  static void         setCellValue(FFTGrid * grid, int i, int j, int k, bool sequential, const fftw_complex & value);
+
+  static const int       symIndex_[3][3];       // Index into sigma_static_static_ and sigma_dynamic_dynamic_ of element (l,m)
+
+  int                    n_threads_;
   FFTGrid *              velocity_relative_to_base_;  //  V_current/V_initial
   std::vector<FFTGrid *> mu_static_;            // [0] = vp, [1] = vs, [2] = rho
   std::vector<FFTGrid *> mu_dynamic_;           // [0] = vp, [1] = vs, [2] = rho
@@ -13,7 +13,7 @@ class TaskList
 {
 
 public:
-  static void addTask(std::string task) {task_.push_back(task);}
+  static void addTask(std::string task);
 
   static void viewAllTasks(bool useFile = false);
 
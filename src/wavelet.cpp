@@ -27,6 +27,7 @@
 #include "src/modelsettings.h"
 #include "src/definitions.h"
 #include "src/fftgrid.h"
+#include "src/fftplancache.h"
 #include "src/simbox.h"
 #include "src/vario.h"
 #include "src/io.h"
@@ -256,15 +257,10 @@ void Wavelet::fft1DInPlace()
 {
   // use the operator version of the fourier transform
   if(isReal_) {
-    int flag;
-    rfftwnd_plan plan;
-    flag    = FFTW_ESTIMATE | FFTW_IN_PLACE;
-    plan    = rfftwnd_create_plan(1, &nzp_ ,FFTW_REAL_TO_COMPLEX,flag);
     //
     // NBNB-PAL: The call rfftwnd_on_real_to_complex is causing UMRs in Purify.
     //
-    rfftwnd_one_real_to_complex(plan,rAmp_,cAmp_);
-    fftwnd_destroy_plan(plan);
+    FFTPlanCache::RealToComplex1D(rAmp_, cAmp_, nzp_);
     isReal_ = false;
   }
 }
@@ -274,13 +270,7 @@ void Wavelet::invFFT1DInPlace()
 {
   // use the operator version of the fourier transform
   if(!isReal_) {
-    int flag;
-    rfftwnd_plan plan;
-
-    flag = FFTW_ESTIMATE | FFTW_IN_PLACE;
-    plan= rfftwnd_create_plan(1,&nzp_,FFTW_COMPLEX_TO_REAL,flag);
-    rfftwnd_one_complex_to_real(plan,cAmp_,rAmp_);
-    fftwnd_destroy_plan(plan);
+    FFTPlanCache::ComplexToReal1D(cAmp_, rAmp_, nzp_);
     isReal_=true;
     double scale= static_cast<double>(1.0/static_cast<double>(nzp_));
     for(int i=0; i < nzp_; i++)
@@ -2735,6 +2735,7 @@ XmlModelFile::parseRockPhysics(TiXmlNode * node, std::string & errTxt)
   legalCommands.push_back("predefinitions");
   legalCommands.push_back("rock");
   legalCommands.push_back("trend-cube");
+  legalCommands.push_back("tabulate-forward-models");
 
   // The order of the parsing-commands should not be changed
   parseReservoir(root, errTxt);
@@ -2749,6 +2750,10 @@ XmlModelFile::parseRockPhysics(TiXmlNode * node, std::string & errTxt)
   if(count > 2)
     errTxt += "The maximum allowed number of trend cubes in <rock-physics><trend-cube> is two.\n";
 
+  bool value;
+  if(parseBool(root, "tabulate-forward-models", value, errTxt) == true)
+    modelSettings_->setUseForwardModelTables(value);
+
   modelSettings_->setFaciesProbFromRockPhysics(true);
 
   modelSettings_->setFaciesProbRelative(false);
@@ -5692,6 +5697,7 @@ XmlModelFile::parseOtherOutput(TiXmlNode * node, std::string & errTxt)
   legalCommands.push_back("error-file");
   legalCommands.push_back("task-file");
   legalCommands.push_back("rock-physics-trends");
+  legalCommands.push_back("profile-trace");
 
   bool value;
   int otherFlag = 0;
@@ -5709,6 +5715,8 @@ XmlModelFile::parseOtherOutput(TiXmlNode * node, std::string & errTxt)
     otherFlag += IO::TASK_FILE;
   if(parseBool(root, "rock-physics-trends", value, errTxt) == true && value == true)
     otherFlag += IO::ROCK_PHYSICS_TRENDS;
+  if(parseBool(root, "profile-trace", value, errTxt) == true && value == true)
+    otherFlag += IO::PROFILE_TRACE;
 
   modelSettings_->setOtherOutputFlag(otherFlag);
 
@@ -5732,6 +5740,7 @@ XmlModelFile::parseAdvancedSettings(TiXmlNode * node, std::string & errTxt)
   legalCommands.push_back("vp-vs-ratio");
   legalCommands.push_back("vp-vs-ratio-from-wells");
   legalCommands.push_back("use-intermediate-disk-storage");
+  legalCommands.push_back("maximum-memory-usage");
   legalCommands.push_back("maximum-relative-thickness-difference");
   legalCommands.push_back("frequency-band");
   legalCommands.push_back("energy-threshold");
@@ -5752,6 +5761,7 @@ XmlModelFile::parseAdvancedSettings(TiXmlNode * node, std::string & errTxt)
   legalCommands.push_back("gradient-smoothing-range");
   legalCommands.push_back("estimate-well-gradient-from-seismic");
   legalCommands.push_back("write-ascii-surfaces");
+  legalCommands.push_back("fft-wisdom-file");
 
 #ifdef PARALLEL
   int n_thread = 0;
@@ -5778,6 +5788,14 @@ XmlModelFile::parseAdvancedSettings(TiXmlNode * node, std::string & errTxt)
   if(parseBool(root, "use-intermediate-disk-storage", fileGrid, errTxt) == true)
     modelSettings_->setFileGrid(fileGrid);
 
+  double memoryBudget;
+  if(parseValue(root, "maximum-memory-usage", memoryBudget, errTxt) == true) {
+    if(memoryBudget <= 0.0)
+      errTxt += "Error in <maximum-memory-usage>: Value must be greater than 0, found "+NRLib::ToString(memoryBudget)+".\n";
+    else
+      modelSettings_->setMemoryBudget(memoryBudget);
+  }
+
   double limit;
   if(parseValue(root,"maximum-relative-thickness-difference", limit, errTxt) == true)
     modelSettings_->setLzLimit(limit);
@@ -5862,6 +5880,10 @@ XmlModelFile::parseAdvancedSettings(TiXmlNode * node, std::string & errTxt)
   if(parseBool(root, "write-ascii-surfaces", ascii_surfaces, errTxt) == true)
     modelSettings_->setWriteAsciiSurfaces(ascii_surfaces);
 
+  std::string wisdom_file = "";
+  if(parseValue(root, "fft-wisdom-file", wisdom_file, errTxt) == true)
+    modelSettings_->setFFTWisdomFile(wisdom_file);
+
   checkForJunk(root, errTxt, legalCommands);
   return(true);
 }